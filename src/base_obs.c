@@ -34,6 +34,7 @@
 #include "timing.h"
 #include "base_obs.h"
 #include "ephemeris.h"
+#include "hatch.h"
 #include "signal.h"
 
 extern bool disable_raim;
@@ -41,6 +42,10 @@ extern bool disable_raim;
 /** \defgroup base_obs Base station observation handling
  * \{ */
 
+/** Number of epochs the base station observation time must go back by to
+ * start a new set mid-sequence. */
+#define BASE_OBS_RESYNC_EPOCHS 3
+
 /** Mutex to control access to the base station observations. */
 MUTEX_DECL(base_obs_lock);
 /** Semaphore that is flagged when a new set of observations are received. */
@@ -57,6 +62,12 @@ bool base_pos_known = false;
  * the BASE_POS message.  */
 double base_pos_ecef[3];
 
+/** Maximum age in seconds of the base station observations from which
+ * observations will be predicted, zero disables prediction. */
+static double base_predict_max_age = 5.0;
+/** Interval over which the TDCP Doppler in #base_obss was calculated. */
+static double base_tdcp_dt = 0;
+
 /** SBP callback for when the base station sends us a message containing its
  * known location in LLH coordinates.
  * Stores the base station position in the global #base_pos_ecef variable and
@@ -98,9 +109,10 @@ static void base_pos_ecef_callback(u16 sender_id, u8 len, u8 msg[], void* contex
 /** Update the #base_obss state given a new set of obss.
  * First sorts by PRN and computes the TDCP Doppler for the observation set. If
  * #base_pos_known is false then a single point position solution is also
- * calculated. Next the `has_pos`, `pos_ecef` and `sat_dists` fields are filled
- * in. Finally the #base_obs_received semaphore is flagged to indicate that new
- * observations are available.
+ * calculated, otherwise the known position is used. Next the `has_pos`,
+ * `pos_ecef` and `sat_dists` fields are filled in. Finally the
+ * #base_obs_received semaphore is flagged to indicate that new observations
+ * are available.
  *
  * \note This function is stateful as it must store the previous observation
  *       set for the TDCP Doppler.
@@ -124,9 +136,11 @@ static void update_obss(obss_t *new_obss)
 
   /* Fill in the navigation measurements in base_obss, using TDCP method to
    * calculate the Doppler shift. */
+  base_tdcp_dt = gpsdifftime(&new_obss->tor, &tor_old);
   base_obss.n = tdcp_doppler(new_obss->n, new_obss->nm,
                              n_old, nm_old, base_obss.nm,
-                             gpsdifftime(&new_obss->tor, &tor_old));
+                             base_tdcp_dt);
+  base_obss.pred_var = 0;
 
   /* Copy over sender ID. */
   base_obss.sender_id = new_obss->sender_id;
@@ -142,7 +156,17 @@ static void update_obss(obss_t *new_obss)
   base_obss.tor = new_obss->tor;
 
   u8 has_pos_old = base_obss.has_pos;
-  if (base_obss.n >= 4) {
+  if (moving_base) {
+    /* A moving base has no fixed position to smooth and only relative
+     * positioning is done against it, skip the position solution. */
+    base_obss.has_pos = 0;
+  } else if (base_pos_known) {
+    /* The base station has sent us its surveyed position, there is no need
+     * to compute a noisy one on its behalf. No need to lock before reading
+     * here as base_pos_* is only written from this thread (SBP). */
+    memcpy(base_obss.pos_ecef, base_pos_ecef, sizeof(base_obss.pos_ecef));
+    base_obss.has_pos = 1;
+  } else if (base_obss.n >= 4) {
     gnss_solution soln;
     dops_t dops;
 
@@ -168,20 +192,12 @@ static void update_obss(obss_t *new_obss)
         memcpy(base_obss.pos_ecef, soln.pos_ecef, 3 * sizeof(double));
       }
       base_obss.has_pos = 1;
-
-      if (base_pos_known) {
-       double base_distance = vector_distance(3, soln.pos_ecef, base_pos_ecef);
-
-       if (base_distance > BASE_STATION_DISTANCE_THRESHOLD) {
-         log_warn("Received base station position %f m from PVT position.",
-                  base_distance);
-       }
-      }
     } else {
       base_obss.has_pos = 0;
       /* TODO(dsk) check for repair failure */
       /* There was an error calculating the position solution. */
-      log_warn("Error calculating base station position: (%s).", pvt_err_msg[-ret-1]);
+      log_warn("Error calculating base station position: (%s).",
+               pvt_err_msg[-ret-1]);
     }
   } else {
     base_obss.has_pos = 0;
@@ -209,6 +225,112 @@ static void update_obss(obss_t *new_obss)
   chBSemSignal(&base_obs_received);
 }
 
+/** Predict the base station observations at a later time.
+ * Extrapolates the raw pseudoranges and carrier phases in #base_obss along the
+ * base station's own TDCP Doppler and recomputes the satellite states and
+ * distances for the new time of transmission. This bridges short gaps in the
+ * base station observation stream, e.g. over lossy radio links.
+ *
+ * The carrier phase error of the prediction grows with its age \f$\tau\f$ as
+ * \f$\sigma_d^2 \tau^2 + q \tau^3 / 3\f$ where \f$\sigma_d\f$ is the Doppler
+ * noise (#BASE_OBS_PREDICT_DOPPLER_SIGMA) and \f$q\f$ the unmodelled phase
+ * acceleration (#BASE_OBS_PREDICT_ACCEL_PSD). It is returned in `pred_var`.
+ *
+ * \note Must be called with #base_obs_lock held.
+ *
+ * \param t    Time to predict the observations at.
+ * \param pred Predicted observation set.
+ * \return Number of observations predicted, zero if no prediction is possible.
+ */
+u8 base_obs_predict(const gps_time_t *t, obss_t *pred)
+{
+  double dt = gpsdifftime(t, &base_obss.tor);
+
+  if (!base_obss.has_pos || (dt < 0) || (dt > base_predict_max_age) ||
+      (base_tdcp_dt <= 0) || (base_tdcp_dt > BASE_OBS_PREDICT_MAX_TDCP_DT)) {
+    return 0;
+  }
+
+  pred->tor = *t;
+  memcpy(pred->pos_ecef, base_obss.pos_ecef, sizeof(pred->pos_ecef));
+  pred->has_pos = 1;
+  pred->sender_id = base_obss.sender_id;
+  pred->pred_var = BASE_OBS_PREDICT_DOPPLER_SIGMA *
+                   BASE_OBS_PREDICT_DOPPLER_SIGMA * dt * dt +
+                   BASE_OBS_PREDICT_ACCEL_PSD * dt * dt * dt / 3;
+  pred->n = 0;
+
+  for (u8 i = 0; i < base_obss.n; i++) {
+    navigation_measurement_t *nm = &pred->nm[pred->n];
+    memcpy(nm, &base_obss.nm[i], sizeof(*nm));
+
+    nav_meas_propagate(nm, dt);
+
+    nm->tot = *t;
+    nm->tot.tow -= nm->raw_pseudorange / GPS_C;
+    normalize_gps_time(&nm->tot);
+
+    const ephemeris_t *e = ephemeris_get(nm->sid);
+    u8 eph_valid;
+    s8 ss_ret;
+    double clock_err;
+    double clock_rate_err;
+
+    ephemeris_lock();
+    eph_valid = ephemeris_valid(e, &nm->tot);
+    if (eph_valid) {
+      ss_ret = calc_sat_state(e, &nm->tot, nm->sat_pos, nm->sat_vel,
+                              &clock_err, &clock_rate_err);
+    }
+    ephemeris_unlock();
+
+    if (!eph_valid || (ss_ret != 0)) {
+      continue;
+    }
+
+    nm->pseudorange = nm->raw_pseudorange + clock_err * GPS_C;
+    nm->carrier_phase = nm->raw_carrier_phase - clock_err * GPS_L1_HZ;
+    nm->tot.tow -= clock_err;
+    normalize_gps_time(&nm->tot);
+
+    pred->sat_dists[pred->n] = vector_distance(3, nm->sat_pos,
+                                               pred->pos_ecef);
+    pred->n++;
+  }
+
+  return pred->n;
+}
+
+/** Pass a received observation set on to update_obss().
+ * Sets missing some of their messages are used with the satellites that did
+ * arrive.
+ *
+ * \param obss     Observation set.
+ * \param received Bit mask of the messages received.
+ * \param total    Total number of messages in the set.
+ */
+static void obss_rx_done(obss_t *obss, u32 received, u8 total)
+{
+  u8 n_received = __builtin_popcount(received);
+  if (n_received != total) {
+    log_info("Dropped %d of %d observation packets, using %d observations.",
+             total - n_received, total, obss->n);
+  }
+
+  if (obss->n == 0) {
+    return;
+  }
+
+  update_obss(obss);
+
+  /* Calculate packet latency. */
+  if (time_quality >= TIME_COARSE) {
+    gps_time_t now = get_current_time();
+    float latency_ms = (float) ((now.tow - obss->tor.tow) * 1000.0);
+    log_obs_latency(latency_ms);
+  }
+}
+
 /** SBP callback for observation messages.
  * SBP observation sets are potentially split across multiple SBP messages to
  * keep the payload within the size limit.
@@ -217,19 +339,21 @@ static void update_obss(obss_t *new_obss)
  * of observations (all referring to the same observation time) and a count of
  * which message this is in the sequence.
  *
- * This function attempts to collect a full set of observations into a single
- * `obss_t` (`base_obss_rx`). Once a full set is received then update_obss()
- * is called.
+ * This function collects the set of observations into a single `obss_t`
+ * (`base_obss_rx`). Once the last message of the set is received, or the first
+ * message of a new set arrives (newer time, other sender or the base going
+ * back in time), the messages received so far are passed on to update_obss().
+ * Dropped messages only lose the satellites they carried.
  */
 static void obs_callback(u16 sender_id, u8 len, u8 msg[], void* context)
 {
   (void) context;
 
-  /* Keep track of where in the sequence of messages we were last time around
-   * so we can verify we haven't dropped a message. */
-  static s16 prev_count = 0;
-
-  static gps_time_t prev_tor = {.tow = 0.0, .wn = 0};
+  /* Keep track of which messages of the set being assembled have been
+   * received, and whether the set has already been passed on. */
+  static u32 rx_received = 0;
+  static u8 rx_total = 0;
+  static bool rx_pending = false;
 
   /* As we receive observation messages we assemble them into a working
    * `obss_t` (`base_obss_rx`) so as not to disturb the global `base_obss`
@@ -244,9 +368,6 @@ static void obs_callback(u16 sender_id, u8 len, u8 msg[], void* context)
     return;
   }
 
-  /* We set the sender_id */
-  base_obss_rx.sender_id = sender_id;
-
   /* Relay observations using sender_id = 0. */
   sbp_send_msg_(SBP_MSG_OBS, len, msg, 0);
 
@@ -262,8 +383,9 @@ static void obs_callback(u16 sender_id, u8 len, u8 msg[], void* context)
   unpack_obs_header((observation_header_t*)msg, &tor, &total, &count);
 
   /* Check to see if the observation is aligned with our internal observations,
-   * i.e. is it going to time match one of our local obs. */
-  u32 obs_freq = soln_freq / obs_output_divisor;
+   * i.e. is it going to time match one of our local obs. A moving base is
+   * matched against every solution epoch. */
+  u32 obs_freq = moving_base ? soln_freq : soln_freq / obs_output_divisor;
   double epoch_count = tor.tow * obs_freq;
   double dt = fabs(epoch_count - round(epoch_count)) / obs_freq;
   if (dt > TIME_MATCH_THRESHOLD) {
@@ -272,33 +394,53 @@ static void obs_callback(u16 sender_id, u8 len, u8 msg[], void* context)
     return;
   }
 
-  /* Verify sequence integrity */
-  if (count == 0) {
-    prev_tor = tor;
-    prev_count = 0;
-  } else if (prev_tor.tow != tor.tow ||
-             prev_tor.wn != tor.wn ||
-             prev_count + 1 != count) {
-    log_info("Dropped one of the observation packets! Skipping this sequence.");
-    prev_count = -1;
+  if (count >= total) {
     return;
-  } else {
-    prev_count = count;
   }
 
-  /* Calculate the number of observations in this message by looking at the SBP
-   * `len` field. */
-  u8 obs_in_msg = (len - sizeof(observation_header_t)) / sizeof(packed_obs_content_t);
+  double set_dt = gpsdifftime(&tor, &base_obss_rx.tor);
+  bool new_set = (sender_id != base_obss_rx.sender_id) ||
+                 (set_dt > TIME_MATCH_THRESHOLD);
+  if (set_dt < -TIME_MATCH_THRESHOLD) {
+    /* An older time is a late message from a set we have already moved on
+     * from, unless the base went back in time, e.g. when it was restarted or
+     * replayed. Resync on the start of a set or on a jump back of more than
+     * a few epochs, rather than ignore the base from then on. */
+    new_set |= (count == 0) ||
+               (set_dt < -(double)BASE_OBS_RESYNC_EPOCHS / obs_freq);
+    if (!new_set) {
+      return;
+    }
+  }
 
-  /* If this is the first packet in the sequence then reset the base_obss_rx
-   * state. */
-  if (count == 0) {
+  if (new_set) {
+    /* First message of a new set, pass on whatever arrived of the previous
+     * set if its last message was dropped, then start over. */
+    if (rx_pending) {
+      obss_rx_done(&base_obss_rx, rx_received, rx_total);
+    }
     base_obss_rx.n = 0;
     base_obss_rx.tor = tor;
+    base_obss_rx.sender_id = sender_id;
+    rx_received = 0;
+    rx_total = total;
+    rx_pending = true;
   }
 
+  if (!rx_pending || (rx_received & (1u << count))) {
+    /* Set already passed on or duplicate message. */
+    return;
+  }
+  rx_received |= 1u << count;
+
+  /* Calculate the number of observations in this message by looking at the SBP
+   * `len` field. */
+  u8 obs_in_msg = (len - sizeof(observation_header_t)) /
+                  sizeof(packed_obs_content_t);
+
   /* Pull out the contents of the message. */
-  packed_obs_content_t *obs = (packed_obs_content_t *)(msg + sizeof(observation_header_t));
+  packed_obs_content_t *obs =
+    (packed_obs_content_t *)(msg + sizeof(observation_header_t));
   for (u8 i=0; i<obs_in_msg; i++) {
     gnss_signal_t sid = sid_from_sbp(obs[i].sid);
     if (!sid_supported(sid))
@@ -353,16 +495,11 @@ static void obs_callback(u16 sender_id, u8 len, u8 msg[], void* context)
     base_obss_rx.n++;
   }
 
-  /* If we can, and all the obs have been received, update to using the new
-   * obss. */
-  if (count == total - 1) {
-    update_obss(&base_obss_rx);
-  /* Calculate packet latency. */
-    if (time_quality >= TIME_COARSE) {
-      gps_time_t now = get_current_time();
-      float latency_ms = (float) ((now.tow - tor.tow) * 1000.0);
-      log_obs_latency(latency_ms);
-    }
+  /* Once the last message of the set has been received update to using the
+   * new obss, even if an earlier message was dropped. */
+  if (count == rx_total - 1) {
+    obss_rx_done(&base_obss_rx, rx_received, rx_total);
+    rx_pending = false;
   }
 }
 
@@ -371,7 +508,8 @@ static void obs_callback(u16 sender_id, u8 len, u8 msg[], void* context)
 static void deprecated_callback(u16 sender_id, u8 len, u8 msg[], void* context)
 {
   (void) context; (void) len; (void) msg; (void) sender_id;
-  log_warn("Received a deprecated obs msg. Verify firmware version on remote Piksi.");
+  log_warn("Received a deprecated obs msg. "
+           "Verify firmware version on remote Piksi.");
 }
 
 /** Setup the base station observation handling subsystem. */
@@ -413,6 +551,8 @@ void base_obs_setup()
     &deprecated_callback,
     &deprecated_node_2
   );
+
+  SETTING("solution", "base_predict_max_age", base_predict_max_age, TYPE_FLOAT);
 }
 
 /* \} */
@@ -41,6 +41,9 @@ typedef struct {
   /** Distances to each satellite based on `pos_ecef` and `nm`.
    * Used for observation propagation. */
   double sat_dists[MAX_CHANNELS];
+  /** Variance of the carrier phase of predicted observations in cycles^2,
+   * zero for measured observations. See base_obs_predict(). */
+  double pred_var;
 } obss_t;
 
 /** Maximum difference between observation times to consider them matched. */
@@ -51,6 +54,18 @@ typedef struct {
  */
 #define BASE_STATION_DISTANCE_THRESHOLD 50
 
+/** Longest TDCP interval, in seconds, from which base station observations
+ * will be predicted. */
+#define BASE_OBS_PREDICT_MAX_TDCP_DT 2.0
+
+/** Noise of the base station TDCP Doppler used for prediction, in
+ * cycles/s. */
+#define BASE_OBS_PREDICT_DOPPLER_SIGMA 0.05
+
+/** Spectral density of the unmodelled carrier phase acceleration at the base
+ * station (atmosphere, receiver clock), in cycles^2/s^3. */
+#define BASE_OBS_PREDICT_ACCEL_PSD 0.01
+
 /* \} */
 
 extern mutex_t base_obs_lock;
@@ -62,5 +77,6 @@ extern bool base_pos_known;
 extern double base_pos_ecef[3];
 
 void base_obs_setup(void);
+u8 base_obs_predict(const gps_time_t *t, obss_t *pred);
 
 #endif
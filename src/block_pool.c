@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#define memory_pool_t MemoryPool
+#include <ch.h>
+#undef memory_pool_t
+
+#include <libswiftnav/logging.h>
+
+#include "block_pool.h"
+#include "mem_placement.h"
+
+/** \addtogroup block_pool
+ * \{ */
+
+typedef struct {
+  MemoryPool pool;
+  block_pool_stats_t stats;
+  u32 n_failures_reported;
+} block_pool_t;
+
+/* Blocks are aligned for any type, payloads are cast to SBP message structs.
+ * None of them are handed to DMA, SBP frames are copied into the USART TX
+ * buffers, so they may follow their subsystem into CCM. */
+typedef union {
+  u8 data[SBP_FRAMING_MAX_PAYLOAD_SIZE];
+  u32 align;
+} sbp_frame_block_t;
+
+typedef sdiff_t sdiffs_block_t[MAX_CHANNELS];
+
+static sbp_frame_block_t sbp_frame_blocks[BLOCK_POOL_SBP_FRAME_COUNT] _SBP;
+static obss_t obss_blocks[BLOCK_POOL_OBSS_COUNT] _SOLN;
+static sdiffs_block_t sdiffs_blocks[BLOCK_POOL_SDIFFS_COUNT] _SOLN;
+
+static block_pool_t pools[BLOCK_POOL_COUNT];
+
+static void pool_init(block_pool_id_t id, const char *name, void *blocks,
+                      u32 block_size, u32 n_blocks)
+{
+  block_pool_t *p = &pools[id];
+  chPoolObjectInit(&p->pool, block_size, NULL);
+  chPoolLoadArray(&p->pool, blocks, n_blocks);
+  p->stats.name = name;
+  p->stats.block_size = block_size;
+  p->stats.n_blocks = n_blocks;
+}
+
+/** Load the blocks into their pools. Must be called before any allocation,
+ * in particular before the first log message. */
+void block_pool_setup(void)
+{
+  pool_init(BLOCK_POOL_SBP_FRAME, "sbp frame", sbp_frame_blocks,
+            sizeof(sbp_frame_blocks[0]), BLOCK_POOL_SBP_FRAME_COUNT);
+  pool_init(BLOCK_POOL_OBSS, "obs set", obss_blocks,
+            sizeof(obss_blocks[0]), BLOCK_POOL_OBSS_COUNT);
+  pool_init(BLOCK_POOL_SDIFFS, "sdiff array", sdiffs_blocks,
+            sizeof(sdiffs_blocks[0]), BLOCK_POOL_SDIFFS_COUNT);
+}
+
+/** Allocate a block.
+ *
+ * \param id Pool to allocate from.
+ *
+ * \return Pointer to the block, or NULL if the pool is empty.
+ */
+void *block_pool_alloc(block_pool_id_t id)
+{
+  block_pool_t *p = &pools[id];
+
+  chSysLock();
+  void *block = chPoolAllocI(&p->pool);
+  if (block == NULL) {
+    p->stats.n_failures++;
+  } else if (++p->stats.n_used > p->stats.max_used) {
+    p->stats.max_used = p->stats.n_used;
+  }
+  chSysUnlock();
+
+  return block;
+}
+
+/** Return a block to the pool it was allocated from. */
+void block_pool_free(block_pool_id_t id, void *block)
+{
+  block_pool_t *p = &pools[id];
+
+  chSysLock();
+  chPoolFreeI(&p->pool, block);
+  p->stats.n_used--;
+  chSysUnlock();
+}
+
+/** Get a snapshot of the usage statistics of a pool. */
+void block_pool_stats(block_pool_id_t id, block_pool_stats_t *stats)
+{
+  chSysLock();
+  *stats = pools[id].stats;
+  chSysUnlock();
+}
+
+/** Warn about pools that refused allocations since the last check. */
+void block_pool_check(void)
+{
+  for (u32 i = 0; i < BLOCK_POOL_COUNT; i++) {
+    block_pool_stats_t s;
+    block_pool_stats(i, &s);
+    u32 n_new = s.n_failures - pools[i].n_failures_reported;
+    if (n_new == 0)
+      continue;
+    pools[i].n_failures_reported = s.n_failures;
+    log_warn("Block pool %s: %u allocations refused (%u of %u blocks used, "
+             "peak %u)", s.name, (unsigned)n_new, (unsigned)s.n_used,
+             (unsigned)s.n_blocks, (unsigned)s.max_used);
+  }
+}
+
+/** \} */
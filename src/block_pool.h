@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_BLOCK_POOL_H
+#define SWIFTNAV_BLOCK_POOL_H
+
+#include <libsbp/common.h>
+#include <libsbp/sbp.h>
+#include <libswiftnav/common.h>
+#include <libswiftnav/observation.h>
+
+#include "base_obs.h"
+#include "solution.h"
+
+/** \defgroup block_pool Block Pools
+ * Typed pools of fixed size blocks for buffers that would otherwise live on
+ * thread stacks or in per-function statics.
+ *
+ * Allocation and release take constant time and never fail silently: a pool
+ * that runs dry returns NULL and counts the refusal, and the system monitor
+ * reports pools that refused allocations. The high-water mark of each pool
+ * shows whether its block count can be reduced.
+ * \{ */
+
+/** Blocks holding one SBP message payload. */
+#define BLOCK_POOL_SBP_FRAME_COUNT 8
+/** Blocks holding one set of observations, shared between the solution
+ * thread and the time matched observation thread. */
+#define BLOCK_POOL_OBSS_COUNT OBS_N_BUFF
+/** Blocks holding MAX_CHANNELS single differences. */
+#define BLOCK_POOL_SDIFFS_COUNT 1
+
+typedef enum {
+  BLOCK_POOL_SBP_FRAME,
+  BLOCK_POOL_OBSS,
+  BLOCK_POOL_SDIFFS,
+  BLOCK_POOL_COUNT
+} block_pool_id_t;
+
+/** Usage statistics of a pool. */
+typedef struct {
+  const char *name;
+  u32 block_size;   /**< Size of a block in bytes. */
+  u32 n_blocks;     /**< Blocks in the pool. */
+  u32 n_used;       /**< Blocks currently allocated. */
+  u32 max_used;     /**< Most blocks allocated at once. */
+  u32 n_failures;   /**< Allocations refused because the pool was empty. */
+} block_pool_stats_t;
+
+void block_pool_setup(void);
+void *block_pool_alloc(block_pool_id_t id);
+void block_pool_free(block_pool_id_t id, void *block);
+void block_pool_stats(block_pool_id_t id, block_pool_stats_t *stats);
+void block_pool_check(void);
+
+/** Allocate a buffer of SBP_FRAMING_MAX_PAYLOAD_SIZE bytes. */
+static inline u8 *sbp_frame_alloc(void)
+{
+  return (u8 *)block_pool_alloc(BLOCK_POOL_SBP_FRAME);
+}
+
+static inline void sbp_frame_free(u8 *frame)
+{
+  block_pool_free(BLOCK_POOL_SBP_FRAME, frame);
+}
+
+/** Allocate a set of observations. */
+static inline obss_t *obss_alloc(void)
+{
+  return (obss_t *)block_pool_alloc(BLOCK_POOL_OBSS);
+}
+
+static inline void obss_free(obss_t *obss)
+{
+  block_pool_free(BLOCK_POOL_OBSS, obss);
+}
+
+/** Allocate an array of MAX_CHANNELS single differences. */
+static inline sdiff_t *sdiffs_alloc(void)
+{
+  return (sdiff_t *)block_pool_alloc(BLOCK_POOL_SDIFFS);
+}
+
+static inline void sdiffs_free(sdiff_t *sdiffs)
+{
+  block_pool_free(BLOCK_POOL_SDIFFS, sdiffs);
+}
+
+/** \} */
+
+#endif  /* SWIFTNAV_BLOCK_POOL_H */
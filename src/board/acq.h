@@ -21,11 +21,26 @@ typedef struct {
   float cp;
   float cf;
   float cn0;
+  u32 excised_bins; /**< Number of sample FFT bins excised as interference. */
 } acq_result_t;
 
+/** Search parameters of one signal in a multi-signal search. */
+typedef struct {
+  gnss_signal_t sid;
+  float cf_min;     /**< Lowest carrier frequency to search. (Hz) */
+  float cf_max;     /**< Highest carrier frequency to search. (Hz) */
+} acq_search_params_t;
+
+/** Maximum number of signals searched against one set of samples. */
+#define ACQ_MULTI_MAX 4
+
 float acq_bin_width(void);
 
 bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
                 float cf_bin_width, acq_result_t *acq_result);
+u8 acq_search_multi(u8 n, const acq_search_params_t params[],
+                    float cf_bin_width, acq_result_t results[]);
+
+void acq_idle_work(void);
 
 #endif /* SWIFTNAV_ACQ_H */
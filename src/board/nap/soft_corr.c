@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include <libswiftnav/prns.h>
+
+#include "soft_corr.h"
+
+/** \addtogroup nap
+ * \{ */
+
+/** \defgroup soft_corr Software correlator
+ * Bit-sliced software model of a NAP track channel, used to replay recorded
+ * samples through the tracking loops on a host.
+ *
+ * Samples, carrier and code replicas are held as planes of sign and
+ * magnitude bits, SOFT_CORR_WORD_SAMPLES samples per word. The correlation of
+ * a word is then evaluated with a handful of AND, XOR and popcount
+ * operations instead of one multiply-accumulate per sample.
+ * \{ */
+
+#define CODE_PHASE_UNITS_PER_CHIP ((u64)1 << 32)
+#define CODE_PHASE_UNITS_PER_CODE \
+          (SOFT_CORR_CODE_LENGTH * CODE_PHASE_UNITS_PER_CHIP)
+
+/** Half chip early/late spacing. */
+#define SOFT_CORR_SPACING (CODE_PHASE_UNITS_PER_CHIP / 2)
+
+/* Carrier quantization by octant of the carrier phase, sampled at the octant
+ * center: cos/sin take the values {+-1, +-2}. */
+static const u8 cos_sign_octant[8] = {0, 0, 1, 1, 1, 1, 0, 0};
+static const u8 cos_mag_octant[8]  = {1, 0, 0, 1, 1, 0, 0, 1};
+static const u8 sin_sign_octant[8] = {0, 0, 0, 0, 1, 1, 1, 1};
+static const u8 sin_mag_octant[8]  = {0, 1, 1, 0, 0, 1, 1, 0};
+
+/** Mask of the n least significant bits, n from 0 to 64. */
+static inline u64 low_mask(u32 n)
+{
+  return (n >= 64) ? ~(u64)0 : (((u64)1 << n) - 1);
+}
+
+static inline u32 popcount(u64 x)
+{
+  return __builtin_popcountll(x);
+}
+
+/** Sum of sample * carrier * code over the valid samples of a word.
+ *
+ * The product magnitude is (1 + 2 mx) (1 + mc) = 1 + 2 mx + mc + 2 mx mc.
+ * Each term contributes popcount(term) - 2 popcount(term & neg).
+ *
+ * \param neg     Product sign plane, set bits are negative.
+ * \param mx      Sample magnitude plane.
+ * \param mc      Carrier magnitude plane.
+ * \param valid   Valid sample mask.
+ *
+ * \return Correlation sum.
+ */
+static inline s32 corr_sum(u64 neg, u64 mx, u64 mc, u64 valid)
+{
+  neg &= valid;
+  mx &= valid;
+  mc &= valid;
+  u64 mxc = mx & mc;
+  s32 sum = (s32)popcount(valid) - 2 * (s32)popcount(neg);
+  sum += 2 * ((s32)popcount(mx) - 2 * (s32)popcount(mx & neg));
+  sum += (s32)popcount(mc) - 2 * (s32)popcount(mc & neg);
+  sum += 2 * ((s32)popcount(mxc) - 2 * (s32)popcount(mxc & neg));
+  return sum;
+}
+
+/** Extract n samples of a plane starting at an arbitrary sample offset. */
+static inline u64 plane_window(const u64 *plane, u32 pos, u32 n)
+{
+  u32 word = pos / SOFT_CORR_WORD_SAMPLES;
+  u32 bit = pos % SOFT_CORR_WORD_SAMPLES;
+  u64 w = plane[word] >> bit;
+  if ((bit != 0) && (bit + n > SOFT_CORR_WORD_SAMPLES)) {
+    w |= plane[word + 1] << (SOFT_CORR_WORD_SAMPLES - bit);
+  }
+  return w;
+}
+
+static inline u64 code_phase_wrap(u64 code_phase)
+{
+  while (code_phase >= CODE_PHASE_UNITS_PER_CODE) {
+    code_phase -= CODE_PHASE_UNITS_PER_CODE;
+  }
+  return code_phase;
+}
+
+/** Build the code replica plane for n samples.
+ *
+ * Rather than evaluating the chip index per sample, the plane is filled one
+ * chip run at a time.
+ *
+ * \param c           Channel.
+ * \param code_phase  Code phase of the first sample.
+ * \param n           Number of samples.
+ *
+ * \return Code plane, set bits are negative chips.
+ */
+static u64 code_plane(const soft_corr_channel_t *c, u64 code_phase, u32 n)
+{
+  u64 plane = 0;
+  u32 k = 0;
+  while (k < n) {
+    u32 chip = code_phase / CODE_PHASE_UNITS_PER_CHIP;
+    u32 frac = (u32)code_phase;
+    /* Samples remaining before the next chip boundary */
+    u64 run = (CODE_PHASE_UNITS_PER_CHIP - frac + c->code_pinc - 1) /
+              c->code_pinc;
+    if (run > n - k) {
+      run = n - k;
+    }
+    if (c->chips[chip]) {
+      plane |= low_mask(run) << k;
+    }
+    k += run;
+    code_phase = code_phase_wrap(code_phase + run * c->code_pinc);
+  }
+  return plane;
+}
+
+/** Convert 2-bit samples to bit-sliced sign and magnitude planes.
+ *
+ * Input samples are packed four to a byte, first sample in the least
+ * significant bits. Within each 2-bit sample bit 1 is the sign and bit 0 the
+ * magnitude.
+ *
+ * \param samples     Packed input samples.
+ * \param n_samples   Number of samples.
+ * \param sign        Output sign plane, ceil(n_samples / 64) words.
+ * \param mag         Output magnitude plane, ceil(n_samples / 64) words.
+ */
+void soft_corr_samples_pack(const u8 *samples, u32 n_samples,
+                            u64 *sign, u64 *mag)
+{
+  u32 n_words = (n_samples + SOFT_CORR_WORD_SAMPLES - 1) /
+                SOFT_CORR_WORD_SAMPLES;
+  memset(sign, 0, n_words * sizeof(u64));
+  memset(mag, 0, n_words * sizeof(u64));
+
+  for (u32 i = 0; i < n_samples; i++) {
+    u8 s = (samples[i / 4] >> (2 * (i % 4))) & 0x3;
+    u64 bit = (u64)1 << (i % SOFT_CORR_WORD_SAMPLES);
+    if (s & 0x2) {
+      sign[i / SOFT_CORR_WORD_SAMPLES] |= bit;
+    }
+    if (s & 0x1) {
+      mag[i / SOFT_CORR_WORD_SAMPLES] |= bit;
+    }
+  }
+}
+
+/** Initialize a software correlator channel.
+ *
+ * As on the NAP the channel starts at zero code and carrier phase.
+ *
+ * \param c             Channel.
+ * \param code          C/A code as returned by ca_code().
+ * \param start_sample  Sample count of the first integration.
+ * \param scaling       Scaling of the correlation outputs.
+ */
+void soft_corr_init(soft_corr_channel_t *c, const u8 *code, u32 start_sample,
+                    soft_corr_scaling_t scaling)
+{
+  memset(c, 0, sizeof(*c));
+  for (u32 i = 0; i < SOFT_CORR_CODE_LENGTH; i++) {
+    c->chips[i] = (get_chip((u8 *)code, i) < 0);
+  }
+  c->start_sample = start_sample;
+  c->scaling = scaling;
+  c->spacing = SOFT_CORR_SPACING;
+}
+
+/** Program the channel for the next integration.
+ *
+ * Arguments are in NAP register units, as written by nap_track_update().
+ *
+ * \param c           Channel.
+ * \param carr_pinc   Carrier phase increment per sample, 2^-32 cycles.
+ * \param code_pinc   Code phase increment per sample, 2^-32 chips.
+ * \param length      Integration length (samples).
+ */
+void soft_corr_update(soft_corr_channel_t *c, u32 carr_pinc, u32 code_pinc,
+                      u32 length)
+{
+  assert(code_pinc != 0);
+
+  c->code_pinc = code_pinc;
+  c->length = length;
+
+  if (c->carrier_lut_valid && (carr_pinc == c->carr_pinc)) {
+    return;
+  }
+  c->carr_pinc = carr_pinc;
+  c->carrier_lut_valid = true;
+
+  /* Rebuild the carrier replicas. Each starts at the center of its phase
+   * state, so the phase error is at most half a state. */
+  for (u32 s = 0; s < SOFT_CORR_CARR_PHASE_STATES; s++) {
+    u32 phase = (s << (32 - SOFT_CORR_CARR_PHASE_STATES_LOG2)) +
+                (1U << (31 - SOFT_CORR_CARR_PHASE_STATES_LOG2));
+    soft_corr_carrier_t *lut = &c->carrier_lut[s];
+    memset(lut, 0, sizeof(*lut));
+    for (u32 k = 0; k < SOFT_CORR_WORD_SAMPLES; k++) {
+      u32 octant = phase >> 29;
+      u64 bit = (u64)1 << k;
+      lut->cos_sign |= cos_sign_octant[octant] ? bit : 0;
+      lut->cos_mag |= cos_mag_octant[octant] ? bit : 0;
+      lut->sin_sign |= sin_sign_octant[octant] ? bit : 0;
+      lut->sin_mag |= sin_mag_octant[octant] ? bit : 0;
+      phase += carr_pinc;
+    }
+  }
+}
+
+/** Run one integration.
+ *
+ * \param c         Channel.
+ * \param samples   Sample buffer, must cover the whole integration.
+ *
+ * \return true if the integration was performed, false if the samples do
+ *         not cover it.
+ */
+bool soft_corr_integrate(soft_corr_channel_t *c,
+                         const soft_corr_samples_t *samples)
+{
+  u32 pos = c->start_sample - samples->first_sample;
+  if ((u64)pos + c->length >
+      (u64)samples->n_words * SOFT_CORR_WORD_SAMPLES) {
+    return false;
+  }
+
+  s32 acc_i[3] = {0, 0, 0};
+  s32 acc_q[3] = {0, 0, 0};
+
+  u32 remaining = c->length;
+  while (remaining > 0) {
+    u32 n = MIN(remaining, SOFT_CORR_WORD_SAMPLES);
+    u64 valid = low_mask(n);
+    u64 xs = plane_window(samples->sign, pos, n);
+    u64 xm = plane_window(samples->mag, pos, n);
+
+    const soft_corr_carrier_t *lut =
+        &c->carrier_lut[(u32)c->carr_phase >>
+                        (32 - SOFT_CORR_CARR_PHASE_STATES_LOG2)];
+
+    u64 code_phase[3] = {
+      code_phase_wrap(c->code_phase + c->spacing),
+      c->code_phase,
+      code_phase_wrap(c->code_phase + CODE_PHASE_UNITS_PER_CODE - c->spacing)
+    };
+
+    for (u32 j = 0; j < 3; j++) {
+      u64 code = code_plane(c, code_phase[j], n);
+      acc_i[j] += corr_sum(xs ^ code ^ lut->cos_sign, xm, lut->cos_mag, valid);
+      acc_q[j] += corr_sum(xs ^ code ^ lut->sin_sign, xm, lut->sin_mag, valid);
+    }
+
+    c->carr_phase += (s64)n * (s32)c->carr_pinc;
+    c->code_phase = code_phase_wrap(c->code_phase + (u64)n * c->code_pinc);
+    pos += n;
+    remaining -= n;
+  }
+
+  for (u32 j = 0; j < 3; j++) {
+    c->corrs[j].I = ((s64)acc_i[j] * c->scaling.gain) >> c->scaling.shift;
+    c->corrs[j].Q = ((s64)acc_q[j] * c->scaling.gain) >> c->scaling.shift;
+  }
+  c->count_snapshot = c->start_sample;
+  c->start_sample += c->length;
+  return true;
+}
+
+/** Read the results of the last integration.
+ *
+ * Outputs match nap_track_read_results(), with the correlations scaled as
+ * set by soft_corr_init().
+ *
+ * \param c                   Channel.
+ * \param count_snapshot      Sample count of the start of the integration.
+ * \param corrs               Early, prompt and late correlations.
+ * \param code_phase_early    Early code phase at the end of the integration
+ *                            (chips).
+ * \param carrier_phase       Carrier phase at the end of the integration
+ *                            (cycles).
+ */
+void soft_corr_read_results(const soft_corr_channel_t *c,
+                            u32 *count_snapshot, corr_t corrs[],
+                            double *code_phase_early,
+                            double *carrier_phase)
+{
+  memcpy(corrs, c->corrs, sizeof(c->corrs));
+  *count_snapshot = c->count_snapshot;
+  *code_phase_early = (double)code_phase_wrap(c->code_phase + c->spacing) /
+                      CODE_PHASE_UNITS_PER_CHIP;
+  *carrier_phase = (double)-c->carr_phase / ((u64)1 << 32);
+}
+
+/** \} */
+
+/** \} */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_SOFT_CORR_H
+#define SWIFTNAV_SOFT_CORR_H
+
+#include <libswiftnav/common.h>
+
+#include "nap_common.h"
+
+/** \addtogroup nap
+ * \{ */
+
+/** Samples per packed word. */
+#define SOFT_CORR_WORD_SAMPLES 64
+
+/** Number of carrier phase states in the carrier lookup table. */
+#define SOFT_CORR_CARR_PHASE_STATES_LOG2 6
+#define SOFT_CORR_CARR_PHASE_STATES (1 << SOFT_CORR_CARR_PHASE_STATES_LOG2)
+
+#define SOFT_CORR_CODE_LENGTH 1023
+
+/** Bit-sliced 2-bit samples.
+ *
+ * Bit k of word w holds sample SOFT_CORR_WORD_SAMPLES * w + k. Samples take
+ * the values {+1, +3, -1, -3}: a set sign bit means negative, a set magnitude
+ * bit means 3. */
+typedef struct {
+  const u64 *sign;        /**< Sign plane. */
+  const u64 *mag;         /**< Magnitude plane. */
+  u32 n_words;            /**< Number of words in each plane. */
+  u32 first_sample;       /**< Sample count of the first sample. */
+} soft_corr_samples_t;
+
+/** Carrier replica for SOFT_CORR_WORD_SAMPLES samples. */
+typedef struct {
+  u64 cos_sign;
+  u64 cos_mag;
+  u64 sin_sign;
+  u64 sin_mag;
+} soft_corr_carrier_t;
+
+/** Scaling of the correlator outputs.
+ *
+ * The correlation sums of the model are those of +-1/+-3 samples against a
+ * +-1/+-2 carrier and +-1 code. The NAP correlates at internal sample and
+ * carrier amplitudes which are not documented, and the v3 track channel
+ * returns its accumulators shifted right by 8. Outputs are
+ * (sum * gain) >> shift, so that a replay can match the correlation scale
+ * the tracking loops were tuned for on the NAP being stood in for. */
+typedef struct {
+  s32 gain;               /**< Multiplier applied to the sums. */
+  u8 shift;               /**< Arithmetic right shift after the gain. */
+} soft_corr_scaling_t;
+
+/** Unscaled correlation sums. */
+#define SOFT_CORR_SCALING_RAW ((soft_corr_scaling_t){.gain = 1, .shift = 0})
+
+/** Software correlator channel.
+ *
+ * Mirrors the NAP track channel registers: the caller programs CARR_PINC,
+ * CODE_PINC and LENGTH for each integration, as nap_track_update() does. */
+typedef struct {
+  u8 chips[SOFT_CORR_CODE_LENGTH];  /**< C/A code, 1 = negative chip. */
+  soft_corr_scaling_t scaling;      /**< Output scaling. */
+  u32 carr_pinc;          /**< Carrier phase increment per sample. */
+  u32 code_pinc;          /**< Code phase increment per sample. */
+  u32 length;             /**< Integration length (samples). */
+  u32 start_sample;       /**< Sample count of the next integration. */
+  u32 count_snapshot;     /**< Sample count of the last integration. */
+  s64 carr_phase;         /**< Carrier phase, 2^-32 cycle units. */
+  u64 code_phase;         /**< Prompt code phase, 2^-32 chip units. */
+  u32 spacing;            /**< Early/late spacing, 2^-32 chip units. */
+  bool carrier_lut_valid; /**< Carrier lookup table matches carr_pinc. */
+  corr_t corrs[3];        /**< Early, prompt, late results. */
+  /** Carrier replicas indexed by the top bits of the carrier phase. */
+  soft_corr_carrier_t carrier_lut[SOFT_CORR_CARR_PHASE_STATES];
+} soft_corr_channel_t;
+
+/** \} */
+
+void soft_corr_samples_pack(const u8 *samples, u32 n_samples,
+                            u64 *sign, u64 *mag);
+
+void soft_corr_init(soft_corr_channel_t *c, const u8 *code, u32 start_sample,
+                    soft_corr_scaling_t scaling);
+void soft_corr_update(soft_corr_channel_t *c, u32 carr_pinc, u32 code_pinc,
+                      u32 length);
+bool soft_corr_integrate(soft_corr_channel_t *c,
+                         const soft_corr_samples_t *samples);
+void soft_corr_read_results(const soft_corr_channel_t *c,
+                            u32 *count_snapshot, corr_t corrs[],
+                            double *code_phase_early,
+                            double *carrier_phase);
+
+#endif /* SWIFTNAV_SOFT_CORR_H */
@@ -24,11 +24,35 @@ float acq_bin_width(void)
 bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
                 float cf_bin_width, acq_result_t *acq_result)
 {
-  acq_set_sid(sid);
+  acq_search_params_t params = {
+    .sid = sid,
+    .cf_min = cf_min,
+    .cf_max = cf_max
+  };
+  return acq_search_multi(1, &params, cf_bin_width, acq_result) == 1;
+}
+
+/** Search for several signals in one set of samples.
+ * The acquisition sample ram is loaded once, then for each signal only the
+ * code ram is rewritten and the Doppler bins are run through the correlation
+ * pipeline against the same samples. The pipeline is drained before the next
+ * code is written, so each result belongs to the signal at the same index.
+ *
+ * \param n            Number of signals to search, at most ACQ_MULTI_MAX.
+ * \param params       Signals and carrier frequency ranges to search.
+ * \param cf_bin_width Carrier frequency step. (Hz)
+ * \param results      Results, in the order of params. All share the
+ *                     sample count of the single load.
+ * \return Number of signals searched.
+ */
+u8 acq_search_multi(u8 n, const acq_search_params_t params[],
+                    float cf_bin_width, acq_result_t results[])
+{
+  if (n == 0)
+    return 0;
 
-  /* We have our SID chosen, now load some fresh data
-   * into the acquisition ram on the Swift NAP for
-   * an initial coarse acquisition.
+  /* Load some fresh data into the acquisition ram on the Swift NAP
+   * for a coarse acquisition of all signals.
    */
   u32 sample_count;
   do {
@@ -36,14 +60,20 @@ bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
     /* acq_load could timeout if we're preempted and miss the timing strobe */
   } while (!acq_load(sample_count));
 
-  acq_search_begin(cf_min, cf_max, cf_bin_width);
+  for (u8 i = 0; i < n; i++) {
+    acq_set_sid(params[i].sid);
+    acq_search_begin(params[i].cf_min, params[i].cf_max, cf_bin_width);
 
-  /* Done with the coarse acquisition, check if we have found a
-   * satellite, if so save the results and start the loading
-   * for the fine acquisition. If not, start again choosing a
-   * different PRN.
-   */
-  acq_result->sample_count = sample_count;
-  acq_get_results(&acq_result->cp, &acq_result->cf, &acq_result->cn0);
-  return true;
+    results[i].sample_count = sample_count;
+    acq_get_results(&results[i].cp, &results[i].cf, &results[i].cn0);
+    results[i].excised_bins = 0;
+  }
+  return n;
+}
+
+/** Perform background work using the acquisition hardware.
+ * Called by acquisition management between searches. Nothing to do here.
+ */
+void acq_idle_work(void)
+{
 }
@@ -11,6 +11,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "cfs-coffee-arch.h"
 #include "peripherals/stm_flash.h"
@@ -24,27 +25,50 @@
  */
 
 /** Read from the Coffee filesystem area in STM flash.
+ * The filesystem is stored inverted so that erased flash reads as zeros.
+ * Aligned words are read and inverted a word at a time.
  * \param buf Pointer to a buffer where the read values will be stored.
  * \param size Number of bytes to read.
  * \param offset Offset into the filesystem area to read from.
  */
 void coffee_read(u8* buf, u32 size, u32 offset)
 {
-  for (u32 i=0; i<size; i++)
-    buf[i] = ~((u8*)(COFFEE_START+offset))[i];
+  const u8 *src = (const u8 *)(COFFEE_START+offset);
+  u32 i = 0;
+
+  if ((((u32)src | (u32)buf) & 3) == 0) {
+    for (; i+4 <= size; i+=4)
+      *(u32 *)&buf[i] = ~*(const u32 *)&src[i];
+  }
+  for (; i<size; i++)
+    buf[i] = ~src[i];
 }
 
 /** Write to the Coffee filesystem area in STM flash.
+ * The aligned middle of the range is programmed a word at a time, the
+ * unaligned head and tail byte by byte.
  * \param buf Pointer to a buffer containing the values to be written.
  * \param size Number of bytes to write.
  * \param offset Offset into the filesystem area to write to.
  */
 void coffee_write(u8* buf, u32 size, u32 offset)
 {
+  u32 addr = COFFEE_START+offset;
+  u32 i = 0;
+
   flash_unlock();
 
-  for (u32 i=0; i<size; i++)
-    flash_program_byte(COFFEE_START+offset+i, ~buf[i]);
+  for (; (i<size) && ((addr+i) & 3); i++)
+    flash_program_byte(addr+i, ~buf[i]);
+
+  for (; i+4 <= size; i+=4) {
+    u32 w;
+    memcpy(&w, &buf[i], sizeof(w));
+    flash_program_word(addr+i, ~w);
+  }
+
+  for (; i<size; i++)
+    flash_program_byte(addr+i, ~buf[i]);
 
   flash_lock();
 }
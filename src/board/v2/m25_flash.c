@@ -11,22 +11,31 @@
  * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
  */
 
-#include <stdio.h>
+#include <string.h>
+
+#include <ch.h>
 
-#include "../error.h"
 #include "../peripherals/spi_wrapper.h"
-#include "../sbp.h"
 #include "../flash.h"
 #include "m25_flash.h"
-#include "main.h"
 
 /** \addtogroup board
  * \{ */
 
 /** \defgroup m25 M25Pxx Flash
  * Interface to the M25Pxx FPGA configuration flash.
+ *
+ * Bulk reads and page programs are sent as a single DMA transfer through a
+ * bounce buffer, as caller buffers may be in CCM which the DMA can not reach.
+ * The buffer is only accessed while the flash is selected, i.e. with the bus
+ * mutex held. Waits for a program or erase to finish poll the status
+ * register with an increasing sleep between polls, releasing the SPI bus to
+ * the front-end in the meantime.
  * \{ */
 
+/* Static buffer NOT in CCM, holds a command header and one page of data. */
+static u8 dma_buffer[M25_CMD_HEADER_LEN + M25_PAGE_SIZE];
+
 /** Send "write enable" command to the flash. */
 void m25_write_enable(void)
 {
@@ -85,8 +94,39 @@ void m25_write_status(u8 sr)
   spi_slave_deselect(SPI_SLAVE_FLASH);
 }
 
+/** Wait for a program or erase operation to finish.
+ * The status register is polled back to back a few times to catch short
+ * page programs, then with a sleep doubling up to
+ * \ref M25_WIP_BACKOFF_MAX_MS between polls.
+ */
+static void m25_wait_ready(void)
+{
+  u32 sleep_ms = 1;
+
+  for (u32 i = 0; m25_read_status() & M25_SR_WIP; i++) {
+    if (i < M25_WIP_SPIN_POLLS)
+      continue;
+    chThdSleepMilliseconds(sleep_ms);
+    if (sleep_ms < M25_WIP_BACKOFF_MAX_MS)
+      sleep_ms *= 2;
+  }
+}
+
+/* Fill in a command header, returns the header length. */
+static u8 m25_cmd_header(u8 header[], u8 cmd, u32 addr)
+{
+  header[0] = cmd;
+  header[1] = (addr >> 16) & 0xFF;
+  header[2] = (addr >> 8) & 0xFF;
+  header[3] = addr & 0xFF;
+  return 4;
+}
+
 /** Read data from flash memory.
- * \todo Use fast read command instead of regular?
+ * Reads shorter than \ref M25_DMA_MIN_LEN are clocked out byte by byte with
+ * the READ command. Longer reads use FAST_READ and are transferred by DMA in
+ * chunks of up to \ref M25_PAGE_SIZE bytes within a single command.
+ *
  * \param addr Starting address to read from
  * \param len Number of addresses to read
  * \param buff Array to write bytes read from flash to
@@ -102,14 +142,27 @@ u8 m25_read(u32 addr, u8 buff[], u32 len)
 
   spi_slave_select(SPI_SLAVE_FLASH);
 
-  spi_slave_xfer(SPI_SLAVE_FLASH, M25_READ);
+  if (len < M25_DMA_MIN_LEN) {
+    spi_slave_xfer(SPI_SLAVE_FLASH, M25_READ);
 
-  spi_slave_xfer(SPI_SLAVE_FLASH, (addr >> 16) & 0xFF);
-  spi_slave_xfer(SPI_SLAVE_FLASH, (addr >> 8) & 0xFF);
-  spi_slave_xfer(SPI_SLAVE_FLASH, addr & 0xFF);
+    spi_slave_xfer(SPI_SLAVE_FLASH, (addr >> 16) & 0xFF);
+    spi_slave_xfer(SPI_SLAVE_FLASH, (addr >> 8) & 0xFF);
+    spi_slave_xfer(SPI_SLAVE_FLASH, addr & 0xFF);
 
-  for (u32 i = 0; i < len; i++)
-    buff[i] = spi_slave_xfer(SPI_SLAVE_FLASH, 0x00);
+    for (u32 i = 0; i < len; i++)
+      buff[i] = spi_slave_xfer(SPI_SLAVE_FLASH, 0x00);
+  } else {
+    /* FAST_READ is followed by one dummy byte before the data. */
+    u8 n = m25_cmd_header(dma_buffer, M25_FAST_READ, addr);
+    dma_buffer[n++] = 0x00;
+    spi_slave_xfer_dma(SPI_SLAVE_FLASH, n, NULL, dma_buffer);
+
+    for (u32 i = 0; i < len; i += M25_PAGE_SIZE) {
+      u16 chunk = MIN(len - i, M25_PAGE_SIZE);
+      spi_slave_xfer_dma(SPI_SLAVE_FLASH, chunk, dma_buffer, dma_buffer);
+      memcpy(&buff[i], dma_buffer, chunk);
+    }
+  }
 
   spi_slave_deselect(SPI_SLAVE_FLASH);
 
@@ -119,6 +172,7 @@ u8 m25_read(u32 addr, u8 buff[], u32 len)
 /** Program a page of the flash.
  * Programs selected bits from 1 to 0. If the write will cross a page
  * boundary, the device will hang and report an error.
+ * Note : m25_write_enable() must be called before this function is called.
  *
  * \param addr Starting address to write to
  * \param len  Number of addresses to write
@@ -135,22 +189,16 @@ u8 m25_page_program(u32 addr, u8 buff[], u8 len)
   if (addr>>8 < (addr+len-1)>>8)
     return FLASH_INVALID_RANGE;
 
-  u32 i;
-
+  /* Note: only access buffer while slave is selected (and mutex is owned). */
   spi_slave_select(SPI_SLAVE_FLASH);
 
-  spi_slave_xfer(SPI_SLAVE_FLASH, M25_PP);
-
-  spi_slave_xfer(SPI_SLAVE_FLASH, (addr >> 16) & 0xFF);
-  spi_slave_xfer(SPI_SLAVE_FLASH, (addr >> 8) & 0xFF);
-  spi_slave_xfer(SPI_SLAVE_FLASH, addr & 0xFF);
-
-  for (i = 0; i < len; i++)
-    spi_slave_xfer(SPI_SLAVE_FLASH, buff[i]);
+  u8 n = m25_cmd_header(dma_buffer, M25_PP, addr);
+  memcpy(&dma_buffer[n], buff, len);
+  spi_slave_xfer_dma(SPI_SLAVE_FLASH, n + len, NULL, dma_buffer);
 
   spi_slave_deselect(SPI_SLAVE_FLASH);
 
-  while (m25_read_status() & M25_SR_WIP) ;
+  m25_wait_ready();
 
   return FLASH_OK;
 }
@@ -177,7 +225,7 @@ u8 m25_sector_erase(u32 addr)
 
   spi_slave_deselect(SPI_SLAVE_FLASH);
 
-  while (m25_read_status() & M25_SR_WIP) ;
+  m25_wait_ready();
 
   return FLASH_OK;
 }
@@ -193,7 +241,7 @@ void m25_bulk_erase(void)
 
   spi_slave_deselect(SPI_SLAVE_FLASH);
 
-  while (m25_read_status() & M25_SR_WIP) ;
+  m25_wait_ready();
 }
 
 /** \} */
@@ -38,6 +38,16 @@
 #define M25_SR_WIP  (1 << 0)  /**< Status Register: Write In Progress Bit */
 
 #define M25_MAX_ADDR 0xFFFFF
+#define M25_PAGE_SIZE 256
+
+/** Length of the longest command header, FAST_READ with its dummy byte. */
+#define M25_CMD_HEADER_LEN 5
+/** Reads of at least this many bytes are transferred by DMA. */
+#define M25_DMA_MIN_LEN 16
+/** Back to back status polls before sleeping between polls. */
+#define M25_WIP_SPIN_POLLS 4
+/** Longest sleep between status polls while waiting for an operation. */
+#define M25_WIP_BACKOFF_MAX_MS 64
 
 /** \} */
 
@@ -25,6 +25,7 @@
 #include "track_channel.h"
 #include "../../ext_events.h"
 #include "../../system_monitor.h"
+#include "../../mem_placement.h"
 #include "peripherals/spi_wrapper.h"
 /** \addtogroup nap
  * \{ */
@@ -36,7 +37,7 @@
  *        if an exti has occurred, maybe we should change to u64? */
 u32 nap_exti_count;
 
-static WORKING_AREA_CCM(wa_nap_exti, 2000);
+static WORKING_AREA_TRACK(wa_nap_exti, 2000);
 static void nap_exti_thread(void *arg);
 static u32 nap_irq_rd_blocking(void);
 
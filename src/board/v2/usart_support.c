@@ -15,10 +15,10 @@
 #include <libswiftnav/logging.h>
 
 #include "peripherals/usart.h"
+#include "peripherals/usart_tx.h"
 #include "error.h"
 #include "main.h"
 
-#define USART_TX_BUFFER_LEN 2048
 #define USART_RX_BUFFER_LEN 2048
 
 #define USART1_TX_DMA_CHANNEL                                               \
@@ -48,21 +48,20 @@ struct usart_support_s {
     binary_semaphore_t ready;
   } rx;
   struct usart_tx_dma_state {
-    /** USART TX DMA buffer. DMA xfers from buffer to USART_DR. */
-    u8 buff[USART_TX_BUFFER_LEN];
-    u32 rd;       /**< Address of next byte to read out of buffer. */
-    u32 wr;       /**< Next buffer address to write to. */
-    u32 xfer_len; /**< Number of bytes to DMA from buffer to USART_DR. */
+    /** Ring of bytes to DMA to USART_DR. */
+    usart_tx_queue_t queue;
     const stm32_dma_stream_t *dma;     /**< DMA for particular USART. */
-    bool busy;
   } tx;
 } SD1, SD3, SD6;
 
 static void usart_rx_dma_isr(struct usart_rx_dma_state* s, u32 flags);
 static void usart_tx_dma_isr(struct usart_tx_dma_state* s, u32 flags);
+static void usart_tx_dma_start(void *ctx, const u8 data[], u32 len);
 
 static void usart_support_init_tx(struct usart_support_s *sd)
 {
+  usart_tx_queue_init(&sd->tx.queue, usart_tx_dma_start, &sd->tx);
+
   /* Setup TX DMA */
   dmaStreamSetMode(sd->tx.dma, sd->dmamode | STM32_DMA_CR_DIR_M2P |
                                STM32_DMA_CR_MINC | STM32_DMA_CR_TCIE);
@@ -232,30 +231,17 @@ u32 usart_support_read_timeout(void *sd, u8 data[], u32 len, u32 timeout)
 
 u32 usart_support_tx_n_free(void *sd)
 {
-  struct usart_tx_dma_state *s = &((struct usart_support_s *)sd)->tx;
-  /* The calculation for the number of bytes in the buffer depends on whether
-   * or not the write pointer has wrapped around the end of the buffer. */
-  if (s->wr >= s->rd)
-    return USART_TX_BUFFER_LEN - 1 - (s->wr - s->rd);
-  else
-    return (s->rd - s->wr) - 1;
+  return usart_tx_queue_n_free(&((struct usart_support_s *)sd)->tx.queue);
 }
 
-static void dma_schedule(struct usart_tx_dma_state *s)
+/* Called with the system locked, either on a write to an idle queue or from
+ * the completion of the previous transfer. */
+static void usart_tx_dma_start(void *ctx, const u8 data[], u32 len)
 {
-  dmaStreamSetMemory0(s->dma, &s->buff[s->rd]);
-  /* Save the transfer length so we can increment the read index after the
-   * transfer is finished. */
-  if (s->rd < s->wr)
-    /* DMA up until write pointer. */
-    s->xfer_len = s->wr - s->rd;
-  else
-    /* DMA up until the end of the buffer. */
-    s->xfer_len = USART_TX_BUFFER_LEN - s->rd;
-
-  dmaStreamSetTransactionSize(s->dma, s->xfer_len);
+  struct usart_tx_dma_state *s = (struct usart_tx_dma_state *)ctx;
+  dmaStreamSetMemory0(s->dma, data);
+  dmaStreamSetTransactionSize(s->dma, len);
   dmaStreamEnable(s->dma);
-  s->busy = true;
 }
 
 static void usart_tx_dma_isr(struct usart_tx_dma_state* s, u32 flags)
@@ -264,56 +250,19 @@ static void usart_tx_dma_isr(struct usart_tx_dma_state* s, u32 flags)
     screaming_death("USART TX DMA error interrupt");
 
   osalSysLockFromISR();
-  /* Now that the transfer has finished we can increment the read index. */
-  s->rd = (s->rd + s->xfer_len) % USART_TX_BUFFER_LEN;
-
-  if (s->wr != s->rd)
-    /* Buffer not empty. */
-    dma_schedule(s);
-  else
-    s->busy = false;
+  /* Release what was sent and start the next transfer. */
+  usart_tx_queue_completeI(&s->queue);
   osalSysUnlockFromISR();
 }
 
 u32 usart_support_write(void *sd, const u8 data[], u32 len)
 {
-  struct usart_tx_dma_state *s = &((struct usart_support_s *)sd)->tx;
-
-  /* If there is no data to write, just return. */
-  if (len == 0) return 0;
-
-  chSysLock();
-
-  /* Check if the write would cause a buffer overflow, if so only write up to
-   * the end of the buffer. */
-  u32 n_free = usart_tx_n_free(sd);
-  if (len > n_free) {
-    chSysUnlock();
-    return 0;
-  }
-
-  u32 old_wr = s->wr;
-  s->wr = (s->wr + len) % USART_TX_BUFFER_LEN;
-
-  if (old_wr + len <= USART_TX_BUFFER_LEN)
-    memcpy(&(s->buff[old_wr]), data, len);
-  else {
-    /* Deal with case where write wraps the buffer. */
-    memcpy(&(s->buff[old_wr]), &data[0], USART_TX_BUFFER_LEN - old_wr);
-    memcpy(&(s->buff[0]), &data[USART_TX_BUFFER_LEN - old_wr],
-           len - (USART_TX_BUFFER_LEN - old_wr));
-  }
-
-  /* Check if there is a DMA transfer either in progress or waiting for its
-   * interrupt to be serviced. Its very important to also check the interrupt
-   * flag as EN will be cleared when the transfer finishes but we really need
-   * to make sure the ISR has been run to finish up the bookkeeping for the
-   * transfer. Also, make sure that this is done atomically without a DMA
-   * interrupt squeezing in there. */
-  if (!s->busy)
-    dma_schedule(s);
-
-  chSysUnlock();
-  return len;
+  return usart_tx_queue_write(&((struct usart_support_s *)sd)->tx.queue,
+                              data, len);
 }
 
+bool usart_support_write_buf(void *sd, usart_tx_buf_t *buf)
+{
+  return usart_tx_queue_submit(&((struct usart_support_s *)sd)->tx.queue,
+                               buf);
+}
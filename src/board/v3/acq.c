@@ -20,18 +20,25 @@
 
 #include "nap/nap_constants.h"
 #include "nap/fft.h"
+#include "acq_kernels.h"
+#include "spectrum.h"
+#include "spectrum_monitor.h"
 
 #define CHIP_RATE 1.023e6f
 #define CODE_LENGTH 1023
 #define CODE_MULT 16384
-#define RESULT_DIV 32
 #define FFT_SCALE_SCHED_CODE 0x15555555
 #define FFT_SCALE_SCHED_SAMPLES 0x15555555
 #define FFT_SCALE_SCHED_INV 0x15550000
 #define FFT_SAMPLES_INPUT FFT_SAMPLES_INPUT_RF1_CH0
+/* Sample FFT bins with power above this multiple of the noise floor are
+ * excised. Noise bin power is exponentially distributed, so noise alone
+ * exceeds it with probability exp(-15), i.e. practically never. */
+#define EXCISION_THRESHOLD 15.0f
 
 static void code_resample(gnss_signal_t sid, float chips_per_sample,
                           fft_cplx_t *resampled, u32 resampled_length);
+static u32 sample_fft_excise(fft_cplx_t *sample_fft, u32 fft_len);
 
 float acq_bin_width(void)
 {
@@ -63,9 +70,12 @@ bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
     return false;
   }
 
+  /* Remove narrowband interference */
+  u32 excised_bins = sample_fft_excise(sample_fft, fft_len);
+
   /* Search for results */
-  float best_mag_sq = 0.0f;
-  float best_mag_sq_sum = 0.0f;
+  u32 best_mag_sq = 0;
+  u64 best_mag_sq_sum = 0;
   float best_doppler = 0.0f;
   u32 best_sample_offset = 0;
 
@@ -81,19 +91,8 @@ bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
 
     /* Multiply sample FFT by shifted conjugate code FFT */
     static fft_cplx_t result_fft[FFT_LEN_MAX];
-    for (u32 i=0; i<fft_len; i++) {
-      const fft_cplx_t *a = &code_fft[i];
-      const fft_cplx_t *b = &sample_fft[(i + sample_offset) & (fft_len - 1)];
-      fft_cplx_t *r = &result_fft[i];
-
-      s32 a_re = (s32)a->re;
-      s32 a_im = (s32)a->im;
-      s32 b_re = (s32)b->re;
-      s32 b_im = (s32)b->im;
-
-      r->re = ((a_re * b_re) + (a_im * b_im)) / RESULT_DIV;
-      r->im = ((a_re * -b_im) + (a_im * b_re)) / RESULT_DIV;
-    }
+    acq_mult_conj(code_fft, sample_fft, (u32)sample_offset, result_fft,
+                  fft_len);
 
     /* Inverse FFT */
     if (!fft(result_fft, result_fft, fft_len_log2,
@@ -102,26 +101,13 @@ bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
     }
 
     /* Peak search */
-    float mag_sq_sum = 0.0f;
-    bool match = false;
-    for (u32 i=0; i<fft_len; i++) {
-      const fft_cplx_t *r = &result_fft[i];
-
-      float re = (float)r->re;
-      float im = (float)r->im;
-      float mag_sq = re*re + im*im;
-      mag_sq_sum += mag_sq;
-
-      if (mag_sq > best_mag_sq) {
-        best_mag_sq = mag_sq;
-        best_doppler = doppler;
-        best_sample_offset = i;
-        match = true;
-      }
-    }
-
-    if (match) {
-      best_mag_sq_sum = mag_sq_sum;
+    acq_peak_t peak;
+    acq_peak_search(result_fft, fft_len, &peak);
+    if (peak.mag_sq > best_mag_sq) {
+      best_mag_sq = peak.mag_sq;
+      best_mag_sq_sum = peak.mag_sq_sum;
+      best_doppler = doppler;
+      best_sample_offset = peak.index;
     }
   }
 
@@ -140,7 +126,7 @@ bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
   cp -= CODE_LENGTH * floorf(cp / CODE_LENGTH);
 
   /* Compute C/N0 */
-  float snr = best_mag_sq / (best_mag_sq_sum / fft_len);
+  float snr = (float)best_mag_sq / ((float)best_mag_sq_sum / fft_len);
   float cn0 = 10.0f * log10f(snr)
             + 10.0f * log10f(fft_bin_width); /* Bandwidth */
 
@@ -149,9 +135,65 @@ bool acq_search(gnss_signal_t sid, float cf_min, float cf_max,
   acq_result->cp = cp;
   acq_result->cf = best_doppler;
   acq_result->cn0 = cn0;
+  acq_result->excised_bins = excised_bins;
   return true;
 }
 
+/** Search for several signals.
+ * Each signal is searched with its own set of samples.
+ *
+ * \param n            Number of signals to search, at most ACQ_MULTI_MAX.
+ * \param params       Signals and carrier frequency ranges to search.
+ * \param cf_bin_width Carrier frequency step. (Hz)
+ * \param results      Results, in the order of params.
+ * \return Number of signals searched before the first failure.
+ */
+u8 acq_search_multi(u8 n, const acq_search_params_t params[],
+                    float cf_bin_width, acq_result_t results[])
+{
+  for (u8 i = 0; i < n; i++) {
+    if (!acq_search(params[i].sid, params[i].cf_min, params[i].cf_max,
+                    cf_bin_width, &results[i]))
+      return i;
+  }
+  return n;
+}
+
+/** Perform background work using the acquisition hardware.
+ * Called by acquisition management between searches.
+ */
+void acq_idle_work(void)
+{
+  spectrum_monitor_run();
+}
+
+/** Excise narrowband interference from a sample FFT.
+ *
+ * Continuous wave interference concentrates in a few sample FFT bins. Left
+ * in place it leaks into every Doppler bin of the search, raising the noise
+ * estimate and producing false peaks. Bins well above the noise floor are
+ * zeroed, which removes a negligible fraction of the signal energy.
+ *
+ * \param sample_fft  Sample FFT, modified in place.
+ * \param fft_len     Number of bins.
+ *
+ * \return Number of bins excised.
+ */
+static u32 sample_fft_excise(fft_cplx_t *sample_fft, u32 fft_len)
+{
+  float threshold = EXCISION_THRESHOLD *
+                    spectrum_noise_floor((const s16 *)sample_fft, fft_len);
+
+  u32 excised_bins = 0;
+  for (u32 i=0; i<fft_len; i++) {
+    if (spectrum_bin_power(sample_fft[i].re, sample_fft[i].im) > threshold) {
+      sample_fft[i] = (fft_cplx_t){ .re = 0, .im = 0 };
+      excised_bins++;
+    }
+  }
+  return excised_bins;
+}
+
 static void code_resample(gnss_signal_t sid, float chips_per_sample,
                           fft_cplx_t *resampled, u32 resampled_length)
 {
@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "acq_kernels.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ACQ_KERNELS_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define ACQ_KERNELS_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ACQ_KERNELS_SSE2
+#endif
+
+#if defined(ACQ_KERNELS_NEON) || defined(ACQ_KERNELS_AVX2) || \
+    defined(ACQ_KERNELS_SSE2)
+#define ACQ_KERNELS_VECTOR
+#endif
+
+/* The vector kernels must produce bit-identical results to the *_ref
+ * reference implementations, which define the arithmetic:
+ *  - products are accumulated in 32 bits, wrapping on overflow, and divided by
+ *    ACQ_KERNEL_RESULT_DIV rounding towards zero, then truncated to 16 bits,
+ *  - squared magnitudes are exact 32 bit unsigned integers and their sum is
+ *    exact in 64 bits,
+ *  - the peak index is that of the first occurrence of the maximum.
+ * The NEON kernels are the ones used on the Piksi v3. The SSE2 and AVX2
+ * kernels serve host builds of the acquisition. */
+
+/** Multiply a run of code FFT points by conjugated sample FFT points.
+ *
+ * \param a     Code FFT points.
+ * \param b     Sample FFT points.
+ * \param r     Output points.
+ * \param n     Number of points.
+ */
+static void mult_conj_run_ref(const fft_cplx_t *a, const fft_cplx_t *b,
+                              fft_cplx_t *r, u32 n)
+{
+  for (u32 i=0; i<n; i++) {
+    s32 a_re = (s32)a[i].re;
+    s32 a_im = (s32)a[i].im;
+    s32 b_re = (s32)b[i].re;
+    s32 b_im = (s32)b[i].im;
+
+    /* The sum overflows only for a == b == -32768 - 32768j and wraps like
+     * the vector multiply-accumulate instructions. */
+    s32 re = (s32)((u32)(a_re * b_re) + (u32)(a_im * b_im));
+    r[i].re = re / ACQ_KERNEL_RESULT_DIV;
+    r[i].im = ((a_re * -b_im) + (a_im * b_re)) / ACQ_KERNEL_RESULT_DIV;
+  }
+}
+
+/** Multiply the code FFT by the conjugate of the circularly shifted sample
+ * FFT, reference implementation.
+ *
+ * result[i] = code[i] * conj(samples[(i + sample_offset) % len]) / DIV
+ *
+ * \param code            Code FFT.
+ * \param samples         Sample FFT.
+ * \param sample_offset   Circular shift applied to the sample FFT.
+ * \param result          Output buffer.
+ * \param len             Number of points, power of two.
+ */
+void acq_mult_conj_ref(const fft_cplx_t *code, const fft_cplx_t *samples,
+                       u32 sample_offset, fft_cplx_t *result, u32 len)
+{
+  u32 offset = sample_offset & (len - 1);
+  mult_conj_run_ref(code, &samples[offset], result, len - offset);
+  mult_conj_run_ref(&code[len - offset], samples, &result[len - offset],
+                    offset);
+}
+
+/** Continue a peak search over points start to len - 1.
+ *
+ * \param in      Input points.
+ * \param start   Index of the first point to search.
+ * \param len     Number of points.
+ * \param peak    Peak of the points before start, updated.
+ */
+static void peak_search_run_ref(const fft_cplx_t *in, u32 start, u32 len,
+                                acq_peak_t *peak)
+{
+  for (u32 i=start; i<len; i++) {
+    s32 re = (s32)in[i].re;
+    s32 im = (s32)in[i].im;
+    u32 mag_sq = (u32)(re*re) + (u32)(im*im);
+    peak->mag_sq_sum += mag_sq;
+    if (mag_sq > peak->mag_sq) {
+      peak->mag_sq = mag_sq;
+      peak->index = i;
+    }
+  }
+}
+
+/** Combine the per lane maxima of a vector peak search.
+ *
+ * \param lane_max        Maximum of each lane.
+ * \param lane_max_index  Index of the first occurrence of each maximum.
+ * \param n_lanes         Number of lanes.
+ * \param peak            Output peak, mag_sq and index are set.
+ */
+static inline void peak_lanes_reduce(const u32 *lane_max,
+                                     const u32 *lane_max_index, u32 n_lanes,
+                                     acq_peak_t *peak)
+{
+  /* Lowest index among the lanes holding the maximum. */
+  peak->mag_sq = lane_max[0];
+  peak->index = lane_max_index[0];
+  for (u32 k = 1; k < n_lanes; k++) {
+    if ((lane_max[k] > peak->mag_sq) ||
+        ((lane_max[k] == peak->mag_sq) && (lane_max_index[k] < peak->index))) {
+      peak->mag_sq = lane_max[k];
+      peak->index = lane_max_index[k];
+    }
+  }
+}
+
+/** Search for the peak squared magnitude, reference implementation.
+ *
+ * \param in      Input points.
+ * \param len     Number of points.
+ * \param peak    Output peak.
+ */
+void acq_peak_search_ref(const fft_cplx_t *in, u32 len, acq_peak_t *peak)
+{
+  peak->mag_sq = 0;
+  peak->index = 0;
+  peak->mag_sq_sum = 0;
+
+  peak_search_run_ref(in, 0, len, peak);
+}
+
+#if defined(ACQ_KERNELS_NEON)
+
+/** Divide by ACQ_KERNEL_RESULT_DIV rounding towards zero. */
+static inline int32x4_t div_result_neon(int32x4_t x)
+{
+  /* Add DIV - 1 to negative values before the arithmetic shift. */
+  uint32x4_t bias = vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(x, 31)),
+                                32 - 5);
+  return vshrq_n_s32(vaddq_s32(x, vreinterpretq_s32_u32(bias)), 5);
+}
+
+static void mult_conj_run(const fft_cplx_t *a, const fft_cplx_t *b,
+                          fft_cplx_t *r, u32 n)
+{
+  _Static_assert(ACQ_KERNEL_RESULT_DIV == (1 << 5),
+                 "NEON kernel assumes a division by 32");
+
+  u32 i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int16x4x2_t va = vld2_s16((const s16 *)&a[i]);
+    int16x4x2_t vb = vld2_s16((const s16 *)&b[i]);
+
+    int32x4_t re = vmull_s16(va.val[0], vb.val[0]);
+    re = vmlal_s16(re, va.val[1], vb.val[1]);
+    int32x4_t im = vmull_s16(va.val[1], vb.val[0]);
+    im = vmlsl_s16(im, va.val[0], vb.val[1]);
+
+    int16x4x2_t vr;
+    vr.val[0] = vmovn_s32(div_result_neon(re));
+    vr.val[1] = vmovn_s32(div_result_neon(im));
+    vst2_s16((s16 *)&r[i], vr);
+  }
+
+  mult_conj_run_ref(&a[i], &b[i], &r[i], n - i);
+}
+
+/** Search for the peak squared magnitude. See acq_peak_search_ref().
+ *
+ * \param in      Input points.
+ * \param len     Number of points.
+ * \param peak    Output peak.
+ */
+void acq_peak_search(const fft_cplx_t *in, u32 len, acq_peak_t *peak)
+{
+  static const u32 lane_index[4] = {0, 1, 2, 3};
+
+  uint32x4_t max = vdupq_n_u32(0);
+  uint32x4_t max_index = vdupq_n_u32(0);
+  uint32x4_t index = vld1q_u32(lane_index);
+  uint32x4_t step = vdupq_n_u32(4);
+  uint64x2_t sum = vdupq_n_u64(0);
+
+  u32 i = 0;
+  for (; i + 4 <= len; i += 4) {
+    int16x4x2_t v = vld2_s16((const s16 *)&in[i]);
+    /* re^2 + im^2 <= 2^31, exact when interpreted as unsigned */
+    uint32x4_t mag_sq = vreinterpretq_u32_s32(
+        vmlal_s16(vmull_s16(v.val[0], v.val[0]), v.val[1], v.val[1]));
+
+    sum = vpadalq_u32(sum, mag_sq);
+
+    /* Strictly greater keeps the first occurrence within each lane. */
+    uint32x4_t gt = vcgtq_u32(mag_sq, max);
+    max = vbslq_u32(gt, mag_sq, max);
+    max_index = vbslq_u32(gt, index, max_index);
+    index = vaddq_u32(index, step);
+  }
+
+  u32 lane_max[4], lane_max_index[4];
+  vst1q_u32(lane_max, max);
+  vst1q_u32(lane_max_index, max_index);
+  peak_lanes_reduce(lane_max, lane_max_index, 4, peak);
+  peak->mag_sq_sum = vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+
+  peak_search_run_ref(in, i, len, peak);
+}
+
+#elif defined(ACQ_KERNELS_AVX2) || defined(ACQ_KERNELS_SSE2)
+
+/* The SSE2 and AVX2 kernels are the same code on 128 and 256 bit vectors.
+ * Each 32 bit lane holds one complex point, real part in the low half. */
+
+#if defined(ACQ_KERNELS_AVX2)
+#define VEC_POINTS 8
+typedef __m256i vec_t;
+#define vec_load(p)           _mm256_loadu_si256((const __m256i *)(p))
+#define vec_store(p, x)       _mm256_storeu_si256((__m256i *)(p), (x))
+#define vec_set1_32(x)        _mm256_set1_epi32(x)
+#define vec_setr_32x8(...)    _mm256_setr_epi32(__VA_ARGS__)
+#define vec_zero()            _mm256_setzero_si256()
+#define vec_madd16(a, b)      _mm256_madd_epi16((a), (b))
+#define vec_add32(a, b)       _mm256_add_epi32((a), (b))
+#define vec_add64(a, b)       _mm256_add_epi64((a), (b))
+#define vec_and(a, b)         _mm256_and_si256((a), (b))
+#define vec_andnot(a, b)      _mm256_andnot_si256((a), (b))
+#define vec_or(a, b)          _mm256_or_si256((a), (b))
+#define vec_xor(a, b)         _mm256_xor_si256((a), (b))
+#define vec_slli32(a, n)      _mm256_slli_epi32((a), (n))
+#define vec_srli32(a, n)      _mm256_srli_epi32((a), (n))
+#define vec_srai32(a, n)      _mm256_srai_epi32((a), (n))
+#define vec_cmpgt32(a, b)     _mm256_cmpgt_epi32((a), (b))
+#define vec_unpacklo32(a, b)  _mm256_unpacklo_epi32((a), (b))
+#define vec_unpackhi32(a, b)  _mm256_unpackhi_epi32((a), (b))
+#else
+#define VEC_POINTS 4
+typedef __m128i vec_t;
+#define vec_load(p)           _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, x)       _mm_storeu_si128((__m128i *)(p), (x))
+#define vec_set1_32(x)        _mm_set1_epi32(x)
+#define vec_zero()            _mm_setzero_si128()
+#define vec_madd16(a, b)      _mm_madd_epi16((a), (b))
+#define vec_add32(a, b)       _mm_add_epi32((a), (b))
+#define vec_add64(a, b)       _mm_add_epi64((a), (b))
+#define vec_and(a, b)         _mm_and_si128((a), (b))
+#define vec_andnot(a, b)      _mm_andnot_si128((a), (b))
+#define vec_or(a, b)          _mm_or_si128((a), (b))
+#define vec_xor(a, b)         _mm_xor_si128((a), (b))
+#define vec_slli32(a, n)      _mm_slli_epi32((a), (n))
+#define vec_srli32(a, n)      _mm_srli_epi32((a), (n))
+#define vec_srai32(a, n)      _mm_srai_epi32((a), (n))
+#define vec_cmpgt32(a, b)     _mm_cmpgt_epi32((a), (b))
+#define vec_unpacklo32(a, b)  _mm_unpacklo_epi32((a), (b))
+#define vec_unpackhi32(a, b)  _mm_unpackhi_epi32((a), (b))
+#endif
+
+/** Divide by ACQ_KERNEL_RESULT_DIV rounding towards zero. */
+static inline vec_t div_result_vec(vec_t x)
+{
+  /* Add DIV - 1 to negative values before the arithmetic shift. */
+  vec_t bias = vec_srli32(vec_srai32(x, 31), 32 - 5);
+  return vec_srai32(vec_add32(x, bias), 5);
+}
+
+static void mult_conj_run(const fft_cplx_t *a, const fft_cplx_t *b,
+                          fft_cplx_t *r, u32 n)
+{
+  _Static_assert(ACQ_KERNEL_RESULT_DIV == (1 << 5),
+                 "vector kernel assumes a division by 32");
+
+  const vec_t low_half = vec_set1_32(0x0000ffff);
+  const vec_t high_half = vec_set1_32((s32)0xffff0000);
+
+  u32 i = 0;
+  for (; i + VEC_POINTS <= n; i += VEC_POINTS) {
+    vec_t va = vec_load(&a[i]);
+    vec_t vb = vec_load(&b[i]);
+
+    /* re = a_re * b_re + a_im * b_im */
+    vec_t re = vec_madd16(va, vb);
+
+    /* im = a_im * b_re - a_re * b_im. Negating b_im overflows for -32768,
+     * so use ~b_im = -b_im - 1 and add back a_re. */
+    vec_t va_swap = vec_or(vec_slli32(va, 16), vec_srli32(va, 16));
+    vec_t vb_conj = vec_xor(vb, high_half);
+    vec_t a_re = vec_srai32(vec_slli32(va, 16), 16);
+    vec_t im = vec_add32(vec_madd16(va_swap, vb_conj), a_re);
+
+    /* Truncate to 16 bits and interleave. */
+    vec_t vr = vec_or(vec_and(div_result_vec(re), low_half),
+                      vec_slli32(div_result_vec(im), 16));
+    vec_store(&r[i], vr);
+  }
+
+  mult_conj_run_ref(&a[i], &b[i], &r[i], n - i);
+}
+
+/** Search for the peak squared magnitude. See acq_peak_search_ref().
+ *
+ * \param in      Input points.
+ * \param len     Number of points.
+ * \param peak    Output peak.
+ */
+void acq_peak_search(const fft_cplx_t *in, u32 len, acq_peak_t *peak)
+{
+  /* Unsigned compares as signed compares with the sign bits flipped. */
+  const vec_t sign = vec_set1_32((s32)0x80000000);
+  const vec_t step = vec_set1_32(VEC_POINTS);
+#if defined(ACQ_KERNELS_AVX2)
+  vec_t index = vec_setr_32x8(0, 1, 2, 3, 4, 5, 6, 7);
+#else
+  vec_t index = _mm_setr_epi32(0, 1, 2, 3);
+#endif
+  vec_t max_biased = sign;
+  vec_t max_index = vec_zero();
+  vec_t sum = vec_zero();
+
+  u32 i = 0;
+  for (; i + VEC_POINTS <= len; i += VEC_POINTS) {
+    vec_t v = vec_load(&in[i]);
+    /* re^2 + im^2 <= 2^31, exact when interpreted as unsigned */
+    vec_t mag_sq = vec_madd16(v, v);
+
+    sum = vec_add64(sum, vec_unpacklo32(mag_sq, vec_zero()));
+    sum = vec_add64(sum, vec_unpackhi32(mag_sq, vec_zero()));
+
+    /* Strictly greater keeps the first occurrence within each lane. */
+    vec_t mag_sq_biased = vec_xor(mag_sq, sign);
+    vec_t gt = vec_cmpgt32(mag_sq_biased, max_biased);
+    max_biased = vec_or(vec_and(gt, mag_sq_biased),
+                        vec_andnot(gt, max_biased));
+    max_index = vec_or(vec_and(gt, index), vec_andnot(gt, max_index));
+    index = vec_add32(index, step);
+  }
+
+  u32 lane_max[VEC_POINTS], lane_max_index[VEC_POINTS];
+  u64 lane_sum[VEC_POINTS / 2];
+  vec_store(lane_max, vec_xor(max_biased, sign));
+  vec_store(lane_max_index, max_index);
+  vec_store(lane_sum, sum);
+
+  peak_lanes_reduce(lane_max, lane_max_index, VEC_POINTS, peak);
+  peak->mag_sq_sum = 0;
+  for (u32 k = 0; k < VEC_POINTS / 2; k++) {
+    peak->mag_sq_sum += lane_sum[k];
+  }
+
+  peak_search_run_ref(in, i, len, peak);
+}
+
+#endif
+
+#ifdef ACQ_KERNELS_VECTOR
+
+/** Multiply the code FFT by the conjugate of the circularly shifted sample
+ * FFT. See acq_mult_conj_ref().
+ */
+void acq_mult_conj(const fft_cplx_t *code, const fft_cplx_t *samples,
+                   u32 sample_offset, fft_cplx_t *result, u32 len)
+{
+  u32 offset = sample_offset & (len - 1);
+  mult_conj_run(code, &samples[offset], result, len - offset);
+  mult_conj_run(&code[len - offset], samples, &result[len - offset], offset);
+}
+
+#else /* ACQ_KERNELS_VECTOR */
+
+void acq_mult_conj(const fft_cplx_t *code, const fft_cplx_t *samples,
+                   u32 sample_offset, fft_cplx_t *result, u32 len)
+{
+  acq_mult_conj_ref(code, samples, sample_offset, result, len);
+}
+
+void acq_peak_search(const fft_cplx_t *in, u32 len, acq_peak_t *peak)
+{
+  acq_peak_search_ref(in, len, peak);
+}
+
+#endif /* ACQ_KERNELS_VECTOR */
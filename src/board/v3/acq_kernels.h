@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_ACQ_KERNELS_H
+#define SWIFTNAV_ACQ_KERNELS_H
+
+#include <libswiftnav/common.h>
+
+#include "nap/fft.h"
+
+/** Divisor applied to the products of the code and sample FFTs. */
+#define ACQ_KERNEL_RESULT_DIV 32
+
+/** Result of a peak search. */
+typedef struct {
+  u32 mag_sq;       /**< Peak squared magnitude. */
+  u32 index;        /**< Index of the first occurrence of the peak. */
+  u64 mag_sq_sum;   /**< Sum of squared magnitudes over all points. */
+} acq_peak_t;
+
+void acq_mult_conj_ref(const fft_cplx_t *code, const fft_cplx_t *samples,
+                       u32 sample_offset, fft_cplx_t *result, u32 len);
+void acq_peak_search_ref(const fft_cplx_t *in, u32 len, acq_peak_t *peak);
+
+void acq_mult_conj(const fft_cplx_t *code, const fft_cplx_t *samples,
+                   u32 sample_offset, fft_cplx_t *result, u32 len);
+void acq_peak_search(const fft_cplx_t *in, u32 len, acq_peak_t *peak);
+
+#endif /* SWIFTNAV_ACQ_KERNELS_H */
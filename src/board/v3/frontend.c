@@ -15,6 +15,8 @@
 #include <hal.h>
 
 #include "frontend.h"
+#include "raw_capture.h"
+#include "spectrum_monitor.h"
 
 #define FRONTEND_SPI SPID2
 
@@ -153,6 +155,8 @@ void frontend_setup(void)
   /* Register any setting... */
 
   frontend_configure();
+  raw_capture_setup();
+  spectrum_monitor_setup();
 }
 
 bool frontend_ant_status(void)
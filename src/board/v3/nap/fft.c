@@ -25,6 +25,8 @@
 #define TIMING_COMPARE_DELTA (NAP_FRONTEND_SAMPLE_RATE_Hz * 1e-3) /* 1ms */
 
 static BSEMAPHORE_DECL(axi_dma_rx_bsem, 0);
+/* Serializes use of the ACQ block between acquisition and raw capture. */
+static MUTEX_DECL(fft_mutex);
 
 static void axi_dma_tx_callback(bool success);
 static void axi_dma_rx_callback(bool success);
@@ -214,10 +216,13 @@ bool fft(const fft_cplx_t *in, fft_cplx_t *out, u32 len_log2,
          fft_dir_t dir, u32 scale_schedule)
 {
   u32 len_bytes = length_points_get(len_log2) * sizeof(fft_cplx_t);
+  chMtxLock(&fft_mutex);
   config_set(dir, scale_schedule);
   control_set_dma();
   dma_start((const u8 *)in, (u8 *)out, len_bytes);
-  return dma_wait();
+  bool result = dma_wait();
+  chMtxUnlock(&fft_mutex);
+  return result;
 }
 
 /** Compute the FFT of a buffer of samples.
@@ -239,12 +244,14 @@ bool fft_samples(fft_samples_input_t samples_input, fft_cplx_t *out,
 {
   u32 len_points = length_points_get(len_log2);
   u32 len_bytes = len_points * sizeof(fft_cplx_t);
+  chMtxLock(&fft_mutex);
   config_set(dir, scale_schedule);
   control_set_frontend_samples(samples_input, len_points);
   sample_stream_start();
   dma_start(0, (u8 *)out, len_bytes);
   bool result = dma_wait();
   *sample_count = sample_stream_snapshot_get();
+  chMtxUnlock(&fft_mutex);
   return result;
 }
 
@@ -258,10 +265,37 @@ bool fft_samples(fft_samples_input_t samples_input, fft_cplx_t *out,
  */
 bool raw_samples_get(u8 *out, u32 len_samples, u32 *sample_count)
 {
+  raw_samples_start(out, len_samples);
+  return raw_samples_wait(sample_count);
+}
+
+/** Start an asynchronous transfer of a buffer of raw samples.
+ *
+ * The ACQ block is held until the matching call to raw_samples_wait(), which
+ * must be made from the same thread. This allows the caller to process a
+ * previously retrieved buffer while the next one is being transferred.
+ *
+ * \param out             Output buffer.
+ * \param len_samples     Number of samples.
+ */
+void raw_samples_start(u8 *out, u32 len_samples)
+{
+  chMtxLock(&fft_mutex);
   control_set_raw_samples(len_samples);
   dma_start(0, out, len_samples);
   sample_stream_start();
+}
+
+/** Wait for a transfer started by raw_samples_start() to complete.
+ *
+ * \param sample_count    Output sample count of the first sample.
+ *
+ * \return True if the samples were successfully retrieved, false otherwise.
+ */
+bool raw_samples_wait(u32 *sample_count)
+{
   bool result = dma_wait();
   *sample_count = sample_stream_snapshot_get();
+  chMtxUnlock(&fft_mutex);
   return result;
 }
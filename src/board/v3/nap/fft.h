@@ -50,5 +50,7 @@ bool fft_samples(fft_samples_input_t samples_input, fft_cplx_t *out,
                  u32 *sample_count);
 
 bool raw_samples_get(u8 *out, u32 len_samples, u32 *sample_count);
+void raw_samples_start(u8 *out, u32 len_samples);
+bool raw_samples_wait(u32 *sample_count);
 
 #endif /* SWIFTNAV_FFT_H */
@@ -20,6 +20,7 @@
 
 #include "track.h"
 #include "system_monitor.h"
+#include "mem_placement.h"
 
 #include <math.h>
 #include <string.h>
@@ -29,7 +30,7 @@
 static void nap_isr(void *context);
 
 static BSEMAPHORE_DECL(nap_exti_sem, TRUE);
-static WORKING_AREA_CCM(wa_nap_exti, 2000);
+static WORKING_AREA_TRACK(wa_nap_exti, 2000);
 static void nap_exti_thread(void *arg);
 
 static u8 nap_dna[NAP_DNA_LENGTH] = {0};
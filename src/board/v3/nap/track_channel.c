@@ -12,6 +12,7 @@
 
 #include "nap_constants.h"
 #include "nap_hw.h"
+#include "track_channel_calc.h"
 #include "nap/nap_common.h"
 #include "nap/track_channel.h"
 #include "track.h"
@@ -31,40 +32,12 @@
 #define TIMING_COMPARE_DELTA_MIN (  1e-3 * TRACK_SAMPLE_FREQ) /*   1ms */
 #define TIMING_COMPARE_DELTA_MAX (100e-3 * TRACK_SAMPLE_FREQ) /* 100ms */
 
-/* NAP track channel parameters. */
-#define NAP_TRACK_CARRIER_FREQ_WIDTH              32
-#define NAP_TRACK_CARRIER_PHASE_FRACTIONAL_WIDTH  32
-#define NAP_TRACK_CODE_PHASE_FRACTIONAL_WIDTH     32
-
-#define NAP_TRACK_CARRIER_FREQ_UNITS_PER_HZ       \
-  (((u64)1 << NAP_TRACK_CARRIER_FREQ_WIDTH) / (double)TRACK_SAMPLE_FREQ)
-
-#define NAP_TRACK_CARRIER_PHASE_UNITS_PER_CYCLE   \
-  ((u64)1 << NAP_TRACK_CARRIER_PHASE_FRACTIONAL_WIDTH)
-
-#define NAP_TRACK_CODE_PHASE_RATE_UNITS_PER_HZ    \
-  (NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP / (double)TRACK_SAMPLE_FREQ)
-
-#define NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP       \
-  ((u64)1 << NAP_TRACK_CODE_PHASE_FRACTIONAL_WIDTH)
-
 #define SPACING_HALF_CHIP ((u16)(TRACK_SAMPLE_FREQ / GPS_CA_CHIPPING_RATE) / 2)
 
 static struct nap_ch_state {
   u32 code_phase;   /**< Fractional part of code phase. */
 } nap_ch_state[NAP_MAX_N_TRACK_CHANNELS];
 
-static u32 calc_length_samples(u8 codes, u32 cp_start_frac_units,
-                               u32 cp_rate_units)
-{
-  u64 cp_end_units = codes * 1023 * NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP;
-  /* cp_start_frac_units is reinterpreted as a signed value. This works
-   * because NAP_TRACK_CODE_PHASE_FRACTIONAL_WIDTH is equal to 32 */
-  u64 cp_units = cp_end_units - (s32)cp_start_frac_units;
-  u32 samples = cp_units / cp_rate_units;
-  return samples;
-}
-
 void nap_track_init(u8 channel, gnss_signal_t sid, u32 ref_timing_count,
                     float carrier_freq, float code_phase)
 {
@@ -138,11 +111,11 @@ void nap_track_update(u8 channel, double carrier_freq,
   nap_trk_regs_t *t = &NAP->TRK_CH[channel];
   struct nap_ch_state *s = &nap_ch_state[channel];
 
-  u32 cp_rate_units = code_phase_rate * NAP_TRACK_CODE_PHASE_RATE_UNITS_PER_HZ;
-  t->CARR_PINC = -carrier_freq * NAP_TRACK_CARRIER_FREQ_UNITS_PER_HZ;
+  u32 cp_rate_units = nap_track_code_pinc(code_phase_rate);
+  t->CARR_PINC = nap_track_carr_pinc(carrier_freq);
   t->CODE_PINC = cp_rate_units;
-  t->LENGTH = calc_length_samples(rollover_count + 1,
-                                  s->code_phase, cp_rate_units);
+  t->LENGTH = nap_track_length_samples(rollover_count + 1,
+                                       s->code_phase, cp_rate_units);
 }
 
 void nap_track_read_results(u8 channel,
@@ -173,10 +146,8 @@ void nap_track_read_results(u8 channel,
   s->code_phase += t->LENGTH * t->CODE_PINC;
 
   *count_snapshot = t->START_SNAPSHOT;
-  *code_phase_early = (double)nap_code_phase /
-                          NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP;
-  *carrier_phase = (double)-nap_carr_phase /
-                       NAP_TRACK_CARRIER_PHASE_UNITS_PER_CYCLE;
+  *code_phase_early = nap_track_code_phase_chips(nap_code_phase);
+  *carrier_phase = nap_track_carrier_phase_cycles(nap_carr_phase);
 }
 
 void nap_track_disable(u8 channel)
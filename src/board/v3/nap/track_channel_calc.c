@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "track_channel_calc.h"
+
+/* Conversions between tracking loop quantities and NAP track channel
+ * register units. These have no hardware dependencies so that they can be
+ * regression tested on the host (see tests/track_regression). */
+
+/** Convert a carrier frequency to the CARR_PINC register value.
+ *
+ * \param carrier_freq    Carrier frequency (Doppler) in Hz.
+ *
+ * \return Carrier phase increment per sample.
+ */
+s32 nap_track_carr_pinc(double carrier_freq)
+{
+  return -carrier_freq * NAP_TRACK_CARRIER_FREQ_UNITS_PER_HZ;
+}
+
+/** Convert a code phase rate to the CODE_PINC register value.
+ *
+ * \param code_phase_rate Code phase rate in chips/s.
+ *
+ * \return Code phase increment per sample.
+ */
+u32 nap_track_code_pinc(double code_phase_rate)
+{
+  return code_phase_rate * NAP_TRACK_CODE_PHASE_RATE_UNITS_PER_HZ;
+}
+
+/** Calculate the integration length in samples.
+ *
+ * \param codes               Number of code periods to integrate for.
+ * \param cp_start_frac_units Fractional code phase at the start of the
+ *                            integration.
+ * \param cp_rate_units       Code phase increment per sample.
+ *
+ * \return Integration length in samples.
+ */
+u32 nap_track_length_samples(u8 codes, u32 cp_start_frac_units,
+                             u32 cp_rate_units)
+{
+  u64 cp_end_units = codes * 1023 * NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP;
+  /* cp_start_frac_units is reinterpreted as a signed value. This works
+   * because NAP_TRACK_CODE_PHASE_FRACTIONAL_WIDTH is equal to 32 */
+  u64 cp_units = cp_end_units - (s32)cp_start_frac_units;
+  u32 samples = cp_units / cp_rate_units;
+  return samples;
+}
+
+/** Convert a CODE_PHASE register value to chips.
+ *
+ * \param nap_code_phase  Code phase, integer and fractional parts.
+ *
+ * \return Code phase in chips.
+ */
+double nap_track_code_phase_chips(u64 nap_code_phase)
+{
+  return (double)nap_code_phase / NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP;
+}
+
+/** Convert a CARR_PHASE register value to cycles.
+ *
+ * \param nap_carr_phase  Carrier phase, integer and fractional parts.
+ *
+ * \return Carrier phase in cycles.
+ */
+double nap_track_carrier_phase_cycles(s64 nap_carr_phase)
+{
+  return (double)-nap_carr_phase / NAP_TRACK_CARRIER_PHASE_UNITS_PER_CYCLE;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_TRACK_CHANNEL_CALC_H
+#define SWIFTNAV_TRACK_CHANNEL_CALC_H
+
+#include <libswiftnav/common.h>
+
+#include "nap_constants.h"
+
+/* NAP track channel parameters. */
+#define NAP_TRACK_CARRIER_FREQ_WIDTH              32
+#define NAP_TRACK_CARRIER_PHASE_FRACTIONAL_WIDTH  32
+#define NAP_TRACK_CODE_PHASE_FRACTIONAL_WIDTH     32
+
+#define NAP_TRACK_CARRIER_FREQ_UNITS_PER_HZ       \
+  (((u64)1 << NAP_TRACK_CARRIER_FREQ_WIDTH) / (double)TRACK_SAMPLE_FREQ)
+
+#define NAP_TRACK_CARRIER_PHASE_UNITS_PER_CYCLE   \
+  ((u64)1 << NAP_TRACK_CARRIER_PHASE_FRACTIONAL_WIDTH)
+
+#define NAP_TRACK_CODE_PHASE_RATE_UNITS_PER_HZ    \
+  (NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP / (double)TRACK_SAMPLE_FREQ)
+
+#define NAP_TRACK_CODE_PHASE_UNITS_PER_CHIP       \
+  ((u64)1 << NAP_TRACK_CODE_PHASE_FRACTIONAL_WIDTH)
+
+s32 nap_track_carr_pinc(double carrier_freq);
+u32 nap_track_code_pinc(double code_phase_rate);
+u32 nap_track_length_samples(u8 codes, u32 cp_start_frac_units,
+                             u32 cp_rate_units);
+double nap_track_code_phase_chips(u64 nap_code_phase);
+double nap_track_carrier_phase_cycles(s64 nap_carr_phase);
+
+#endif /* SWIFTNAV_TRACK_CHANNEL_CALC_H */
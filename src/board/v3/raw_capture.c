@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <ch.h>
+
+#include <libswiftnav/edc.h>
+#include <libswiftnav/logging.h>
+
+#include "peripherals/usart.h"
+#include "settings.h"
+#include "nap/fft.h"
+
+#include "raw_capture.h"
+
+/** \defgroup raw_capture Raw sample capture
+ * Stream raw frontend samples over the FTDI USB link.
+ * \{ */
+
+/** Number of samples per DMA buffer. */
+#define RAW_CAPTURE_BUFFER_SAMPLES (64 * 1024)
+
+#define RAW_CAPTURE_IDLE_INTERVAL_ms 100
+#define RAW_CAPTURE_TX_WAIT_ms 1
+
+#define RAW_CAPTURE_THREAD_PRIORITY (LOWPRIO + 2)
+#define RAW_CAPTURE_THREAD_STACK    1024
+
+/** DMA buffer with room for the frame header in front of the samples.
+ * Samples are packed in place, so header and payload can be written out
+ * directly from this buffer. The header is 32 bytes long which keeps the
+ * sample area cache line aligned. */
+typedef struct {
+  raw_capture_header_t header;
+  u8 samples[RAW_CAPTURE_BUFFER_SAMPLES];
+} __attribute__((aligned(32))) raw_capture_buffer_t;
+
+static const char RAW_CAPTURE_MODULE[] = "raw_capture";
+
+static bool raw_capture_enabled = false;
+static u32 raw_capture_frames = 0;
+
+static raw_capture_buffer_t raw_capture_buffers[2];
+
+static THD_WORKING_AREA(wa_raw_capture_thread, RAW_CAPTURE_THREAD_STACK);
+
+/** Pack raw samples in place.
+ *
+ * Each input byte holds one sample in its RAW_CAPTURE_SAMPLE_BITS least
+ * significant bits. Samples are packed RAW_CAPTURE_SAMPLES_PER_BYTE to a
+ * byte, first sample in the least significant bits.
+ *
+ * \param buf         Buffer of raw samples, overwritten with packed samples.
+ * \param n_samples   Number of samples, multiple of
+ *                    RAW_CAPTURE_SAMPLES_PER_BYTE.
+ *
+ * \return Number of packed bytes.
+ */
+u32 raw_capture_pack(u8 *buf, u32 n_samples)
+{
+  u32 n_bytes = n_samples / RAW_CAPTURE_SAMPLES_PER_BYTE;
+  const u8 *in = buf;
+  for (u32 i = 0; i < n_bytes; i++) {
+    u8 packed = 0;
+    for (u32 j = 0; j < RAW_CAPTURE_SAMPLES_PER_BYTE; j++) {
+      packed |= (*in++ & RAW_CAPTURE_SAMPLE_MASK) <<
+                (j * RAW_CAPTURE_SAMPLE_BITS);
+    }
+    /* Output index never overtakes input index. */
+    buf[i] = packed;
+  }
+  return n_bytes;
+}
+
+/** Fill in a raw capture frame header.
+ *
+ * \param header        Header to fill in.
+ * \param sequence      Frame sequence number.
+ * \param sample_count  NAP sample count of the first sample.
+ * \param n_samples     Number of samples in the frame.
+ * \param flags         RAW_CAPTURE_FLAG_* values.
+ * \param payload       Packed payload, used to compute the frame CRC.
+ */
+void raw_capture_header_fill(raw_capture_header_t *header, u32 sequence,
+                             u32 sample_count, u32 n_samples, u16 flags,
+                             const u8 *payload)
+{
+  memset(header, 0, sizeof(*header));
+  header->sync = RAW_CAPTURE_SYNC;
+  header->version = RAW_CAPTURE_VERSION;
+  header->sample_bits = RAW_CAPTURE_SAMPLE_BITS;
+  header->flags = flags;
+  header->sequence = sequence;
+  header->sample_count = sample_count;
+  header->n_samples = n_samples;
+  header->payload_len = n_samples / RAW_CAPTURE_SAMPLES_PER_BYTE;
+
+  u16 crc = crc16_ccitt((const u8 *)header,
+                        offsetof(raw_capture_header_t, crc), 0);
+  header->crc = crc16_ccitt(payload, header->payload_len, crc);
+}
+
+/** Write a buffer to the FTDI USART, waiting for space as required.
+ *
+ * \param data  Data to write.
+ * \param len   Number of bytes.
+ */
+static void raw_capture_write(const u8 *data, u32 len)
+{
+  while (len > 0) {
+    u32 n = usart_write(&ftdi_state, data, len);
+    data += n;
+    len -= n;
+    if (len > 0) {
+      chThdSleepMilliseconds(RAW_CAPTURE_TX_WAIT_ms);
+    }
+  }
+}
+
+/** Stream raw samples until capture is disabled or the frame limit is
+ * reached. While one buffer is being filled by DMA the previous one is
+ * packed and sent.
+ */
+static void raw_capture_stream(void)
+{
+  u32 sequence = 0;
+  u32 next_sample_count = 0;
+  u32 dma_errors = 0;
+  u32 buffer_index = 0;
+
+  raw_samples_start(raw_capture_buffers[buffer_index].samples,
+                    RAW_CAPTURE_BUFFER_SAMPLES);
+
+  while (raw_capture_enabled &&
+         ((raw_capture_frames == 0) || (sequence < raw_capture_frames))) {
+    u32 sample_count;
+    bool ok = raw_samples_wait(&sample_count);
+    raw_capture_buffer_t *b = &raw_capture_buffers[buffer_index];
+
+    /* Swap buffers and start the next transfer before sending this one. */
+    buffer_index ^= 1;
+    raw_samples_start(raw_capture_buffers[buffer_index].samples,
+                      RAW_CAPTURE_BUFFER_SAMPLES);
+
+    if (!ok) {
+      dma_errors++;
+      continue;
+    }
+
+    u16 flags = 0;
+    if ((sequence != 0) && (sample_count != next_sample_count)) {
+      flags |= RAW_CAPTURE_FLAG_DISCONTINUITY;
+    }
+    next_sample_count = sample_count + RAW_CAPTURE_BUFFER_SAMPLES;
+
+    raw_capture_pack(b->samples, RAW_CAPTURE_BUFFER_SAMPLES);
+    raw_capture_header_fill(&b->header, sequence, sample_count,
+                            RAW_CAPTURE_BUFFER_SAMPLES, flags, b->samples);
+    raw_capture_write((const u8 *)b,
+                      sizeof(b->header) + b->header.payload_len);
+    sequence++;
+  }
+
+  /* Drain the outstanding transfer. */
+  u32 sample_count;
+  raw_samples_wait(&sample_count);
+
+  raw_capture_enabled = false;
+  log_info("Raw capture stopped: %lu frames, %lu DMA errors",
+           (unsigned long)sequence, (unsigned long)dma_errors);
+}
+
+static void raw_capture_thread(void *arg)
+{
+  (void)arg;
+  chRegSetThreadName("raw capture");
+
+  while (TRUE) {
+    if (!raw_capture_enabled) {
+      chThdSleepMilliseconds(RAW_CAPTURE_IDLE_INTERVAL_ms);
+      continue;
+    }
+
+    /* Claiming the FTDI port inhibits SBP on it for the duration of the
+     * capture. */
+    if (!usart_claim(&ftdi_state, RAW_CAPTURE_MODULE)) {
+      chThdSleepMilliseconds(RAW_CAPTURE_IDLE_INTERVAL_ms);
+      continue;
+    }
+
+    raw_capture_stream();
+    usart_release(&ftdi_state);
+  }
+}
+
+/** Set up raw sample capture.
+ * Registers the capture settings and starts the capture thread.
+ */
+void raw_capture_setup(void)
+{
+  SETTING("raw_capture", "frames", raw_capture_frames, TYPE_INT);
+  SETTING("raw_capture", "enable", raw_capture_enabled, TYPE_BOOL);
+
+  /* An unbounded capture holds the FTDI port until it is disabled, which
+   * takes SBP on that same port. Never resume one from saved settings. */
+  if (raw_capture_enabled && (raw_capture_frames == 0)) {
+    raw_capture_enabled = false;
+    log_warn("Raw capture enabled at boot without a frame limit, "
+             "not starting");
+  }
+
+  chThdCreateStatic(wa_raw_capture_thread, sizeof(wa_raw_capture_thread),
+                    RAW_CAPTURE_THREAD_PRIORITY, raw_capture_thread, NULL);
+}
+
+/** \} */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_RAW_CAPTURE_H
+#define SWIFTNAV_RAW_CAPTURE_H
+
+#include <libswiftnav/common.h>
+
+/** Frame sync word, reads "RAWC" in a little endian byte dump. */
+#define RAW_CAPTURE_SYNC 0x43574152U
+#define RAW_CAPTURE_VERSION 1
+
+/** Number of bits per packed sample. */
+#define RAW_CAPTURE_SAMPLE_BITS 2
+#define RAW_CAPTURE_SAMPLES_PER_BYTE (8 / RAW_CAPTURE_SAMPLE_BITS)
+#define RAW_CAPTURE_SAMPLE_MASK ((1 << RAW_CAPTURE_SAMPLE_BITS) - 1)
+
+/** Frame flags. */
+#define RAW_CAPTURE_FLAG_DISCONTINUITY 0x0001 /**< Samples were skipped between
+                                                   this frame and the previous
+                                                   one. */
+
+/** Raw capture frame header.
+ *
+ * All fields are little endian. The header is immediately followed by
+ * payload_len bytes of packed samples, four samples per byte with the first
+ * sample in the least significant bits. The CRC-16-CCITT covers the header up
+ * to the crc field followed by the payload.
+ */
+typedef struct __attribute__((packed)) {
+  u32 sync;            /**< RAW_CAPTURE_SYNC. */
+  u8 version;          /**< RAW_CAPTURE_VERSION. */
+  u8 sample_bits;      /**< Bits per packed sample. */
+  u16 flags;           /**< RAW_CAPTURE_FLAG_* */
+  u32 sequence;        /**< Frame sequence number. */
+  u32 sample_count;    /**< NAP sample count of the first sample. */
+  u32 n_samples;       /**< Number of samples in the frame. */
+  u32 payload_len;     /**< Length of the packed payload (bytes). */
+  u8 reserved[6];
+  u16 crc;             /**< CRC of header and payload. */
+} raw_capture_header_t;
+
+u32 raw_capture_pack(u8 *buf, u32 n_samples);
+void raw_capture_header_fill(raw_capture_header_t *header, u32 sequence,
+                             u32 sample_count, u32 n_samples, u16 flags,
+                             const u8 *payload);
+
+void raw_capture_setup(void);
+
+#endif /* SWIFTNAV_RAW_CAPTURE_H */
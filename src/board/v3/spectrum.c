@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "spectrum.h"
+
+#include <assert.h>
+
+/* These helpers operate on plain I/Q buffers and depend on neither the OS nor
+ * the NAP, so that they can be built on a host against recorded or synthetic
+ * sample FFTs. */
+
+static float select_kth(float *v, u32 n, u32 k);
+
+/** Compute the power of an FFT bin.
+ *
+ * \param re    In-phase component.
+ * \param im    Quadrature component.
+ *
+ * \return Power (squared magnitude).
+ */
+float spectrum_bin_power(s16 re, s16 im)
+{
+  float fre = (float)re;
+  float fim = (float)im;
+  return fre*fre + fim*fim;
+}
+
+/** Estimate the noise floor of a spectrum.
+ *
+ * The spectrum is split into blocks of SPECTRUM_FLOOR_BLOCK_LEN bins and the
+ * median of the block mean powers is returned. Narrowband interference only
+ * affects a handful of blocks, so the estimate is robust to it while costing
+ * little more than one pass over the data.
+ *
+ * \param iq    FFT bins, interleaved I/Q.
+ * \param len   Number of bins, multiple of SPECTRUM_FLOOR_BLOCK_LEN.
+ *
+ * \return Mean noise power per bin.
+ */
+float spectrum_noise_floor(const s16 *iq, u32 len)
+{
+  static float block_power[SPECTRUM_FLOOR_BLOCKS_MAX];
+
+  u32 n_blocks = len / SPECTRUM_FLOOR_BLOCK_LEN;
+  assert((n_blocks > 0) && (n_blocks <= SPECTRUM_FLOOR_BLOCKS_MAX));
+
+  for (u32 b = 0; b < n_blocks; b++) {
+    float sum = 0.0f;
+    const s16 *p = &iq[2 * b * SPECTRUM_FLOOR_BLOCK_LEN];
+    for (u32 i = 0; i < SPECTRUM_FLOOR_BLOCK_LEN; i++) {
+      sum += spectrum_bin_power(p[2*i], p[2*i+1]);
+    }
+    block_power[b] = sum / SPECTRUM_FLOOR_BLOCK_LEN;
+  }
+
+  return select_kth(block_power, n_blocks, n_blocks / 2);
+}
+
+/** Find bins whose power exceeds a threshold.
+ *
+ * Adjacent bins above the threshold are reported as a single peak at the
+ * strongest bin. If more than max_peaks peaks are present only the first
+ * max_peaks are stored but all are counted.
+ *
+ * \param iq          FFT bins, interleaved I/Q.
+ * \param len         Number of bins.
+ * \param threshold   Power threshold.
+ * \param peaks       Output peaks.
+ * \param max_peaks   Size of the peaks array.
+ *
+ * \return Number of peaks found.
+ */
+u32 spectrum_peaks_find(const s16 *iq, u32 len, float threshold,
+                        spectrum_peak_t *peaks, u32 max_peaks)
+{
+  u32 n_peaks = 0;
+  bool in_peak = false;
+  spectrum_peak_t peak = {0, 0.0f};
+
+  for (u32 i = 0; i < len; i++) {
+    float power = spectrum_bin_power(iq[2*i], iq[2*i+1]);
+    if (power > threshold) {
+      if (!in_peak || (power > peak.power)) {
+        peak.bin = i;
+        peak.power = power;
+      }
+      in_peak = true;
+    } else if (in_peak) {
+      if (n_peaks < max_peaks) {
+        peaks[n_peaks] = peak;
+      }
+      n_peaks++;
+      in_peak = false;
+    }
+  }
+
+  if (in_peak) {
+    if (n_peaks < max_peaks) {
+      peaks[n_peaks] = peak;
+    }
+    n_peaks++;
+  }
+
+  return n_peaks;
+}
+
+/** Update an exponentially averaged, decimated power spectrum.
+ *
+ * The output is ordered by frequency, i.e. average[0] covers the most
+ * negative frequencies and average[average_len - 1] the most positive.
+ *
+ * \param iq            FFT bins in natural FFT order, interleaved I/Q.
+ * \param len           Number of bins.
+ * \param average       Averaged spectrum, updated in place.
+ * \param average_len   Number of averaged bins, must divide len.
+ * \param alpha         Averaging weight of the new spectrum, 0 to 1.
+ */
+void spectrum_average_update(const s16 *iq, u32 len,
+                             float *average, u32 average_len, float alpha)
+{
+  u32 group = len / average_len;
+  for (u32 k = 0; k < average_len; k++) {
+    float sum = 0.0f;
+    for (u32 j = 0; j < group; j++) {
+      u32 i = (k * group + j + len / 2) & (len - 1);
+      sum += spectrum_bin_power(iq[2*i], iq[2*i+1]);
+    }
+    average[k] += alpha * (sum / group - average[k]);
+  }
+}
+
+/** Compute the frequency offset of an FFT bin from the band center.
+ *
+ * \param bin           FFT bin index.
+ * \param len           Number of bins.
+ * \param sample_rate   Sample rate (Hz).
+ *
+ * \return Frequency offset (Hz).
+ */
+float spectrum_bin_freq(u32 bin, u32 len, float sample_rate)
+{
+  s32 signed_bin = (bin < len / 2) ? (s32)bin : (s32)bin - (s32)len;
+  return signed_bin * sample_rate / len;
+}
+
+/** Find the k-th smallest element, partially reordering the array.
+ *
+ * \param v   Array of values.
+ * \param n   Number of values.
+ * \param k   Rank of the element to find, 0 to n-1.
+ *
+ * \return k-th smallest value.
+ */
+static float select_kth(float *v, u32 n, u32 k)
+{
+  u32 lo = 0;
+  u32 hi = n - 1;
+  while (lo < hi) {
+    float pivot = v[(lo + hi) / 2];
+    u32 i = lo;
+    u32 j = hi;
+    while (i <= j) {
+      while (v[i] < pivot) i++;
+      while (v[j] > pivot) j--;
+      if (i <= j) {
+        float t = v[i];
+        v[i] = v[j];
+        v[j] = t;
+        i++;
+        if (j == 0) {
+          break;
+        }
+        j--;
+      }
+    }
+    if (k <= j) {
+      hi = j;
+    } else if (k >= i) {
+      lo = i;
+    } else {
+      break;
+    }
+  }
+  return v[k];
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_SPECTRUM_H
+#define SWIFTNAV_SPECTRUM_H
+
+#include <libswiftnav/common.h>
+
+/* Spectra are passed as interleaved 16 bit I/Q pairs, bin i at iq[2*i] and
+ * iq[2*i+1], which is the layout of the NAP FFT output. */
+
+/** Maximum number of FFT bins. */
+#define SPECTRUM_LEN_MAX 32768
+/** Number of FFT bins averaged into one block by spectrum_noise_floor(). */
+#define SPECTRUM_FLOOR_BLOCK_LEN 64
+/** Maximum number of blocks used by spectrum_noise_floor(). */
+#define SPECTRUM_FLOOR_BLOCKS_MAX (SPECTRUM_LEN_MAX / SPECTRUM_FLOOR_BLOCK_LEN)
+
+/** Spectral peak. */
+typedef struct {
+  u32 bin;        /**< FFT bin index. */
+  float power;    /**< Bin power. */
+} spectrum_peak_t;
+
+float spectrum_bin_power(s16 re, s16 im);
+float spectrum_noise_floor(const s16 *iq, u32 len);
+u32 spectrum_peaks_find(const s16 *iq, u32 len, float threshold,
+                        spectrum_peak_t *peaks, u32 max_peaks);
+void spectrum_average_update(const s16 *iq, u32 len,
+                             float *average, u32 average_len, float alpha);
+float spectrum_bin_freq(u32 bin, u32 len, float sample_rate);
+
+#endif /* SWIFTNAV_SPECTRUM_H */
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <ch.h>
+
+#include <libswiftnav/constants.h>
+#include <libswiftnav/logging.h>
+
+#include "sbp.h"
+#include "settings.h"
+#include "timing.h"
+#include "nap/nap_constants.h"
+#include "nap/fft.h"
+#include "spectrum.h"
+
+#include "spectrum_monitor.h"
+
+/** \defgroup spectrum_monitor Spectrum monitor
+ * Monitor the frontend spectrum for narrowband interference using the
+ * acquisition FFT.
+ * \{ */
+
+#define SPECTRUM_FFT_LEN_LOG2 FFT_LEN_LOG2_MAX
+#define SPECTRUM_FFT_LEN (1 << SPECTRUM_FFT_LEN_LOG2)
+#define SPECTRUM_FFT_SCALE_SCHED 0x15555555
+#define SPECTRUM_SAMPLES_INPUT FFT_SAMPLES_INPUT_RF1_CH0
+
+/** Averaging weight of each new snapshot. */
+#define SPECTRUM_AVERAGE_ALPHA 0.1f
+
+/** Maximum number of peaks recorded per snapshot. */
+#define SPECTRUM_PEAKS_MAX 8
+
+/** Number of consecutive snapshots with (without) peaks required to raise
+ * (clear) the interference alarm. */
+#define SPECTRUM_ALARM_SET_COUNT   3
+#define SPECTRUM_ALARM_CLEAR_COUNT 5
+
+static bool spectrum_monitor_enabled = true;
+static u32 spectrum_monitor_interval_ms = 1000;
+static float spectrum_monitor_threshold_db = 20.0f;
+
+/** Sample FFT, interleaved I/Q. */
+static s16 spectrum_iq[2 * SPECTRUM_FFT_LEN] __attribute__((aligned(4)));
+static float spectrum_average[SPECTRUM_MONITOR_BINS];
+
+static struct {
+  systime_t last_run;
+  bool initialized;
+  bool alarm;
+  u32 detect_count;
+  u32 clear_count;
+} monitor_state;
+
+/** Convert a power ratio to dB. */
+static float power_db(float ratio)
+{
+  return 10.0f * log10f(MAX(ratio, 1e-6f));
+}
+
+/** Pack the averaged spectrum into an SBP spectrum analyzer message and send
+ * it.
+ *
+ * \param floor   Noise floor, the reference of the amplitudes.
+ */
+static void spectrum_monitor_send(float floor)
+{
+  static union {
+    msg_specan_t msg;
+    u8 buf[sizeof(msg_specan_t) + SPECTRUM_MONITOR_BINS];
+  } specan;
+  msg_specan_t *msg = &specan.msg;
+
+  float fs = NAP_ACQ_SAMPLE_RATE_Hz;
+
+  memset(&msg->t, 0, sizeof(msg->t));
+  if (time_quality >= TIME_COARSE) {
+    gps_time_t t = get_current_time();
+    double tow_ms = round(t.tow * 1e3);
+    msg->t.tow = (u32)tow_ms;
+    msg->t.ns_residual = (s32)round((t.tow * 1e3 - tow_ms) * 1e6);
+    msg->t.wn = t.wn;
+  }
+
+  msg->channel_tag = SPECTRUM_SAMPLES_INPUT;
+  msg->freq_ref = (GPS_L1_HZ - fs / 2) / 1e6f;
+  msg->freq_step = fs / SPECTRUM_MONITOR_BINS / 1e6f;
+  msg->amplitude_ref = power_db(floor) - SPECTRUM_AMPLITUDE_OFFSET_dB;
+  msg->amplitude_unit = SPECTRUM_AMPLITUDE_STEP_dB;
+
+  for (u32 k = 0; k < SPECTRUM_MONITOR_BINS; k++) {
+    float a = (power_db(spectrum_average[k] / floor) +
+               SPECTRUM_AMPLITUDE_OFFSET_dB) / SPECTRUM_AMPLITUDE_STEP_dB;
+    msg->amplitude_value[k] = (u8)MAX(0.0f, MIN(roundf(a), 255.0f));
+  }
+
+  sbp_send_msg(SBP_MSG_SPECAN, sizeof(specan.buf), specan.buf);
+}
+
+/** Update the interference alarm from the latest snapshot.
+ *
+ * \param n_peaks   Number of peaks in the snapshot.
+ * \param peak      Strongest peak, valid if n_peaks > 0.
+ * \param floor     Noise floor.
+ */
+static void spectrum_alarm_update(u32 n_peaks, const spectrum_peak_t *peak,
+                                  float floor)
+{
+  if (n_peaks > 0) {
+    monitor_state.clear_count = 0;
+    if (!monitor_state.alarm &&
+        (++monitor_state.detect_count >= SPECTRUM_ALARM_SET_COUNT)) {
+      monitor_state.alarm = true;
+      log_warn("Narrowband interference detected: %lu peaks, "
+               "strongest %.1f dB at %+.0f Hz",
+               (unsigned long)n_peaks, power_db(peak->power / floor),
+               spectrum_bin_freq(peak->bin, SPECTRUM_FFT_LEN,
+                                 NAP_ACQ_SAMPLE_RATE_Hz));
+    }
+  } else {
+    monitor_state.detect_count = 0;
+    if (monitor_state.alarm &&
+        (++monitor_state.clear_count >= SPECTRUM_ALARM_CLEAR_COUNT)) {
+      monitor_state.alarm = false;
+      log_info("Narrowband interference cleared");
+    }
+  }
+}
+
+/** Take a spectrum snapshot if one is due.
+ *
+ * Called from the acquisition management thread between searches, so the
+ * FFT core is never taken away from a search in progress. At most one sample
+ * FFT is computed per spectrum_monitor_interval_ms.
+ */
+void spectrum_monitor_run(void)
+{
+  if (!spectrum_monitor_enabled) {
+    return;
+  }
+
+  if (monitor_state.initialized &&
+      (chVTTimeElapsedSinceX(monitor_state.last_run) <
+       MS2ST(spectrum_monitor_interval_ms))) {
+    return;
+  }
+  monitor_state.last_run = chVTGetSystemTime();
+
+  u32 sample_count;
+  if (!fft_samples(SPECTRUM_SAMPLES_INPUT, (fft_cplx_t *)spectrum_iq,
+                   SPECTRUM_FFT_LEN_LOG2,
+                   FFT_DIR_FORWARD, SPECTRUM_FFT_SCALE_SCHED, &sample_count)) {
+    return;
+  }
+
+  if (!monitor_state.initialized) {
+    memset(spectrum_average, 0, sizeof(spectrum_average));
+  }
+  spectrum_average_update(spectrum_iq, SPECTRUM_FFT_LEN, spectrum_average,
+                          SPECTRUM_MONITOR_BINS,
+                          monitor_state.initialized ? SPECTRUM_AVERAGE_ALPHA
+                                                    : 1.0f);
+  monitor_state.initialized = true;
+
+  float floor = spectrum_noise_floor(spectrum_iq, SPECTRUM_FFT_LEN);
+  float threshold = floor * powf(10.0f, spectrum_monitor_threshold_db / 10.0f);
+
+  spectrum_peak_t peaks[SPECTRUM_PEAKS_MAX];
+  u32 n_peaks = spectrum_peaks_find(spectrum_iq, SPECTRUM_FFT_LEN, threshold,
+                                    peaks, SPECTRUM_PEAKS_MAX);
+
+  const spectrum_peak_t *strongest = &peaks[0];
+  for (u32 i = 1; i < MIN(n_peaks, SPECTRUM_PEAKS_MAX); i++) {
+    if (peaks[i].power > strongest->power) {
+      strongest = &peaks[i];
+    }
+  }
+
+  spectrum_alarm_update(n_peaks, strongest, floor);
+  spectrum_monitor_send(floor);
+}
+
+/** Register spectrum monitor settings. */
+void spectrum_monitor_setup(void)
+{
+  SETTING("spectrum_monitor", "enable", spectrum_monitor_enabled, TYPE_BOOL);
+  SETTING("spectrum_monitor", "interval_ms", spectrum_monitor_interval_ms,
+          TYPE_INT);
+  SETTING("spectrum_monitor", "threshold_db", spectrum_monitor_threshold_db,
+          TYPE_FLOAT);
+}
+
+/** \} */
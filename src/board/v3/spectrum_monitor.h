@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_SPECTRUM_MONITOR_H
+#define SWIFTNAV_SPECTRUM_MONITOR_H
+
+#include <libswiftnav/common.h>
+
+/** Number of bins in the published decimated spectrum. */
+#define SPECTRUM_MONITOR_BINS 128
+
+/** Amplitude encoding of the published spectrum: amplitude_value[k] is the
+ * bin power relative to the noise floor in dB, plus
+ * SPECTRUM_AMPLITUDE_OFFSET_dB, in steps of SPECTRUM_AMPLITUDE_STEP_dB. */
+#define SPECTRUM_AMPLITUDE_OFFSET_dB 10.0f
+#define SPECTRUM_AMPLITUDE_STEP_dB   0.25f
+
+#ifndef SBP_MSG_SPECAN
+/* Spectrum analyzer message MSG_SPECAN, as specified in libsbp
+ * (spec/yaml/swiftnav/sbp/piksi.yaml). Defined here while the libsbp
+ * submodule predates it; remove when the submodule is updated. */
+#define SBP_MSG_SPECAN 0x0051
+typedef struct __attribute__((packed)) {
+  u16 channel_tag;        /**< Channel ID */
+  struct __attribute__((packed)) {
+    u32 tow;              /**< Milliseconds since start of GPS week [ms] */
+    s32 ns_residual;      /**< Nanosecond residual of millisecond-rounded
+                               TOW [ns] */
+    u16 wn;               /**< GPS week number [week] */
+  } t;                    /**< Receiver time of this observation */
+  float freq_ref;         /**< Reference frequency of this packet [MHz] */
+  float freq_step;        /**< Frequency step of points in this packet
+                               [MHz] */
+  float amplitude_ref;    /**< Reference amplitude of this packet [dB] */
+  float amplitude_unit;   /**< Amplitude unit value of points in this packet
+                               [dB] */
+  u8 amplitude_value[0];  /**< Amplitude values (in the above units) of
+                               points in this packet */
+} msg_specan_t;
+#endif
+
+void spectrum_monitor_setup(void);
+void spectrum_monitor_run(void);
+
+#endif /* SWIFTNAV_SPECTRUM_MONITOR_H */
@@ -64,3 +64,11 @@ u32 usart_support_write(void *sd, const u8 data[], u32 len)
   return chnWriteTimeout((SerialDriver*)sd, data, len, TIME_IMMEDIATE);
 }
 
+bool usart_support_write_buf(void *sd, usart_tx_buf_t *buf)
+{
+  /* The serial driver has its own output queue, so the buffer is copied and
+   * the caller's reference is all that is needed. */
+  return chnWriteTimeout((SerialDriver*)sd, buf->data, buf->len,
+                         TIME_IMMEDIATE) == buf->len;
+}
+
@@ -23,15 +23,16 @@
 #include "timing.h"
 #include "ephemeris.h"
 #include "signal.h"
+#include "mem_placement.h"
 
 #define EPHEMERIS_TRANSMIT_EPOCH_SPACING_ms   (15 * 1000)
 #define EPHEMERIS_MESSAGE_SPACING_ms          (200)
 
 MUTEX_DECL(es_mutex);
-static ephemeris_t es[PLATFORM_SIGNAL_COUNT] _CCM;
-static ephemeris_t es_candidate[PLATFORM_SIGNAL_COUNT] _CCM;
+static ephemeris_t es[PLATFORM_SIGNAL_COUNT] _EPHEMERIS;
+static ephemeris_t es_candidate[PLATFORM_SIGNAL_COUNT] _EPHEMERIS;
 
-static WORKING_AREA_CCM(wa_ephemeris_thread, 1400);
+static WORKING_AREA_EPHEMERIS(wa_ephemeris_thread, 1400);
 
 static void ephemeris_thread(void *arg)
 {
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <string.h>
+
+#include <libswiftnav/constants.h>
+
+#include "hatch.h"
+#include "signal.h"
+
+/** \defgroup hatch Carrier smoothing
+ * Hatch filter smoothing of the pseudoranges with the carrier phase.
+ * \{ */
+
+typedef struct {
+  u32 epoch;              /**< Epoch of the last update. */
+  u32 n;                  /**< Updates since the filter was reset. */
+  u16 lock_counter;       /**< Lock counter at the last update. */
+  double pseudorange;     /**< Smoothed raw pseudorange. */
+  double carrier_phase;   /**< Raw carrier phase at the last update. */
+} hatch_state_t;
+
+static hatch_state_t hatch_states[PLATFORM_SIGNAL_COUNT];
+
+/** Current update epoch, zero is never used so states start out stale. */
+static u32 hatch_epoch = 0;
+
+/** Reset the filters of all signals.
+ * To be called when the pseudoranges jump relative to the carrier phases,
+ * e.g. on a receiver clock jump. */
+void hatch_filter_reset(void)
+{
+  memset(hatch_states, 0, sizeof(hatch_states));
+}
+
+/** Smooth the pseudoranges of a set of navigation measurements.
+ *
+ * Each signal is filtered as
+ * \f[
+ *   \tilde{P}_k = \frac{1}{M} P_k + \frac{M - 1}{M}
+ *                 \left(\tilde{P}_{k-1} - \lambda (\phi_k - \phi_{k-1})\right)
+ * \f]
+ * with \f$M\f$ growing from one up to the window length after a reset. The
+ * carrier phase decreases as the range grows, hence the sign of the carrier
+ * phase term.
+ *
+ * The filter of a signal is reset when its lock counter changes, i.e. after a
+ * loss of lock or a tracker_ambiguity_unknown() event, or when it was missing
+ * from the previous update. The smoothing correction is applied to both
+ * `raw_pseudorange` and `pseudorange`, the carrier phases are not modified.
+ *
+ * \param n      Number of measurements.
+ * \param nm     Measurements, updated in place.
+ * \param window Window length in updates, 0 or 1 disables smoothing.
+ */
+void hatch_filter_update(u8 n, navigation_measurement_t nm[], u32 window)
+{
+  if (++hatch_epoch == 0) {
+    hatch_filter_reset();
+    hatch_epoch = 1;
+  }
+
+  for (u8 i = 0; i < n; i++) {
+    /* Carrier phase is only available in L1 cycles. */
+    if (nm[i].sid.code != CODE_GPS_L1CA) {
+      continue;
+    }
+
+    hatch_state_t *s = &hatch_states[sid_to_global_index(nm[i].sid)];
+
+    if ((window <= 1) ||
+        (s->epoch + 1 != hatch_epoch) ||
+        (s->lock_counter != nm[i].lock_counter)) {
+      s->n = 0;
+    }
+
+    if (s->n < window) {
+      s->n++;
+    }
+
+    if (s->n == 1) {
+      s->pseudorange = nm[i].raw_pseudorange;
+    } else {
+      double predicted = s->pseudorange - GPS_L1_LAMBDA *
+                         (nm[i].raw_carrier_phase - s->carrier_phase);
+      s->pseudorange = predicted +
+                       (nm[i].raw_pseudorange - predicted) / s->n;
+    }
+
+    s->epoch = hatch_epoch;
+    s->lock_counter = nm[i].lock_counter;
+    s->carrier_phase = nm[i].raw_carrier_phase;
+
+    double correction = s->pseudorange - nm[i].raw_pseudorange;
+    nm[i].raw_pseudorange += correction;
+    nm[i].pseudorange += correction;
+  }
+}
+
+/** Propagate the raw pseudorange and carrier phase of a measurement by its
+ * Doppler.
+ *
+ * Uses the sign convention of hatch_filter_update(): the carrier phase
+ * advances by the Doppler and the pseudorange moves the opposite way. Base
+ * and rover observations must both be propagated with this function so that
+ * their differences are unaffected.
+ *
+ * \param nm Measurement, updated in place.
+ * \param dt Time to propagate by (s), may be negative.
+ */
+void nav_meas_propagate(navigation_measurement_t *nm, double dt)
+{
+  nm->raw_carrier_phase += dt * nm->raw_doppler;
+  nm->raw_pseudorange -= dt * nm->raw_doppler * GPS_L1_LAMBDA;
+}
+
+/** \} */
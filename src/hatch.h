@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_HATCH_H
+#define SWIFTNAV_HATCH_H
+
+#include <libswiftnav/common.h>
+#include <libswiftnav/track.h>
+
+void hatch_filter_reset(void);
+void hatch_filter_update(u8 n, navigation_measurement_t nm[], u32 window);
+void nav_meas_propagate(navigation_measurement_t *nm, double dt);
+
+#endif  /* SWIFTNAV_HATCH_H */
@@ -29,11 +29,13 @@
 #include "ext_events.h"
 #include "solution.h"
 #include "base_obs.h"
+#include "block_pool.h"
 #include "position.h"
 #include "system_monitor.h"
 #include "simulator.h"
 #include "settings.h"
 #include "sbp_fileio.h"
+#include "sbp_logger.h"
 #include "ephemeris.h"
 #include "pps.h"
 #include "decode.h"
@@ -49,6 +51,9 @@ int main(void)
    * priority NORMALPRIO and the RTOS is active. */
   chSysInit();
 
+  /* Buffer pools, needed by the first log message. */
+  block_pool_setup();
+
   /* Piksi hardware initialization. */
   pre_init();
 
@@ -90,6 +95,7 @@ int main(void)
   simulator_setup();
 
   sbp_fileio_setup();
+  sbp_logger_setup();
   ext_setup();
   pps_setup();
 
@@ -41,6 +41,7 @@
 #include "cfs/cfs.h"
 #include "cfs/cfs-coffee.h"
 #include "./system_monitor.h"
+#include "mem_placement.h"
 #include "settings.h"
 #include "signal.h"
 
@@ -74,6 +75,8 @@ typedef struct {
   u16 score[ACQ_HINT_NUM]; /**< Acquisition preference of signal. */
   float dopp_hint_low;     /**< Low bound of doppler search hint. */
   float dopp_hint_high;    /**< High bound of doppler search hint. */
+  systime_t preempted_time;/**< Time at which signal was last preempted. */
+  bool preempted;          /**< Signal has been preempted at least once. */
   gnss_signal_t sid;       /**< Signal identifier. */
 } acq_status_t;
 static acq_status_t acq_status[PLATFORM_SIGNAL_COUNT];
@@ -90,47 +93,53 @@ static bool track_mask[PLATFORM_SIGNAL_COUNT];
 #define DOPP_UNCERT_ALMANAC 4000
 #define DOPP_UNCERT_EPHEM   500
 
-#define COMPILER_BARRIER() asm volatile ("" : : : "memory")
+#define TRACKING_STARTUP_QUEUE_SIZE 16    /* Must be a power of 2 */
 
-#define TRACKING_STARTUP_FIFO_SIZE 8    /* Must be a power of 2 */
+#define TRACKING_STARTUP_QUEUE_INDEX_MASK ((TRACKING_STARTUP_QUEUE_SIZE) - 1)
 
-#define TRACKING_STARTUP_FIFO_INDEX_MASK ((TRACKING_STARTUP_FIFO_SIZE) - 1)
-#define TRACKING_STARTUP_FIFO_INDEX_DIFF(write_index, read_index) \
-          ((tracking_startup_fifo_index_t)((write_index) - (read_index)))
-#define TRACKING_STARTUP_FIFO_LENGTH(p_fifo) \
-          (TRACKING_STARTUP_FIFO_INDEX_DIFF((p_fifo)->write_index, \
-                                            (p_fifo)->read_index))
-
-typedef u8 tracking_startup_fifo_index_t;
+/** Tracking startup queue slot. The sequence number indicates whether the
+ * slot is free for the producer claiming write index n (sequence == n) or
+ * holds data for the consumer at read index n (sequence == n + 1). */
+typedef struct {
+  u32 sequence;
+  tracking_startup_params_t element;
+} tracking_startup_queue_slot_t;
 
+/** Bounded lock-free multi-producer single-consumer queue of tracking
+ * startup requests. */
 typedef struct {
-  tracking_startup_fifo_index_t read_index;
-  tracking_startup_fifo_index_t write_index;
-  tracking_startup_params_t elements[TRACKING_STARTUP_FIFO_SIZE];
-} tracking_startup_fifo_t;
+  u32 write_index;  /**< Next index to be claimed by a producer. */
+  u32 read_index;   /**< Next index to be read by the consumer. */
+  tracking_startup_queue_slot_t slots[TRACKING_STARTUP_QUEUE_SIZE];
+  tracking_startup_queue_stats_t stats;
+} tracking_startup_queue_t;
 
-static tracking_startup_fifo_t tracking_startup_fifo;
+static tracking_startup_queue_t tracking_startup_queue;
 
-static MUTEX_DECL(tracking_startup_mutex);
+static MUTEX_DECL(drop_channel_mutex);
 
 static almanac_t almanac[PLATFORM_SIGNAL_COUNT];
 
 static float elevation_mask = 0.0; /* degrees */
 static bool sbas_enabled = false;
+/** Number of signals searched against each load of acquisition samples. */
+static s8 acq_signals_per_load = ACQ_MULTI_MAX;
 
 static void acq_result_send(gnss_signal_t sid, float snr, float cp, float cf);
 
 static u8 manage_track_new_acq(gnss_signal_t sid);
+static u8 manage_track_preempt(const tracking_startup_params_t *startup_params);
+static void drop_channel(u8 channel_id);
 static void manage_acq(void);
 static void manage_track(void);
 
 static void manage_tracking_startup(void);
-static void tracking_startup_fifo_init(tracking_startup_fifo_t *fifo);
-static bool tracking_startup_fifo_write(tracking_startup_fifo_t *fifo,
-                                        const tracking_startup_params_t *
-                                        element);
-static bool tracking_startup_fifo_read(tracking_startup_fifo_t *fifo,
-                                       tracking_startup_params_t *element);
+static void tracking_startup_queue_init(tracking_startup_queue_t *queue);
+static bool tracking_startup_queue_write(tracking_startup_queue_t *queue,
+                                         const tracking_startup_params_t *
+                                         element);
+static bool tracking_startup_queue_read(tracking_startup_queue_t *queue,
+                                        tracking_startup_params_t *element);
 
 static sbp_msg_callbacks_node_t almanac_callback_node;
 static void almanac_callback(u16 sender_id, u8 len, u8 msg[], void* context)
@@ -161,7 +170,7 @@ static void mask_sat_callback(u16 sender_id, u8 len, u8 msg[], void* context)
   }
 }
 
-static WORKING_AREA_BCKP(wa_manage_acq_thread, MANAGE_ACQ_THREAD_STACK);
+static WORKING_AREA_MANAGE(wa_manage_acq_thread, MANAGE_ACQ_THREAD_STACK);
 static void manage_acq_thread(void *arg)
 {
   /* TODO: This should be trigged by a semaphore from the acq ISR code, not
@@ -170,6 +179,7 @@ static void manage_acq_thread(void *arg)
   chRegSetThreadName("manage acq");
   while (TRUE) {
     manage_acq();
+    acq_idle_work();
     manage_tracking_startup();
     watchdog_notify(WD_NOTIFY_ACQ_MGMT);
   }
@@ -178,8 +188,9 @@ static void manage_acq_thread(void *arg)
 void manage_acq_setup()
 {
   SETTING("acquisition", "sbas enabled", sbas_enabled, TYPE_BOOL);
+  SETTING("acquisition", "signals per load", acq_signals_per_load, TYPE_INT);
 
-  tracking_startup_fifo_init(&tracking_startup_fifo);
+  tracking_startup_queue_init(&tracking_startup_queue);
 
   for (u32 i=0; i<PLATFORM_SIGNAL_COUNT; i++) {
     acq_status[i].state = ACQ_PRN_ACQUIRING;
@@ -187,6 +198,7 @@ void manage_acq_setup()
     memset(&acq_status[i].score, 0, sizeof(acq_status[i].score));
     acq_status[i].dopp_hint_low = ACQ_FULL_CF_MIN;
     acq_status[i].dopp_hint_high = ACQ_FULL_CF_MAX;
+    acq_status[i].preempted = false;
     acq_status[i].sid = sid_from_global_index(i);
 
     track_mask[i] = false;
@@ -300,12 +312,70 @@ static u16 manage_warm_start(gnss_signal_t sid, const gps_time_t* t,
     return SCORE_COLDSTART + SCORE_WARMSTART * el / 90.f;
 }
 
-static acq_status_t * choose_acq_sat(void)
+/** Predict the elevation of a satellite from ephemeris or almanac.
+ *
+ * \param sid Signal identifier.
+ * \param t   Time at which to evaluate the elevation.
+ *
+ * \return Elevation (deg), or TRACKING_ELEVATION_UNKNOWN if it could not be
+ *         determined.
+ */
+static s8 manage_elevation_predict(gnss_signal_t sid, const gps_time_t *t)
+{
+  if (time_quality < TIME_GUESS &&
+      position_quality < POSITION_GUESS)
+    return TRACKING_ELEVATION_UNKNOWN;
+
+  double _, el_d;
+  const ephemeris_t *e = ephemeris_get(sid);
+  u8 eph_valid;
+  s8 ss_ret;
+  double sat_pos[3], sat_vel[3];
+
+  ephemeris_lock();
+  eph_valid = ephemeris_valid(e, t);
+  if (eph_valid) {
+    ss_ret = calc_sat_state(e, t, sat_pos, sat_vel, &_, &_);
+  }
+  ephemeris_unlock();
+
+  if (eph_valid && (ss_ret == 0)) {
+    wgsecef2azel(sat_pos, position_solution.pos_ecef, &_, &el_d);
+    return (s8)(el_d * R2D);
+  }
+
+  const almanac_t *a = &almanac[sid_to_global_index(sid)];
+  if (a->valid &&
+      calc_sat_az_el_almanac(a, t, position_solution.pos_ecef,
+                             &_, &el_d) == 0) {
+    return (s8)(el_d * R2D);
+  }
+
+  return TRACKING_ELEVATION_UNKNOWN;
+}
+
+static u32 acq_sat_score(const acq_status_t *acq)
+{
+  u32 sat_score = 0;
+  for (enum acq_hint hint = 0; hint < ACQ_HINT_NUM; hint++)
+    sat_score += acq->score[hint];
+  return sat_score;
+}
+
+/** Pick distinct signals to acquire, weighted by their hint scores.
+ *
+ * \param acqs  Output array of picked signals.
+ * \param n_max Maximum number of signals to pick.
+ * \return Number of signals picked.
+ */
+static u8 choose_acq_sats(acq_status_t *acqs[], u8 n_max)
 {
   u32 total_score = 0;
   gps_time_t t = get_current_time();
+  bool chosen[PLATFORM_SIGNAL_COUNT];
 
   for (u32 i=0; i<PLATFORM_SIGNAL_COUNT; i++) {
+    chosen[i] = false;
     if ((acq_status[i].state != ACQ_PRN_ACQUIRING) ||
         acq_status[i].masked)
       continue;
@@ -315,35 +385,37 @@ static acq_status_t * choose_acq_sat(void)
                         &acq_status[i].dopp_hint_low,
                         &acq_status[i].dopp_hint_high);
 
-    for (enum acq_hint hint = 0; hint < ACQ_HINT_NUM; hint++) {
-      total_score += acq_status[i].score[hint];
-    }
+    total_score += acq_sat_score(&acq_status[i]);
   }
 
   if (total_score == 0) {
     log_error("Failed to pick a sat for acquisition!");
-    return NULL;
+    return 0;
   }
 
-  u32 pick = rand() % total_score;
-
-  for (u32 i=0; i<PLATFORM_SIGNAL_COUNT; i++) {
-    if ((acq_status[i].state != ACQ_PRN_ACQUIRING) ||
-        acq_status[i].masked)
-      continue;
-
-    u32 sat_score = 0;
-    for (enum acq_hint hint = 0; hint < ACQ_HINT_NUM; hint++)
-      sat_score += acq_status[i].score[hint];
-    if (pick < sat_score) {
-      return &acq_status[i];
-    } else {
-      pick -= sat_score;
+  u8 n = 0;
+  while ((n < n_max) && (total_score > 0)) {
+    u32 pick = rand() % total_score;
+
+    for (u32 i=0; i<PLATFORM_SIGNAL_COUNT; i++) {
+      if ((acq_status[i].state != ACQ_PRN_ACQUIRING) ||
+          acq_status[i].masked || chosen[i])
+        continue;
+
+      u32 sat_score = acq_sat_score(&acq_status[i]);
+      if (pick < sat_score) {
+        chosen[i] = true;
+        acqs[n++] = &acq_status[i];
+        total_score -= sat_score;
+        break;
+      } else {
+        pick -= sat_score;
+      }
     }
   }
 
-  assert(!"Error picking a sat for acquisition");
-  return NULL;
+  assert((n > 0) && "Error picking a sat for acquisition");
+  return n;
 }
 
 /** Hint acqusition at satellites observed by peer.
@@ -364,55 +436,83 @@ void manage_set_obs_hint(gnss_signal_t sid)
     acq_status[sid_to_global_index(sid)].score[ACQ_HINT_REMOTE_OBS] = SCORE_OBS;
 }
 
-/** Manages acquisition searches and starts tracking channels after successful acquisitions. */
-static void manage_acq()
+/** Handle the result of an acquisition search.
+ * Starts tracking if the signal was found, widens the Doppler search range
+ * and decays the hint scores otherwise.
+ */
+static void manage_acq_result(acq_status_t *acq, const acq_result_t *acq_result)
 {
-  /* Decide which SID to try and then start it acquiring. */
-  acq_status_t *acq = choose_acq_sat();
-  if (acq == NULL) {
+  /* Send result of an acquisition to the host. */
+  acq_result_send(acq->sid, acq_result->cn0, acq_result->cp, acq_result->cf);
+
+  if (acq_result->excised_bins > 0) {
+    log_debug("Acq: excised %lu interference bins",
+              (unsigned long)acq_result->excised_bins);
+  }
+
+  if (acq_result->cn0 < ACQ_THRESHOLD) {
+    /* Didn't find the satellite :( */
+    /* Double the size of the doppler search space for next time. */
+    float dilute = (acq->dopp_hint_high - acq->dopp_hint_low) / 2;
+    acq->dopp_hint_high = MIN(acq->dopp_hint_high + dilute, ACQ_FULL_CF_MAX);
+    acq->dopp_hint_low = MAX(acq->dopp_hint_low - dilute, ACQ_FULL_CF_MIN);
+    /* Decay hint scores */
+    for (u8 i = 0; i < ACQ_HINT_NUM; i++)
+      acq->score[i] = (acq->score[i] * 3) / 4;
+    /* Reset hint score for acquisition. */
+    acq->score[ACQ_HINT_PREV_ACQ] = 0;
     return;
   }
 
-  /* Check for NaNs in dopp hints, or low > high */
-  if (!(acq->dopp_hint_low <= acq->dopp_hint_high)) {
-    log_error("Acq: caught bogus dopp_hints (%f, %f)",
-              acq->dopp_hint_low,
-              acq->dopp_hint_high);
-    acq->dopp_hint_high = ACQ_FULL_CF_MAX;
-    acq->dopp_hint_low = ACQ_FULL_CF_MIN;
+  gps_time_t t = get_current_time();
+  tracking_startup_params_t tracking_startup_params = {
+    .sid = acq->sid,
+    .sample_count = acq_result->sample_count,
+    .carrier_freq = acq_result->cf,
+    .code_phase = acq_result->cp,
+    .cn0_init = acq_result->cn0,
+    .elevation = manage_elevation_predict(acq->sid, &t)
+  };
+
+  tracking_startup_request(&tracking_startup_params);
+}
+
+/** Manages acquisition searches and starts tracking channels after successful acquisitions.
+ * Up to acq_signals_per_load signals are searched against one set of
+ * samples, their results are matched back by index.
+ */
+static void manage_acq()
+{
+  /* Decide which SIDs to try and then start them acquiring. */
+  acq_status_t *acqs[ACQ_MULTI_MAX];
+  u8 n_max = MAX(MIN(acq_signals_per_load, ACQ_MULTI_MAX), 1);
+  u8 n = choose_acq_sats(acqs, n_max);
+  if (n == 0) {
+    return;
   }
 
-  acq_result_t acq_result;
-  if (acq_search(acq->sid, acq->dopp_hint_low, acq->dopp_hint_high,
-                 ACQ_FULL_CF_STEP, &acq_result)) {
-
-    /* Send result of an acquisition to the host. */
-    acq_result_send(acq->sid, acq_result.cn0, acq_result.cp, acq_result.cf);
-
-    if (acq_result.cn0 < ACQ_THRESHOLD) {
-      /* Didn't find the satellite :( */
-      /* Double the size of the doppler search space for next time. */
-      float dilute = (acq->dopp_hint_high - acq->dopp_hint_low) / 2;
-      acq->dopp_hint_high = MIN(acq->dopp_hint_high + dilute, ACQ_FULL_CF_MAX);
-      acq->dopp_hint_low = MAX(acq->dopp_hint_low - dilute, ACQ_FULL_CF_MIN);
-      /* Decay hint scores */
-      for (u8 i = 0; i < ACQ_HINT_NUM; i++)
-        acq->score[i] = (acq->score[i] * 3) / 4;
-      /* Reset hint score for acquisition. */
-      acq->score[ACQ_HINT_PREV_ACQ] = 0;
-      return;
+  acq_search_params_t params[ACQ_MULTI_MAX];
+  for (u8 i = 0; i < n; i++) {
+    acq_status_t *acq = acqs[i];
+
+    /* Check for NaNs in dopp hints, or low > high */
+    if (!(acq->dopp_hint_low <= acq->dopp_hint_high)) {
+      log_error("Acq: caught bogus dopp_hints (%f, %f)",
+                acq->dopp_hint_low,
+                acq->dopp_hint_high);
+      acq->dopp_hint_high = ACQ_FULL_CF_MAX;
+      acq->dopp_hint_low = ACQ_FULL_CF_MIN;
     }
 
-    tracking_startup_params_t tracking_startup_params = {
-      .sid = acq->sid,
-      .sample_count = acq_result.sample_count,
-      .carrier_freq = acq_result.cf,
-      .code_phase = acq_result.cp,
-      .cn0_init = acq_result.cn0,
-      .elevation = TRACKING_ELEVATION_UNKNOWN
-    };
+    params[i].sid = acq->sid;
+    params[i].cf_min = acq->dopp_hint_low;
+    params[i].cf_max = acq->dopp_hint_high;
+  }
 
-    tracking_startup_request(&tracking_startup_params);
+  acq_result_t acq_results[ACQ_MULTI_MAX];
+  u8 n_done = acq_search_multi(n, params, ACQ_FULL_CF_STEP, acq_results);
+  for (u8 i = 0; i < n_done; i++) {
+    manage_acq_result(acqs[i], &acq_results[i]);
   }
 }
 
@@ -437,6 +537,93 @@ static void acq_result_send(gnss_signal_t sid, float snr, float cp, float cf)
                (u8 *)&acq_result_msg);
 }
 
+/** Find the running tracking channel with the lowest quality score.
+ *
+ * Channels that are still converging (running for less than TRACK_INIT_T)
+ * are not considered.
+ *
+ * \param quality  Output quality score of the returned channel.
+ *
+ * \return Index of the lowest quality channel, or MANAGE_NO_CHANNELS_FREE if
+ *         no channel is eligible.
+ */
+static u8 manage_track_lowest_quality(u8 *quality)
+{
+  u8 lowest = MANAGE_NO_CHANNELS_FREE;
+  *quality = TRACK_QUALITY_MAX;
+  for (u8 i=0; i<nap_track_n_channels; i++) {
+    if (!tracking_channel_running(i) ||
+        (tracking_channel_running_time_ms_get(i) < TRACK_INIT_T)) {
+      continue;
+    }
+    u8 q = tracking_channel_quality_get(i);
+    if ((lowest == MANAGE_NO_CHANNELS_FREE) || (q < *quality)) {
+      lowest = i;
+      *quality = q;
+    }
+  }
+  return lowest;
+}
+
+/** Hand over the lowest quality tracking channel to a newly acquired signal.
+ *
+ * The candidate's estimated quality, from its acquisition C/N0 and predicted
+ * elevation, must exceed that of the weakest running channel by
+ * TRACK_QUALITY_REPLACE_MARGIN. Signals which were themselves preempted
+ * within TRACK_PREEMPT_HOLDOFF_T may not preempt, and channels still within
+ * TRACK_INIT_T are never preempted, which together prevent thrashing.
+ *
+ * \note Blocks for up to TRACK_PREEMPT_WAIT_T while the preempted channel is
+ *       released.
+ *
+ * \param startup_params Startup parameters of the new signal.
+ *
+ * \return Index of the freed tracking channel, or MANAGE_NO_CHANNELS_FREE if
+ *         no channel was preempted.
+ */
+static u8 manage_track_preempt(const tracking_startup_params_t *startup_params)
+{
+  acq_status_t *acq = &acq_status[sid_to_global_index(startup_params->sid)];
+  if (acq->preempted &&
+      (chVTTimeElapsedSinceX(acq->preempted_time) <
+         MS2ST(TRACK_PREEMPT_HOLDOFF_T))) {
+    return MANAGE_NO_CHANNELS_FREE;
+  }
+
+  u8 lowest_quality;
+  u8 lowest = manage_track_lowest_quality(&lowest_quality);
+  if (lowest == MANAGE_NO_CHANNELS_FREE) {
+    return MANAGE_NO_CHANNELS_FREE;
+  }
+
+  u8 candidate_quality = tracking_quality_estimate(startup_params->cn0_init,
+                                                   startup_params->elevation);
+  if (candidate_quality <= lowest_quality + TRACK_QUALITY_REPLACE_MARGIN) {
+    return MANAGE_NO_CHANNELS_FREE;
+  }
+
+  gnss_signal_t lowest_sid = tracking_channel_sid_get(lowest);
+  log_info_sid(lowest_sid, "quality %u, preempted (new quality %u)",
+               lowest_quality, candidate_quality);
+  acq_status_t *lowest_acq = &acq_status[sid_to_global_index(lowest_sid)];
+  lowest_acq->preempted = true;
+  lowest_acq->preempted_time = chVTGetSystemTime();
+  drop_channel(lowest);
+
+  /* Wait for the tracking and decoder channels to be released. */
+  systime_t start = chVTGetSystemTime();
+  do {
+    chThdSleepMilliseconds(10);
+    u8 chan = manage_track_new_acq(startup_params->sid);
+    if (chan != MANAGE_NO_CHANNELS_FREE) {
+      return chan;
+    }
+  } while (chVTTimeElapsedSinceX(start) < MS2ST(TRACK_PREEMPT_WAIT_T));
+
+  log_warn_sid(startup_params->sid, "preempted channel not released");
+  return MANAGE_NO_CHANNELS_FREE;
+}
+
 /** Find an available tracking channel to start tracking an acquired PRN with.
  *
  * \return Index of first unused tracking channel.
@@ -473,7 +660,7 @@ static void check_clear_unhealthy(void)
   }
 }
 
-static WORKING_AREA_BCKP(wa_manage_track_thread, MANAGE_TRACK_THREAD_STACK);
+static WORKING_AREA_MANAGE(wa_manage_track_thread, MANAGE_TRACK_THREAD_STACK);
 static void manage_track_thread(void *arg)
 {
   (void)arg;
@@ -502,6 +689,14 @@ void manage_track_setup()
 }
 
 static void drop_channel(u8 channel_id) {
+  /* Channels may be dropped from both the track and acq management threads,
+   * make sure only one of them disables a given channel. */
+  chMtxLock(&drop_channel_mutex);
+  if (!tracking_channel_running(channel_id)) {
+    chMtxUnlock(&drop_channel_mutex);
+    return;
+  }
+
   /* Read the required parameters from the tracking channel first to ensure
    * that the tracking channel is not restarted in the mean time.
    */
@@ -519,6 +714,7 @@ static void drop_channel(u8 channel_id) {
   /* Finally disable the decoder and tracking channels */
   decoder_channel_disable(channel_id);
   tracker_channel_disable(channel_id);
+  chMtxUnlock(&drop_channel_mutex);
 }
 
 /** Disable any tracking channel that has lost phase lock or is
@@ -564,22 +760,26 @@ static void manage_track()
       continue;
     }
 
+    /* The drop conditions below are evaluated by the tracker on every
+     * integration and summarized in the quality flags. */
+    u8 quality_flags = tracking_channel_quality_flags_get(i);
+
     /* Do we not have nav bit sync yet? */
-    if (!tracking_channel_bit_sync_resolved(i)) {
+    if (!(quality_flags & TRACK_QUALITY_FLAG_BIT_SYNC)) {
       drop_channel(i);
       continue;
     }
 
     /* Optimistic phase lock detector "unlocked" for a while? */
     /* TODO: This isn't doing much.  Use the pessimistic detector instead? */
-    if (tracking_channel_ld_opti_unlocked_ms_get(i) > TRACK_DROP_UNLOCKED_T) {
+    if (quality_flags & TRACK_QUALITY_FLAG_PLL_LOST) {
       log_info_sid(sid, "PLL unlocked too long, dropping");
       drop_channel(i);
       continue;
     }
 
     /* CN0 below threshold for a while? */
-    if (tracking_channel_cn0_drop_ms_get(i) > TRACK_DROP_CN0_T) {
+    if (quality_flags & TRACK_QUALITY_FLAG_CN0_LOST) {
       log_info_sid(sid, "low CN0 too long, dropping");
       drop_channel(i);
       continue;
@@ -603,20 +803,18 @@ s8 use_tracking_channel(u8 i)
   if (tracking_channel_running(i)
       /* Make sure no errors have occurred. */
       && !tracking_channel_error(i)
-      /* Check SNR has been above threshold for the minimum time. */
-      && (tracking_channel_cn0_useable_ms_get(i) > TRACK_SNR_THRES_COUNT)
+      /* The tracker maintains the following in the quality flags:
+       * - SNR has been above threshold for the minimum time.
+       * - Pessimistic phase lock detector = "locked".
+       * - Some time has elapsed since the last tracking channel mode
+       *   change, to allow any transients to stabilize.
+       *   TODO: is this still necessary?
+       * - Channel time of week has been decoded.
+       * - Nav bit polarity is known, i.e. half-cycles have been resolved. */
+      && ((tracking_channel_quality_flags_get(i) & TRACK_QUALITY_FLAGS_USABLE)
+            == TRACK_QUALITY_FLAGS_USABLE)
       /* Satellite elevation is above the mask. */
-      && (tracking_channel_evelation_degrees_get(i) >= elevation_mask)
-      /* Pessimistic phase lock detector = "locked". */
-      && (tracking_channel_ld_pess_locked_ms_get(i) > TRACK_USE_LOCKED_T)
-      /* Some time has elapsed since the last tracking channel mode
-       * change, to allow any transients to stabilize.
-       * TODO: is this still necessary? */
-      && (tracking_channel_last_mode_change_ms_get(i) > TRACK_STABILIZATION_T)
-      /* Channel time of week has been decoded. */
-      && (tracking_channel_tow_ms_get(i) != TOW_INVALID)
-      /* Nav bit polarity is known, i.e. half-cycles have been resolved. */
-      && tracking_channel_bit_polarity_resolved(i))
+      && (tracking_channel_evelation_degrees_get(i) >= elevation_mask))
       /* TODO: Alert flag is not set */
       {
     /* Ephemeris must be valid, not stale. Satellite must be healthy.
@@ -645,38 +843,66 @@ u8 tracking_channels_ready()
 
 /** Queue a request to start up tracking and decoding for the specified sid.
  *
- * \note This function is thread-safe and non-blocking.
+ * \note This function is thread-safe, lock-free and non-blocking. It may be
+ *       called concurrently from any number of threads, e.g. acquisition,
+ *       reacquisition or SBP callbacks.
  *
  * \param startup_params    Struct containing startup parameters.
  *
- * \return true if the request was successfully submitted, false otherwise.
+ * \return true if the request was successfully submitted, false if the queue
+ *         was full.
  */
 bool tracking_startup_request(const tracking_startup_params_t *startup_params)
 {
-  bool result = false;
-  if(chMtxTryLock(&tracking_startup_mutex))
-  {
-    result = tracking_startup_fifo_write(&tracking_startup_fifo,
-                                         startup_params);
-
-    chMtxUnlock(&tracking_startup_mutex);
-  }
+  return tracking_startup_queue_write(&tracking_startup_queue,
+                                      startup_params);
+}
 
-  return result;
+/** Retrieve tracking startup queue statistics.
+ *
+ * \param stats   Output statistics.
+ */
+void tracking_startup_stats_get(tracking_startup_queue_stats_t *stats)
+{
+  const tracking_startup_queue_stats_t *s = &tracking_startup_queue.stats;
+  stats->requests = __atomic_load_n(&s->requests, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&s->dropped, __ATOMIC_RELAXED);
+  stats->contended = __atomic_load_n(&s->contended, __ATOMIC_RELAXED);
+  stats->max_length = __atomic_load_n(&s->max_length, __ATOMIC_RELAXED);
 }
 
-/** Read tracking startup requests from the FIFO and attempt to start
+/** Read tracking startup requests from the queue and attempt to start
  * tracking and decoding.
  */
 static void manage_tracking_startup(void)
 {
+  /* Report requests lost to a full queue since the last call. */
+  static u32 dropped_reported = 0;
+  tracking_startup_queue_stats_t stats;
+  tracking_startup_stats_get(&stats);
+  if (stats.dropped != dropped_reported) {
+    log_warn("tracking startup queue full, %lu requests dropped "
+             "(%lu requests, %lu contended, max length %lu of %u)",
+             (unsigned long)(stats.dropped - dropped_reported),
+             (unsigned long)stats.requests, (unsigned long)stats.contended,
+             (unsigned long)stats.max_length, TRACKING_STARTUP_QUEUE_SIZE);
+    dropped_reported = stats.dropped;
+  }
+
   tracking_startup_params_t startup_params;
-  while(tracking_startup_fifo_read(&tracking_startup_fifo, &startup_params)) {
+  while(tracking_startup_queue_read(&tracking_startup_queue,
+                                    &startup_params)) {
 
     acq_status_t *acq = &acq_status[sid_to_global_index(startup_params.sid)];
 
     /* Make sure a tracking channel and a decoder channel are available */
     u8 chan = manage_track_new_acq(startup_params.sid);
+    if (chan == MANAGE_NO_CHANNELS_FREE) {
+      /* Hand over the weakest channel if the new satellite is clearly
+       * better. */
+      chan = manage_track_preempt(&startup_params);
+    }
+
     if (chan == MANAGE_NO_CHANNELS_FREE) {
 
       /* No channels are free to accept our new satellite :( */
@@ -699,10 +925,9 @@ static void manage_tracking_startup(void)
                              startup_params.code_phase,
                              startup_params.carrier_freq,
                              startup_params.cn0_init,
-                             TRACKING_ELEVATION_UNKNOWN)) {
+                             startup_params.elevation)) {
       log_error("tracker channel init failed");
     }
-    /* TODO: Initialize elevation from ephemeris if we know it precisely */
 
     /* Start the decoder channel */
     if (!decoder_channel_init(chan, startup_params.sid)) {
@@ -714,62 +939,101 @@ static void manage_tracking_startup(void)
   }
 }
 
-/** Initialize a tracking_startup_fifo_t struct.
+/** Initialize a tracking_startup_queue_t struct.
  *
- * \param fifo        tracking_startup_fifo_t struct to use.
+ * \param queue       tracking_startup_queue_t struct to use.
  */
-static void tracking_startup_fifo_init(tracking_startup_fifo_t *fifo)
+static void tracking_startup_queue_init(tracking_startup_queue_t *queue)
 {
-  fifo->read_index = 0;
-  fifo->write_index = 0;
+  memset(queue, 0, sizeof(*queue));
+  for (u32 i = 0; i < TRACKING_STARTUP_QUEUE_SIZE; i++) {
+    queue->slots[i].sequence = i;
+  }
 }
 
-/** Write data to a tracking startup FIFO.
+/** Write data to a tracking startup queue.
  *
- * \param fifo        tracking_startup_fifo_t struct to use.
- * \param element     Element to write to the FIFO.
+ * \note Safe to call concurrently from multiple producers. A producer
+ *       claims a slot by advancing write_index with compare-and-swap, fills
+ *       it, then publishes it to the consumer by updating its sequence.
  *
- * \return true if element was read, false otherwise.
+ * \param queue       tracking_startup_queue_t struct to use.
+ * \param element     Element to write to the queue.
+ *
+ * \return true if element was written, false if the queue was full.
  */
-static bool tracking_startup_fifo_write(tracking_startup_fifo_t *fifo,
-                                        const tracking_startup_params_t *
-                                        element)
+static bool tracking_startup_queue_write(tracking_startup_queue_t *queue,
+                                         const tracking_startup_params_t *
+                                         element)
 {
-  if (TRACKING_STARTUP_FIFO_LENGTH(fifo) < TRACKING_STARTUP_FIFO_SIZE) {
-    COMPILER_BARRIER(); /* Prevent compiler reordering */
-    memcpy(&fifo->elements[fifo->write_index &
-                           TRACKING_STARTUP_FIFO_INDEX_MASK],
-           element, sizeof(tracking_startup_params_t));
-    COMPILER_BARRIER(); /* Prevent compiler reordering */
-    fifo->write_index++;
-    return true;
+  tracking_startup_queue_stats_t *stats = &queue->stats;
+  __atomic_fetch_add(&stats->requests, 1, __ATOMIC_RELAXED);
+
+  tracking_startup_queue_slot_t *slot;
+  u32 index = __atomic_load_n(&queue->write_index, __ATOMIC_RELAXED);
+  while (1) {
+    slot = &queue->slots[index & TRACKING_STARTUP_QUEUE_INDEX_MASK];
+    u32 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    s32 diff = (s32)(sequence - index);
+    if (diff == 0) {
+      /* Slot is free, try to claim it. On failure index is reloaded. */
+      if (__atomic_compare_exchange_n(&queue->write_index, &index, index + 1,
+                                      true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        break;
+      }
+      __atomic_fetch_add(&stats->contended, 1, __ATOMIC_RELAXED);
+    } else if (diff < 0) {
+      /* Slot still holds unread data from the previous lap, queue is full. */
+      __atomic_fetch_add(&stats->dropped, 1, __ATOMIC_RELAXED);
+      return false;
+    } else {
+      /* Another producer claimed this slot first. */
+      index = __atomic_load_n(&queue->write_index, __ATOMIC_RELAXED);
+    }
   }
 
-  return false;
+  memcpy(&slot->element, element, sizeof(tracking_startup_params_t));
+  __atomic_store_n(&slot->sequence, index + 1, __ATOMIC_RELEASE);
+
+  /* Track the queue high-water mark. */
+  u32 length = index + 1 - __atomic_load_n(&queue->read_index,
+                                           __ATOMIC_RELAXED);
+  u32 max_length = __atomic_load_n(&stats->max_length, __ATOMIC_RELAXED);
+  while ((length > max_length) &&
+         !__atomic_compare_exchange_n(&stats->max_length, &max_length, length,
+                                      true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED));
+  return true;
 }
 
-/** Read pending data from a tracking startup FIFO.
+/** Read pending data from a tracking startup queue.
+ *
+ * \note Must only be called from a single consumer thread.
  *
- * \param fifo        tracking_startup_fifo_t struct to use.
- * \param element     Output element read from the FIFO.
+ * \param queue       tracking_startup_queue_t struct to use.
+ * \param element     Output element read from the queue.
  *
  * \return true if element was read, false otherwise.
  */
-static bool tracking_startup_fifo_read(tracking_startup_fifo_t *fifo,
-                                       tracking_startup_params_t *element)
+static bool tracking_startup_queue_read(tracking_startup_queue_t *queue,
+                                        tracking_startup_params_t *element)
 {
-  if (TRACKING_STARTUP_FIFO_LENGTH(fifo) > 0) {
-    COMPILER_BARRIER(); /* Prevent compiler reordering */
-    memcpy(element,
-           &fifo->elements[fifo->read_index &
-                           TRACKING_STARTUP_FIFO_INDEX_MASK],
-           sizeof(tracking_startup_params_t));
-    COMPILER_BARRIER(); /* Prevent compiler reordering */
-    fifo->read_index++;
-    return true;
+  u32 index = queue->read_index;
+  tracking_startup_queue_slot_t *slot =
+      &queue->slots[index & TRACKING_STARTUP_QUEUE_INDEX_MASK];
+  u32 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+  if ((s32)(sequence - (index + 1)) < 0) {
+    /* Empty, or the producer has claimed the slot but not yet published. */
+    return false;
   }
 
-  return false;
+  memcpy(element, &slot->element, sizeof(tracking_startup_params_t));
+  /* Hand the slot back to producers for the next lap. */
+  __atomic_store_n(&slot->sequence, index + TRACKING_STARTUP_QUEUE_SIZE,
+                   __ATOMIC_RELEASE);
+  __atomic_store_n(&queue->read_index, index + 1, __ATOMIC_RELAXED);
+  return true;
 }
 
 /** \} */
@@ -24,8 +24,6 @@
 #define ACQ_THRESHOLD 37.0
 #define ACQ_RETRY_THRESHOLD 38.0
 
-#define TRACK_SNR_THRES_COUNT 2000
-
 /** How many ms to allow tracking channel to converge after
     initialization before we consider dropping it */
 #define TRACK_INIT_T 2500
@@ -34,21 +32,18 @@
     this long, mark it for prioritized reacquisition. */
 #define TRACK_REACQ_T 5000
 
-/** If C/N0 is below track_cn0_threshold for >= TRACK_DROP_CN0_T ms,
-    drop the channel. */
-#define TRACK_DROP_CN0_T 5000
-
-/** If optimistic phase lock detector shows "unlocked" for >=
-    TRACK_DROP_UNLOCKED_T ms, drop the channel. */
-#define TRACK_DROP_UNLOCKED_T 5000
+/** A newly acquired signal preempts the lowest quality tracking channel
+    when no channel is free and its estimated quality exceeds that channel's
+    by more than this margin. */
+#define TRACK_QUALITY_REPLACE_MARGIN 20
 
-/** If pessimistic phase lock detector shows "locked" for >=
-    TRACK_USE_LOCKED_T ms, use the channel. */
-#define TRACK_USE_LOCKED_T 100
+/** A signal which has been preempted may not itself preempt another
+    channel for this many ms, to prevent channels thrashing. */
+#define TRACK_PREEMPT_HOLDOFF_T 30000
 
-/** How many milliseconds to wait for the tracking loops to
- * stabilize after any mode change before using obs. */
-#define TRACK_STABILIZATION_T 1000
+/** Maximum time in ms to wait for a preempted channel to be released
+    before handing it over to the new signal. */
+#define TRACK_PREEMPT_WAIT_T 500
 
 #define ACQ_FULL_CF_MIN  -8500
 #define ACQ_FULL_CF_MAX   8500
@@ -71,6 +66,14 @@ typedef struct {
   s8 elevation;           /**< Elevation (deg). */
 } tracking_startup_params_t;
 
+/** Tracking startup queue statistics. */
+typedef struct {
+  u32 requests;     /**< Total startup requests submitted. */
+  u32 dropped;      /**< Requests rejected because the queue was full. */
+  u32 contended;    /**< Producer retries due to concurrent submissions. */
+  u32 max_length;   /**< Maximum observed queue length. */
+} tracking_startup_queue_stats_t;
+
 /** \} */
 
 void manage_acq_setup(void);
@@ -82,5 +85,6 @@ s8 use_tracking_channel(u8 i);
 u8 tracking_channels_ready(void);
 
 bool tracking_startup_request(const tracking_startup_params_t *startup_params);
+void tracking_startup_stats_get(tracking_startup_queue_stats_t *stats);
 
 #endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_MEM_PLACEMENT_H
+#define SWIFTNAV_MEM_PLACEMENT_H
+
+#include <ch.h>
+
+/** \defgroup mem_placement Memory Placement
+ * Placement of subsystem working sets in RAM regions.
+ *
+ * Subsystems place their working areas and hot data with the macros below
+ * rather than with _CCM or _BCKP directly. The region of each subsystem is
+ * chosen at build time, for example
+ *
+ *     make UDEFS=-DMEM_PLACE_SBP=MEM_SRAM
+ *
+ * and `make memmap` reports where every symbol ended up. The defaults keep
+ * the placement the firmware has always used.
+ *
+ * Regions:
+ *  - MEM_SRAM: main SRAM, reachable by DMA.
+ *  - MEM_CCM:  64k core coupled memory, no contention with DMA but not
+ *              reachable by it. Buffers read or written by DMA must never be
+ *              placed here.
+ *  - MEM_BCKP: 4k backup SRAM on the peripheral bus, slowest.
+ *
+ * Boards without CCM or backup SRAM define _CCM and _BCKP empty, every region
+ * is main RAM there.
+ * \{ */
+
+#define MEM_SECTION_MEM_SRAM
+#define MEM_SECTION_MEM_CCM  _CCM
+#define MEM_SECTION_MEM_BCKP _BCKP
+#define MEM_SECTION_(region) MEM_SECTION_##region
+/** Section attribute of a region, empty for MEM_SRAM. */
+#define MEM_SECTION(region)  MEM_SECTION_(region)
+
+/** Tracking: NAP ISR thread. */
+#ifndef MEM_PLACE_TRACK
+#define MEM_PLACE_TRACK MEM_CCM
+#endif
+
+/** Acquisition and tracking management threads. */
+#ifndef MEM_PLACE_MANAGE
+#define MEM_PLACE_MANAGE MEM_BCKP
+#endif
+
+/** Solution: time matched observation thread and observation buffers. */
+#ifndef MEM_PLACE_SOLN
+#define MEM_PLACE_SOLN MEM_CCM
+#endif
+
+/** Ephemeris store and thread. */
+#ifndef MEM_PLACE_EPHEMERIS
+#define MEM_PLACE_EPHEMERIS MEM_CCM
+#endif
+
+/** SBP: SBP, file I/O and logger threads. */
+#ifndef MEM_PLACE_SBP
+#define MEM_PLACE_SBP MEM_CCM
+#endif
+
+#define _TRACK     MEM_SECTION(MEM_PLACE_TRACK)
+#define _MANAGE    MEM_SECTION(MEM_PLACE_MANAGE)
+#define _SOLN      MEM_SECTION(MEM_PLACE_SOLN)
+#define _EPHEMERIS MEM_SECTION(MEM_PLACE_EPHEMERIS)
+#define _SBP       MEM_SECTION(MEM_PLACE_SBP)
+
+#define WORKING_AREA_TRACK(s, n)     THD_WORKING_AREA(s, n) _TRACK
+#define WORKING_AREA_MANAGE(s, n)    THD_WORKING_AREA(s, n) _MANAGE
+#define WORKING_AREA_SOLN(s, n)      THD_WORKING_AREA(s, n) _SOLN
+#define WORKING_AREA_EPHEMERIS(s, n) THD_WORKING_AREA(s, n) _EPHEMERIS
+#define WORKING_AREA_SBP(s, n)       THD_WORKING_AREA(s, n) _SBP
+
+/** \} */
+
+#endif /* SWIFTNAV_MEM_PLACEMENT_H */
@@ -140,6 +140,23 @@ void flash_program_byte(u32 addr, u8 data)
   FLASH->CR &= ~FLASH_CR_PG;
 }
 
+/** Program a word of the STM32F4 flash memory.
+ * Uses x32 program parallelism, which requires a supply voltage of at least
+ * 2.7V.
+ * \param addr Word aligned address to program.
+ * \param data Word to program.
+ */
+void flash_program_word(u32 addr, u32 data)
+{
+  while (FLASH->SR & FLASH_SR_BSY);
+  FLASH->CR &= ~(3 << 8);
+  FLASH->CR |= FLASH_CR_PSIZE_1;
+  FLASH->CR |= FLASH_CR_PG;
+  *(volatile u32*)(addr) = data;
+  while (FLASH->SR & FLASH_SR_BSY);
+  FLASH->CR &= ~FLASH_CR_PG;
+}
+
 void flash_unlock(void)
 {
 	FLASH->CR |= FLASH_CR_LOCK;
@@ -34,5 +34,6 @@ u8 stm_flash_program(u32 address, u8 data[], u8 length);
 void flash_unlock(void);
 void flash_lock(void);
 void flash_program_byte(u32 addr, u8 data);
+void flash_program_word(u32 addr, u32 data);
 
 #endif
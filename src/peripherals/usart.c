@@ -306,6 +306,25 @@ u32 usart_write(usart_state* s, const u8 data[], u32 len)
   return n;
 }
 
+/** Write out a buffer over the USART without copying it.
+ *
+ * The caller keeps its reference to the buffer and must release it. The
+ * buffer contents must not be modified until it returns to the pool.
+ *
+ * \param s   The USART state structure.
+ * \param buf Buffer holding the data to write out.
+ * \return True if the buffer will be written, false if it was dropped.
+ */
+bool usart_write_buf(usart_state* s, usart_tx_buf_t *buf)
+{
+  if (s->sd == NULL)
+    return true;
+  bool ok = usart_support_write_buf(s->sd, buf);
+  if (ok)
+    s->tx.byte_counter += buf->len;
+  return ok;
+}
+
 /** \} */
 
 /** \} */
@@ -15,6 +15,7 @@
 
 #include <libswiftnav/common.h>
 #include "settings.h"
+#include "usart_tx.h"
 
 #include <hal.h>
 #include <ch.h>
@@ -89,6 +90,7 @@ void usart_release(usart_state* s);
 
 u32 usart_tx_n_free(usart_state* s);
 u32 usart_write(usart_state* s, const u8 data[], u32 len);
+bool usart_write_buf(usart_state* s, usart_tx_buf_t *buf);
 
 u32 usart_n_read(usart_state* s);
 u32 usart_read(usart_state* s, u8 data[], u32 len);
@@ -104,6 +106,7 @@ u32 usart_support_n_read(void *sd);
 u32 usart_support_tx_n_free(void *sd);
 u32 usart_support_read_timeout(void *sd, u8 data[], u32 len, u32 timeout);
 u32 usart_support_write(void *sd, const u8 data[], u32 len);
+bool usart_support_write_buf(void *sd, usart_tx_buf_t *buf);
 
 #endif  /* SWIFTNAV_USART_H */
 
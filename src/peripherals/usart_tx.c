@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <string.h>
+
+#include "usart_tx.h"
+
+/** \addtogroup peripherals
+ * \{ */
+
+/** \addtogroup usart
+ * \{ */
+
+/* Buffers are read by DMA, so the pool must not be placed in CCM. */
+static usart_tx_buf_t tx_bufs[USART_TX_BUF_COUNT];
+
+/** Allocate a TX buffer from the pool.
+ *
+ * \return Buffer holding one reference with len set to zero, or NULL if the
+ *         pool is exhausted.
+ */
+usart_tx_buf_t *usart_tx_buf_alloc(void)
+{
+  usart_tx_buf_t *b = NULL;
+
+  chSysLock();
+  for (u32 i = 0; i < USART_TX_BUF_COUNT; i++) {
+    if (tx_bufs[i].refs == 0) {
+      b = &tx_bufs[i];
+      b->refs = 1;
+      break;
+    }
+  }
+  chSysUnlock();
+
+  if (b != NULL)
+    b->len = 0;
+  return b;
+}
+
+/** Release a reference to a TX buffer. To be called from thread context. */
+void usart_tx_buf_release(usart_tx_buf_t *b)
+{
+  chSysLock();
+  usart_tx_buf_releaseI(b);
+  chSysUnlock();
+}
+
+/** Release a reference to a TX buffer. To be called with the system locked. */
+void usart_tx_buf_releaseI(usart_tx_buf_t *b)
+{
+  if (b->refs > 0)
+    b->refs--;
+}
+
+/** Initialize a TX queue.
+ *
+ * \param q     Queue to initialize.
+ * \param start Starts a hardware transfer.
+ * \param ctx   Context passed to start.
+ */
+void usart_tx_queue_init(usart_tx_queue_t *q, usart_tx_start_t start,
+                         void *ctx)
+{
+  q->ring_rd = q->ring_wr = 0;
+  q->rd = q->wr = 0;
+  q->pending = q->n_bufs = 0;
+  q->busy = false;
+  chMtxObjectInit(&q->write_mutex);
+  q->start = start;
+  q->ctx = ctx;
+}
+
+static u32 queue_n_desc_free(const usart_tx_queue_t *q)
+{
+  return USART_TX_QUEUE_LEN - (q->wr - q->rd);
+}
+
+/* Must be called with the system locked and a descriptor queued. */
+static void queue_start(usart_tx_queue_t *q)
+{
+  const usart_tx_desc_t *d = &q->desc[q->rd % USART_TX_QUEUE_LEN];
+  q->busy = true;
+  q->start(q->ctx, d->data, d->len);
+}
+
+/* Must be called with the system locked and space checked. Ring data
+ * following on from the last descriptor extends it, unless that descriptor
+ * is already being sent. */
+static void queue_push(usart_tx_queue_t *q, const u8 *data, u32 len,
+                       usart_tx_buf_t *b)
+{
+  q->pending += len;
+
+  if ((b == NULL) && (q->wr - q->rd > 1)) {
+    usart_tx_desc_t *last = &q->desc[(q->wr - 1) % USART_TX_QUEUE_LEN];
+    if ((last->buf == NULL) && (last->data + last->len == data)) {
+      last->len += len;
+      return;
+    }
+  }
+
+  usart_tx_desc_t *d = &q->desc[q->wr % USART_TX_QUEUE_LEN];
+  d->data = data;
+  d->len = len;
+  d->buf = b;
+  q->wr++;
+}
+
+/** Complete the active transfer and start the next one.
+ * To be called from the transfer complete ISR with the system locked.
+ *
+ * \param q Queue whose active transfer has finished.
+ */
+void usart_tx_queue_completeI(usart_tx_queue_t *q)
+{
+  if (!q->busy)
+    return;
+
+  usart_tx_desc_t *d = &q->desc[q->rd % USART_TX_QUEUE_LEN];
+  q->pending -= d->len;
+  if (d->buf != NULL) {
+    q->n_bufs--;
+    usart_tx_buf_releaseI(d->buf);
+    d->buf = NULL;
+  } else {
+    q->ring_rd += d->len;
+  }
+  q->rd++;
+
+  if (q->rd != q->wr)
+    queue_start(q);
+  else
+    q->busy = false;
+}
+
+/** Number of bytes that can be queued before the queue is full.
+ *
+ * Buffers that cannot be held are copied into the ring instead, so this is
+ * the space left for both usart_tx_queue_write() and
+ * usart_tx_queue_submit(). */
+u32 usart_tx_queue_n_free(usart_tx_queue_t *q)
+{
+  chSysLock();
+  u32 n = 0;
+  if (queue_n_desc_free(q) >= 2)
+    n = USART_TX_RING_SIZE - q->pending;
+  chSysUnlock();
+  return n;
+}
+
+/* Must be called with the write mutex held. Space is only ever released
+ * behind the ring write index, so the copy is made outside of the critical
+ * section, which only covers the descriptor updates. A copy wrapping the
+ * ring end takes two descriptors. */
+static u32 queue_copy(usart_tx_queue_t *q, const u8 data[], u32 len)
+{
+  chSysLock();
+  bool space = (q->pending + len <= USART_TX_RING_SIZE) &&
+               (queue_n_desc_free(q) >= 2);
+  chSysUnlock();
+
+  if (!space)
+    return 0;
+
+  /* Ring bytes are a subset of the pending bytes, so they fit. */
+  u32 offset = q->ring_wr % USART_TX_RING_SIZE;
+  u32 n = MIN(len, USART_TX_RING_SIZE - offset);
+  memcpy(&q->ring[offset], data, n);
+  memcpy(&q->ring[0], &data[n], len - n);
+
+  chSysLock();
+  queue_push(q, &q->ring[offset], n, NULL);
+  if (len > n)
+    queue_push(q, &q->ring[0], len - n, NULL);
+  q->ring_wr += len;
+  if (!q->busy)
+    queue_start(q);
+  chSysUnlock();
+
+  return len;
+}
+
+/** Copy data into the ring and queue it for transmission.
+ *
+ * The data is queued entirely or not at all. Writers are serialised by the
+ * queue mutex, so this must be called from thread context.
+ *
+ * \param q    Queue to write to.
+ * \param data Data to send.
+ * \param len  Number of bytes to send.
+ * \return len if the data was queued, 0 otherwise.
+ */
+u32 usart_tx_queue_write(usart_tx_queue_t *q, const u8 data[], u32 len)
+{
+  if (len == 0)
+    return 0;
+
+  chMtxLock(&q->write_mutex);
+  u32 n = queue_copy(q, data, len);
+  chMtxUnlock(&q->write_mutex);
+  return n;
+}
+
+/** Submit a buffer for transmission without copying it.
+ *
+ * On success the queue takes its own reference to the buffer, released from
+ * the transfer complete ISR once it has been sent. The caller keeps its
+ * reference and must release it. The buffer contents must not be modified
+ * until the last reference is released.
+ *
+ * A port already holding USART_TX_PORT_BUFS buffers gets a copy in its ring
+ * instead, so it never holds more than its share of the pool.
+ *
+ * \param q Queue to submit to.
+ * \param b Buffer to send.
+ * \return True if the buffer was queued, false if the queue is full.
+ */
+bool usart_tx_queue_submit(usart_tx_queue_t *q, usart_tx_buf_t *b)
+{
+  if (b->len == 0)
+    return true;
+
+  chMtxLock(&q->write_mutex);
+
+  chSysLock();
+  bool fits = (q->pending + b->len <= USART_TX_RING_SIZE);
+  /* Keep two descriptors for a copy following this buffer. */
+  bool in_place = fits && (q->n_bufs < USART_TX_PORT_BUFS) &&
+                  (queue_n_desc_free(q) >= 3);
+  if (in_place) {
+    b->refs++;
+    q->n_bufs++;
+    queue_push(q, b->data, b->len, b);
+    if (!q->busy)
+      queue_start(q);
+  }
+  chSysUnlock();
+
+  if (fits && !in_place)
+    fits = (queue_copy(q, b->data, b->len) == b->len);
+
+  chMtxUnlock(&q->write_mutex);
+  return fits;
+}
+
+/** \} */
+
+/** \} */
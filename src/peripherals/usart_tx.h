@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_USART_TX_H
+#define SWIFTNAV_USART_TX_H
+
+#include <ch.h>
+
+#include <libswiftnav/common.h>
+
+/** \addtogroup peripherals
+ * \{ */
+
+/** \addtogroup usart
+ * \{ */
+
+/** Size of the TX ring of each USART, must be a power of two. This is also
+ * the most bytes a port may have queued, whether copied or submitted. */
+#ifndef USART_TX_RING_SIZE
+#define USART_TX_RING_SIZE 2048
+#endif
+
+/** Size of a TX buffer, large enough for a complete SBP frame. */
+#define USART_TX_BUF_SIZE 264
+
+/** Number of TX buffers each port may hold at once. Further buffers
+ * submitted to a port are copied into its ring. */
+#define USART_TX_PORT_BUFS 6
+
+/** Number of USARTs submitting buffers from the shared pool. */
+#define USART_TX_PORTS 3
+
+/** Number of buffers in the shared TX buffer pool: every port can hold its
+ * full share while one more frame is being built, so a stalled port can
+ * never starve the others. */
+#define USART_TX_BUF_COUNT (USART_TX_PORTS * USART_TX_PORT_BUFS + 1)
+
+/** Number of descriptors in each TX queue, must be a power of two.
+ *
+ * Consecutive copies coalesce into one descriptor, so a queue holds at most
+ * USART_TX_PORT_BUFS buffer descriptors and a ring descriptor on either side
+ * of each of them, plus one where the active transfer cannot be extended
+ * and one where a copy wraps the ring end: 15 in all. */
+#define USART_TX_QUEUE_LEN 16
+
+/** Reference counted TX buffer.
+ *
+ * A buffer may be submitted to several queues at once. It returns to the pool
+ * when the last reference is released. */
+typedef struct {
+  u8 data[USART_TX_BUF_SIZE];
+  u16 len;                /**< Number of valid bytes in data. */
+  u8 refs;                /**< Number of holders, 0 when free. */
+} usart_tx_buf_t;
+
+/** Start a transfer, called with the system locked. */
+typedef void (*usart_tx_start_t)(void *ctx, const u8 data[], u32 len);
+
+/** TX descriptor, one contiguous transfer. */
+typedef struct {
+  const u8 *data;         /**< First byte to send. */
+  u16 len;                /**< Number of bytes to send. */
+  usart_tx_buf_t *buf;    /**< Buffer released once sent, NULL for data
+                               copied into the ring. */
+} usart_tx_desc_t;
+
+/** USART TX queue.
+ *
+ * Descriptors are sent in order, the transfer of the next one being started
+ * from the completion of the previous one. A descriptor either references a
+ * submitted buffer, which is sent in place, or data copied into the ring
+ * owned by the port. Both count against the same per-port byte budget, so a
+ * port can only ever run out of its own space. */
+typedef struct {
+  /** Ring of copied bytes, read by DMA so it must not be placed in CCM. */
+  u8 ring[USART_TX_RING_SIZE];
+  u32 ring_rd;            /**< Free running index of the first ring byte. */
+  u32 ring_wr;            /**< Free running index of the next ring byte. */
+  usart_tx_desc_t desc[USART_TX_QUEUE_LEN];
+  u32 rd;                 /**< Index of the descriptor being sent. */
+  u32 wr;                 /**< Index of the next free descriptor. */
+  u32 pending;            /**< Bytes queued, including the active transfer. */
+  u32 n_bufs;             /**< Buffer descriptors queued. */
+  bool busy;              /**< Transfer in progress. */
+  mutex_t write_mutex;    /**< Serialises writers. */
+  usart_tx_start_t start; /**< Starts a transfer on the hardware. */
+  void *ctx;              /**< Context passed to start. */
+} usart_tx_queue_t;
+
+/** \} */
+
+/** \} */
+
+usart_tx_buf_t *usart_tx_buf_alloc(void);
+void usart_tx_buf_release(usart_tx_buf_t *b);
+void usart_tx_buf_releaseI(usart_tx_buf_t *b);
+
+void usart_tx_queue_init(usart_tx_queue_t *q, usart_tx_start_t start,
+                         void *ctx);
+void usart_tx_queue_completeI(usart_tx_queue_t *q);
+u32 usart_tx_queue_n_free(usart_tx_queue_t *q);
+u32 usart_tx_queue_write(usart_tx_queue_t *q, const u8 data[], u32 len);
+bool usart_tx_queue_submit(usart_tx_queue_t *q, usart_tx_buf_t *b);
+
+#endif  /* SWIFTNAV_USART_TX_H */
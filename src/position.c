@@ -17,6 +17,7 @@
 #include <libswiftnav/linear_algebra.h>
 
 #include "position.h"
+#include "sbp_fileio.h"
 #include "timing.h"
 
 #include "cfs/cfs-coffee.h"
@@ -38,6 +39,7 @@ double last_ecef[3];
  */
 void position_setup(void)
 {
+  sbp_fileio_lock();
   int fd = cfs_open("posn", CFS_READ);
 
   if (fd != -1) {
@@ -60,6 +62,7 @@ void position_setup(void)
     cfs_coffee_reserve("posn", sizeof(gnss_solution));
     cfs_coffee_configure_log("posn", 256, sizeof(gnss_solution));
   }
+  sbp_fileio_unlock();
 }
 
 /** Save position to file. */
@@ -73,6 +76,9 @@ void position_updated(void)
   double dt = gpsdifftime(&position_solution.time, &last_time);
 
   if (dt > 30 * 60 || dx > 10e3) {
+    /* Called from the solution thread, Coffee is shared with the logger and
+     * host file IO. */
+    sbp_fileio_lock();
     int fd = cfs_open("posn", CFS_WRITE);
     if (fd != -1) {
       if (cfs_write(fd, (void *)&position_solution,
@@ -82,9 +88,11 @@ void position_updated(void)
         log_info("Saved position to flash");
       }
       cfs_close(fd);
+      sbp_fileio_invalidate("posn");
     } else {
       log_error("Error opening position file");
     }
+    sbp_fileio_unlock();
     last_time = position_solution.time;
     memcpy(last_ecef, position_solution.pos_ecef, sizeof(last_ecef));
   }
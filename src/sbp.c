@@ -23,9 +23,12 @@
 #include <libswiftnav/logging.h>
 
 #include "peripherals/leds.h"
+#include "block_pool.h"
 #include "error.h"
+#include "mem_placement.h"
 #include "peripherals/usart.h"
 #include "sbp.h"
+#include "sbp_logger.h"
 #include "sbp_utils.h"
 #include "settings.h"
 #include "main.h"
@@ -47,6 +50,8 @@ msg_uart_state_t uart_state_msg;
 #define LATENCY_SMOOTHING 0.5
 #define PERIOD_SMOOTHING 0.5
 #define LOG_OBS_WINDOW_DURATION 3.0
+/** Text length of log messages sent while the SBP frame pool is empty. */
+#define LOG_FALLBACK_TEXT_LEN 64
 
 double latency_count;
 double latency_accum_ms;
@@ -61,10 +66,10 @@ sbp_state_t ftdi_sbp_state;
 
 static const char SBP_MODULE[] = "sbp";
 
-static u8 sbp_buffer[264];
-static u32 sbp_buffer_length;
+/** Frame being built by sbp_send_msg_(), submitted to the USARTs in place. */
+static usart_tx_buf_t *sbp_frame;
 
-static WORKING_AREA_CCM(wa_sbp_thread, 6084);
+static WORKING_AREA_SBP(wa_sbp_thread, 6084);
 static void sbp_thread(void *arg)
 {
   (void)arg;
@@ -171,17 +176,12 @@ static inline u32 use_usart(usart_settings_t *us, u16 msg_type, u16 sender_id)
   return 1;
 }
 
-static void sbp_buffer_reset(void)
-{
-  sbp_buffer_length = 0;
-}
-
-static u32 sbp_buffer_write(u8 *buff, u32 n, void *context)
+static u32 sbp_frame_write(u8 *buff, u32 n, void *context)
 {
   (void)context;
-  u32 len = MIN(sizeof(sbp_buffer) - sbp_buffer_length, n);
-  memcpy(&sbp_buffer[sbp_buffer_length], buff, len);
-  sbp_buffer_length += len;
+  u32 len = MIN(sizeof(sbp_frame->data) - sbp_frame->len, n);
+  memcpy(&sbp_frame->data[sbp_frame->len], buff, len);
+  sbp_frame->len += len;
   return len;
 }
 
@@ -200,20 +200,27 @@ u32 sbp_send_msg(u16 msg_type, u8 len, u8 buff[])
 
 u32 sbp_send_msg_(u16 msg_type, u8 len, u8 buff[], u16 sender_id)
 {
+  sbp_logger_msg(msg_type, sender_id, len, buff);
+
   static MUTEX_DECL(send_mutex);
   chMtxLock(&send_mutex);
 
   u16 ret = 0;
 
-  /* Write message into buffer */
-  sbp_buffer_reset();
+  /* Frame the message directly into a TX buffer which is shared by all of
+   * the USARTs, each of them holding a reference until it has been sent. */
+  sbp_frame = usart_tx_buf_alloc();
+  if (sbp_frame == NULL) {
+    chMtxUnlock(&send_mutex);
+    return SBP_SEND_ERROR;
+  }
   ret |= sbp_send_message(&uarta_sbp_state, msg_type, sender_id,
-                          len, buff, &sbp_buffer_write);
+                          len, buff, &sbp_frame_write);
 
   /* Don't relayed messages (sender_id 0) on the A and B UARTs. (Only FTDI USB) */
 
     if (use_usart(&uarta_usart, msg_type, sender_id) && usart_claim(&uarta_state, SBP_MODULE)) {
-      usart_write(&uarta_state, sbp_buffer, sbp_buffer_length);
+      usart_write_buf(&uarta_state, sbp_frame);
       usart_release(&uarta_state);
     }
 
@@ -222,7 +229,7 @@ u32 sbp_send_msg_(u16 msg_type, u8 len, u8 buff[], u16 sender_id)
         255 - (255 * usart_tx_n_free(&uarta_state)) / (SERIAL_BUFFERS_SIZE-1));
 
     if (use_usart(&uartb_usart, msg_type, sender_id) && usart_claim(&uartb_state, SBP_MODULE)) {
-      usart_write(&uartb_state, sbp_buffer, sbp_buffer_length);
+      usart_write_buf(&uartb_state, sbp_frame);
       usart_release(&uartb_state);
     }
 
@@ -231,7 +238,7 @@ u32 sbp_send_msg_(u16 msg_type, u8 len, u8 buff[], u16 sender_id)
         255 - (255 * usart_tx_n_free(&uartb_state)) / (SERIAL_BUFFERS_SIZE-1));
 
   if (use_usart(&ftdi_usart, msg_type, sender_id) && usart_claim(&ftdi_state, SBP_MODULE)) {
-    usart_write(&ftdi_state, sbp_buffer, sbp_buffer_length);
+    usart_write_buf(&ftdi_state, sbp_frame);
     usart_release(&ftdi_state);
   }
 
@@ -239,10 +246,33 @@ u32 sbp_send_msg_(u16 msg_type, u8 len, u8 buff[], u16 sender_id)
     MAX(uart_state_msg.uart_ftdi.tx_buffer_level,
       255 - (255 * usart_tx_n_free(&ftdi_state)) / (SERIAL_BUFFERS_SIZE-1));
 
+  usart_tx_buf_release(sbp_frame);
+  sbp_frame = NULL;
   chMtxUnlock(&send_mutex);
   return ret;
 }
 
+/** Free TX space for a message type.
+ *
+ * \param msg_type Message ID
+ *
+ * \return         Smallest number of bytes free in the TX buffers of the
+ *                 USARTs the message would be sent on.
+ */
+u32 sbp_tx_n_free(u16 msg_type)
+{
+  u32 n = SERIAL_BUFFERS_SIZE;
+
+  if (use_usart(&uarta_usart, msg_type, my_sender_id))
+    n = MIN(n, usart_tx_n_free(&uarta_state));
+  if (use_usart(&uartb_usart, msg_type, my_sender_id))
+    n = MIN(n, usart_tx_n_free(&uartb_state));
+  if (use_usart(&ftdi_usart, msg_type, my_sender_id))
+    n = MIN(n, usart_tx_n_free(&ftdi_state));
+
+  return n;
+}
+
 u32 uarta_read(u8 *buff, u32 n, void *context)
 {
   (void)context;
@@ -259,6 +289,13 @@ u32 ftdi_read(u8 *buff, u32 n, void *context)
   return usart_read(&ftdi_state, buff, n);
 }
 
+/** Pass a message completed by sbp_process() to the logger. */
+static void sbp_log_received(sbp_state_t *s, s8 ret)
+{
+  if ((ret == SBP_OK_CALLBACK_EXECUTED) || (ret == SBP_OK_CALLBACK_UNDEFINED))
+    sbp_logger_msg(s->msg_type, s->sender_id, s->msg_len, s->msg_buff);
+}
+
 /** Process SBP messages received through the USARTs.
  * This function should be called periodically to clear the USART DMA RX
  * buffers and handle the SBP callbacks in them.
@@ -274,6 +311,7 @@ void sbp_process_messages()
   if (usart_claim(&uarta_state, SBP_MODULE)) {
     while (usart_n_read(&uarta_state) > 0) {
       ret = sbp_process(&uarta_sbp_state, &uarta_read);
+      sbp_log_received(&uarta_sbp_state, ret);
       if (ret == SBP_CRC_ERROR)
         uart_state_msg.uart_a.crc_error_count++;
     }
@@ -287,6 +325,7 @@ void sbp_process_messages()
   if (usart_claim(&uartb_state, SBP_MODULE)) {
     while (usart_n_read(&uartb_state) > 0) {
       ret = sbp_process(&uartb_sbp_state, &uartb_read);
+      sbp_log_received(&uartb_sbp_state, ret);
       if (ret == SBP_CRC_ERROR)
         uart_state_msg.uart_b.crc_error_count++;
     }
@@ -300,6 +339,7 @@ void sbp_process_messages()
   if (usart_claim(&ftdi_state, SBP_MODULE)) {
     while (usart_n_read(&ftdi_state) > 0) {
       ret = sbp_process(&ftdi_sbp_state, &ftdi_read);
+      sbp_log_received(&ftdi_sbp_state, ret);
       if (ret == SBP_CRC_ERROR)
         uart_state_msg.uart_ftdi.crc_error_count++;
     }
@@ -335,24 +375,54 @@ int _write(int file, char *ptr, int len)
   }
 }
 
-/** Directs log_ output to the SBP log message */
-void log_(u8 level, const char *msg, ...)
+/** Format a log message into log and send it.
+ *
+ * \param log      Message buffer.
+ * \param text_len Room for the text in the buffer, longer messages are
+ *                 truncated.
+ */
+static void log_send(msg_log_t *log, u8 text_len, const char *msg, va_list ap)
 {
-  msg_log_t *log;
-  va_list ap;
-  char buf[SBP_FRAMING_MAX_PAYLOAD_SIZE];
+  int n = vsnprintf(log->text, text_len, msg, ap);
+  if (n < 0)
+    return;
 
-  log = (msg_log_t *)buf;
+  /* vsnprintf returns the length before truncation. */
+  n = MIN(n, text_len - 1);
+  sbp_send_msg(SBP_MSG_LOG, n+sizeof(msg_log_t), (u8 *)log);
+}
+
+/** Send a log message from a truncated copy on the stack. Out of line so the
+ * buffer only takes stack while the frame pool is empty. */
+static void __attribute__((noinline))
+log_fallback(u8 level, const char *msg, va_list ap)
+{
+  u8 buf[sizeof(msg_log_t) + LOG_FALLBACK_TEXT_LEN];
+  msg_log_t *log = (msg_log_t *)buf;
   log->level = level;
+  log_send(log, LOG_FALLBACK_TEXT_LEN, msg, ap);
+}
 
+/** Directs log_ output to the SBP log message */
+void log_(u8 level, const char *msg, ...)
+{
+  va_list ap;
   va_start(ap, msg);
-  int n = vsnprintf(log->text, SBP_FRAMING_MAX_PAYLOAD_SIZE-sizeof(msg_log_t), msg, ap);
-  va_end(ap);
 
-  if (n < 0)
-    return;
+  /* log_ is called from every thread, so the full size buffer comes from
+   * the frame pool rather than the stack. When concurrent loggers have
+   * emptied the pool the message is still sent, truncated. */
+  u8 *buf = sbp_frame_alloc();
+  if (buf == NULL) {
+    log_fallback(level, msg, ap);
+  } else {
+    msg_log_t *log = (msg_log_t *)buf;
+    log->level = level;
+    log_send(log, SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(msg_log_t), msg, ap);
+    sbp_frame_free(buf);
+  }
 
-  sbp_send_msg(SBP_MSG_LOG, n+sizeof(msg_log_t), (u8 *)buf);
+  va_end(ap);
 }
 
 void log_obs_latency(float latency_ms)
@@ -24,6 +24,10 @@
 
 #include "peripherals/usart.h"
 
+/** Bytes added to a message payload by SBP framing: preamble, message type,
+ * sender ID, length and CRC. */
+#define SBP_FRAMING_OVERHEAD 8
+
 void log_obs_latency(float latency_ms);
 void log_obs_latency_tick();
 
@@ -32,6 +36,7 @@ void sbp_register_cbk(u16 msg_type, sbp_msg_callback_t cb, sbp_msg_callbacks_nod
 void sbp_disable(void);
 u32 sbp_send_msg(u16 msg_type, u8 len, u8 buff[]);
 u32 sbp_send_msg_(u16 msg_type, u8 len, u8 buff[], u16 sender_id);
+u32 sbp_tx_n_free(u16 msg_type);
 void sbp_process_messages(void);
 
 #endif
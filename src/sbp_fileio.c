@@ -12,26 +12,88 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <alloca.h>
+
+#include <ch.h>
 
 #include <libsbp/file_io.h>
 #include <libswiftnav/logging.h>
 
+#include "block_pool.h"
 #include "sbp.h"
 #include "sbp_fileio.h"
 #include "sbp_utils.h"
 #include "cfs/cfs.h"
+#include "mem_placement.h"
+
+/** Number of files that can be kept open between requests. */
+#define FILEIO_MAX_TRANSFERS      2
+/** Longest filename of a cached transfer, including the terminator. */
+#define FILEIO_FILENAME_MAX       32
+/** Bytes read from flash at once for a read transfer. */
+#define FILEIO_READAHEAD_SIZE     1024
+/** Number of outstanding read requests that are queued. */
+#define FILEIO_WINDOW_SIZE        16
+/** Transfers idle for this long are closed. */
+#define FILEIO_IDLE_TIMEOUT_ms    5000
+/** Poll period while waiting for TX space. */
+#define FILEIO_TX_POLL_ms         5
+/** Longest wait for TX space before sending regardless. */
+#define FILEIO_TX_WAIT_ms         1000
+
+/** A file kept open between the requests of a transfer. */
+typedef struct {
+  char filename[FILEIO_FILENAME_MAX];
+  int fd;                 /**< Coffee file descriptor, -1 when unused. */
+  int mode;               /**< CFS_READ or CFS_WRITE. */
+  u32 pos;                /**< Current position of fd. */
+  systime_t last_used;    /**< Time of the last request. */
+  u32 ra_offset;          /**< File offset of the read-ahead buffer. */
+  u32 ra_len;             /**< Number of valid bytes in ra. */
+  bool ra_eof;            /**< The read-ahead buffer reaches the file end. */
+  u8 ra[FILEIO_READAHEAD_SIZE];
+} fileio_transfer_t;
+
+/** An outstanding read request. */
+typedef struct {
+  fileio_transfer_t *t;   /**< Transfer, NULL if it was closed. */
+  u32 sequence;
+  u32 offset;
+  u8 chunk_size;
+} fileio_read_req_t;
+
+static fileio_transfer_t transfers[FILEIO_MAX_TRANSFERS];
+
+/** Window of read requests waiting to be answered, oldest first. */
+static struct {
+  fileio_read_req_t req[FILEIO_WINDOW_SIZE];
+  u32 rd;
+  u32 wr;
+} window;
 
+/** Protects transfers, window and the calls into Coffee. */
+static MUTEX_DECL(fileio_mutex);
+static BSEMAPHORE_DECL(window_pending, TRUE);
+
+static WORKING_AREA_SBP(wa_fileio_thread, 1500);
+
+static void fileio_thread(void *arg);
 static void read_cb(u16 sender_id, u8 len, u8 msg[], void* context);
 static void read_dir_cb(u16 sender_id, u8 len, u8 msg[], void* context);
 static void remove_cb(u16 sender_id, u8 len, u8 msg[], void* context);
 static void write_cb(u16 sender_id, u8 len, u8 msg[], void* context);
 
 /** Setup file IO
- * Registers relevant SBP callbacks for file IO operations.
+ * Registers relevant SBP callbacks for file IO operations and starts the
+ * thread answering read requests.
  */
 void sbp_fileio_setup(void)
 {
+  for (u32 i = 0; i < FILEIO_MAX_TRANSFERS; i++)
+    transfers[i].fd = -1;
+
+  chThdCreateStatic(wa_fileio_thread, sizeof(wa_fileio_thread),
+                    NORMALPRIO-2, fileio_thread, NULL);
+
   static sbp_msg_callbacks_node_t read_node;
   sbp_register_cbk(
     SBP_MSG_FILEIO_READ_REQ,
@@ -58,12 +120,259 @@ void sbp_fileio_setup(void)
   );
 }
 
+/* The functions below must be called with fileio_mutex held. */
+
+/** Close a transfer and forget the read requests queued on it. */
+static void transfer_close(fileio_transfer_t *t)
+{
+  if (t->fd < 0)
+    return;
+
+  cfs_close(t->fd);
+  t->fd = -1;
+
+  for (u32 i = window.rd; i != window.wr; i++) {
+    if (window.req[i % FILEIO_WINDOW_SIZE].t == t)
+      window.req[i % FILEIO_WINDOW_SIZE].t = NULL;
+  }
+}
+
+/** Close all transfers of a file. */
+static void transfer_close_file(const char *filename)
+{
+  for (u32 i = 0; i < FILEIO_MAX_TRANSFERS; i++) {
+    if ((transfers[i].fd >= 0) &&
+        (strcmp(transfers[i].filename, filename) == 0))
+      transfer_close(&transfers[i]);
+  }
+}
+
+/** Find the open transfer of a file, or open one.
+ *
+ * A file is only open in one mode at a time. When all transfers are in use
+ * the least recently used one is closed.
+ *
+ * \param filename Name of the file.
+ * \param mode     CFS_READ or CFS_WRITE.
+ * \return Transfer, or NULL if the file can't be opened.
+ */
+static fileio_transfer_t *transfer_get(const char *filename, int mode)
+{
+  fileio_transfer_t *t = NULL;
+
+  if (strlen(filename) >= FILEIO_FILENAME_MAX)
+    return NULL;
+
+  for (u32 i = 0; i < FILEIO_MAX_TRANSFERS; i++) {
+    fileio_transfer_t *u = &transfers[i];
+    if ((u->fd < 0) || (strcmp(u->filename, filename) != 0))
+      continue;
+    if (u->mode == mode)
+      t = u;
+    else
+      transfer_close(u);
+  }
+
+  if (t == NULL) {
+    t = &transfers[0];
+    for (u32 i = 0; i < FILEIO_MAX_TRANSFERS; i++) {
+      fileio_transfer_t *u = &transfers[i];
+      if (u->fd < 0) {
+        t = u;
+        break;
+      }
+      if ((s32)(u->last_used - t->last_used) < 0)
+        t = u;
+    }
+    transfer_close(t);
+
+    int fd = cfs_open(filename, mode);
+    if (fd < 0)
+      return NULL;
+    strcpy(t->filename, filename);
+    t->fd = fd;
+    t->mode = mode;
+    t->pos = 0;
+    t->ra_offset = 0;
+    t->ra_len = 0;
+    t->ra_eof = false;
+  }
+
+  t->last_used = chVTGetSystemTime();
+  return t;
+}
+
+/** Move the file position of a transfer. */
+static bool transfer_seek(fileio_transfer_t *t, u32 offset)
+{
+  if (t->pos == offset)
+    return true;
+
+  if (cfs_seek(t->fd, offset, CFS_SEEK_SET) != (cfs_offset_t)offset) {
+    /* Position unknown, force a seek next time. */
+    t->pos = (u32)-1;
+    return false;
+  }
+  t->pos = offset;
+  return true;
+}
+
+/** Read from a transfer through its read-ahead buffer.
+ *
+ * Sequential and retransmitted requests within the buffer are answered
+ * without accessing the flash.
+ *
+ * \return Number of bytes read.
+ */
+static u32 transfer_read(fileio_transfer_t *t, u32 offset, u8 *data, u32 len)
+{
+  u32 ra_end = t->ra_offset + t->ra_len;
+  bool hit = (offset >= t->ra_offset) &&
+             ((offset + len <= ra_end) || (t->ra_eof && (offset <= ra_end)));
+
+  if (!hit) {
+    t->ra_offset = offset;
+    t->ra_len = 0;
+    t->ra_eof = true;
+    if (!transfer_seek(t, offset))
+      return 0;
+    int n = cfs_read(t->fd, t->ra, FILEIO_READAHEAD_SIZE);
+    if (n < 0)
+      n = 0;
+    t->pos += n;
+    t->ra_len = n;
+    t->ra_eof = (n < FILEIO_READAHEAD_SIZE);
+    ra_end = t->ra_offset + t->ra_len;
+  }
+
+  len = MIN(len, ra_end - offset);
+  memcpy(data, &t->ra[offset - t->ra_offset], len);
+  return len;
+}
+
+/** Close transfers that have not been used recently. */
+static void transfers_close_idle(void)
+{
+  for (u32 i = 0; i < FILEIO_MAX_TRANSFERS; i++) {
+    if ((transfers[i].fd >= 0) &&
+        (chVTTimeElapsedSinceX(transfers[i].last_used) >=
+         MS2ST(FILEIO_IDLE_TIMEOUT_ms)))
+      transfer_close(&transfers[i]);
+  }
+}
+
+/** Take the file IO lock.
+ * Coffee is not re-entrant, so every module accessing the file system
+ * (settings, position, SBP logger) must hold it, serializing their accesses
+ * with each other and with those made on behalf of the host.
+ */
+void sbp_fileio_lock(void)
+{
+  chMtxLock(&fileio_mutex);
+}
+
+/** Release the file IO lock. */
+void sbp_fileio_unlock(void)
+{
+  chMtxUnlock(&fileio_mutex);
+}
+
+/** Remove a file, closing any transfer that has it open.
+ * To be called with the file IO lock held.
+ */
+void sbp_fileio_remove(const char *filename)
+{
+  transfer_close_file(filename);
+  cfs_remove(filename);
+}
+
+/** Drop the read-ahead of any transfer reading a file, so that the host is
+ * answered with what was written to it rather than with stale data or an
+ * early end of file. To be called with the file IO lock held, after writing
+ * to the file.
+ */
+void sbp_fileio_invalidate(const char *filename)
+{
+  for (u32 i = 0; i < FILEIO_MAX_TRANSFERS; i++) {
+    fileio_transfer_t *t = &transfers[i];
+    if ((t->fd >= 0) && (strcmp(t->filename, filename) == 0)) {
+      t->ra_offset = 0;
+      t->ra_len = 0;
+      t->ra_eof = false;
+    }
+  }
+}
+
+/** Wait until a message of the given length can be sent without being
+ * dropped, so that a window of responses is paced by the link bandwidth. */
+static void wait_tx_space(u16 msg_type, u32 len)
+{
+  systime_t start = chVTGetSystemTime();
+  while ((sbp_tx_n_free(msg_type) < len + SBP_FRAMING_OVERHEAD) &&
+         (chVTTimeElapsedSinceX(start) < MS2ST(FILEIO_TX_WAIT_ms)))
+    chThdSleepMilliseconds(FILEIO_TX_POLL_ms);
+}
+
+/** Answers the queued read requests in order. */
+static void fileio_thread(void *arg)
+{
+  (void)arg;
+  chRegSetThreadName("fileio");
+
+  u8 buf[SBP_FRAMING_MAX_PAYLOAD_SIZE];
+  msg_fileio_read_resp_t *reply = (msg_fileio_read_resp_t *)buf;
+
+  while (TRUE) {
+    chBSemWaitTimeout(&window_pending, MS2ST(FILEIO_IDLE_TIMEOUT_ms));
+
+    while (TRUE) {
+      chMtxLock(&fileio_mutex);
+      if (window.rd == window.wr) {
+        transfers_close_idle();
+        chMtxUnlock(&fileio_mutex);
+        break;
+      }
+      fileio_read_req_t req = window.req[window.rd % FILEIO_WINDOW_SIZE];
+      chMtxUnlock(&fileio_mutex);
+
+      u8 readlen = MIN(req.chunk_size,
+                       SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(*reply));
+      wait_tx_space(SBP_MSG_FILEIO_READ_RESP, sizeof(*reply) + readlen);
+
+      chMtxLock(&fileio_mutex);
+      /* The request stays in the window until answered so that duplicates
+       * arriving meanwhile are recognised. */
+      window.rd++;
+      if (req.t == NULL) {
+        /* Transfer closed while queued, the host will retransmit. */
+        chMtxUnlock(&fileio_mutex);
+        continue;
+      }
+      reply->sequence = req.sequence;
+      readlen = transfer_read(req.t, req.offset, reply->contents, readlen);
+      req.t->last_used = chVTGetSystemTime();
+      chMtxUnlock(&fileio_mutex);
+
+      sbp_send_msg(SBP_MSG_FILEIO_READ_RESP,
+                   sizeof(*reply) + readlen, (u8*)reply);
+    }
+  }
+}
+
 /** File read callback.
  * Responds to a SBP_MSG_FILEIO_READ_REQ message.
  *
  * Reads a certain length (up to 255 bytes) from a given offset. Returns the
  * data in a SBP_MSG_FILEIO_READ_RESP message where the message length field
  * indicates how many bytes were succesfully read.
+ *
+ * Requests are queued and answered in order by the fileio thread, so the
+ * host can keep a window of up to FILEIO_WINDOW_SIZE requests with distinct
+ * sequence numbers outstanding. Responses are paced by the free space in the
+ * TX buffers rather than dropped. A request whose response was lost is
+ * simply sent again and is normally answered from the read-ahead buffer.
+ * Duplicates of requests still queued are ignored, as are requests arriving
+ * while the window is full.
  */
 static void read_cb(u16 sender_id, u8 len, u8 msg_[], void* context)
 {
@@ -83,17 +392,35 @@ static void read_cb(u16 sender_id, u8 len, u8 msg_[], void* context)
   /* Add a null termination to filename */
   msg_[len] = 0;
 
-  msg_fileio_read_resp_t *reply;
-  u8 readlen = MIN(msg->chunk_size, SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(*reply));
-  reply = alloca(sizeof(msg_fileio_read_resp_t) + readlen);
-  reply->sequence = msg->sequence;
-  int f = cfs_open(msg->filename, CFS_READ);
-  cfs_seek(f, msg->offset, CFS_SEEK_SET);
-  readlen = cfs_read(f, &reply->contents, readlen);
-  cfs_close(f);
+  chMtxLock(&fileio_mutex);
+  fileio_transfer_t *t = transfer_get(msg->filename, CFS_READ);
+  if (t == NULL) {
+    chMtxUnlock(&fileio_mutex);
+    /* Reply with no data. */
+    msg_fileio_read_resp_t reply = {.sequence = msg->sequence};
+    sbp_send_msg(SBP_MSG_FILEIO_READ_RESP, sizeof(reply), (u8*)&reply);
+    return;
+  }
 
-  sbp_send_msg(SBP_MSG_FILEIO_READ_RESP,
-               sizeof(*reply) + readlen, (u8*)reply);
+  bool queue = (window.wr - window.rd) < FILEIO_WINDOW_SIZE;
+  for (u32 i = window.rd; queue && (i != window.wr); i++) {
+    fileio_read_req_t *r = &window.req[i % FILEIO_WINDOW_SIZE];
+    if ((r->t == t) && (r->sequence == msg->sequence))
+      queue = false;
+  }
+  if (queue) {
+    window.req[window.wr % FILEIO_WINDOW_SIZE] = (fileio_read_req_t) {
+      .t = t,
+      .sequence = msg->sequence,
+      .offset = msg->offset,
+      .chunk_size = msg->chunk_size,
+    };
+    window.wr++;
+  }
+  chMtxUnlock(&fileio_mutex);
+
+  if (queue)
+    chBSemSignal(&window_pending);
 }
 
 /** Directory listing callback.
@@ -128,8 +455,14 @@ static void read_dir_cb(u16 sender_id, u8 len, u8 msg_[], void* context)
   struct cfs_dir dir;
   struct cfs_dirent dirent;
   u32 offset = msg->offset;
-  msg_fileio_read_dir_resp_t *reply = alloca(SBP_FRAMING_MAX_PAYLOAD_SIZE);
+  msg_fileio_read_dir_resp_t *reply =
+    (msg_fileio_read_dir_resp_t *)sbp_frame_alloc();
+  if (reply == NULL) {
+    log_error("No buffer for fileio read dir reply!");
+    return;
+  }
   reply->sequence = msg->sequence;
+  chMtxLock(&fileio_mutex);
   cfs_opendir(&dir, msg->dirname);
   while (offset && (cfs_readdir(&dir, &dirent) == 0))
     offset--;
@@ -144,9 +477,11 @@ static void read_dir_cb(u16 sender_id, u8 len, u8 msg_[], void* context)
   }
 
   cfs_closedir(&dir);
+  chMtxUnlock(&fileio_mutex);
 
   sbp_send_msg(SBP_MSG_FILEIO_READ_DIR_RESP,
                sizeof(*reply) + len, (u8*)reply);
+  sbp_frame_free((u8 *)reply);
 }
 
 /* Remove file callback.
@@ -169,7 +504,9 @@ static void remove_cb(u16 sender_id, u8 len, u8 msg[], void* context)
   /* Add a null termination to filename */
   msg[len] = 0;
 
-  cfs_remove((char*)msg);
+  chMtxLock(&fileio_mutex);
+  sbp_fileio_remove((char*)msg);
+  chMtxUnlock(&fileio_mutex);
 }
 
 /* Write to file callback.
@@ -178,6 +515,9 @@ static void remove_cb(u16 sender_id, u8 len, u8 msg[], void* context)
  * Writes a certain length (up to 255 bytes) at a given offset. Returns a copy
  * of the original SBP_MSG_FILEIO_WRITE_RESP message to check integrity of
  * the write.
+ *
+ * The file is kept open between requests, so consecutive chunks are written
+ * without reopening the file or seeking.
  */
 static void write_cb(u16 sender_id, u8 len, u8 msg_[], void* context)
 {
@@ -197,10 +537,16 @@ static void write_cb(u16 sender_id, u8 len, u8 msg_[], void* context)
   }
 
   u8 headerlen = sizeof(*msg) + strlen(msg->filename) + 1;
-  int f = cfs_open(msg->filename, CFS_WRITE);
-  cfs_seek(f, msg->offset, CFS_SEEK_SET);
-  cfs_write(f, msg_ + headerlen, len - headerlen);
-  cfs_close(f);
+  chMtxLock(&fileio_mutex);
+  fileio_transfer_t *t = transfer_get(msg->filename, CFS_WRITE);
+  if ((t != NULL) && transfer_seek(t, msg->offset)) {
+    int n = cfs_write(t->fd, msg_ + headerlen, len - headerlen);
+    if (n > 0)
+      t->pos += n;
+    else
+      t->pos = (u32)-1;
+  }
+  chMtxUnlock(&fileio_mutex);
 
   msg_fileio_write_resp_t reply = {.sequence = msg->sequence};
   sbp_send_msg(SBP_MSG_FILEIO_WRITE_RESP, sizeof(reply), (u8*)&reply);
@@ -14,6 +14,10 @@
 #define SWIFTNAV_SBP_FILEIO_H
 
 void sbp_fileio_setup(void);
+void sbp_fileio_lock(void);
+void sbp_fileio_unlock(void);
+void sbp_fileio_remove(const char *filename);
+void sbp_fileio_invalidate(const char *filename);
 
 #endif
 
@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ch.h>
+
+#include <libsbp/logging.h>
+#include <libsbp/navigation.h>
+#include <libsbp/observation.h>
+#include <libswiftnav/logging.h>
+
+#include "sbp.h"
+#include "sbp_fileio.h"
+#include "sbp_logger.h"
+#include "settings.h"
+#include "timing.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs/cfs.h"
+#include "cfs-coffee-arch.h"
+#include "mem_placement.h"
+
+/** \defgroup sbp_logger SBP logger
+ * Record selected SBP messages sent and received by the device to flash.
+ *
+ * Messages are framed as on the wire and appended, a flash page at a time,
+ * to SBP_LOGGER_N_FILES pre-allocated Coffee files named "sbplog0",
+ * "sbplog1", ... When the current file is full the oldest one is replaced.
+ * The index file "sbplidx" holds a sbp_logger_index_t for each log file, so
+ * that the host can find the files covering a time range and fetch them
+ * with the SBP file IO messages. Flash accesses are made with
+ * sbp_fileio_lock() held.
+ * \{ */
+
+#define LOGGER_INDEX_FILE       "sbplidx"
+#define LOGGER_FILE_NAME_FMT    "sbplog%u"
+
+#define LOGGER_PAGE_SIZE        COFFEE_PAGE_SIZE
+/** Size of the buffer between the message senders and the flash writes. */
+#define LOGGER_BUFFER_PAGES     16
+#define LOGGER_BUFFER_SIZE      (LOGGER_BUFFER_PAGES * LOGGER_PAGE_SIZE)
+/** Smallest usable log file. */
+#define LOGGER_MIN_FILE_PAGES   16
+/** Period at which the index file is updated while logging. */
+#define LOGGER_INDEX_PERIOD_ms  30000
+/** Period at which the settings are checked when no data is pending. */
+#define LOGGER_POLL_ms          1000
+
+#define LOGGER_GROUP_OBS        (1 << 0)
+#define LOGGER_GROUP_SOLUTION   (1 << 1)
+#define LOGGER_GROUP_LOG        (1 << 2)
+
+/** Message types that can be logged and the group selecting them. */
+static const struct {
+  u16 msg_type;
+  u8 group;
+} logger_msgs[] = {
+  {SBP_MSG_OBS,             LOGGER_GROUP_OBS},
+  {SBP_MSG_BASE_POS_LLH,    LOGGER_GROUP_OBS},
+  {SBP_MSG_BASE_POS_ECEF,   LOGGER_GROUP_OBS},
+  {SBP_MSG_EPHEMERIS,       LOGGER_GROUP_OBS},
+  {SBP_MSG_GPS_TIME,        LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_POS_LLH,         LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_POS_ECEF,        LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_VEL_NED,         LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_VEL_ECEF,        LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_DOPS,            LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_BASELINE_NED,    LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_BASELINE_ECEF,   LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_BASELINE_HEADING, LOGGER_GROUP_SOLUTION},
+  {SBP_MSG_LOG,             LOGGER_GROUP_LOG},
+};
+
+static bool logger_enabled = false;
+static bool logger_obs = true;
+static bool logger_solution = true;
+static bool logger_log = false;
+
+/** Groups being logged, 0 when the logger is stopped. */
+static volatile u8 logger_groups;
+
+/** Framed messages waiting to be written. rd is always at a page boundary
+ * while logging. */
+static struct {
+  u8 buf[LOGGER_BUFFER_SIZE];
+  u32 rd;
+  u32 wr;
+  u32 dropped;        /**< Messages dropped because the buffer was full. */
+} ring;
+
+static MUTEX_DECL(ring_mutex);
+static BSEMAPHORE_DECL(page_ready, TRUE);
+static sbp_state_t logger_sbp_state;
+
+static sbp_logger_index_t logger_index[SBP_LOGGER_N_FILES];
+static bool index_dirty;
+static int log_fd = -1;
+static u32 log_file;
+static u32 log_file_size;
+
+static WORKING_AREA_SBP(wa_logger_thread, 1500);
+
+static u8 msg_group(u16 msg_type)
+{
+  for (u32 i = 0; i < sizeof(logger_msgs) / sizeof(logger_msgs[0]); i++) {
+    if (logger_msgs[i].msg_type == msg_type)
+      return logger_msgs[i].group;
+  }
+  return 0;
+}
+
+/* Called with ring_mutex held, space has been checked. */
+static u32 ring_write(u8 *buff, u32 n, void *context)
+{
+  (void)context;
+  for (u32 i = 0; i < n; i++)
+    ring.buf[(ring.wr + i) % LOGGER_BUFFER_SIZE] = buff[i];
+  ring.wr += n;
+  return n;
+}
+
+/** Log a message if its type is selected.
+ * Called for every message sent and received over SBP. The message is
+ * framed into a RAM buffer, the flash is written by the logger thread.
+ *
+ * \param msg_type  Message ID
+ * \param sender_id Sender ID
+ * \param len       Length of message data
+ * \param payload   Message data
+ */
+void sbp_logger_msg(u16 msg_type, u16 sender_id, u8 len, const u8 payload[])
+{
+  if ((msg_group(msg_type) & logger_groups) == 0)
+    return;
+
+  chMtxLock(&ring_mutex);
+  if (LOGGER_BUFFER_SIZE - (ring.wr - ring.rd) <
+      (u32)len + SBP_FRAMING_OVERHEAD) {
+    ring.dropped++;
+    chMtxUnlock(&ring_mutex);
+    return;
+  }
+  u32 page = ring.wr / LOGGER_PAGE_SIZE;
+  sbp_send_message(&logger_sbp_state, msg_type, sender_id, len,
+                   (u8 *)payload, &ring_write);
+  bool page_full = (ring.wr / LOGGER_PAGE_SIZE) != page;
+  chMtxUnlock(&ring_mutex);
+
+  if (page_full)
+    chBSemSignal(&page_ready);
+}
+
+static void file_name(char *name, u32 i)
+{
+  sprintf(name, LOGGER_FILE_NAME_FMT, (unsigned int)i);
+}
+
+/* The file functions below must be called with the file IO lock held. */
+
+static void index_read(void)
+{
+  int fd = cfs_open(LOGGER_INDEX_FILE, CFS_READ);
+  if (fd >= 0) {
+    int n = cfs_read(fd, logger_index, sizeof(logger_index));
+    cfs_close(fd);
+    if (n == sizeof(logger_index))
+      return;
+  }
+
+  memset(logger_index, 0, sizeof(logger_index));
+  if (fd < 0) {
+    cfs_coffee_reserve(LOGGER_INDEX_FILE, sizeof(logger_index));
+    cfs_coffee_configure_log(LOGGER_INDEX_FILE, LOGGER_PAGE_SIZE,
+                             sizeof(logger_index));
+  }
+}
+
+static bool index_write(void)
+{
+  int fd = cfs_open(LOGGER_INDEX_FILE, CFS_WRITE);
+  if (fd < 0)
+    return false;
+  int n = cfs_write(fd, logger_index, sizeof(logger_index));
+  cfs_close(fd);
+  sbp_fileio_invalidate(LOGGER_INDEX_FILE);
+  index_dirty = false;
+  return n == sizeof(logger_index);
+}
+
+/** Replace the oldest log file with an empty one and make it current. */
+static bool file_rotate(void)
+{
+  u32 generation = 0;
+  u32 next = 0;
+  for (u32 i = 0; i < SBP_LOGGER_N_FILES; i++) {
+    if (logger_index[i].generation > generation) {
+      generation = logger_index[i].generation;
+      next = (i + 1) % SBP_LOGGER_N_FILES;
+    }
+  }
+
+  if (log_fd >= 0) {
+    cfs_close(log_fd);
+    log_fd = -1;
+  }
+
+  char name[16];
+  file_name(name, next);
+  sbp_fileio_remove(name);
+  if (cfs_coffee_reserve(name, log_file_size) == 0)
+    log_fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+
+  logger_index[next] = (sbp_logger_index_t) {
+    .generation = generation + 1,
+    .length = 0,
+    .start_wn = SBP_LOGGER_WN_UNKNOWN,
+    .end_wn = SBP_LOGGER_WN_UNKNOWN,
+  };
+  log_file = next;
+  index_write();
+
+  return log_fd >= 0;
+}
+
+/** Reopen the newest log file, or start one. */
+static bool file_resume(void)
+{
+  index_read();
+
+  u32 generation = 0;
+  for (u32 i = 0; i < SBP_LOGGER_N_FILES; i++) {
+    if (logger_index[i].generation > generation) {
+      generation = logger_index[i].generation;
+      log_file = i;
+    }
+  }
+
+  if (generation > 0) {
+    char name[16];
+    file_name(name, log_file);
+    log_fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+    if (log_fd >= 0) {
+      /* The index may be behind the file. */
+      cfs_offset_t end = cfs_seek(log_fd, 0, CFS_SEEK_END);
+      if (end != (cfs_offset_t)-1)
+        logger_index[log_file].length = end;
+      return true;
+    }
+  }
+
+  return file_rotate();
+}
+
+static void index_update_time(sbp_logger_index_t *e)
+{
+  if (time_quality == TIME_UNKNOWN)
+    return;
+
+  gps_time_t t = get_current_time();
+  if (e->start_wn == SBP_LOGGER_WN_UNKNOWN) {
+    e->start_wn = t.wn;
+    e->start_tow_ms = (u32)(t.tow * 1000.0);
+  }
+  e->end_wn = t.wn;
+  e->end_tow_ms = (u32)(t.tow * 1000.0);
+}
+
+/** Append data to the current log file, rotating when it is full. */
+static bool file_append(const u8 *data, u32 len)
+{
+  bool ok = true;
+
+  sbp_fileio_lock();
+  if (logger_index[log_file].length + len > log_file_size)
+    ok = file_rotate();
+
+  if (ok) {
+    int n = cfs_write(log_fd, data, len);
+    if (n > 0) {
+      logger_index[log_file].length += n;
+      char name[16];
+      file_name(name, log_file);
+      sbp_fileio_invalidate(name);
+    }
+    index_update_time(&logger_index[log_file]);
+    index_dirty = true;
+    /* Start a new file rather than keep writing to a bad one. */
+    if (n != (int)len) {
+      file_rotate();
+      ok = false;
+    }
+  }
+  sbp_fileio_unlock();
+
+  return ok;
+}
+
+/** Write the complete pages in the buffer to flash. */
+static void write_pages(void)
+{
+  while (TRUE) {
+    chMtxLock(&ring_mutex);
+    u32 n = ring.wr - ring.rd;
+    u32 rd = ring.rd;
+    chMtxUnlock(&ring_mutex);
+
+    if (n < LOGGER_PAGE_SIZE)
+      break;
+
+    /* The page stays in the buffer until written, senders only append after
+     * ring.wr so it can be read without the lock. */
+    if (!file_append(&ring.buf[rd % LOGGER_BUFFER_SIZE], LOGGER_PAGE_SIZE))
+      log_error("SBP logger: error writing to flash");
+
+    chMtxLock(&ring_mutex);
+    ring.rd += LOGGER_PAGE_SIZE;
+    chMtxUnlock(&ring_mutex);
+  }
+}
+
+static bool logger_start(void)
+{
+  log_file_size = (COFFEE_SIZE / 2 / SBP_LOGGER_N_FILES) / LOGGER_PAGE_SIZE *
+                  LOGGER_PAGE_SIZE;
+  if (log_file_size < LOGGER_MIN_FILE_PAGES * LOGGER_PAGE_SIZE) {
+    log_error("SBP logger: not enough flash");
+    return false;
+  }
+
+  sbp_fileio_lock();
+  bool ok = file_resume();
+  sbp_fileio_unlock();
+
+  if (!ok) {
+    log_error("SBP logger: could not open log file");
+    return false;
+  }
+
+  log_info("SBP logger: logging to " LOGGER_FILE_NAME_FMT,
+           (unsigned int)log_file);
+  return true;
+}
+
+static void logger_stop(void)
+{
+  logger_groups = 0;
+  write_pages();
+
+  /* Write the last partial page, it lies within one page of the buffer. */
+  chMtxLock(&ring_mutex);
+  u32 n = ring.wr - ring.rd;
+  u32 rd = ring.rd;
+  chMtxUnlock(&ring_mutex);
+  if (n > 0)
+    file_append(&ring.buf[rd % LOGGER_BUFFER_SIZE], n);
+
+  chMtxLock(&ring_mutex);
+  ring.rd = ring.wr = 0;
+  chMtxUnlock(&ring_mutex);
+
+  sbp_fileio_lock();
+  if (log_fd >= 0) {
+    cfs_close(log_fd);
+    log_fd = -1;
+  }
+  index_write();
+  sbp_fileio_unlock();
+}
+
+static void logger_thread(void *arg)
+{
+  (void)arg;
+  chRegSetThreadName("logger");
+
+  bool running = false;
+  systime_t index_time = chVTGetSystemTime();
+  u32 dropped = 0;
+
+  while (TRUE) {
+    chBSemWaitTimeout(&page_ready, MS2ST(LOGGER_POLL_ms));
+
+    if (logger_enabled && !running) {
+      running = logger_start();
+      if (!running)
+        logger_enabled = false;
+      index_time = chVTGetSystemTime();
+    } else if (!logger_enabled && running) {
+      logger_stop();
+      running = false;
+    }
+
+    if (!running)
+      continue;
+
+    logger_groups = (logger_obs ? LOGGER_GROUP_OBS : 0) |
+                    (logger_solution ? LOGGER_GROUP_SOLUTION : 0) |
+                    (logger_log ? LOGGER_GROUP_LOG : 0);
+
+    write_pages();
+
+    if (chVTTimeElapsedSinceX(index_time) >= MS2ST(LOGGER_INDEX_PERIOD_ms)) {
+      index_time = chVTGetSystemTime();
+      if (index_dirty) {
+        sbp_fileio_lock();
+        index_write();
+        sbp_fileio_unlock();
+      }
+      if (ring.dropped != dropped) {
+        log_warn("SBP logger: %u messages dropped",
+                 (unsigned int)(ring.dropped - dropped));
+        dropped = ring.dropped;
+      }
+    }
+  }
+}
+
+/** Register the logger settings and start the logger thread. */
+void sbp_logger_setup(void)
+{
+  sbp_state_init(&logger_sbp_state);
+
+  SETTING("logger", "enable", logger_enabled, TYPE_BOOL);
+  SETTING("logger", "observations", logger_obs, TYPE_BOOL);
+  SETTING("logger", "solution", logger_solution, TYPE_BOOL);
+  SETTING("logger", "log", logger_log, TYPE_BOOL);
+
+  chThdCreateStatic(wa_logger_thread, sizeof(wa_logger_thread),
+                    NORMALPRIO-3, logger_thread, NULL);
+}
+
+/** \} */
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_SBP_LOGGER_H
+#define SWIFTNAV_SBP_LOGGER_H
+
+#include <libswiftnav/common.h>
+
+/** \addtogroup sbp_logger
+ * \{ */
+
+/** Number of log files in rotation. */
+#define SBP_LOGGER_N_FILES 4
+
+/** Entry of the log index file, one per log file.
+ *
+ * The index file holds SBP_LOGGER_N_FILES entries, entry i describing the
+ * log file named "sbplog<i>". Times are GPS times of the first and last
+ * pages written to the file, the week number is SBP_LOGGER_WN_UNKNOWN while
+ * no time was known. */
+typedef struct __attribute__((packed)) {
+  u32 generation;     /**< Increments with each new file, 0 if unused. */
+  u32 length;         /**< Bytes written to the file. */
+  u16 start_wn;       /**< Week number of the first page. */
+  u32 start_tow_ms;   /**< Time of week of the first page. */
+  u16 end_wn;         /**< Week number of the last page. */
+  u32 end_tow_ms;     /**< Time of week of the last page. */
+} sbp_logger_index_t;
+
+#define SBP_LOGGER_WN_UNKNOWN 0xFFFF
+
+/** \} */
+
+void sbp_logger_setup(void);
+void sbp_logger_msg(u16 msg_type, u16 sender_id, u8 len, const u8 payload[]);
+
+#endif  /* SWIFTNAV_SBP_LOGGER_H */
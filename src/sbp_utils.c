@@ -157,25 +157,34 @@ void sbp_make_dops(msg_dops_t *dops_out, const dops_t *dops_in, const gps_time_t
   dops_out->vdop = round(dops_in->vdop * 100);
 }
 
+/** Convert an accuracy in metres to the millimetres of the SBP messages,
+ * saturating at the field limit. */
+static u16 sbp_accuracy_mm(double accuracy)
+{
+  return (u16)round(MIN(MAX(accuracy, 0) * 1e3, UINT16_MAX));
+}
+
 void sbp_make_baseline_ecef(msg_baseline_ecef_t *baseline_ecef, const gps_time_t *t,
-                            u8 n_sats, const double b_ecef[3], u8 flags) {
+                            u8 n_sats, const double b_ecef[3], double accuracy,
+                            u8 flags) {
   baseline_ecef->tow = round(t->tow * 1e3);
   baseline_ecef->x = round(1e3 * b_ecef[0]);
   baseline_ecef->y = round(1e3 * b_ecef[1]);
   baseline_ecef->z = round(1e3 * b_ecef[2]);
-  baseline_ecef->accuracy = 0;
+  baseline_ecef->accuracy = sbp_accuracy_mm(accuracy);
   baseline_ecef->n_sats = n_sats;
   baseline_ecef->flags = flags;
 }
 
 void sbp_make_baseline_ned(msg_baseline_ned_t *baseline_ned, const gps_time_t *t,
-                           u8 n_sats, const double b_ned[3], u8 flags) {
+                           u8 n_sats, const double b_ned[3],
+                           double h_accuracy, double v_accuracy, u8 flags) {
   baseline_ned->tow = round(t->tow * 1e3);
   baseline_ned->n = round(1e3 * b_ned[0]);
   baseline_ned->e = round(1e3 * b_ned[1]);
   baseline_ned->d = round(1e3 * b_ned[2]);
-  baseline_ned->h_accuracy = 0;
-  baseline_ned->v_accuracy = 0;
+  baseline_ned->h_accuracy = sbp_accuracy_mm(h_accuracy);
+  baseline_ned->v_accuracy = sbp_accuracy_mm(v_accuracy);
   baseline_ned->n_sats = n_sats;
   baseline_ned->flags = flags;
 }
@@ -32,9 +32,11 @@ void sbp_make_vel_ned(msg_vel_ned_t *vel_ned, const gnss_solution *soln, u8 flag
 void sbp_make_vel_ecef(msg_vel_ecef_t *vel_ecef, const gnss_solution *soln, u8 flags);
 void sbp_make_dops(msg_dops_t *dops_out, const dops_t *dops_in, const gps_time_t *t);
 void sbp_make_baseline_ecef(msg_baseline_ecef_t *baseline_ecef, const gps_time_t *t,
-                            u8 n_sats, const double b_ecef[3], u8 flags);
+                            u8 n_sats, const double b_ecef[3], double accuracy,
+                            u8 flags);
 void sbp_make_baseline_ned(msg_baseline_ned_t *baseline_ned, const gps_time_t *t,
-                           u8 n_sats, const double b_ned[3], u8 flags);
+                           u8 n_sats, const double b_ned[3],
+                           double h_accuracy, double v_accuracy, u8 flags);
 void sbp_make_heading(msg_baseline_heading_t *baseline_heading, const gps_time_t *t,
                       const double heading, u8 n_used, u8 flags);
 #define MSG_OBS_HEADER_SEQ_SHIFT 4u
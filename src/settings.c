@@ -18,6 +18,7 @@
 #include "peripherals/usart.h"
 #include "minIni/minIni.h"
 #include "sbp.h"
+#include "sbp_fileio.h"
 #include "settings.h"
 
 #define SETTINGS_FILE "config"
@@ -232,7 +233,9 @@ void settings_register(struct setting *setting, enum setting_types type)
     s->next = setting;
   }
   char buf[128];
+  sbp_fileio_lock();
   ini_gets(setting->section, setting->name, "", buf, sizeof(buf), SETTINGS_FILE);
+  sbp_fileio_unlock();
   if (buf[0] == 0) {
     setting->type->to_string(setting->type->priv, buf, sizeof(buf),
                              setting->addr, setting->len);
@@ -291,7 +294,6 @@ static void settings_write_callback(u16 sender_id, u8 len, u8 msg[], void* conte
     return;
   }
 
-  static struct setting *s = NULL;
   const char *section = NULL, *setting = NULL, *value = NULL;
 
   if (len == 0) {
@@ -334,19 +336,33 @@ static void settings_write_callback(u16 sender_id, u8 len, u8 msg[], void* conte
     return;
   }
 
-  s = settings_lookup(section, setting);
-  if (s == NULL) {
+  if (!settings_write(section, setting, value)) {
     log_error("Error in settings write message");
     return;
   }
+}
+
+/** Assign a value to a setting as if written by the host.
+ * The setting is marked dirty so it is persisted by the next settings_save().
+ *
+ * \param section Section name.
+ * \param name    Setting name.
+ * \param value   Value as a string.
+ * \return True if the setting exists and accepted the value.
+ */
+bool settings_write(const char *section, const char *name, const char *value)
+{
+  struct setting *s = settings_lookup(section, name);
+  if (s == NULL) {
+    return false;
+  }
 
   /* This is an assignment, call notify function */
   if (!s->notify(s, value)) {
-    log_error("Error in settings write message");
-    return;
+    return false;
   }
   s->dirty = true;
-  return;
+  return true;
 }
 
 static void settings_read_callback(u16 sender_id, u8 len, u8 msg[], void* context)
@@ -441,14 +457,23 @@ static void settings_read_by_index_callback(u16 sender_id, u8 len, u8 msg[], voi
 
 static void settings_save_callback(u16 sender_id, u8 len, u8 msg[], void* context)
 {
-  int f = cfs_open(SETTINGS_FILE, CFS_WRITE);
+  (void)sender_id; (void) context; (void)len; (void)msg;
+
+  settings_save();
+}
+
+/** Write all changed settings to the config file. */
+void settings_save(void)
+{
   const char *sec = NULL;
   char buf[128];
   int i;
 
-  (void)sender_id; (void) context; (void)len; (void)msg;
+  sbp_fileio_lock();
 
+  int f = cfs_open(SETTINGS_FILE, CFS_WRITE);
   if (f == -1) {
+    sbp_fileio_unlock();
     log_error("Error opening config file!");
     return;
   }
@@ -477,6 +502,8 @@ static void settings_save_callback(u16 sender_id, u8 len, u8 msg[], void* contex
   }
 
   cfs_close(f);
+  sbp_fileio_invalidate(SETTINGS_FILE);
+  sbp_fileio_unlock();
   log_info("Wrote settings to config file.");
 }
 
@@ -60,6 +60,8 @@ void settings_register(struct setting *s, enum setting_types type);
 bool settings_default_notify(struct setting *setting, const char *val);
 bool uarta_baudrate_notify(struct setting *setting, const char *val);
 bool settings_read_only_notify(struct setting *setting, const char *val);
+bool settings_write(const char *section, const char *name, const char *value);
+void settings_save(void);
 
 #endif  /* SWIFTNAV_SETTINGS_H */
 
@@ -29,6 +29,7 @@
 #undef memory_pool_t
 
 #include "peripherals/leds.h"
+#include "block_pool.h"
 #include "position.h"
 #include "nmea.h"
 #include "sbp.h"
@@ -40,8 +41,10 @@
 #include "timing.h"
 #include "base_obs.h"
 #include "ephemeris.h"
+#include "hatch.h"
 #include "signal.h"
 #include "system_monitor.h"
+#include "mem_placement.h"
 #include "main.h"
 
 /* Maximum CPU time the solution thread is allowed to use. */
@@ -54,7 +57,6 @@
 #define DGNSS_TIMEOUT(soln_freq_hz) MS2ST((DGNSS_TIMEOUT_PERIODS * \
   1/((float) (soln_freq_hz)) * 1000))
 
-MemoryPool obs_buff_pool;
 mailbox_t obs_mailbox;
 
 dgnss_solution_mode_t dgnss_soln_mode = SOLN_MODE_LOW_LATENCY;
@@ -76,8 +78,26 @@ u16 msg_obs_max_size = 102;
 static u16 lock_counters[PLATFORM_SIGNAL_COUNT];
 
 bool disable_raim = false;
+/** Length of the carrier smoothing window for the SPP solution in seconds,
+ * zero disables smoothing. */
+static double hatch_window = 30.0;
 bool send_heading = false;
 
+/** Moving baseline mode, the base station is a second receiver on the same
+ * vehicle streaming observations at the solution rate. */
+bool moving_base = false;
+/** Known length of the moving baseline in meters, zero if unknown. */
+static double moving_base_length = 0;
+/** Request to initialise the ambiguities from #moving_base_init_ecef. */
+static bool moving_base_init = false;
+/** Float baseline scaled to the known length, used for initialisation. */
+static double moving_base_init_ecef[3];
+/** The ambiguities have been seeded from the known length since the filters
+ * were initialised or the IAR was last reset. */
+static bool moving_base_seeded = false;
+/** Request to reset the IAR. */
+static bool reset_iar = false;
+
 void solution_send_sbp(gnss_solution *soln, dops_t *dops, bool clock_jump)
 {
   if (soln) {
@@ -155,24 +175,33 @@ double calc_heading(const double b_ned[3])
  * \param ref_ecef size 3 vector of doubles representing reference position
  * for conversion from ECEF to local NED coordinates (meters)
  * \param flags u8 RTK solution flags. 1 if float, 0 if fixed
+ * \param hdop horizontal dilution of precision reported in NMEA GGA
+ * \param corrections_age age of the base station observations (seconds)
+ * \param h_accuracy horizontal 1-sigma accuracy (meters), 0 if unknown
+ * \param v_accuracy vertical 1-sigma accuracy (meters), 0 if unknown
+ * \param sender_id SBP sender ID of the base station
  */
 void solution_send_baseline(const gps_time_t *t, u8 n_sats, double b_ecef[3],
                             double ref_ecef[3], u8 flags, double hdop,
-                            double corrections_age, u16 sender_id)
+                            double corrections_age, double h_accuracy,
+                            double v_accuracy, u16 sender_id)
 {
   double* base_station_pos;
   msg_baseline_ecef_t sbp_ecef;
-  sbp_make_baseline_ecef(&sbp_ecef, t, n_sats, b_ecef, flags);
+  sbp_make_baseline_ecef(&sbp_ecef, t, n_sats, b_ecef,
+                         sqrt(h_accuracy * h_accuracy + v_accuracy * v_accuracy),
+                         flags);
   sbp_send_msg(SBP_MSG_BASELINE_ECEF, sizeof(sbp_ecef), (u8 *)&sbp_ecef);
 
   double b_ned[3];
   wgsecef2ned(b_ecef, ref_ecef, b_ned);
 
   msg_baseline_ned_t sbp_ned;
-  sbp_make_baseline_ned(&sbp_ned, t, n_sats, b_ned, flags);
+  sbp_make_baseline_ned(&sbp_ned, t, n_sats, b_ned, h_accuracy, v_accuracy,
+                        flags);
   sbp_send_msg(SBP_MSG_BASELINE_NED, sizeof(sbp_ned), (u8 *)&sbp_ned);
 
-  if (send_heading) {
+  if (send_heading || moving_base) {
     double heading = calc_heading(b_ned);
     msg_baseline_heading_t sbp_heading;
     sbp_make_heading(&sbp_heading, t, heading, n_sats, flags);
@@ -180,7 +209,8 @@ void solution_send_baseline(const gps_time_t *t, u8 n_sats, double b_ecef[3],
   }
 
   chMtxLock(&base_pos_lock);
-  if (base_pos_known || (simulation_enabled_for(SIMULATION_MODE_FLOAT) ||
+  if ((base_pos_known && !moving_base) ||
+      (simulation_enabled_for(SIMULATION_MODE_FLOAT) ||
       simulation_enabled_for(SIMULATION_MODE_RTK))) {
     last_dgnss = chVTGetSystemTime();
     double pseudo_absolute_ecef[3];
@@ -214,8 +244,60 @@ void solution_send_baseline(const gps_time_t *t, u8 n_sats, double b_ecef[3],
   chMtxUnlock(&base_pos_lock);
 }
 
+/** Check a moving baseline against its known length.
+ * A fixed baseline whose length disagrees is a wrong fix, the IAR is reset
+ * and the baseline reported as float. The first float baseline within
+ * #MOVING_BASE_INIT_TOLERANCE of the known length after the filters are
+ * initialised or the IAR is reset is scaled to it and used to initialise
+ * the ambiguities on the next matched epoch.
+ *
+ * The fix is then reported one matched epoch after the first float baseline
+ * within a metre of the known length, typically within the first seconds
+ * after initialisation, when the seed is right. A wrong seed costs one more
+ * epoch for the fixed length check to reject it, and the seeding repeats
+ * with the float baseline of that epoch. Without the wider tolerance the
+ * seed waited for the float length to converge to 5 cm, which takes about
+ * as long as resolving the ambiguities without it.
+ *
+ * \param b     Baseline in ECEF (meters).
+ * \param flags RTK solution flags, 1 if fixed, 0 if float. Updated.
+ */
+static void moving_base_check(const double b[3], u8 *flags)
+{
+  double length = vector_norm(3, b);
+  double err = fabs(length - moving_base_length);
+
+  if (*flags == 1) {
+    if (err > MOVING_BASE_FIX_TOLERANCE) {
+      log_warn("Fixed baseline length %.3f m disagrees with known length, "
+               "resetting IAR", length);
+      reset_iar = true;
+      *flags = 0;
+    }
+  } else if (!moving_base_seeded && (err < MOVING_BASE_INIT_TOLERANCE) &&
+             (length > 0)) {
+    for (u8 i = 0; i < 3; i++) {
+      moving_base_init_ecef[i] = b[i] * moving_base_length / length;
+    }
+    moving_base_init = true;
+    moving_base_seeded = true;
+  }
+}
+
+/** Calculate and send the RTK baseline.
+ *
+ * \param num_sdiffs Number of single differences.
+ * \param sdiffs     Single differenced observations.
+ * \param t          Time of the observations.
+ * \param dops       DOPs of the rover solution, NULL if not available.
+ * \param diff_time  Age of the base station observations (seconds).
+ * \param pred_err   1-sigma range error of predicted base station
+ *                   observations (meters), 0 if not predicted.
+ * \param base_id    SBP sender ID of the base station.
+ */
 static void output_baseline(u8 num_sdiffs, const sdiff_t *sdiffs,
-                            const gps_time_t *t, double hdop, double diff_time, u16 base_id)
+                            const gps_time_t *t, const dops_t *dops,
+                            double diff_time, double pred_err, u16 base_id)
 {
   double b[3];
   u8 num_used, flags;
@@ -254,13 +336,25 @@ static void output_baseline(u8 num_sdiffs, const sdiff_t *sdiffs,
     break;
   }
 
-  solution_send_baseline(t, num_used, b, position_solution.pos_ecef, flags, hdop, diff_time, base_id);
+  if (moving_base && (moving_base_length > 0)) {
+    moving_base_check(b, &flags);
+  }
+
+  double hdop = (dops != NULL) ? dops->hdop : 0;
+  double vdop = (dops != NULL) ? dops->vdop : 0;
+  solution_send_baseline(t, num_used, b, position_solution.pos_ecef, flags,
+                         hdop, diff_time, hdop * pred_err, vdop * pred_err,
+                         base_id);
 }
 
 static void send_observations(u8 n, const navigation_measurement_t *m,
                               const gps_time_t *t)
 {
-  static u8 buff[256];
+  u8 *buff = sbp_frame_alloc();
+  if (buff == NULL) {
+    log_error("No buffer for observation message!");
+    return;
+  }
 
   /* Upper limit set by SBP framing size, preventing underflow */
   u16 msg_payload_size = MAX(
@@ -302,6 +396,8 @@ static void send_observations(u8 n, const navigation_measurement_t *m,
       buff);
 
   }
+
+  sbp_frame_free(buff);
 }
 
 static void post_observations(u8 n, const navigation_measurement_t *m,
@@ -312,7 +408,14 @@ static void post_observations(u8 n, const navigation_measurement_t *m,
    * pushing the message into the mailbox then we just wasted an
    * observation from the mailbox for no good reason. */
 
-  obss_t *obs = chPoolAlloc(&obs_buff_pool);
+  /* Without base observations the mailbox stays full. Recycle the oldest
+   * item then rather than running the pool dry, which is reported as a
+   * fault by the system monitor. */
+  chSysLock();
+  bool mailbox_full = (chMBGetFreeCountI(&obs_mailbox) == 0);
+  chSysUnlock();
+
+  obss_t *obs = mailbox_full ? NULL : obss_alloc();
   msg_t ret;
   if (obs == NULL) {
     /* Pool is empty, grab a buffer from the mailbox instead, i.e.
@@ -320,6 +423,7 @@ static void post_observations(u8 n, const navigation_measurement_t *m,
     ret = chMBFetch(&obs_mailbox, (msg_t *)&obs, TIME_IMMEDIATE);
     if (ret != MSG_OK) {
       log_error("Pool full and mailbox empty!");
+      return;
     }
   }
   obs->tor = *t;
@@ -367,7 +471,7 @@ static void solution_simulation()
     solution_send_baseline(&(soln->time),
       simulation_current_num_sats(),
       simulation_current_baseline_ecef(),
-      simulation_ref_ecef(), flags, 1.5, 0.25, 1023);
+      simulation_ref_ecef(), flags, 1.5, 0.25, 0, 0, 1023);
 
     double t_check = expected_tow * (soln_freq / obs_output_divisor);
     if (fabs(t_check - (u32)t_check) < TIME_MATCH_THRESHOLD) {
@@ -392,6 +496,227 @@ static void update_sat_elevations(const navigation_measurement_t nav_meas[],
   }
 }
 
+/** Maximum age of the cached position used for screening. */
+#define PVT_SCREEN_MAX_AGE 1.0
+
+/** Maximum age of the cached geometry matrix before it is rebuilt. */
+#define PVT_SCREEN_GEOMETRY_MAX_AGE 10.0
+
+/** Post-fit pseudorange residual RMS below which the measurements are
+ * considered fault free, in metres. */
+#define PVT_SCREEN_RESIDUAL_THRESHOLD 10.0
+
+typedef enum {
+  PVT_SCREEN_UNKNOWN,   /**< Not screened, run calc_PVT() with RAIM. */
+  PVT_SCREEN_CLEAN,     /**< No fault, RAIM can be skipped. */
+  PVT_SCREEN_FAULT,     /**< A single faulty measurement was identified. */
+} pvt_screen_t;
+
+/** Least squares geometry cached between epochs for screening. */
+static struct {
+  bool valid;
+  gps_time_t time;                /**< Time of pos_ecef and vel_ecef. */
+  double pos_ecef[3];
+  double vel_ecef[3];
+  u8 n;
+  gps_time_t geometry_time;       /**< Time G and N_inv were built. */
+  gnss_signal_t sids[MAX_CHANNELS];
+  double G[MAX_CHANNELS][4];      /**< Geometry matrix, one row per sid. */
+  double N_inv[4][4];             /**< Inverse of G^T G. */
+} pvt_cache;
+
+/** Invert a symmetric positive definite 4x4 matrix by Cholesky
+ * decomposition.
+ * \return True on success, false if the matrix is not positive definite.
+ */
+static bool pvt_sym4_inverse(const double a[4][4], double a_inv[4][4])
+{
+  double l[4][4] = {{0}};
+  for (u8 j = 0; j < 4; j++) {
+    double d = a[j][j];
+    for (u8 k = 0; k < j; k++)
+      d -= l[j][k] * l[j][k];
+    if (d <= 0)
+      return false;
+    l[j][j] = sqrt(d);
+    for (u8 i = j + 1; i < 4; i++) {
+      double s = a[i][j];
+      for (u8 k = 0; k < j; k++)
+        s -= l[i][k] * l[j][k];
+      l[i][j] = s / l[j][j];
+    }
+  }
+
+  /* a_inv = L^-T L^-1, solved column by column. */
+  for (u8 c = 0; c < 4; c++) {
+    double y[4];
+    for (u8 i = 0; i < 4; i++) {
+      double s = (i == c) ? 1.0 : 0.0;
+      for (u8 k = 0; k < i; k++)
+        s -= l[i][k] * y[k];
+      y[i] = s / l[i][i];
+    }
+    for (s8 i = 3; i >= 0; i--) {
+      double s = y[i];
+      for (u8 k = i + 1; k < 4; k++)
+        s -= l[k][i] * a_inv[k][c];
+      a_inv[i][c] = s / l[i][i];
+    }
+  }
+  return true;
+}
+
+/** Geometric range from the receiver to a satellite including the Earth
+ * rotation during the signal flight time, as modelled by calc_PVT(). */
+static double pvt_range(const double sat_pos[3], const double rx_pos[3],
+                        double los[3])
+{
+  double tau = vector_distance(3, sat_pos, rx_pos) / GPS_C;
+  double we_tau = GPS_OMEGAE_DOT * tau;
+  double sat_rot[3] = {
+    cos(we_tau) * sat_pos[0] + sin(we_tau) * sat_pos[1],
+    -sin(we_tau) * sat_pos[0] + cos(we_tau) * sat_pos[1],
+    sat_pos[2]
+  };
+  vector_subtract(3, sat_rot, rx_pos, los);
+  double r = vector_norm(3, los);
+  for (u8 i = 0; i < 3; i++)
+    los[i] /= r;
+  return r;
+}
+
+/** Check whether the measurements match the cached geometry. */
+static bool pvt_cache_matches(u8 n, const navigation_measurement_t nm[])
+{
+  if (n != pvt_cache.n)
+    return false;
+  for (u8 i = 0; i < n; i++) {
+    if (!sid_is_equal(nm[i].sid, pvt_cache.sids[i]))
+      return false;
+  }
+  return true;
+}
+
+/** Screen the measurements for faults before calc_PVT().
+ *
+ * The pseudoranges are linearised about the previous solution extrapolated
+ * to the current epoch, so a single least squares step gives the post-fit
+ * residuals. The geometry matrix and its normal matrix inverse are reused
+ * from the previous epoch while the set of satellites is unchanged, as the
+ * line of sight vectors barely move over a solution period.
+ *
+ * If the residuals fail the test, each measurement is tested for being the
+ * single fault by a rank-one downdate of the normal equations: removing
+ * measurement \f$i\f$ reduces the residual sum of squares by
+ * \f$e_i^2 / (1 - h_{ii})\f$ where \f$h_{ii} = g_i^T (G^T G)^{-1} g_i\f$.
+ *
+ * \param n     Number of measurements.
+ * \param nm    Measurements.
+ * \param t     Time of the measurements.
+ * \param fault Index of the faulty measurement if PVT_SCREEN_FAULT.
+ * \return Screening result.
+ */
+static pvt_screen_t pvt_screen(u8 n, const navigation_measurement_t nm[],
+                               const gps_time_t *t, u8 *fault)
+{
+  if (!pvt_cache.valid || (n < 5))
+    return PVT_SCREEN_UNKNOWN;
+
+  double dt = gpsdifftime(t, &pvt_cache.time);
+  if (fabs(dt) > PVT_SCREEN_MAX_AGE)
+    return PVT_SCREEN_UNKNOWN;
+
+  double pos[3];
+  for (u8 i = 0; i < 3; i++)
+    pos[i] = pvt_cache.pos_ecef[i] + dt * pvt_cache.vel_ecef[i];
+
+  bool reuse = pvt_cache_matches(n, nm) &&
+               (fabs(gpsdifftime(t, &pvt_cache.geometry_time))
+                  < PVT_SCREEN_GEOMETRY_MAX_AGE);
+
+  /* Pre-fit residuals, with the geometry rebuilt if the satellites changed. */
+  double v[MAX_CHANNELS];
+  for (u8 i = 0; i < n; i++) {
+    double los[3];
+    v[i] = nm[i].pseudorange - pvt_range(nm[i].sat_pos, pos, los);
+    if (!reuse) {
+      pvt_cache.G[i][0] = -los[0];
+      pvt_cache.G[i][1] = -los[1];
+      pvt_cache.G[i][2] = -los[2];
+      pvt_cache.G[i][3] = 1.0;
+      pvt_cache.sids[i] = nm[i].sid;
+    }
+  }
+
+  if (!reuse) {
+    double N[4][4] = {{0}};
+    for (u8 i = 0; i < n; i++)
+      for (u8 r = 0; r < 4; r++)
+        for (u8 c = 0; c < 4; c++)
+          N[r][c] += pvt_cache.G[i][r] * pvt_cache.G[i][c];
+    pvt_cache.n = 0;
+    if (!pvt_sym4_inverse(N, pvt_cache.N_inv))
+      return PVT_SCREEN_UNKNOWN;
+    pvt_cache.n = n;
+    pvt_cache.geometry_time = *t;
+  }
+
+  /* Least squares step and post-fit residuals. */
+  double y[4] = {0};
+  for (u8 i = 0; i < n; i++)
+    for (u8 r = 0; r < 4; r++)
+      y[r] += pvt_cache.G[i][r] * v[i];
+
+  double dx[4] = {0};
+  for (u8 r = 0; r < 4; r++)
+    for (u8 c = 0; c < 4; c++)
+      dx[r] += pvt_cache.N_inv[r][c] * y[c];
+
+  double e[MAX_CHANNELS];
+  double sse = 0;
+  for (u8 i = 0; i < n; i++) {
+    e[i] = v[i];
+    for (u8 c = 0; c < 4; c++)
+      e[i] -= pvt_cache.G[i][c] * dx[c];
+    sse += e[i] * e[i];
+  }
+
+  const double thresh_sq = PVT_SCREEN_RESIDUAL_THRESHOLD *
+                           PVT_SCREEN_RESIDUAL_THRESHOLD;
+  if (sse < thresh_sq * (n - 4))
+    return PVT_SCREEN_CLEAN;
+
+  /* Identifying a fault needs redundancy after removing it. */
+  if (n < 6)
+    return PVT_SCREEN_UNKNOWN;
+
+  u8 n_candidates = 0;
+  for (u8 i = 0; i < n; i++) {
+    double h = 0;
+    for (u8 r = 0; r < 4; r++)
+      for (u8 c = 0; c < 4; c++)
+        h += pvt_cache.G[i][r] * pvt_cache.N_inv[r][c] * pvt_cache.G[i][c];
+    if (h >= 1.0 - 1e-9)
+      continue;
+    double sse_i = sse - e[i] * e[i] / (1.0 - h);
+    if (sse_i < thresh_sq * (n - 5)) {
+      *fault = i;
+      n_candidates++;
+    }
+  }
+
+  return (n_candidates == 1) ? PVT_SCREEN_FAULT : PVT_SCREEN_UNKNOWN;
+}
+
+/** Update the cached position used by pvt_screen(). */
+static void pvt_cache_update(const gnss_solution *soln)
+{
+  pvt_cache.valid = soln->valid;
+  pvt_cache.time = soln->time;
+  memcpy(pvt_cache.pos_ecef, soln->pos_ecef, sizeof(pvt_cache.pos_ecef));
+  memcpy(pvt_cache.vel_ecef, soln->vel_ecef, sizeof(pvt_cache.vel_ecef));
+}
+
 /** Sleep until the next solution deadline.
  *
  * \param deadline    Pointer to the current deadline, updated by this function.
@@ -522,12 +847,56 @@ static void solution_thread(void *arg)
       continue;
     }
 
+    /* Smooth the pseudoranges used for the SPP solution with the carrier
+     * phase. The observations sent out and used for RTK are left unsmoothed.
+     * A clock jump shifts all pseudoranges but not the carrier phases, so the
+     * filters are restarted. */
+    static navigation_measurement_t nav_meas_pvt[MAX_CHANNELS];
+    memcpy(nav_meas_pvt, nav_meas_tdcp,
+           n_ready_tdcp * sizeof(navigation_measurement_t));
+    if (clock_jump || (time_quality != TIME_FINE)) {
+      hatch_filter_reset();
+    }
+    hatch_filter_update(n_ready_tdcp, nav_meas_pvt,
+                        (u32)(hatch_window * soln_freq));
+
+    /* Screen the measurements against the previous solution. RAIM in
+     * calc_PVT() re-solves from scratch for every satellite subset, so skip
+     * it when the residuals are clean and drop a single identified fault
+     * ourselves. */
+    u8 n_pvt = n_ready_tdcp;
+    bool raim_off = disable_raim;
+    bool repaired = false;
+    if (!disable_raim) {
+      u8 fault;
+      switch (pvt_screen(n_pvt, nav_meas_pvt, &rec_time, &fault)) {
+      case PVT_SCREEN_CLEAN:
+        raim_off = true;
+        break;
+      case PVT_SCREEN_FAULT:
+        memmove(&nav_meas_pvt[fault], &nav_meas_pvt[fault + 1],
+                (n_pvt - fault - 1) * sizeof(navigation_measurement_t));
+        n_pvt--;
+        raim_off = true;
+        repaired = true;
+        break;
+      case PVT_SCREEN_UNKNOWN:
+      default:
+        break;
+      }
+    }
+
     dops_t dops;
     /* Calculate the SPP position
      * disable_raim controlled by external setting. Defaults to false. */
-    s8 pvt_ret = calc_PVT(n_ready_tdcp, nav_meas_tdcp, disable_raim,
+    s8 pvt_ret = calc_PVT(n_pvt, nav_meas_pvt, raim_off,
                           &position_solution, &dops);
+    if ((pvt_ret == 0) && repaired) {
+      pvt_ret = 1;
+    }
     if (pvt_ret < 0) {
+      pvt_cache.valid = false;
+
       /* An error occurred with calc_PVT! */
       /* TODO: Make this based on time since last error instead of a simple
        * count. */
@@ -544,6 +913,8 @@ static void solution_thread(void *arg)
     if (pvt_ret == 1)
 	  log_warn("calc_PVT: RAIM repair");
 
+    pvt_cache_update(&position_solution);
+
     if (time_quality < TIME_FINE) {
       /* If the time quality is not FINE then our receiver clock bias isn't
        * known. We should only use this PVT solution to update our time
@@ -570,6 +941,7 @@ static void solution_thread(void *arg)
 
     /* Update global position solution state. */
     position_updated();
+    base_survey_update(&position_solution, &dops);
 
     /* Save elevation angles every so often */
     DO_EVERY((u32)soln_freq,
@@ -614,11 +986,7 @@ static void solution_thread(void *arg)
      *  the fact that uncorrected and corrected pseudoranges correspond to the
      *  exact same observations.
      */
-    for (u8 i = 0; i < n_ready_tdcp; i++) {
-      double pr_err = GPS_C * gpsdifftime(&position_solution.time, &rec_time);
-      nav_meas_tdcp[i].raw_pseudorange += pr_err;
-      nav_meas_tdcp[i].pseudorange += pr_err;
-    }
+    double pr_err = GPS_C * gpsdifftime(&position_solution.time, &rec_time);
     /*
      * The next correction is done to create a new pseudorange that is valid for
      * a different time of arrival.  In particular we'd like to propagate all the
@@ -641,74 +1009,73 @@ static void solution_thread(void *arg)
       new_obs_time.wn = position_solution.time.wn;
       new_obs_time.tow = expected_tow;
 
-      /* Propagate observations to desired time. */
+      /* Apply the receiver clock correction and propagate the observations
+       * to the desired time in a single pass. */
       /* We have to use the tdcp_doppler result to account for TCXO drift. */
-      /* nav_meas_tdcp is updated in place, skipping elements if required. */
-      u8 n_ready_tdcp_new = 0;
+      /* The time of transmission moves by at most OBS_PROPAGATION_LIMIT plus
+       * the satellite clock error, so the satellite state is propagated from
+       * the PVT epoch by a first order Taylor expansion rather than evaluating
+       * the ephemeris again. The neglected acceleration term is below
+       * 0.1 mm. */
       for (u8 i = 0; i < n_ready_tdcp; i++) {
-        navigation_measurement_t *nm = &nav_meas_tdcp[n_ready_tdcp_new];
-
-        /* Copy measurement to new index if a previous measurement
-         * has been skipped. */
-        if (i != n_ready_tdcp_new) {
-          memcpy(nm, &nav_meas_tdcp[i], sizeof(*nm));
-        }
-
-        nm->raw_pseudorange += t_err * nm->raw_doppler * GPS_L1_LAMBDA;
-        nm->raw_carrier_phase += t_err * nm->raw_doppler;
+        navigation_measurement_t *nm = &nav_meas_tdcp[i];
 
-        nm->tot = new_obs_time;
-        nm->tot.tow -= nm->raw_pseudorange / GPS_C;
-        normalize_gps_time(&nm->tot);
+        nm->raw_pseudorange += pr_err;
+        nm->pseudorange += pr_err;
+        nav_meas_propagate(nm, t_err);
 
-        const ephemeris_t *e = ephemeris_get(nm->sid);
-        u8 eph_valid;
-        s8 ss_ret;
-        double clock_err;
-        double clock_rate_err;
+        gps_time_t tot = new_obs_time;
+        tot.tow -= nm->raw_pseudorange / GPS_C;
+        normalize_gps_time(&tot);
 
-        ephemeris_lock();
-        eph_valid = ephemeris_valid(e, &nm->tot);
-        if (eph_valid) {
-          ss_ret = calc_sat_state(e, &nm->tot, nm->sat_pos, nm->sat_vel,
-                                  &clock_err, &clock_rate_err);
+        double dt_tot = gpsdifftime(&tot, &nm->tot);
+        for (u8 j = 0; j < 3; j++) {
+          nm->sat_pos[j] += dt_tot * nm->sat_vel[j];
         }
-        ephemeris_unlock();
-
-        if (!eph_valid || (ss_ret != 0)) {
-          continue;
-        }
-
-        n_ready_tdcp_new++;
+        nm->tot = tot;
       }
 
-      /* Update n_ready_tdcp. */
-      n_ready_tdcp = n_ready_tdcp_new;
-
       /* If we have a recent set of observations from the base station, do a
        * differential solution. */
       double pdt;
       chMtxLock(&base_obs_lock);
       if (base_obss.n > 0 && !simulation_enabled()) {
-        if ((pdt = gpsdifftime(&new_obs_time, &base_obss.tor))
-              < MAX_AGE_OF_DIFFERENTIAL) {
-
-          /* Propagate base station observations to the current time and
-           * process a low-latency differential solution. */
+        pdt = gpsdifftime(&new_obs_time, &base_obss.tor);
+
+        /* Propagate base station observations to the current time and
+         * process a low-latency differential solution. If the base station
+         * observations are late or were lost, bridge the gap with predicted
+         * observations. In extrapolated mode the base station observations
+         * are always predicted to the rover epoch, giving RTK output at the
+         * full solution rate over low rate correction links. */
+        static obss_t base_obss_pred;
+        obss_t *base = &base_obss;
+        if ((dgnss_soln_mode == SOLN_MODE_EXTRAPOLATED) ||
+            (pdt >= MAX_AGE_OF_DIFFERENTIAL)) {
+          base = NULL;
+          if (base_obs_predict(&new_obs_time, &base_obss_pred) > 0) {
+            base = &base_obss_pred;
+          }
+        }
 
-          /* Hook in low-latency filter here. */
-          if (dgnss_soln_mode == SOLN_MODE_LOW_LATENCY &&
-              base_obss.has_pos) {
+        /* Hook in low-latency filter here. A moving base cannot be
+         * propagated, its baselines come from the time matched thread. */
+        if ((dgnss_soln_mode == SOLN_MODE_LOW_LATENCY ||
+             dgnss_soln_mode == SOLN_MODE_EXTRAPOLATED) &&
+            !moving_base && base != NULL && base->has_pos) {
 
-            sdiff_t sdiffs[MAX(base_obss.n, n_ready_tdcp)];
+          sdiff_t *sdiffs = sdiffs_alloc();
+          if (sdiffs != NULL) {
             u8 num_sdiffs = make_propagated_sdiffs(n_ready_tdcp, nav_meas_tdcp,
-                                    base_obss.n, base_obss.nm,
-                                    base_obss.sat_dists, base_obss.pos_ecef,
+                                    base->n, base->nm,
+                                    base->sat_dists, base->pos_ecef,
                                     sdiffs);
             if (num_sdiffs >= 4) {
-              output_baseline(num_sdiffs, sdiffs, &new_obs_time, pdt,
-                              dops.hdop, base_obss.sender_id);
+              output_baseline(num_sdiffs, sdiffs, &new_obs_time, &dops, pdt,
+                              sqrt(base->pred_var) * GPS_L1_LAMBDA,
+                              base->sender_id);
             }
+            sdiffs_free(sdiffs);
           }
         }
       }
@@ -719,13 +1086,17 @@ static void solution_thread(void *arg)
       /* Also only output observations once our receiver clock is
        * correctly set. */
       double t_check = expected_tow * (soln_freq / obs_output_divisor);
-      if (!simulation_enabled() &&
-          time_quality == TIME_FINE &&
-          fabs(t_check - (u32)t_check) < TIME_MATCH_THRESHOLD) {
-        /* Post the observations to the mailbox. */
-        post_observations(n_ready_tdcp, nav_meas_tdcp, &new_obs_time);
+      bool obs_epoch = fabs(t_check - (u32)t_check) < TIME_MATCH_THRESHOLD;
+      if (!simulation_enabled() && time_quality == TIME_FINE) {
+        /* Post the observations to the mailbox. A moving base streams at
+         * the solution rate, so match against every epoch. */
+        if (obs_epoch || moving_base) {
+          post_observations(n_ready_tdcp, nav_meas_tdcp, &new_obs_time);
+        }
         /* Send the observations. */
-        send_observations(n_ready_tdcp, nav_meas_tdcp, &new_obs_time);
+        if (obs_epoch) {
+          send_observations(n_ready_tdcp, nav_meas_tdcp, &new_obs_time);
+        }
       }
     }
 
@@ -746,7 +1117,6 @@ static void solution_thread(void *arg)
 
 static bool init_done = false;
 static bool init_known_base = false;
-static bool reset_iar = false;
 
 void process_matched_obs(u8 n_sds, gps_time_t *t, sdiff_t *sds, u16 base_id)
 {
@@ -764,6 +1134,14 @@ void process_matched_obs(u8 n_sds, gps_time_t *t, sdiff_t *sds, u16 base_id)
       log_warn("> 4 satellites required for known baseline init.");
     }
   }
+  if (moving_base_init && init_done && (n_sds > 4)) {
+    /* Calculate ambiguities from the float baseline constrained to the known
+     * moving baseline length. */
+    log_info("Initializing using known moving baseline length");
+    dgnss_init_known_baseline(n_sds, sds, position_solution.pos_ecef,
+                              moving_base_init_ecef);
+    moving_base_init = false;
+  }
   if (!init_done) {
     if (n_sds > 4) {
       /* Initialize filters. */
@@ -773,11 +1151,13 @@ void process_matched_obs(u8 n_sds, gps_time_t *t, sdiff_t *sds, u16 base_id)
       ambiguities_init(&amb_state.fixed_ambs);
       ambiguities_init(&amb_state.float_ambs);
       init_done = 1;
+      moving_base_seeded = false;
     }
   } else {
     if (reset_iar) {
       dgnss_reset_iar();
       reset_iar = false;
+      moving_base_seeded = false;
     }
     /* Update filters. */
     dgnss_update(n_sds, sds, position_solution.pos_ecef,
@@ -786,16 +1166,16 @@ void process_matched_obs(u8 n_sds, gps_time_t *t, sdiff_t *sds, u16 base_id)
     chMtxLock(&amb_state_lock);
     dgnss_update_ambiguity_state(&amb_state);
     chMtxUnlock(&amb_state_lock);
-    /* If we are in time matched mode then calculate and output the baseline
-     * for this observation. */
-    if (dgnss_soln_mode == SOLN_MODE_TIME_MATCHED &&
+    /* If we are in time matched or moving baseline mode then calculate and
+     * output the baseline for this observation. */
+    if ((dgnss_soln_mode == SOLN_MODE_TIME_MATCHED || moving_base) &&
         !simulation_enabled() && n_sds >= 4) {
-      output_baseline(n_sds, sds, t, 0, 0, base_id);
+      output_baseline(n_sds, sds, t, NULL, 0, 0, base_id);
     }
   }
 }
 
-static WORKING_AREA_CCM(wa_time_matched_obs_thread, 20000);
+static WORKING_AREA_SOLN(wa_time_matched_obs_thread, 20000);
 static void time_matched_obs_thread(void *arg)
 {
   (void)arg;
@@ -816,8 +1196,10 @@ static void time_matched_obs_thread(void *arg)
 
       chMtxLock(&base_obs_lock);
       double dt = gpsdifftime(&obss->tor, &base_obss.tor);
+      double match_threshold = moving_base ? MOVING_BASE_TIME_MATCH_THRESHOLD
+                                           : TIME_MATCH_THRESHOLD;
 
-      if (fabs(dt) < TIME_MATCH_THRESHOLD) {
+      if (fabs(dt) < match_threshold) {
         /* Times match! Process obs and base_obss */
         static sdiff_t sds[MAX_CHANNELS];
         u8 n_sds = single_diff(
@@ -842,7 +1224,7 @@ static void time_matched_obs_thread(void *arg)
           n_sds = filter_sdiffs(n_sds, sds, num_sats_to_drop, sats_to_drop);
         }
         process_matched_obs(n_sds, &obss->tor, sds, base_obss.sender_id);
-        chPoolFree(&obs_buff_pool, obss);
+        obss_free(obss);
         break;
       } else {
         chMtxUnlock(&base_obs_lock);
@@ -864,13 +1246,13 @@ static void time_matched_obs_thread(void *arg)
             /* Something went wrong with returning it to the buffer, better just
              * free it and carry on. */
             log_warn("Obs Matching: mailbox full, discarding observation!");
-            chPoolFree(&obs_buff_pool, obss);
+            obss_free(obss);
           }
           break;
         } else {
           /* Time of base obs later than time of local obs,
            * keep moving through the mailbox. */
-          chPoolFree(&obs_buff_pool, obss);
+          obss_free(obss);
         }
       }
     }
@@ -908,6 +1290,26 @@ void init_base_callback(u16 sender_id, u8 len, u8 msg[], void* context)
   init_known_base = true;
 }
 
+/** Settings callback for the carrier smoothing window.
+ * Negative windows are rejected, the window is converted to a number of
+ * epochs.
+ *
+ * \param s Pointer to settings config.
+ * \param val Pointer to new value.
+ * \return Returns true if the change was successful, false otherwise.
+ */
+static bool hatch_window_changed(struct setting *s, const char *val)
+{
+  double window;
+  if (!s->type->from_string(s->type->priv, &window, s->len, val) ||
+      !(window >= 0)) {
+    log_warn("Invalid hatch_window, must not be negative");
+    return false;
+  }
+  hatch_window = window;
+  return true;
+}
+
 void solution_setup()
 {
   /* Set time of last differential solution in the past. */
@@ -918,6 +1320,7 @@ void solution_setup()
   static const char const *dgnss_soln_mode_enum[] = {
     "Low Latency",
     "Time Matched",
+    "Extrapolated",
     NULL
   };
   static struct setting_type dgnss_soln_mode_setting;
@@ -952,15 +1355,16 @@ void solution_setup()
   SETTING("sbp", "obs_msg_max_size", msg_obs_max_size, TYPE_INT);
 
   SETTING("solution", "disable_raim", disable_raim, TYPE_BOOL);
+  SETTING_NOTIFY("solution", "hatch_window", hatch_window, TYPE_FLOAT,
+                 hatch_window_changed);
   SETTING("solution", "send_heading", send_heading, TYPE_BOOL);
+  SETTING("solution", "moving_base", moving_base, TYPE_BOOL);
+  SETTING("solution", "moving_base_length", moving_base_length, TYPE_FLOAT);
 
   nmea_setup();
 
   static msg_t obs_mailbox_buff[OBS_N_BUFF];
   chMBObjectInit(&obs_mailbox, obs_mailbox_buff, OBS_N_BUFF);
-  chPoolObjectInit(&obs_buff_pool, sizeof(obss_t), NULL);
-  static obss_t obs_buff[OBS_N_BUFF] _CCM;
-  chPoolLoadArray(&obs_buff_pool, obs_buff, OBS_N_BUFF);
 
   /* Start solution thread */
   chThdCreateStatic(wa_solution_thread, sizeof(wa_solution_thread),
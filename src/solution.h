@@ -21,7 +21,8 @@
 
 typedef enum {
   SOLN_MODE_LOW_LATENCY,
-  SOLN_MODE_TIME_MATCHED
+  SOLN_MODE_TIME_MATCHED,
+  SOLN_MODE_EXTRAPOLATED
 } dgnss_solution_mode_t;
 
 typedef enum {
@@ -35,11 +36,31 @@ typedef enum {
 
 #define MAX_AGE_OF_DIFFERENTIAL 1.0
 
+/** Maximum difference between rover and moving base observation times to
+ * consider them matched. Both receivers align their observations to the
+ * solution epochs, so their times agree far better than #TIME_MATCH_THRESHOLD
+ * requires. */
+#define MOVING_BASE_TIME_MATCH_THRESHOLD 1e-4
+
+/** Maximum difference between the float baseline length and the known
+ * moving baseline length for the float baseline to seed the ambiguities.
+ * Set to the error of a float baseline a few epochs after the filters are
+ * initialised, not to that of a converged one. A seed which is off by
+ * more than a fraction of a cycle gives a wrong fix, rejected by
+ * #MOVING_BASE_FIX_TOLERANCE, after which the next float baseline seeds
+ * again. */
+#define MOVING_BASE_INIT_TOLERANCE 1.0
+
+/** Maximum difference between the fixed baseline length and the known
+ * moving baseline length before the fix is rejected. */
+#define MOVING_BASE_FIX_TOLERANCE 0.05
+
 #define OBS_N_BUFF 5
 #define OBS_BUFF_SIZE (OBS_N_BUFF * sizeof(obss_t))
 
 extern double soln_freq;
 extern u32 obs_output_divisor;
+extern bool moving_base;
 
 void solution_send_sbp(gnss_solution *soln, dops_t *dops, bool clock_jump);
 void solution_send_nmea(gnss_solution *soln, dops_t *dops,
@@ -48,7 +69,8 @@ void solution_send_nmea(gnss_solution *soln, dops_t *dops,
 double calc_heading(const double b_ned[3]);
 void solution_send_baseline(const gps_time_t *t, u8 n_sats, double b_ecef[3],
                             double ref_ecef[3], u8 flags, double hdop, 
-                            double corrections_age, u16 sender_id);
+                            double corrections_age, double h_accuracy,
+                            double v_accuracy, u16 sender_id);
 void solution_setup(void);
 
 #endif
@@ -10,7 +10,9 @@
  * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #define memory_pool_t MemoryPool
 #include <ch.h>
@@ -22,8 +24,10 @@
 #include <libswiftnav/dgnss_management.h>
 #include <libswiftnav/linear_algebra.h>
 #include <libswiftnav/coord_system.h>
+#include <libswiftnav/constants.h>
 
 #include "board/nap/nap_common.h"
+#include "block_pool.h"
 #include "board/frontend.h"
 #include "peripherals/leds.h"
 #include "main.h"
@@ -33,6 +37,7 @@
 #include "system_monitor.h"
 #include "position.h"
 #include "base_obs.h"
+#include "settings.h"
 
 #define WATCHDOG_THREAD_PERIOD_MS 15000
 extern const WDGConfig board_wdg_config;
@@ -57,15 +62,75 @@ static double base_llh[3];
 u64 g_ctime = 0;
 
 
+/** Stack fill pattern written by ChibiOS, see CH_DBG_FILL_THREADS. */
+#define STACK_FILL 0x55555555
+/** Upper bound on the words scanned from the stack limit. */
+#define STACK_SCAN_MAX_WORDS (65536/sizeof(u32))
+/** Words below the low-water mark checked for deeper stack use. */
+#define STACK_MARK_GUARD_WORDS 64
+/** A full scan is made every this many checks of a thread. */
+#define STACK_MARK_FULL_SCAN_PERIOD 32
+#define STACK_MARK_MAX_THREADS 32
+
+/** Low-water mark of a thread stack, in words above the stack limit. */
+typedef struct {
+  thread_t *tp;
+  u32 free_words;
+  u32 n_checks;
+} stack_mark_t;
+
+static stack_mark_t stack_marks[STACK_MARK_MAX_THREADS];
+
+static stack_mark_t *stack_mark_get(thread_t *tp)
+{
+  for (u32 i = 0; i < STACK_MARK_MAX_THREADS; i++) {
+    if (stack_marks[i].tp == tp)
+      return &stack_marks[i];
+    if (stack_marks[i].tp == NULL) {
+      stack_marks[i].tp = tp;
+      return &stack_marks[i];
+    }
+  }
+  return NULL;
+}
+
+/** Get the free stack space of a thread at its low-water mark.
+ *
+ * The fill pattern below the deepest stack use is never restored, so the
+ * low-water mark only moves down. After a first full scan from the stack
+ * limit only a window of STACK_MARK_GUARD_WORDS below the previous mark is
+ * checked, restarting the window whenever a used word is found. Untouched
+ * parts of a deep local array wider than the window are caught by the full
+ * scan made every STACK_MARK_FULL_SCAN_PERIOD checks.
+ *
+ * \param tp Thread to check.
+ * \return Free stack space in bytes.
+ */
 u32 check_stack_free(thread_t *tp)
 {
-  u32 *stack = (u32 *)tp->p_stklimit;
+  const u32 *stack = (const u32 *)tp->p_stklimit;
+  stack_mark_t *m = stack_mark_get(tp);
   u32 i;
-  for (i=0; i<65536/sizeof(u32); i++) {
-    if (stack[i] != 0x55555555)
-      break;
+
+  if ((m == NULL) || (m->n_checks % STACK_MARK_FULL_SCAN_PERIOD == 0)) {
+    for (i=0; i<STACK_SCAN_MAX_WORDS; i++) {
+      if (stack[i] != STACK_FILL)
+        break;
+    }
+  } else {
+    i = m->free_words;
+    for (u32 j = i; (j > 0) && (i - j < STACK_MARK_GUARD_WORDS); ) {
+      j--;
+      if (stack[j] != STACK_FILL)
+        i = j;
+    }
+  }
+
+  if (m != NULL) {
+    m->free_words = i;
+    m->n_checks++;
   }
-  return 4 * (i - 1);
+  return (i > 0) ? 4 * (i - 1) : 0;
 }
 
 void send_thread_states()
@@ -85,6 +150,128 @@ void send_thread_states()
   g_ctime = 0;
 }
 
+/** Minimum survey-in duration before the accuracy target can end it. */
+#define SURVEY_MIN_DURATION 60.0
+/** Correlation time of the single point position error. Samples closer
+ * together than this are not independent when estimating the accuracy of the
+ * surveyed position. */
+#define SURVEY_CORRELATION_TIME 60.0
+
+/** Base station survey-in state, protected by #survey_lock. */
+static MUTEX_DECL(survey_lock);
+static bool survey_in = false;
+static double survey_duration = 300.0;
+static double survey_accuracy = 0.0;
+static struct {
+  u32 n;                  /**< Number of samples. */
+  double weight;          /**< Sum of the sample weights. */
+  double mean[3];         /**< Weighted mean ECEF position. */
+  double m2[3][3];        /**< Weighted sum of squared deviations. */
+  gps_time_t t_start;     /**< Time of the first sample. */
+  gps_time_t t_last;      /**< Time of the last sample. */
+} survey;
+
+static bool survey_in_notify(struct setting *s, const char *val)
+{
+  chMtxLock(&survey_lock);
+  bool ret = s->type->from_string(s->type->priv, s->addr, s->len, val);
+  memset(&survey, 0, sizeof(survey));
+  chMtxUnlock(&survey_lock);
+  if (ret && survey_in) {
+    log_info("Base station survey-in started.");
+  }
+  return ret;
+}
+
+/** Add a single point position solution to the base station survey-in.
+ * Samples are weighted by the inverse square of the PDOP. Does nothing
+ * unless a survey-in is in progress.
+ *
+ * \param soln Position solution.
+ * \param dops DOPs of the position solution.
+ */
+void base_survey_update(const gnss_solution *soln, const dops_t *dops)
+{
+  if (!survey_in || !soln->valid || (dops->pdop <= 0)) {
+    return;
+  }
+
+  chMtxLock(&survey_lock);
+  if (survey_in) {
+    double w = 1.0 / (dops->pdop * dops->pdop);
+    double delta[3];
+
+    if (survey.n == 0) {
+      survey.t_start = soln->time;
+    }
+    survey.n++;
+    survey.t_last = soln->time;
+    survey.weight += w;
+
+    /* Weighted incremental mean and covariance (West, 1979). */
+    for (u8 i = 0; i < 3; i++) {
+      delta[i] = soln->pos_ecef[i] - survey.mean[i];
+      survey.mean[i] += delta[i] * w / survey.weight;
+    }
+    for (u8 i = 0; i < 3; i++) {
+      for (u8 j = 0; j < 3; j++) {
+        survey.m2[i][j] += w * delta[i] * (soln->pos_ecef[j] - survey.mean[j]);
+      }
+    }
+  }
+  chMtxUnlock(&survey_lock);
+}
+
+/** Check for the end of a base station survey-in.
+ * Once the configured duration has passed, or the accuracy target has been
+ * met, the surveyed position is locked in as the broadcast base station
+ * position and the settings are saved.
+ */
+static void survey_check(void)
+{
+  double llh[3];
+  double accuracy;
+  double elapsed;
+
+  chMtxLock(&survey_lock);
+  if (!survey_in || (survey.n < 2)) {
+    chMtxUnlock(&survey_lock);
+    return;
+  }
+
+  elapsed = gpsdifftime(&survey.t_last, &survey.t_start);
+  double var = (survey.m2[0][0] + survey.m2[1][1] + survey.m2[2][2])
+               / survey.weight;
+  accuracy = sqrt(var / MAX(1.0, elapsed / SURVEY_CORRELATION_TIME));
+
+  bool done = (elapsed >= survey_duration) ||
+              ((survey_accuracy > 0) && (elapsed >= SURVEY_MIN_DURATION) &&
+               (accuracy <= survey_accuracy));
+  if (done) {
+    wgsecef2llh(survey.mean, llh);
+  }
+  chMtxUnlock(&survey_lock);
+
+  if (!done) {
+    return;
+  }
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.12g", llh[0] * R2D);
+  settings_write("surveyed_position", "surveyed_lat", buf);
+  snprintf(buf, sizeof(buf), "%.12g", llh[1] * R2D);
+  settings_write("surveyed_position", "surveyed_lon", buf);
+  snprintf(buf, sizeof(buf), "%.12g", llh[2]);
+  settings_write("surveyed_position", "surveyed_alt", buf);
+  settings_write("surveyed_position", "broadcast", "True");
+  settings_write("surveyed_position", "survey_in", "False");
+  settings_save();
+
+  log_info("Base station survey-in complete after %.0f s: "
+           "%.8f %.8f %.3f, accuracy %.2f m",
+           elapsed, llh[0] * R2D, llh[1] * R2D, llh[2], accuracy);
+}
+
 static THD_WORKING_AREA(wa_track_status_thread, 256);
 static void track_status_thread(void *arg)
 {
@@ -140,7 +327,7 @@ void sleep_until(systime_t *previous, systime_t period)
   *previous = future;
 }
 
-static WORKING_AREA_CCM(wa_system_monitor_thread, 1000);
+static WORKING_AREA_CCM(wa_system_monitor_thread, 2000);
 static void system_monitor_thread(void *arg)
 {
   (void)arg;
@@ -164,6 +351,8 @@ static void system_monitor_thread(void *arg)
     u32 status_flags = ant_status << 31 | SBP_MAJOR_VERSION << 16 | SBP_MINOR_VERSION << 8;
     sbp_send_msg(SBP_MSG_HEARTBEAT, sizeof(status_flags), (u8 *)&status_flags);
 
+    survey_check();
+
     /* If we are in base station mode then broadcast our known location. */
     if (broadcast_surveyed_position && position_quality == POSITION_FIX) {
       double tmp[3];
@@ -192,6 +381,7 @@ static void system_monitor_thread(void *arg)
 
     DO_EVERY(2,
      send_thread_states();
+     block_pool_check();
     );
 
     sleep_until(&time, MS2ST(heartbeat_period_milliseconds));
@@ -259,6 +449,10 @@ void system_monitor_setup()
   SETTING("surveyed_position", "surveyed_lat", base_llh[0], TYPE_FLOAT);
   SETTING("surveyed_position", "surveyed_lon", base_llh[1], TYPE_FLOAT);
   SETTING("surveyed_position", "surveyed_alt", base_llh[2], TYPE_FLOAT);
+  SETTING_NOTIFY("surveyed_position", "survey_in", survey_in, TYPE_BOOL,
+                 survey_in_notify);
+  SETTING("surveyed_position", "survey_duration", survey_duration, TYPE_FLOAT);
+  SETTING("surveyed_position", "survey_accuracy", survey_accuracy, TYPE_FLOAT);
 
 
   chThdCreateStatic(
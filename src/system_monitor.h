@@ -14,8 +14,10 @@
 #define SWIFTNAV_SYSTEM_MONITOR_H
 
 #include <libswiftnav/common.h>
+#include <libswiftnav/pvt.h>
 
 void system_monitor_setup(void);
+void base_survey_update(const gnss_solution *soln, const dops_t *dops);
 
 /* Notification flags: system_monitor_thread will only clear the
  * hardware watchdog if watchdog_notify() is called with *each* of
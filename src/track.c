@@ -86,6 +86,10 @@ typedef struct {
   mutex_t mutex;
   /** Elevation angle, degrees. TODO: find a better place for this. */
   s8 elevation;
+  /** Quality score, 0 - TRACK_QUALITY_MAX. Higher is better. */
+  u8 quality;
+  /** Quality flags, see track_quality_flag_t. */
+  u8 quality_flags;
   /** Associated tracker interface. */
   const tracker_interface_t *interface;
   /** Associated tracker instance. */
@@ -135,6 +139,8 @@ static void tracker_channel_unlock(tracker_channel_t *tracker_channel);
 static void error_flags_clear(tracker_channel_t *tracker_channel);
 static void error_flags_add(tracker_channel_t *tracker_channel,
                             error_flag_t error_flag);
+static void quality_update(tracker_channel_t *tracker_channel);
+static float quality_term_ramp(float x, float x_min, float x_max);
 
 
 /** Set up the tracking module. */
@@ -275,26 +281,6 @@ bool tracker_channel_available(tracker_channel_id_t id, gnss_signal_t sid)
                                   &tracker_interface);
 }
 
-/** Calculate the future code phase after N samples.
- * Calculate the expected code phase in N samples time with carrier aiding.
- *
- * \param code_phase   Current code phase in chips.
- * \param carrier_freq Current carrier frequency (i.e. Doppler) in Hz used for
- *                     carrier aiding.
- * \param n_samples    N, the number of samples to propagate for.
- *
- * \return The propagated code phase in chips.
- */
-double propagate_code_phase(double code_phase, double carrier_freq, u32 n_samples)
-{
-  /* Calculate the code phase rate with carrier aiding. */
-  double code_phase_rate = (1.0 + carrier_freq/GPS_L1_HZ) * GPS_CA_CHIPPING_RATE;
-  code_phase += n_samples * code_phase_rate / NAP_FRONTEND_SAMPLE_RATE_Hz;
-  u32 cp_int = floor(code_phase);
-  code_phase -= cp_int - (cp_int % 1023);
-  return code_phase;
-}
-
 /** Initialize a tracker channel to track the specified sid.
  *
  * \param id                    ID of the tracker channel to be initialized.
@@ -330,6 +316,8 @@ bool tracker_channel_init(tracker_channel_id_t id, gnss_signal_t sid,
     tracker_channel->tracker = tracker;
 
     tracker_channel->elevation = elevation;
+    tracker_channel->quality = 0;
+    tracker_channel->quality_flags = 0;
 
     common_data_init(&tracker_channel->common_data, ref_sample_count,
                      carrier_freq, cn0_init);
@@ -636,6 +624,56 @@ s8 tracking_channel_evelation_degrees_get(tracker_channel_id_t id)
   return tracker_channel->elevation;
 }
 
+/** Return the quality score for a tracker channel.
+ *
+ * The score is maintained by the tracking thread on every integration and
+ * ranks channels from 0 (worst) to TRACK_QUALITY_MAX (best).
+ *
+ * \param id      ID of the tracker channel to use.
+ */
+u8 tracking_channel_quality_get(tracker_channel_id_t id)
+{
+  const tracker_channel_t *tracker_channel = tracker_channel_get(id);
+  return tracker_channel->quality;
+}
+
+/** Return the quality flags for a tracker channel.
+ *
+ * \param id      ID of the tracker channel to use.
+ *
+ * \return Bitfield of track_quality_flag_t values.
+ */
+u8 tracking_channel_quality_flags_get(tracker_channel_id_t id)
+{
+  const tracker_channel_t *tracker_channel = tracker_channel_get(id);
+  return tracker_channel->quality_flags;
+}
+
+/** Estimate the quality score a signal would reach once its tracking loops
+ * have converged.
+ *
+ * Used to compare an acquisition candidate against running channels, so the
+ * lock and stability terms are assumed to be fully satisfied.
+ *
+ * \param cn0         C/N0 estimate (dBHz).
+ * \param elevation   Elevation (deg), or TRACKING_ELEVATION_UNKNOWN.
+ *
+ * \return Estimated quality score.
+ */
+u8 tracking_quality_estimate(float cn0, s8 elevation)
+{
+  float q = TRACK_QUALITY_WEIGHT_LOCK + TRACK_QUALITY_WEIGHT_STABLE;
+  q += TRACK_QUALITY_WEIGHT_CN0 *
+       quality_term_ramp(cn0, TRACK_QUALITY_CN0_MIN, TRACK_QUALITY_CN0_MAX);
+  if (elevation == TRACKING_ELEVATION_UNKNOWN) {
+    q += TRACK_QUALITY_WEIGHT_ELEVATION / 2;
+  } else {
+    q += TRACK_QUALITY_WEIGHT_ELEVATION *
+         quality_term_ramp(elevation, 0, 90);
+  }
+  return (u8)q;
+}
+
 /** Read the next pending nav bit for a tracker channel.
  *
  * \note This function should should be called from the same thread as
@@ -721,6 +759,7 @@ static void tracker_channel_process(tracker_channel_t *tracker_channel,
       {
         interface_function(tracker_channel,
                            tracker_channel->interface->update);
+        quality_update(tracker_channel);
       }
       tracker_channel_unlock(tracker_channel);
     }
@@ -1049,4 +1088,87 @@ static void error_flags_add(tracker_channel_t *tracker_channel,
   tracker_channel->error_flags |= error_flag;
 }
 
+/** Map x linearly from [x_min, x_max] onto [0, 1], saturating at both ends.
+ */
+static float quality_term_ramp(float x, float x_min, float x_max)
+{
+  if (x <= x_min)
+    return 0.0f;
+  if (x >= x_max)
+    return 1.0f;
+  return (x - x_min) / (x_max - x_min);
+}
+
+/** Update the quality score and flags of a tracker channel.
+ *
+ * Called after each tracker update so that consumers can gate and rank
+ * channels by reading a single value instead of re-evaluating every
+ * counter.
+ *
+ * \param tracker_channel   Tracker channel to use.
+ */
+static void quality_update(tracker_channel_t *tracker_channel)
+{
+  const tracker_common_data_t *common_data = &tracker_channel->common_data;
+  const tracker_internal_data_t *internal_data =
+      &tracker_channel->internal_data;
+
+  u32 cn0_useable_ms =
+      update_count_diff(tracker_channel,
+                        &common_data->cn0_below_use_thres_count);
+  u32 cn0_drop_ms =
+      update_count_diff(tracker_channel,
+                        &common_data->cn0_above_drop_thres_count);
+  u32 ld_opti_unlocked_ms =
+      update_count_diff(tracker_channel, &common_data->ld_opti_locked_count);
+  u32 ld_pess_locked_ms =
+      update_count_diff(tracker_channel, &common_data->ld_pess_unlocked_count);
+  u32 mode_change_ms =
+      update_count_diff(tracker_channel, &common_data->mode_change_count);
+
+  u8 flags = 0;
+  if (cn0_useable_ms > TRACK_SNR_THRES_COUNT)
+    flags |= TRACK_QUALITY_FLAG_CN0_USABLE;
+  if (ld_pess_locked_ms > TRACK_USE_LOCKED_T)
+    flags |= TRACK_QUALITY_FLAG_PLL_LOCKED;
+  if (mode_change_ms > TRACK_STABILIZATION_T)
+    flags |= TRACK_QUALITY_FLAG_STABLE;
+  if (common_data->TOW_ms != TOW_INVALID)
+    flags |= TRACK_QUALITY_FLAG_TOW_VALID;
+  if (internal_data->bit_polarity != BIT_POLARITY_UNKNOWN)
+    flags |= TRACK_QUALITY_FLAG_POLARITY;
+  if (internal_data->bit_sync.bit_phase_ref != BITSYNC_UNSYNCED)
+    flags |= TRACK_QUALITY_FLAG_BIT_SYNC;
+  if (ld_opti_unlocked_ms > TRACK_DROP_UNLOCKED_T)
+    flags |= TRACK_QUALITY_FLAG_PLL_LOST;
+  if (cn0_drop_ms > TRACK_DROP_CN0_T)
+    flags |= TRACK_QUALITY_FLAG_CN0_LOST;
+
+  float q = 0.0f;
+  if (!(flags & (TRACK_QUALITY_FLAG_PLL_LOST | TRACK_QUALITY_FLAG_CN0_LOST))) {
+    q += TRACK_QUALITY_WEIGHT_CN0 *
+         quality_term_ramp(common_data->cn0, TRACK_QUALITY_CN0_MIN,
+                           TRACK_QUALITY_CN0_MAX);
+
+    /* Full lock credit for pessimistic lock, half for optimistic only. */
+    if (flags & TRACK_QUALITY_FLAG_PLL_LOCKED)
+      q += TRACK_QUALITY_WEIGHT_LOCK;
+    else if (ld_opti_unlocked_ms == 0)
+      q += TRACK_QUALITY_WEIGHT_LOCK / 2;
+
+    q += TRACK_QUALITY_WEIGHT_STABLE *
+         quality_term_ramp(mode_change_ms, 0, TRACK_STABILIZATION_T);
+
+    if (tracker_channel->elevation == TRACKING_ELEVATION_UNKNOWN) {
+      q += TRACK_QUALITY_WEIGHT_ELEVATION / 2;
+    } else {
+      q += TRACK_QUALITY_WEIGHT_ELEVATION *
+           quality_term_ramp(tracker_channel->elevation, 0, 90);
+    }
+  }
+
+  tracker_channel->quality_flags = flags;
+  tracker_channel->quality = (u8)q;
+}
+
 /** \} */
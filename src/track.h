@@ -29,6 +29,66 @@
 
 #define TRACKING_ELEVATION_UNKNOWN 100 /* Ensure it will be above elev. mask */
 
+/** If C/N0 has been above the use threshold for >= TRACK_SNR_THRES_COUNT ms,
+    the channel's C/N0 is considered usable. */
+#define TRACK_SNR_THRES_COUNT 2000
+
+/** If C/N0 is below track_cn0_threshold for >= TRACK_DROP_CN0_T ms,
+    drop the channel. */
+#define TRACK_DROP_CN0_T 5000
+
+/** If optimistic phase lock detector shows "unlocked" for >=
+    TRACK_DROP_UNLOCKED_T ms, drop the channel. */
+#define TRACK_DROP_UNLOCKED_T 5000
+
+/** If pessimistic phase lock detector shows "locked" for >=
+    TRACK_USE_LOCKED_T ms, use the channel. */
+#define TRACK_USE_LOCKED_T 100
+
+/** How many milliseconds to wait for the tracking loops to
+ * stabilize after any mode change before using obs. */
+#define TRACK_STABILIZATION_T 1000
+
+/** Maximum value of the tracking channel quality score. */
+#define TRACK_QUALITY_MAX 100
+
+/* Contributions of each term to the quality score, summing to
+ * TRACK_QUALITY_MAX. */
+#define TRACK_QUALITY_WEIGHT_CN0        40
+#define TRACK_QUALITY_WEIGHT_LOCK       30
+#define TRACK_QUALITY_WEIGHT_STABLE     15
+#define TRACK_QUALITY_WEIGHT_ELEVATION  15
+
+/** C/N0 range (dBHz) mapped linearly onto the C/N0 quality term. */
+#define TRACK_QUALITY_CN0_MIN 30.0f
+#define TRACK_QUALITY_CN0_MAX 50.0f
+
+/** Tracking channel quality flags, updated by the tracker on every
+ * integration. */
+typedef enum {
+  TRACK_QUALITY_FLAG_CN0_USABLE =   0x01, /**< C/N0 above use threshold for
+                                               TRACK_SNR_THRES_COUNT ms. */
+  TRACK_QUALITY_FLAG_PLL_LOCKED =   0x02, /**< Pessimistic lock detector
+                                               locked for TRACK_USE_LOCKED_T. */
+  TRACK_QUALITY_FLAG_STABLE =       0x04, /**< No mode change for
+                                               TRACK_STABILIZATION_T ms. */
+  TRACK_QUALITY_FLAG_TOW_VALID =    0x08, /**< Time of week decoded. */
+  TRACK_QUALITY_FLAG_POLARITY =     0x10, /**< Half-cycle ambiguity resolved. */
+  TRACK_QUALITY_FLAG_BIT_SYNC =     0x20, /**< Nav bit sync achieved. */
+  TRACK_QUALITY_FLAG_PLL_LOST =     0x40, /**< Optimistic lock detector
+                                               unlocked for
+                                               TRACK_DROP_UNLOCKED_T ms. */
+  TRACK_QUALITY_FLAG_CN0_LOST =     0x80, /**< C/N0 below drop threshold for
+                                               TRACK_DROP_CN0_T ms. */
+} track_quality_flag_t;
+
+/** Flags which must all be set for a channel's measurements to be used. */
+#define TRACK_QUALITY_FLAGS_USABLE (TRACK_QUALITY_FLAG_CN0_USABLE | \
+                                    TRACK_QUALITY_FLAG_PLL_LOCKED | \
+                                    TRACK_QUALITY_FLAG_STABLE | \
+                                    TRACK_QUALITY_FLAG_TOW_VALID | \
+                                    TRACK_QUALITY_FLAG_POLARITY)
+
 typedef u8 tracker_channel_id_t;
 
 /** \} */
@@ -76,6 +136,10 @@ void tracking_channel_measurement_get(tracker_channel_id_t id, u64 ref_tc,
 bool tracking_channel_evelation_degrees_set(gnss_signal_t sid, s8 elevation);
 s8 tracking_channel_evelation_degrees_get(tracker_channel_id_t id);
 
+u8 tracking_channel_quality_get(tracker_channel_id_t id);
+u8 tracking_channel_quality_flags_get(tracker_channel_id_t id);
+u8 tracking_quality_estimate(float cn0, s8 elevation);
+
 /* Decoder interface */
 bool tracking_channel_nav_bit_get(tracker_channel_id_t id, s8 *soft_bit);
 bool tracking_channel_time_sync(tracker_channel_id_t id, s32 TOW_ms,
@@ -285,8 +285,10 @@ static void tracker_gps_l1ca_update(const tracker_channel_info_t *channel_info,
   common_data->code_phase_rate = data->tl_state.code_freq + GPS_CA_CHIPPING_RATE;
 
   /* Attempt alias detection if we have pessimistic phase lock detect, OR
-     (optimistic phase lock detect AND are in second-stage tracking) */
-  if (use_alias_detection &&
+     (optimistic phase lock detect AND are in second-stage tracking).
+     Alias detection compares the short and long cycles, so it needs an
+     integration period of more than 1 ms. */
+  if (use_alias_detection && (data->int_ms > 1) &&
       (data->lock_detect.outp ||
        (data->lock_detect.outo && data->stage > 0))) {
     s32 I = (cs[1].I - data->alias_detect.first_I) / (data->int_ms - 1);
@@ -13,12 +13,16 @@
 #include "track_internal.h"
 #include "track.h"
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
 #include <ch.h>
 
+#include <libswiftnav/constants.h>
+
+#include "nap/nap_constants.h"
 #include "signal.h"
 #include "peripherals/random.h"
 
@@ -222,6 +226,26 @@ s8 nav_bit_quantize(s32 bit_integrate)
     return ((bit_integrate + 1) / (1 << 24)) - 1;
 }
 
+/** Calculate the future code phase after N samples.
+ * Calculate the expected code phase in N samples time with carrier aiding.
+ *
+ * \param code_phase   Current code phase in chips.
+ * \param carrier_freq Current carrier frequency (i.e. Doppler) in Hz used for
+ *                     carrier aiding.
+ * \param n_samples    N, the number of samples to propagate for.
+ *
+ * \return The propagated code phase in chips.
+ */
+double propagate_code_phase(double code_phase, double carrier_freq, u32 n_samples)
+{
+  /* Calculate the code phase rate with carrier aiding. */
+  double code_phase_rate = (1.0 + carrier_freq/GPS_L1_HZ) * GPS_CA_CHIPPING_RATE;
+  code_phase += n_samples * code_phase_rate / NAP_FRONTEND_SAMPLE_RATE_Hz;
+  u32 cp_int = floor(code_phase);
+  code_phase -= cp_int - (cp_int % 1023);
+  return code_phase;
+}
+
 /** Increment and return the tracking lock counter for the specified sid.
  *
  * \param sid         Signal identifier to use.
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the v3 acquisition kernels: the vector kernels built for the
+ * host (NEON on ARM, SSE2 or AVX2 on x86) must be bit-identical to the *_ref
+ * reference kernels, over random and full scale inputs, every circular
+ * offset class and lengths that leave a scalar tail. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <libswiftnav/common.h>
+
+#include "acq_kernels.h"
+#include "check.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define KERNELS "NEON"
+#elif defined(__AVX2__)
+#define KERNELS "AVX2"
+#elif defined(__SSE2__)
+#define KERNELS "SSE2"
+#else
+#define KERNELS "scalar"
+#endif
+
+#define LEN_MAX 16384
+
+static fft_cplx_t code[LEN_MAX];
+static fft_cplx_t samples[LEN_MAX];
+static fft_cplx_t result[LEN_MAX];
+static fft_cplx_t result_ref[LEN_MAX];
+
+static u32 rng_state = 12345;
+
+static u32 rand_u32(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+/** Random point, with full scale values in one component of eight. */
+static fft_cplx_t rand_point(void)
+{
+  static const s16 extremes[] = {-32768, -32767, 32767, -1, 0, 1};
+  u32 x = rand_u32();
+  fft_cplx_t p = {.re = (s16)x, .im = (s16)(x >> 16)};
+  if ((x & 0x7) == 0)
+    p.re = extremes[(x >> 3) % ARRAY_SIZE(extremes)];
+  if (((x >> 8) & 0x7) == 0)
+    p.im = extremes[(x >> 11) % ARRAY_SIZE(extremes)];
+  return p;
+}
+
+static void fill(fft_cplx_t *p, u32 len)
+{
+  for (u32 i = 0; i < len; i++)
+    p[i] = rand_point();
+}
+
+static bool peak_equal(const acq_peak_t *a, const acq_peak_t *b)
+{
+  return (a->mag_sq == b->mag_sq) && (a->index == b->index) &&
+         (a->mag_sq_sum == b->mag_sq_sum);
+}
+
+static void check_mult_conj(u32 len, u32 offset)
+{
+  memset(result, 0x55, sizeof(result));
+  memset(result_ref, 0xaa, sizeof(result_ref));
+  acq_mult_conj(code, samples, offset, result, len);
+  acq_mult_conj_ref(code, samples, offset, result_ref, len);
+  bool ok = memcmp(result, result_ref, len * sizeof(fft_cplx_t)) == 0;
+  CHECK(ok);
+  if (!ok)
+    printf("  mult_conj len %u offset %u\n", (unsigned)len, (unsigned)offset);
+}
+
+static void check_peak_search(const fft_cplx_t *in, u32 len)
+{
+  acq_peak_t peak, peak_ref;
+  acq_peak_search(in, len, &peak);
+  acq_peak_search_ref(in, len, &peak_ref);
+  bool ok = peak_equal(&peak, &peak_ref);
+  CHECK(ok);
+  if (!ok)
+    printf("  peak_search len %u: %u@%u sum %llu, ref %u@%u sum %llu\n",
+           (unsigned)len, (unsigned)peak.mag_sq, (unsigned)peak.index,
+           (unsigned long long)peak.mag_sq_sum, (unsigned)peak_ref.mag_sq,
+           (unsigned)peak_ref.index, (unsigned long long)peak_ref.mag_sq_sum);
+}
+
+/* Random inputs at acquisition and odd lengths, all offsets near the ends of
+ * the buffer and random ones in between. */
+static void test_mult_conj(void)
+{
+  static const u32 lens[] = {LEN_MAX, 1024, 16, 8, 4, 2, 1};
+
+  for (u32 l = 0; l < ARRAY_SIZE(lens); l++) {
+    u32 len = lens[l];
+    fill(code, len);
+    fill(samples, len);
+    for (u32 offset = 0; offset < MIN(len, 17); offset++) {
+      check_mult_conj(len, offset);
+      check_mult_conj(len, len - 1 - offset);
+    }
+    for (u32 k = 0; k < 16; k++)
+      check_mult_conj(len, rand_u32());
+  }
+}
+
+/* Products at the limits of the 32 bit accumulation. */
+static void test_mult_conj_extremes(void)
+{
+  static const s16 v[] = {-32768, -32767, 32767, 0};
+  u32 n = 0;
+  for (u32 a = 0; a < 16; a++) {
+    for (u32 b = 0; b < 16; b++) {
+      code[n] = (fft_cplx_t){.re = v[a & 3], .im = v[a >> 2]};
+      samples[n] = (fft_cplx_t){.re = v[b & 3], .im = v[b >> 2]};
+      n++;
+    }
+  }
+  check_mult_conj(n, 0);
+
+  /* -32768 - 32768j squared overflows the real sum of products. */
+  code[0] = samples[0] = (fft_cplx_t){.re = -32768, .im = -32768};
+  acq_mult_conj_ref(code, samples, 0, result_ref, 1);
+  CHECK(result_ref[0].re == (s16)(-(1 << 26)));
+  CHECK(result_ref[0].im == 0);
+}
+
+static void test_peak_search(void)
+{
+  /* Random points, including full scale ones whose squared magnitude is
+   * 2^31. */
+  fill(code, LEN_MAX);
+  for (u32 len = 1; len <= 40; len++)
+    check_peak_search(code, len);
+  check_peak_search(code, LEN_MAX);
+
+  code[LEN_MAX / 3] = (fft_cplx_t){.re = -32768, .im = -32768};
+  check_peak_search(code, LEN_MAX);
+
+  /* No signal. */
+  memset(code, 0, sizeof(code));
+  check_peak_search(code, LEN_MAX);
+
+  /* Ties in different lanes and in the tail: the first occurrence wins. */
+  static const u32 ties[][3] = {
+    {7, 5, 100}, {5, 7, 100}, {3, 2, 1}, {9, 17, 4}, {LEN_MAX - 1, 6, 3},
+  };
+  for (u32 t = 0; t < ARRAY_SIZE(ties); t++) {
+    fill(code, LEN_MAX);
+    for (u32 i = 0; i < LEN_MAX; i++)
+      code[i].re = code[i].im = (s16)(rand_u32() % 1000);
+    for (u32 k = 0; k < 3; k++)
+      code[ties[t][k]] = (fft_cplx_t){.re = 30000, .im = -30000};
+    check_peak_search(code, LEN_MAX);
+    check_peak_search(code, 27);
+
+    acq_peak_t peak;
+    acq_peak_search(code, LEN_MAX, &peak);
+    CHECK(peak.index == MIN(MIN(ties[t][0], ties[t][1]), ties[t][2]));
+  }
+}
+
+int main(void)
+{
+  printf("acquisition kernels: %s\n", KERNELS);
+
+  test_mult_conj();
+  test_mult_conj_extremes();
+  test_peak_search();
+
+  return check_summary();
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of multi-signal acquisition searches on the v2 board.
+ *
+ * The NAP acquisition driver is replaced by a model of the acquisition
+ * channel. A load captures the sky at the sample count of the timing strobe,
+ * the code ram holds one signal and a search correlates the loaded samples
+ * with the code in the code ram. Each satellite of the modelled sky has a
+ * code phase that drifts with the sample count, so a result computed with
+ * the wrong code or the wrong samples does not match the expected one. */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "acq.h"
+#include "nap/nap_acq.h"
+#include "check.h"
+
+#define N_SATS 32
+#define NOISE_CN0 30.0f
+#define SIGNAL_CN0 45.0f
+
+u8 nap_acq_fft_index_bits = 14;
+u8 nap_acq_downsample_stages = 1;
+
+typedef struct {
+  u64 timing_count;     /**< NAP sample counter. */
+  u32 n_load_failures;  /**< Loads left to fail, as if the strobe was missed. */
+  bool loaded;          /**< Sample ram holds samples. */
+  u32 load_count;       /**< Sample count of the loaded samples. */
+  bool code_valid;      /**< Code ram holds a code. */
+  gnss_signal_t code;   /**< Signal whose code is in the code ram. */
+  bool searched;        /**< Results of a search are available. */
+  float cp, cf, cn0;    /**< Results of the last search. */
+  u32 n_loads;
+  u32 n_load_attempts;
+  u32 n_code_writes;
+  u32 n_searches;
+  u32 n_errors;
+} acq_model_t;
+
+static acq_model_t m;
+
+/* Satellites with odd PRNs are visible. */
+static bool sky_visible(gnss_signal_t sid)
+{
+  return (sid.sat % 2) == 1;
+}
+
+static float sky_doppler(gnss_signal_t sid)
+{
+  return -4000.0f + 250.0f * sid.sat;
+}
+
+static float sky_code_phase(gnss_signal_t sid, u32 sample_count)
+{
+  return fmodf(37.0f * sid.sat + (sample_count % 100000) * 0.001f, 1023.0f);
+}
+
+static void error(const char *what)
+{
+  printf("model error: %s\n", what);
+  m.n_errors++;
+}
+
+u64 nap_timing_count(void)
+{
+  m.timing_count += 1000;
+  return m.timing_count;
+}
+
+void acq_set_sid(gnss_signal_t sid)
+{
+  m.code = sid;
+  m.code_valid = true;
+  m.searched = false;
+  m.n_code_writes++;
+}
+
+bool acq_load(u32 count)
+{
+  m.n_load_attempts++;
+  if (count <= m.timing_count)
+    error("load scheduled in the past");
+  if (m.n_load_failures > 0) {
+    m.n_load_failures--;
+    return false;
+  }
+  m.loaded = true;
+  m.load_count = count;
+  m.searched = false;
+  m.n_loads++;
+  return true;
+}
+
+void acq_search_begin(float cf_min, float cf_max, float cf_bin_width)
+{
+  if (!m.loaded || !m.code_valid) {
+    error("search without samples or code");
+    return;
+  }
+
+  float dopp = sky_doppler(m.code);
+  if (sky_visible(m.code) && (dopp >= cf_min) && (dopp <= cf_max)) {
+    m.cp = sky_code_phase(m.code, m.load_count);
+    m.cf = dopp;
+    m.cn0 = SIGNAL_CN0;
+  } else {
+    m.cp = 0;
+    m.cf = cf_min;
+    m.cn0 = NOISE_CN0;
+  }
+  m.searched = true;
+  m.n_searches++;
+}
+
+void acq_get_results(float* cp, float* cf, float* cn0)
+{
+  if (!m.searched)
+    error("results read without a search");
+  *cp = m.cp;
+  *cf = m.cf;
+  *cn0 = m.cn0;
+}
+
+static void model_reset(void)
+{
+  memset(&m, 0, sizeof(m));
+  m.timing_count = 123456;
+}
+
+static gnss_signal_t sid_gps(u16 sat)
+{
+  gnss_signal_t sid;
+  memset(&sid, 0, sizeof(sid));
+  sid.sat = sat;
+  return sid;
+}
+
+static void check_result(const acq_search_params_t *p, const acq_result_t *r,
+                         u32 sample_count)
+{
+  CHECK(r->sample_count == sample_count);
+  CHECK(r->excised_bins == 0);
+  float dopp = sky_doppler(p->sid);
+  if (sky_visible(p->sid) && (dopp >= p->cf_min) && (dopp <= p->cf_max)) {
+    CHECK(r->cn0 == SIGNAL_CN0);
+    CHECK(r->cf == dopp);
+    CHECK(r->cp == sky_code_phase(p->sid, sample_count));
+  } else {
+    CHECK(r->cn0 == NOISE_CN0);
+  }
+}
+
+/* A single search loads samples and writes the code once. */
+static void test_single(void)
+{
+  model_reset();
+
+  acq_result_t r;
+  acq_search_params_t p = {sid_gps(5), -5000, 5000};
+  CHECK(acq_search(p.sid, p.cf_min, p.cf_max, 250, &r));
+  CHECK(m.n_loads == 1);
+  CHECK(m.n_code_writes == 1);
+  CHECK(m.n_searches == 1);
+  check_result(&p, &r, m.load_count);
+  CHECK(m.n_errors == 0);
+}
+
+/* Several signals are searched against one load, results matched by index. */
+static void test_multi(void)
+{
+  model_reset();
+
+  acq_search_params_t p[ACQ_MULTI_MAX];
+  acq_result_t r[ACQ_MULTI_MAX];
+  for (u32 i = 0; i < ACQ_MULTI_MAX; i++) {
+    p[i].sid = sid_gps(3 + 2 * i + (i == 1));
+    p[i].cf_min = -5000;
+    p[i].cf_max = 5000;
+  }
+  /* Out of range for the second visible signal. */
+  p[2].cf_max = sky_doppler(p[2].sid) - 100;
+
+  CHECK(acq_search_multi(ACQ_MULTI_MAX, p, 250, r) == ACQ_MULTI_MAX);
+  CHECK(m.n_loads == 1);
+  CHECK(m.n_code_writes == ACQ_MULTI_MAX);
+  CHECK(m.n_searches == ACQ_MULTI_MAX);
+  for (u32 i = 0; i < ACQ_MULTI_MAX; i++)
+    check_result(&p[i], &r[i], m.load_count);
+  CHECK(r[0].cn0 == SIGNAL_CN0);
+  CHECK(r[1].cn0 == NOISE_CN0);
+  CHECK(r[2].cn0 == NOISE_CN0);
+  CHECK(r[3].cn0 == SIGNAL_CN0);
+  CHECK(r[0].cp != r[3].cp);
+  CHECK(m.n_errors == 0);
+}
+
+/* Missed strobes are retried with a new sample count. */
+static void test_load_retry(void)
+{
+  model_reset();
+  m.n_load_failures = 3;
+
+  acq_search_params_t p[2] = {
+    {sid_gps(7), -5000, 5000},
+    {sid_gps(9), -5000, 5000},
+  };
+  acq_result_t r[2];
+  CHECK(acq_search_multi(2, p, 250, r) == 2);
+  CHECK(m.n_load_attempts == 4);
+  CHECK(m.n_loads == 1);
+  CHECK(r[0].sample_count == r[1].sample_count);
+  check_result(&p[0], &r[0], m.load_count);
+  check_result(&p[1], &r[1], m.load_count);
+
+  /* Nothing to search, nothing loaded. */
+  model_reset();
+  CHECK(acq_search_multi(0, p, 250, r) == 0);
+  CHECK(m.n_load_attempts == 0);
+  CHECK(m.n_errors == 0);
+}
+
+int main(void)
+{
+  test_single();
+  test_multi();
+  test_load_retry();
+
+  return check_summary();
+}
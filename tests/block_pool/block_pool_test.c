@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the typed block pools: block sizes and alignment, exhaustion,
+ * statistics and the reporting of refused allocations. */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <ch.h>
+#include <libswiftnav/logging.h>
+
+#include "block_pool.h"
+#include "check.h"
+
+static u32 n_warnings;
+
+void log_(u8 level, const char *msg, ...)
+{
+  (void)msg;
+  if (level == LOG_WARN)
+    n_warnings++;
+}
+
+static const u32 block_sizes[BLOCK_POOL_COUNT] = {
+  [BLOCK_POOL_SBP_FRAME] = SBP_FRAMING_MAX_PAYLOAD_SIZE,
+  [BLOCK_POOL_OBSS] = sizeof(obss_t),
+  [BLOCK_POOL_SDIFFS] = MAX_CHANNELS * sizeof(sdiff_t),
+};
+
+/* Every block of a pool can be allocated once, written in full without
+ * touching the others, and the pool then refuses further allocations. */
+static void test_exhaust(block_pool_id_t id)
+{
+  block_pool_stats_t s;
+  block_pool_stats(id, &s);
+  CHECK(s.n_used == 0);
+  CHECK(s.block_size >= block_sizes[id]);
+
+  void *blocks[s.n_blocks];
+  for (u32 i = 0; i < s.n_blocks; i++) {
+    blocks[i] = block_pool_alloc(id);
+    CHECK(blocks[i] != NULL);
+    CHECK(((uintptr_t)blocks[i] % sizeof(u32)) == 0);
+    memset(blocks[i], (int)i, block_sizes[id]);
+  }
+  CHECK(block_pool_alloc(id) == NULL);
+  CHECK(block_pool_alloc(id) == NULL);
+
+  for (u32 i = 0; i < s.n_blocks; i++) {
+    const u8 *b = blocks[i];
+    CHECK((b[0] == (u8)i) && (b[block_sizes[id] - 1] == (u8)i));
+  }
+
+  block_pool_stats(id, &s);
+  CHECK(s.n_used == s.n_blocks);
+  CHECK(s.max_used == s.n_blocks);
+  CHECK(s.n_failures == 2);
+
+  /* A freed block is handed out again. */
+  block_pool_free(id, blocks[0]);
+  CHECK(block_pool_alloc(id) == blocks[0]);
+
+  for (u32 i = 0; i < s.n_blocks; i++)
+    block_pool_free(id, blocks[i]);
+
+  block_pool_stats(id, &s);
+  CHECK(s.n_used == 0);
+  CHECK(s.max_used == s.n_blocks);
+}
+
+/* The typed wrappers draw from their own pools. */
+static void test_typed(void)
+{
+  u8 *frame = sbp_frame_alloc();
+  obss_t *obss = obss_alloc();
+  sdiff_t *sdiffs = sdiffs_alloc();
+  CHECK((frame != NULL) && (obss != NULL) && (sdiffs != NULL));
+
+  block_pool_stats_t s[BLOCK_POOL_COUNT];
+  for (u32 i = 0; i < BLOCK_POOL_COUNT; i++) {
+    block_pool_stats(i, &s[i]);
+    CHECK(s[i].n_used == 1);
+  }
+
+  sbp_frame_free(frame);
+  obss_free(obss);
+  sdiffs_free(sdiffs);
+  for (u32 i = 0; i < BLOCK_POOL_COUNT; i++) {
+    block_pool_stats(i, &s[i]);
+    CHECK(s[i].n_used == 0);
+  }
+}
+
+/* Refusals are reported once, each pool on its own. */
+static void test_check(void)
+{
+  /* Refusals of test_exhaust, one warning per pool. */
+  n_warnings = 0;
+  block_pool_check();
+  CHECK(n_warnings == BLOCK_POOL_COUNT);
+  block_pool_check();
+  CHECK(n_warnings == BLOCK_POOL_COUNT);
+
+  obss_t *obss[BLOCK_POOL_OBSS_COUNT];
+  for (u32 i = 0; i < BLOCK_POOL_OBSS_COUNT; i++)
+    obss[i] = obss_alloc();
+  CHECK(obss_alloc() == NULL);
+  for (u32 i = 0; i < BLOCK_POOL_OBSS_COUNT; i++)
+    obss_free(obss[i]);
+
+  n_warnings = 0;
+  block_pool_check();
+  CHECK(n_warnings == 1);
+}
+
+int main(void)
+{
+  block_pool_setup();
+
+  for (u32 i = 0; i < BLOCK_POOL_COUNT; i++)
+    test_exhaust(i);
+  test_typed();
+  test_check();
+
+  CHECK(host_lock_errors == 0);
+
+  return check_summary();
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the Hatch filter and of the Doppler propagation of
+ * navigation measurements.
+ *
+ * Observations of a satellite whose range changes at a constant rate are
+ * generated exactly, with the carrier phase decreasing as the range grows.
+ * Base and rover observations taken at different times and propagated to a
+ * common epoch must then difference to zero, and smoothing must leave them
+ * on the true range. */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libswiftnav/constants.h>
+
+#include "hatch.h"
+#include "signal.h"
+#include "check.h"
+
+#define RANGE_0        2.2e7    /* m */
+#define RANGE_PHASE_0  1234.25  /* cycles */
+#define TOLERANCE      1e-6     /* m */
+
+u16 sid_to_global_index(gnss_signal_t sid)
+{
+  return sid.sat - 1;
+}
+
+/** Exact observation at time t of a range changing at range_rate. */
+static navigation_measurement_t observe(double t, double range_rate)
+{
+  navigation_measurement_t nm;
+  memset(&nm, 0, sizeof(nm));
+  nm.sid.code = CODE_GPS_L1CA;
+  nm.sid.sat = 1;
+  nm.raw_pseudorange = RANGE_0 + range_rate * t;
+  nm.pseudorange = nm.raw_pseudorange;
+  nm.raw_carrier_phase = RANGE_PHASE_0 - nm.raw_pseudorange / GPS_L1_LAMBDA;
+  nm.raw_doppler = -range_rate / GPS_L1_LAMBDA;
+  return nm;
+}
+
+/* Base and rover observations made at different times differ once
+ * propagated to the same epoch only by what differs in the observations. */
+static void test_propagate(void)
+{
+  static const double range_rates[] = {-800.0, -1.5, 0.0, 3.0, 650.0};
+  static const double t_base[] = {-0.95, -0.2, 0.0, 0.05};
+  static const double t_rover[] = {-0.03, 0.0, 0.01, 0.4};
+
+  for (u32 i = 0; i < sizeof(range_rates) / sizeof(range_rates[0]); i++) {
+    for (u32 j = 0; j < sizeof(t_base) / sizeof(t_base[0]); j++) {
+      for (u32 k = 0; k < sizeof(t_rover) / sizeof(t_rover[0]); k++) {
+        double rate = range_rates[i];
+        navigation_measurement_t base = observe(t_base[j], rate);
+        navigation_measurement_t rover = observe(t_rover[k], rate);
+        nav_meas_propagate(&base, -t_base[j]);
+        nav_meas_propagate(&rover, -t_rover[k]);
+
+        double dpr = rover.raw_pseudorange - base.raw_pseudorange;
+        double dcp = (rover.raw_carrier_phase - base.raw_carrier_phase) *
+                     GPS_L1_LAMBDA;
+        CHECK(fabs(dpr) < TOLERANCE);
+        CHECK(fabs(dcp) < TOLERANCE);
+        if ((fabs(dpr) >= TOLERANCE) || (fabs(dcp) >= TOLERANCE)) {
+          printf("  rate %.1f t_base %.2f t_rover %.2f: dpr %g dcp %g\n",
+                 rate, t_base[j], t_rover[k], dpr, dcp);
+        }
+
+        navigation_measurement_t truth = observe(0, rate);
+        CHECK(fabs(base.raw_pseudorange - truth.raw_pseudorange) <
+              TOLERANCE);
+        CHECK(fabs(base.raw_carrier_phase - truth.raw_carrier_phase) *
+              GPS_L1_LAMBDA < TOLERANCE);
+      }
+    }
+  }
+}
+
+/* The filter follows a noiseless range exactly, so smoothing agrees with
+ * the propagation convention. */
+static void test_smooth(void)
+{
+  const double rate = 420.0;
+  const double dt = 0.2;
+
+  hatch_filter_reset();
+  for (u32 k = 0; k < 200; k++) {
+    navigation_measurement_t nm = observe(k * dt, rate);
+    double range = nm.raw_pseudorange;
+    hatch_filter_update(1, &nm, 100);
+    CHECK(fabs(nm.raw_pseudorange - range) < TOLERANCE);
+    CHECK(fabs(nm.pseudorange - range) < TOLERANCE);
+  }
+}
+
+/* Noise on the pseudorange is reduced while the carrier phase carries the
+ * range change. */
+static void test_noise(void)
+{
+  const double rate = -300.0;
+  const double dt = 0.1;
+  const u32 window = 100;
+  double sum_raw = 0;
+  double sum_smoothed = 0;
+  u32 n = 0;
+
+  hatch_filter_reset();
+  for (u32 k = 0; k < 1000; k++) {
+    navigation_measurement_t nm = observe(k * dt, rate);
+    double range = nm.raw_pseudorange;
+    double noise = (k % 2) ? 1.0 : -1.0;
+    nm.raw_pseudorange += noise;
+    nm.pseudorange += noise;
+    hatch_filter_update(1, &nm, window);
+    if (k >= window) {
+      sum_raw += noise * noise;
+      sum_smoothed += (nm.raw_pseudorange - range) *
+                      (nm.raw_pseudorange - range);
+      n++;
+    }
+  }
+  CHECK(sqrt(sum_smoothed / n) < 0.05 * sqrt(sum_raw / n));
+}
+
+int main(void)
+{
+  test_propagate();
+  test_smooth();
+  test_noise();
+
+  return check_summary();
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Minimal stand-in for the ChibiOS header shared by the host-built tests.
+ *
+ * Host tests are single threaded. The lock state is tracked so tests can
+ * check that I-class functions are called with the system locked. The
+ * memory pool follows the ChibiOS one, a LIFO free list threaded through
+ * the free blocks. Functions that block or read the time are defined weak
+ * in host_ch.c, so a test can replace them, e.g. to advance the time of a
+ * device model on sleeps. */
+
+#ifndef SWIFTNAV_TESTS_HOST_CH_H
+#define SWIFTNAV_TESTS_HOST_CH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRUE  1
+#define FALSE 0
+
+#define CH_CFG_ST_FREQUENCY 1000
+#define MS2ST(ms) ((systime_t)(ms))
+
+#define LOWPRIO    2
+#define NORMALPRIO 64
+#define HIGHPRIO   127
+
+#define MSG_OK         0
+#define MSG_TIMEOUT    -1
+#define TIME_IMMEDIATE ((systime_t)0)
+#define TIME_INFINITE  ((systime_t)-1)
+
+/* No CCM or backup SRAM on the host. */
+#define _CCM
+#define _BCKP
+
+typedef uint32_t systime_t;
+typedef int tprio_t;
+typedef int32_t msg_t;
+typedef void (*tfunc_t)(void *arg);
+
+typedef struct {
+  int dummy;
+} thread_t;
+
+typedef struct {
+  int locked;
+} mutex_t;
+
+typedef struct {
+  bool taken;
+} binary_semaphore_t;
+
+#define MUTEX_DECL(name) mutex_t name = {0}
+#define BSEMAPHORE_DECL(name, taken) binary_semaphore_t name = {taken}
+#define THD_WORKING_AREA(s, n) uint8_t s[n]
+#define WORKING_AREA_CCM(s, n) THD_WORKING_AREA(s, n)
+
+extern bool host_sys_locked;
+extern unsigned int host_lock_errors;
+
+static inline void chSysLock(void) { host_sys_locked = true; }
+static inline void chSysUnlock(void) { host_sys_locked = false; }
+
+static inline void chMtxObjectInit(mutex_t *mp) { mp->locked = 0; }
+void chMtxLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio,
+                            tfunc_t pf, void *arg);
+void chRegSetThreadName(const char *name);
+void chThdSleepMilliseconds(uint32_t ms);
+
+systime_t chVTGetSystemTime(void);
+systime_t chVTTimeElapsedSinceX(systime_t start);
+
+struct pool_header {
+  struct pool_header *next;
+};
+
+typedef struct {
+  struct pool_header *next;
+  size_t object_size;
+  void *provider;
+} memory_pool_t;
+
+static inline void chPoolObjectInit(memory_pool_t *mp, size_t size,
+                                    void *provider)
+{
+  mp->next = NULL;
+  mp->object_size = size;
+  mp->provider = provider;
+}
+
+static inline void chPoolFreeI(memory_pool_t *mp, void *objp)
+{
+  if (!host_sys_locked)
+    host_lock_errors++;
+  struct pool_header *php = (struct pool_header *)objp;
+  php->next = mp->next;
+  mp->next = php;
+}
+
+static inline void *chPoolAllocI(memory_pool_t *mp)
+{
+  if (!host_sys_locked)
+    host_lock_errors++;
+  struct pool_header *php = mp->next;
+  if (php != NULL)
+    mp->next = php->next;
+  return php;
+}
+
+static inline void chPoolLoadArray(memory_pool_t *mp, void *p, size_t n)
+{
+  while (n--) {
+    chSysLock();
+    chPoolFreeI(mp, p);
+    chSysUnlock();
+    p = (char *)p + mp->object_size;
+  }
+}
+
+#endif /* SWIFTNAV_TESTS_HOST_CH_H */
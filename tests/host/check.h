@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Check macro of the host-built tests. A failed check prints its location
+ * and the test carries on, check_summary() prints the verdict and returns
+ * the exit status of the test. */
+
+#ifndef SWIFTNAV_TESTS_HOST_CHECK_H
+#define SWIFTNAV_TESTS_HOST_CHECK_H
+
+#include <stdio.h>
+
+static unsigned int check_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      check_failures++; \
+    } \
+  } while (0)
+
+static inline int check_summary(void)
+{
+  if (check_failures > 0) {
+    printf("FAIL: %u checks failed\n", check_failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
+
+#endif /* SWIFTNAV_TESTS_HOST_CHECK_H */
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Minimal stand-in for the ChibiOS HAL header shared by the host-built
+ * tests. */
+
+#ifndef SWIFTNAV_TESTS_HOST_HAL_H
+#define SWIFTNAV_TESTS_HOST_HAL_H
+
+#include "ch.h"
+
+/* Serial buffer size of the v3 board configuration. */
+#define SERIAL_BUFFERS_SIZE 1024
+
+#endif /* SWIFTNAV_TESTS_HOST_HAL_H */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Default RTOS stubs of the host-built tests, see ch.h. */
+
+#include "ch.h"
+
+#define WEAK __attribute__((weak))
+
+bool host_sys_locked;
+unsigned int host_lock_errors;
+
+WEAK void chMtxLock(mutex_t *mp)
+{
+  mp->locked++;
+}
+
+WEAK void chMtxUnlock(mutex_t *mp)
+{
+  mp->locked--;
+}
+
+WEAK thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio,
+                                 tfunc_t pf, void *arg)
+{
+  (void)wsp;
+  (void)size;
+  (void)prio;
+  (void)pf;
+  (void)arg;
+  return NULL;
+}
+
+WEAK void chRegSetThreadName(const char *name)
+{
+  (void)name;
+}
+
+WEAK void chThdSleepMilliseconds(uint32_t ms)
+{
+  (void)ms;
+}
+
+WEAK systime_t chVTGetSystemTime(void)
+{
+  return 0;
+}
+
+WEAK systime_t chVTTimeElapsedSinceX(systime_t start)
+{
+  return chVTGetSystemTime() - start;
+}
@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the M25 flash driver command sequencing.
+ *
+ * The SPI wrapper is replaced by a model of the M25 SPI protocol. Bytes are
+ * interpreted as the device would, commands take effect on deselect and
+ * program or erase operations keep the write in progress bit set for their
+ * typical duration. Time advances with each status poll and with each sleep,
+ * so the cost of waiting for an operation can be checked. Caller buffers are
+ * placed in a region standing in for CCM, which DMA transfers must never
+ * touch. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ch.h>
+
+#include "peripherals/spi_wrapper.h"
+#include "board/v2/m25_flash.h"
+#include "flash.h"
+#include "check.h"
+
+#define MEM_SIZE (M25_MAX_ADDR + 1)
+#define SECTOR_SIZE 0x10000
+
+#define POLL_US          10
+#define PAGE_PROGRAM_US  800
+#define SECTOR_ERASE_US  600000
+#define BULK_ERASE_US    8000000
+
+typedef struct {
+  u8 mem[MEM_SIZE];
+  bool locked;          /**< Bus mutex held. */
+  bool selected;        /**< Chip select asserted. */
+  u8 cmd;               /**< Command of the current selection. */
+  u32 n_bytes;          /**< Bytes exchanged in the current selection. */
+  u32 addr;             /**< Address of the current command. */
+  u8 page[M25_PAGE_SIZE];
+  u32 n_page;           /**< Data bytes of the current page program. */
+  bool wel;             /**< Write enable latch. */
+  u64 now_us;
+  u64 busy_until_us;    /**< End of the operation in progress. */
+  u32 n_errors;         /**< Protocol violations. */
+  u32 n_status_polls;
+  u32 n_sleeps;
+  u32 n_polled;         /**< Bytes exchanged by polled transfers. */
+  u32 n_dma;            /**< DMA transfers. */
+  u8 last_read_cmd;
+} m25_model_t;
+
+static m25_model_t m;
+
+/* Caller buffers, in the region standing in for CCM. */
+static u8 ccm[2 * 4096];
+static u8 expected[4096];
+
+static bool busy(void)
+{
+  return m.now_us < m.busy_until_us;
+}
+
+static void error(const char *what)
+{
+  printf("protocol error: %s (cmd 0x%02X)\n", what, m.cmd);
+  m.n_errors++;
+}
+
+static u8 model_byte(u8 mosi)
+{
+  u32 i = m.n_bytes++;
+
+  if (i == 0) {
+    m.cmd = mosi;
+    m.addr = 0;
+    m.n_page = 0;
+    if (busy() && (m.cmd != M25_RDSR))
+      error("command while write in progress");
+    if ((m.cmd == M25_READ) || (m.cmd == M25_FAST_READ))
+      m.last_read_cmd = m.cmd;
+    return 0xFF;
+  }
+
+  switch (m.cmd) {
+  case M25_RDSR:
+    m.n_status_polls++;
+    m.now_us += POLL_US;
+    return (busy() ? M25_SR_WIP : 0) | (m.wel ? M25_SR_WEL : 0);
+
+  case M25_READ:
+  case M25_FAST_READ:
+  case M25_PP:
+  case M25_SE:
+    if (i <= 3) {
+      m.addr = (m.addr << 8) | mosi;
+      return 0xFF;
+    }
+    if (m.cmd == M25_SE) {
+      error("sector erase too long");
+      return 0xFF;
+    }
+    if (m.cmd == M25_PP) {
+      /* The device wraps within the page, the driver must never let it. */
+      if ((m.addr & 0xFF) + m.n_page >= M25_PAGE_SIZE)
+        error("page program crosses page boundary");
+      else
+        m.page[m.n_page++] = mosi;
+      return 0xFF;
+    }
+    if ((m.cmd == M25_FAST_READ) && (i == 4))
+      return 0xFF;
+    return m.mem[(m.addr++) & M25_MAX_ADDR];
+
+  default:
+    error("unexpected byte");
+    return 0xFF;
+  }
+}
+
+static void model_deselect(void)
+{
+  if (m.n_bytes == 0)
+    return;
+
+  switch (m.cmd) {
+  case M25_WREN:
+    m.wel = true;
+    break;
+  case M25_WRDI:
+    m.wel = false;
+    break;
+  case M25_PP:
+    if (!m.wel) {
+      error("page program without write enable");
+      break;
+    }
+    for (u32 i = 0; i < m.n_page; i++)
+      m.mem[m.addr + i] &= m.page[i];
+    m.wel = false;
+    m.busy_until_us = m.now_us + PAGE_PROGRAM_US;
+    break;
+  case M25_SE:
+    if (!m.wel || (m.n_bytes != 4)) {
+      error("bad sector erase");
+      break;
+    }
+    memset(&m.mem[m.addr & ~(SECTOR_SIZE - 1)], 0xFF, SECTOR_SIZE);
+    m.wel = false;
+    m.busy_until_us = m.now_us + SECTOR_ERASE_US;
+    break;
+  case M25_BE:
+    if (!m.wel || (m.n_bytes != 1)) {
+      error("bad bulk erase");
+      break;
+    }
+    memset(m.mem, 0xFF, MEM_SIZE);
+    m.wel = false;
+    m.busy_until_us = m.now_us + BULK_ERASE_US;
+    break;
+  default:
+    break;
+  }
+  m.n_bytes = 0;
+}
+
+void spi_lock(u8 slave)
+{
+  if (m.locked)
+    error("bus locked twice");
+  m.locked = true;
+}
+
+void spi_unlock(u8 slave)
+{
+  if (!m.locked)
+    error("bus unlocked twice");
+  m.locked = false;
+}
+
+void spi_slave_select(u8 slave)
+{
+  CHECK(slave == SPI_SLAVE_FLASH);
+  spi_lock(slave);
+  if (m.selected)
+    error("selected twice");
+  m.selected = true;
+  m.n_bytes = 0;
+}
+
+void spi_slave_deselect(u8 slave)
+{
+  if (!m.selected)
+    error("deselected twice");
+  model_deselect();
+  m.selected = false;
+  spi_unlock(slave);
+}
+
+u8 spi_slave_xfer(u8 slave, u8 data)
+{
+  if (!m.selected)
+    error("transfer while deselected");
+  m.n_polled++;
+  return model_byte(data);
+}
+
+void spi_slave_xfer_dma(u8 slave, u16 n_bytes, u8 data_in[],
+                        const u8 data_out[])
+{
+  if (!m.selected)
+    error("DMA transfer while deselected");
+  if ((data_out == NULL) || (n_bytes == 0))
+    error("bad DMA transfer");
+  if (((data_out >= ccm) && (data_out < ccm + sizeof(ccm))) ||
+      ((data_in >= ccm) && (data_in < ccm + sizeof(ccm))))
+    error("DMA transfer from CCM");
+
+  m.n_dma++;
+  for (u32 i = 0; i < n_bytes; i++) {
+    u8 miso = model_byte(data_out[i]);
+    if (data_in != NULL)
+      data_in[i] = miso;
+  }
+}
+
+void chThdSleepMilliseconds(uint32_t ms)
+{
+  if (m.locked)
+    error("sleep with the bus locked");
+  m.n_sleeps++;
+  m.now_us += 1000 * (u64)ms;
+}
+
+static void model_reset(void)
+{
+  memset(&m, 0, sizeof(m));
+  for (u32 i = 0; i < MEM_SIZE; i++)
+    m.mem[i] = (u8)(i * 7 + (i >> 8));
+}
+
+static void model_check_idle(void)
+{
+  CHECK(!m.locked);
+  CHECK(!m.selected);
+  CHECK(!busy());
+  CHECK(m.n_errors == 0);
+}
+
+/* Short reads are polled with READ, long reads use FAST_READ over DMA. */
+static void test_read(void)
+{
+  static const u32 lens[] = {1, 4, M25_DMA_MIN_LEN - 1, M25_DMA_MIN_LEN,
+                             M25_PAGE_SIZE - 1, M25_PAGE_SIZE,
+                             M25_PAGE_SIZE + 1, 1000, 4096};
+  static const u32 addrs[] = {0, 1, 0x12345, M25_MAX_ADDR + 1 - 4096};
+
+  model_reset();
+
+  for (u32 a = 0; a < sizeof(addrs) / sizeof(addrs[0]); a++) {
+    for (u32 l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+      u32 addr = addrs[a], len = lens[l];
+      u8 *buf = &ccm[a];
+
+      memset(buf, 0, len);
+      m.n_dma = 0;
+      m.n_polled = 0;
+      CHECK(m25_read(addr, buf, len) == FLASH_OK);
+      CHECK(memcmp(buf, &m.mem[addr], len) == 0);
+      if (len < M25_DMA_MIN_LEN) {
+        CHECK(m.last_read_cmd == M25_READ);
+        CHECK(m.n_dma == 0);
+      } else {
+        CHECK(m.last_read_cmd == M25_FAST_READ);
+        CHECK(m.n_polled == 0);
+        CHECK(m.n_dma == 1 + (len + M25_PAGE_SIZE - 1) / M25_PAGE_SIZE);
+      }
+    }
+  }
+
+  CHECK(m25_read(M25_MAX_ADDR + 1, ccm, 1) == FLASH_INVALID_ADDR);
+  CHECK(m25_read(M25_MAX_ADDR, ccm, 2) == FLASH_INVALID_RANGE);
+  model_check_idle();
+}
+
+/* A page program is one DMA transfer and waits without long sleeps. */
+static void test_page_program(void)
+{
+  model_reset();
+
+  u32 addr = 0x23410;
+  u32 len = 200;
+  for (u32 i = 0; i < len; i++) {
+    ccm[i] = (u8)(0xA5 ^ i);
+    expected[i] = m.mem[addr + i] & ccm[i];
+  }
+
+  m25_write_enable();
+  CHECK(m.wel);
+  CHECK(m25_page_program(addr, ccm, len) == FLASH_OK);
+  CHECK(memcmp(&m.mem[addr], expected, len) == 0);
+  CHECK(m.mem[addr - 1] == (u8)((addr - 1) * 7 + ((addr - 1) >> 8)));
+  CHECK(m.mem[addr + len] == (u8)((addr + len) * 7 + ((addr + len) >> 8)));
+  CHECK(!m.wel);
+  CHECK(m.n_dma == 1);
+  CHECK(m.n_sleeps <= 1);
+  model_check_idle();
+
+  /* Crossing a page boundary is refused without touching the device. */
+  u32 n_dma = m.n_dma;
+  m25_write_enable();
+  CHECK(m25_page_program(0x23480, ccm, 200) == FLASH_INVALID_RANGE);
+  CHECK(m.n_dma == n_dma);
+  CHECK(m25_page_program(M25_MAX_ADDR + 1, ccm, 1) == FLASH_INVALID_ADDR);
+  m25_write_disable();
+  CHECK(!m.wel);
+  model_check_idle();
+}
+
+/* Long operations are waited for with few polls and bounded overshoot. */
+static void test_erase(void)
+{
+  model_reset();
+
+  m25_write_enable();
+  CHECK(m25_sector_erase(0x34567) == FLASH_OK);
+  for (u32 i = 0x30000; i < 0x40000; i++)
+    CHECK(m.mem[i] == 0xFF);
+  CHECK(m.mem[0x2FFFF] != 0xFF || m.mem[0x40000] != 0xFF);
+  CHECK(m.n_status_polls < 40);
+  CHECK(m.now_us < SECTOR_ERASE_US + 1000 * M25_WIP_BACKOFF_MAX_MS +
+                   POLL_US * m.n_status_polls);
+  model_check_idle();
+
+  model_reset();
+  m25_write_enable();
+  m25_bulk_erase();
+  for (u32 i = 0; i < MEM_SIZE; i++)
+    CHECK(m.mem[i] == 0xFF);
+  CHECK(m.n_status_polls < 200);
+  CHECK(m.now_us < BULK_ERASE_US + 1000 * M25_WIP_BACKOFF_MAX_MS +
+                   POLL_US * m.n_status_polls);
+  model_check_idle();
+}
+
+/* Programs read back through both read paths. */
+static void test_program_read_back(void)
+{
+  model_reset();
+
+  m25_write_enable();
+  CHECK(m25_sector_erase(0x50000) == FLASH_OK);
+
+  for (u32 p = 0; p < 8; p++) {
+    for (u32 i = 0; i < 255; i++)
+      ccm[i] = (u8)(p * 31 + i);
+    m25_write_enable();
+    CHECK(m25_page_program(0x50000 + p * M25_PAGE_SIZE, ccm, 255) ==
+          FLASH_OK);
+  }
+
+  CHECK(m25_read(0x50000, ccm, 8 * M25_PAGE_SIZE) == FLASH_OK);
+  for (u32 p = 0; p < 8; p++) {
+    for (u32 i = 0; i < 255; i++)
+      CHECK(ccm[p * M25_PAGE_SIZE + i] == (u8)(p * 31 + i));
+    CHECK(ccm[p * M25_PAGE_SIZE + 255] == 0xFF);
+  }
+
+  u8 b[4];
+  CHECK(m25_read(0x50000 + 3 * M25_PAGE_SIZE + 10, b, sizeof(b)) == FLASH_OK);
+  CHECK(b[0] == (u8)(3 * 31 + 10));
+  model_check_idle();
+}
+
+int main(void)
+{
+  test_read();
+  test_page_program();
+  test_erase();
+  test_program_read_back();
+
+  return check_summary();
+}
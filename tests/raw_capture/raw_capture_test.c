@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* End-to-end host test of the v3 raw sample capture.
+ *
+ * The NAP sample grabber is replaced by a model which fills each buffer with
+ * a known function of the NAP sample count, with junk in the bits above the
+ * sample. The FTDI USART is a wire buffer which accepts a limited number of
+ * bytes per write. The capture thread runs in the test until it goes idle,
+ * then the frames on the wire are parsed as the host receiver does and the
+ * samples are compared with the model.
+ *
+ *   raw_capture_test [wire.bin]
+ *
+ * writes the wire bytes of the streaming test to wire.bin, for the host
+ * receiver tools/raw_capture_rx.py. */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ch.h>
+#include <libswiftnav/edc.h>
+#include <libswiftnav/logging.h>
+
+#include "peripherals/usart.h"
+#include "settings.h"
+#include "nap/fft.h"
+#include "raw_capture.h"
+#include "check.h"
+
+#define WIRE_SIZE (8 * 1024 * 1024)
+#define WRITE_CHUNK 4000
+#define SAVED_MAX 4
+
+/* -------------------------------------------------------------------------
+ * Sample grabber model
+ * ------------------------------------------------------------------------- */
+
+static struct {
+  u8 *out;              /**< Buffer of the transfer in progress. */
+  u32 len;
+  u32 sample_count;     /**< NAP sample count of the next transfer. */
+  u32 gap_at;           /**< Transfer after which samples are skipped. */
+  u32 gap;
+  u32 error_at;         /**< Transfer which fails. */
+  u32 n_transfers;
+  u32 n_errors;         /**< Protocol violations. */
+} grabber;
+
+static u8 model_sample(u32 sample_count)
+{
+  u32 x = sample_count * 2654435761u;
+  return (x >> 13) & RAW_CAPTURE_SAMPLE_MASK;
+}
+
+void raw_samples_start(u8 *out, u32 len_samples)
+{
+  if (grabber.out != NULL)
+    grabber.n_errors++;
+  grabber.out = out;
+  grabber.len = len_samples;
+}
+
+bool raw_samples_wait(u32 *sample_count)
+{
+  if (grabber.out == NULL) {
+    grabber.n_errors++;
+    return false;
+  }
+
+  u32 n = ++grabber.n_transfers;
+  *sample_count = grabber.sample_count;
+  for (u32 i = 0; i < grabber.len; i++) {
+    /* The bits above the sample must be masked by the packing. */
+    grabber.out[i] = 0xa4 | model_sample(grabber.sample_count + i);
+  }
+  grabber.sample_count += grabber.len;
+  if (n == grabber.gap_at)
+    grabber.sample_count += grabber.gap;
+  grabber.out = NULL;
+
+  return n != grabber.error_at;
+}
+
+/* -------------------------------------------------------------------------
+ * FTDI USART
+ * ------------------------------------------------------------------------- */
+
+usart_state ftdi_state;
+
+static struct {
+  u8 *data;
+  u32 len;
+  bool claimed;
+  u32 n_claims;
+  u32 n_writes;
+  u32 n_short;          /**< Writes which accepted nothing. */
+  u32 n_errors;
+} wire;
+
+bool usart_claim(usart_state *s, const void *module)
+{
+  if ((s != &ftdi_state) || wire.claimed)
+    return false;
+  wire.claimed = true;
+  wire.n_claims++;
+  return true;
+}
+
+void usart_release(usart_state *s)
+{
+  if (!wire.claimed)
+    wire.n_errors++;
+  wire.claimed = false;
+}
+
+u32 usart_write(usart_state *s, const u8 data[], u32 len)
+{
+  if (!wire.claimed)
+    wire.n_errors++;
+
+  /* Every other write finds the port busy. */
+  if ((wire.n_writes++ & 1) == 0) {
+    wire.n_short++;
+    return 0;
+  }
+
+  u32 n = MIN(len, WRITE_CHUNK);
+  if (wire.len + n > WIRE_SIZE)
+    n = WIRE_SIZE - wire.len;
+  memcpy(&wire.data[wire.len], data, n);
+  wire.len += n;
+  return n;
+}
+
+/* -------------------------------------------------------------------------
+ * Settings and RTOS
+ * ------------------------------------------------------------------------- */
+
+int TYPE_BOOL = TYPE_STRING + 1;
+
+/* Values restored from the settings file by settings_register(). */
+static struct {
+  const char *name;
+  u32 value;
+} saved[SAVED_MAX];
+
+void settings_register(struct setting *s, enum setting_types type)
+{
+  for (u32 i = 0; i < SAVED_MAX; i++) {
+    if ((saved[i].name != NULL) && (strcmp(saved[i].name, s->name) == 0)) {
+      if (s->len == sizeof(bool))
+        *(bool *)s->addr = saved[i].value;
+      else
+        *(u32 *)s->addr = saved[i].value;
+    }
+  }
+}
+
+bool settings_default_notify(struct setting *setting, const char *val)
+{
+  return true;
+}
+
+static u32 n_warnings;
+
+void log_(u8 level, const char *msg, ...)
+{
+  if (level <= LOG_WARN)
+    n_warnings++;
+}
+
+static tfunc_t capture_thread;
+static jmp_buf idle_jmp;
+static u32 n_idle_sleeps;
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio,
+                            tfunc_t pf, void *arg)
+{
+  capture_thread = pf;
+  return NULL;
+}
+
+/* The capture thread sleeps in its idle loop and while the port is busy.
+ * The first idle sleep returns to the test. */
+void chThdSleepMilliseconds(uint32_t ms)
+{
+  if (!wire.claimed) {
+    n_idle_sleeps++;
+    longjmp(idle_jmp, 1);
+  }
+}
+
+/* -------------------------------------------------------------------------
+ * Test
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+  raw_capture_header_t header;
+  u32 offset;           /**< Offset of the frame on the wire. */
+} frame_t;
+
+static void reset(void)
+{
+  memset(&grabber, 0, sizeof(grabber));
+  grabber.sample_count = 0x12345678;
+  u8 *data = wire.data;
+  memset(&wire, 0, sizeof(wire));
+  wire.data = data;
+  memset(saved, 0, sizeof(saved));
+  n_warnings = 0;
+  n_idle_sleeps = 0;
+}
+
+static void save(u32 i, const char *name, u32 value)
+{
+  saved[i].name = name;
+  saved[i].value = value;
+}
+
+/** Set up capture from the saved settings and run its thread until idle. */
+static void run(void)
+{
+  raw_capture_setup();
+  if (setjmp(idle_jmp) == 0)
+    capture_thread(NULL);
+}
+
+/** Parse the frames on the wire as the host receiver does, checking header,
+ * CRC and every sample against the model.
+ *
+ * \return Number of frames.
+ */
+static u32 parse_wire(frame_t frames[], u32 max_frames)
+{
+  u32 n = 0;
+  u32 offset = 0;
+
+  while (offset + sizeof(raw_capture_header_t) <= wire.len) {
+    raw_capture_header_t h;
+    memcpy(&h, &wire.data[offset], sizeof(h));
+    CHECK(h.sync == RAW_CAPTURE_SYNC);
+    CHECK(h.version == RAW_CAPTURE_VERSION);
+    CHECK(h.sample_bits == RAW_CAPTURE_SAMPLE_BITS);
+    CHECK(h.payload_len == h.n_samples / RAW_CAPTURE_SAMPLES_PER_BYTE);
+    if ((h.sync != RAW_CAPTURE_SYNC) ||
+        (offset + sizeof(h) + h.payload_len > wire.len))
+      break;
+
+    const u8 *payload = &wire.data[offset + sizeof(h)];
+    u16 crc = crc16_ccitt((const u8 *)&h, offsetof(raw_capture_header_t, crc),
+                          0);
+    CHECK(crc16_ccitt(payload, h.payload_len, crc) == h.crc);
+
+    u32 n_bad = 0;
+    for (u32 i = 0; i < h.n_samples; i++) {
+      u8 s = (payload[i / RAW_CAPTURE_SAMPLES_PER_BYTE] >>
+              ((i % RAW_CAPTURE_SAMPLES_PER_BYTE) * RAW_CAPTURE_SAMPLE_BITS)) &
+             RAW_CAPTURE_SAMPLE_MASK;
+      n_bad += (s != model_sample(h.sample_count + i));
+    }
+    CHECK(n_bad == 0);
+
+    if (n < max_frames) {
+      frames[n].header = h;
+      frames[n].offset = offset;
+    }
+    n++;
+    offset += sizeof(h) + h.payload_len;
+  }
+  CHECK(offset == wire.len);
+  return n;
+}
+
+/* A bounded capture sends its frames in sequence and releases the port. */
+static void test_stream(const char *dump_path)
+{
+  reset();
+  save(0, "enable", true);
+  save(1, "frames", 4);
+  grabber.gap_at = 2;
+  grabber.gap = 1000;
+  run();
+
+  frame_t f[8];
+  CHECK(parse_wire(f, 8) == 4);
+  for (u32 i = 0; i < 4; i++) {
+    CHECK(f[i].header.sequence == i);
+    CHECK(f[i].header.n_samples > 0);
+  }
+  /* Samples were skipped after the second transfer only. */
+  CHECK(f[0].header.flags == 0);
+  CHECK(f[1].header.flags == 0);
+  CHECK(f[2].header.flags == RAW_CAPTURE_FLAG_DISCONTINUITY);
+  CHECK(f[3].header.flags == 0);
+  CHECK(f[1].header.sample_count ==
+        f[0].header.sample_count + f[0].header.n_samples);
+
+  CHECK(wire.n_claims == 1);
+  CHECK(!wire.claimed);
+  CHECK(wire.n_short > 0);
+  CHECK(wire.n_errors == 0);
+  CHECK(grabber.n_errors == 0);
+  CHECK(grabber.out == NULL);
+  CHECK(n_idle_sleeps == 1);
+
+  if (dump_path != NULL) {
+    FILE *fp = fopen(dump_path, "wb");
+    CHECK(fp != NULL);
+    if (fp != NULL) {
+      CHECK(fwrite(wire.data, 1, wire.len, fp) == wire.len);
+      fclose(fp);
+    }
+  }
+}
+
+/* A failed transfer is dropped without a sequence gap and the next frame is
+ * flagged as discontinuous. */
+static void test_dma_error(void)
+{
+  reset();
+  save(0, "enable", true);
+  save(1, "frames", 3);
+  grabber.error_at = 2;
+  run();
+
+  frame_t f[8];
+  CHECK(parse_wire(f, 8) == 3);
+  CHECK(f[0].header.sequence == 0);
+  CHECK(f[1].header.sequence == 1);
+  CHECK(f[2].header.sequence == 2);
+  CHECK(f[1].header.flags == RAW_CAPTURE_FLAG_DISCONTINUITY);
+  CHECK(f[2].header.flags == 0);
+  CHECK(grabber.n_transfers == 5);
+  CHECK(grabber.n_errors == 0);
+  CHECK(!wire.claimed);
+}
+
+/* A saved unbounded capture is not resumed at boot, the port stays with
+ * SBP. */
+static void test_boot_unbounded(void)
+{
+  reset();
+  save(0, "enable", true);
+  save(1, "frames", 0);
+  run();
+
+  CHECK(wire.n_claims == 0);
+  CHECK(wire.len == 0);
+  CHECK(grabber.n_transfers == 0);
+  CHECK(n_warnings == 1);
+}
+
+/* Nothing happens while capture is disabled. */
+static void test_disabled(void)
+{
+  reset();
+  save(1, "frames", 2);
+  run();
+
+  CHECK(wire.n_claims == 0);
+  CHECK(wire.len == 0);
+  CHECK(n_warnings == 0);
+}
+
+int main(int argc, char *argv[])
+{
+  wire.data = malloc(WIRE_SIZE);
+  if (wire.data == NULL) {
+    printf("out of memory\n");
+    return 1;
+  }
+
+  test_stream((argc > 1) ? argv[1] : NULL);
+  test_dma_error();
+  test_boot_unbounded();
+  test_disabled();
+
+  free(wire.data);
+  return check_summary();
+}
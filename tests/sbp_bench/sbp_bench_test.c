@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host throughput and latency benchmark for the SBP send and receive paths.
+ *
+ * The real sbp.c and libsbp are linked against in-memory loopback USARTs:
+ * bytes written to a port's TX queue (peripherals/usart_tx.c, as on v2) are
+ * moved to the same port's RX buffer after every message, as if by an
+ * infinitely fast wire, and
+ * sbp_process_messages() parses them back once per epoch.
+ *
+ * Each epoch sends a burst of mixed traffic similar to a running receiver:
+ * observations, tracking IQ, settings responses and log messages. Every
+ * message carries a sequence number, so per-message latency is measured from
+ * sbp_send_msg() to the receive callback. Only the FTDI port is in SBP mode,
+ * so each message is framed once and written once. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libsbp/edc.h>
+#include <libsbp/logging.h>
+#include <libsbp/observation.h>
+#include <libsbp/settings.h>
+#include <libsbp/tracking.h>
+#include <libswiftnav/logging.h>
+
+#include "block_pool.h"
+#include "peripherals/usart_tx.h"
+#include "sbp.h"
+
+#define DEFAULT_EPOCHS 20000
+
+#define OBS_MSGS_PER_EPOCH      4
+#define IQ_MSGS_PER_EPOCH       8
+#define SETTINGS_MSGS_PER_EPOCH 2
+#define LOG_MSGS_PER_EPOCH      1
+#define MSGS_PER_EPOCH (OBS_MSGS_PER_EPOCH + IQ_MSGS_PER_EPOCH + \
+                        SETTINGS_MSGS_PER_EPOCH + LOG_MSGS_PER_EPOCH)
+
+#define OBS_PER_MSG \
+  ((SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(observation_header_t)) / \
+   sizeof(packed_obs_content_t))
+
+#define LOOPBACK_RX_SIZE 65536
+
+#define CRC_BENCH_ITERATIONS 100000
+
+/* -------------------------------------------------------------------------
+ * Loopback USARTs
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+  u8 buf[LOOPBACK_RX_SIZE];
+  u32 head;
+  u32 tail;
+} ring_t;
+
+typedef struct {
+  usart_tx_queue_t tx;
+  const u8 *tx_mem;     /**< Transfer started by the TX queue. */
+  u32 tx_len;
+  ring_t rx;
+  u32 tx_dropped;
+} loopback_t;
+
+static loopback_t loopback_ftdi;
+static loopback_t loopback_uarta;
+static loopback_t loopback_uartb;
+
+usart_settings_t ftdi_usart = {
+  .mode             = SBP,
+  .sbp_message_mask = 0xFFFF,
+  .sbp_fwd          = 1,
+};
+
+usart_settings_t uarta_usart = {
+  .mode             = NMEA,
+};
+
+usart_settings_t uartb_usart = {
+  .mode             = NMEA,
+};
+
+usart_state ftdi_state = {.sd = &loopback_ftdi, .configured = true};
+usart_state uarta_state = {.sd = &loopback_uarta, .configured = true};
+usart_state uartb_state = {.sd = &loopback_uartb, .configured = true};
+
+static u32 ring_used(const ring_t *r)
+{
+  return r->head - r->tail;
+}
+
+static u32 ring_write(ring_t *r, const u8 *data, u32 len, u32 size)
+{
+  u32 n = MIN(len, size - ring_used(r));
+  for (u32 i = 0; i < n; i++) {
+    r->buf[(r->head + i) % LOOPBACK_RX_SIZE] = data[i];
+  }
+  r->head += n;
+  return n;
+}
+
+static u32 ring_read(ring_t *r, u8 *data, u32 len)
+{
+  u32 n = MIN(len, ring_used(r));
+  for (u32 i = 0; i < n; i++) {
+    data[i] = r->buf[(r->tail + i) % LOOPBACK_RX_SIZE];
+  }
+  r->tail += n;
+  return n;
+}
+
+/* TX queue start hook, the transfer is latched until the wire is run. */
+static void loopback_tx_start(void *ctx, const u8 data[], u32 len)
+{
+  loopback_t *l = (loopback_t *)ctx;
+  l->tx_mem = data;
+  l->tx_len = len;
+}
+
+static void loopback_init(loopback_t *l)
+{
+  usart_tx_queue_init(&l->tx, loopback_tx_start, l);
+}
+
+/** Move everything queued for TX to the RX buffer, completing the transfers
+ * as the TX DMA ISR does. */
+static void loopback_link(loopback_t *l)
+{
+  while (l->tx_len > 0) {
+    ring_write(&l->rx, l->tx_mem, l->tx_len, LOOPBACK_RX_SIZE);
+    l->tx_len = 0;
+    chSysLock();
+    usart_tx_queue_completeI(&l->tx);
+    chSysUnlock();
+  }
+}
+
+bool usart_claim(usart_state *s, const void *module)
+{
+  if (!s->configured) {
+    return false;
+  }
+  if (!s->claimed.taken) {
+    s->claimed.taken = true;
+    s->claimed_by = module;
+    s->claim_nest = 0;
+    return true;
+  }
+  if (s->claimed_by == module) {
+    s->claim_nest++;
+    return true;
+  }
+  return false;
+}
+
+void usart_release(usart_state *s)
+{
+  if (s->claim_nest) {
+    s->claim_nest--;
+  } else {
+    s->claimed.taken = false;
+  }
+}
+
+u32 usart_tx_n_free(usart_state *s)
+{
+  loopback_t *l = s->sd;
+  return usart_tx_queue_n_free(&l->tx);
+}
+
+u32 usart_write(usart_state *s, const u8 data[], u32 len)
+{
+  loopback_t *l = s->sd;
+  u32 n = usart_tx_queue_write(&l->tx, data, len);
+  l->tx_dropped += len - n;
+  s->tx.byte_counter += n;
+  return n;
+}
+
+bool usart_write_buf(usart_state *s, usart_tx_buf_t *buf)
+{
+  loopback_t *l = s->sd;
+  bool ok = usart_tx_queue_submit(&l->tx, buf);
+  if (ok) {
+    s->tx.byte_counter += buf->len;
+  } else {
+    l->tx_dropped += buf->len;
+  }
+  return ok;
+}
+
+u32 usart_n_read(usart_state *s)
+{
+  loopback_t *l = s->sd;
+  return ring_used(&l->rx);
+}
+
+u32 usart_read(usart_state *s, u8 data[], u32 len)
+{
+  loopback_t *l = s->sd;
+  u32 n = ring_read(&l->rx, data, len);
+  s->rx.byte_counter += n;
+  return n;
+}
+
+float usart_throughput(struct usart_stats *s)
+{
+  s->byte_counter = 0;
+  return 0;
+}
+
+void usarts_disable(void)
+{
+}
+
+/* The on-device logger is not part of the link path being measured. */
+void sbp_logger_msg(u16 msg_type, u16 sender_id, u8 len, const u8 payload[])
+{
+}
+
+/* -------------------------------------------------------------------------
+ * Traffic and measurement
+ * ------------------------------------------------------------------------- */
+
+enum traffic_class {
+  TRAFFIC_OBS,
+  TRAFFIC_IQ,
+  TRAFFIC_SETTINGS,
+  TRAFFIC_LOG,
+  TRAFFIC_COUNT
+};
+
+static const char * const traffic_names[TRAFFIC_COUNT] = {
+  "obs", "iq", "settings", "log",
+};
+
+/* Not exported by sbp.h. */
+extern msg_uart_state_t uart_state_msg;
+
+static struct {
+  u32 sent;
+  u32 received;
+  u64 payload_bytes;      /**< Payload bytes received. */
+  u64 send_ns;
+} traffic[TRAFFIC_COUNT];
+
+static u64 *send_time_ns;
+static u64 *latency_ns;
+static u32 n_latency;
+static u32 n_sent;
+
+static u64 time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void message_received(u32 seq)
+{
+  if (seq < n_sent) {
+    latency_ns[n_latency++] = time_ns() - send_time_ns[seq];
+  }
+}
+
+static void payload_received(enum traffic_class c, u8 len, u8 msg[])
+{
+  u32 seq;
+  if (len >= sizeof(seq)) {
+    memcpy(&seq, msg, sizeof(seq));
+    traffic[c].received++;
+    traffic[c].payload_bytes += len;
+    message_received(seq);
+  }
+}
+
+static void obs_cb(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  (void)sender_id;
+  (void)context;
+  payload_received(TRAFFIC_OBS, len, msg);
+}
+
+static void iq_cb(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  (void)sender_id;
+  (void)context;
+  payload_received(TRAFFIC_IQ, len, msg);
+}
+
+static void settings_cb(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  (void)sender_id;
+  (void)context;
+  payload_received(TRAFFIC_SETTINGS, len, msg);
+}
+
+static void log_cb(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  (void)sender_id;
+  (void)context;
+  if (len > sizeof(msg_log_t)) {
+    /* The text starts with the sequence number in hex. */
+    char text[SBP_FRAMING_MAX_PAYLOAD_SIZE];
+    memcpy(text, ((msg_log_t *)msg)->text, len - sizeof(msg_log_t));
+    text[len - sizeof(msg_log_t)] = '\0';
+    traffic[TRAFFIC_LOG].received++;
+    traffic[TRAFFIC_LOG].payload_bytes += len;
+    message_received(strtoul(text, NULL, 16));
+  }
+}
+
+static void send_payload(enum traffic_class c, u16 msg_type, u8 len,
+                         u8 *payload)
+{
+  u32 seq = n_sent++;
+  memcpy(payload, &seq, sizeof(seq));
+
+  u64 t0 = time_ns();
+  send_time_ns[seq] = t0;
+  sbp_send_msg(msg_type, len, payload);
+  traffic[c].send_ns += time_ns() - t0;
+
+  traffic[c].sent++;
+  loopback_link(&loopback_ftdi);
+}
+
+static void send_log(void)
+{
+  u32 seq = n_sent++;
+
+  /* Every other message is logged with the frame pool drained, as when
+   * several threads log at once, and takes the truncated stack path. */
+  u8 *held[BLOCK_POOL_SBP_FRAME_COUNT];
+  u32 n_held = 0;
+  if (seq & 1) {
+    while ((n_held < BLOCK_POOL_SBP_FRAME_COUNT) &&
+           ((held[n_held] = sbp_frame_alloc()) != NULL)) {
+      n_held++;
+    }
+  }
+
+  u64 t0 = time_ns();
+  send_time_ns[seq] = t0;
+  log_info("%08" PRIx32 " bench: tracking channel %u lost lock, "
+           "C/N0 %.1f dBHz", seq, (unsigned)(seq % 32), 30.0 + seq % 20);
+  traffic[TRAFFIC_LOG].send_ns += time_ns() - t0;
+
+  while (n_held > 0) {
+    sbp_frame_free(held[--n_held]);
+  }
+
+  traffic[TRAFFIC_LOG].sent++;
+  loopback_link(&loopback_ftdi);
+}
+
+static void send_epoch(u32 epoch)
+{
+  u8 payload[SBP_FRAMING_MAX_PAYLOAD_SIZE];
+
+  for (u32 i = 0; i < sizeof(payload); i++) {
+    payload[i] = (u8)(epoch * 31 + i * 7);
+  }
+
+  /* Observation burst, 16 satellites. */
+  u32 n_obs = 16;
+  for (u32 i = 0; i < OBS_MSGS_PER_EPOCH; i++) {
+    u32 n = MIN(n_obs, OBS_PER_MSG);
+    u8 len = sizeof(observation_header_t) + n * sizeof(packed_obs_content_t);
+    send_payload(TRAFFIC_OBS, SBP_MSG_OBS, len, payload);
+    n_obs = (n_obs > n) ? n_obs - n : 16;
+  }
+
+  for (u32 i = 0; i < IQ_MSGS_PER_EPOCH; i++) {
+    send_payload(TRAFFIC_IQ, SBP_MSG_TRACKING_IQ, sizeof(msg_tracking_iq_t),
+                 payload);
+  }
+
+  for (u32 i = 0; i < SETTINGS_MSGS_PER_EPOCH; i++) {
+    static const char setting[] = "\0\0\0\0track\0loop_params\0"
+                                  "(1 ms, (1, 0.7, 1, 1540), (10, 0.7, 1, 5))";
+    memcpy(payload, setting, sizeof(setting));
+    send_payload(TRAFFIC_SETTINGS, SBP_MSG_SETTINGS_READ_RESP,
+                 sizeof(setting), payload);
+  }
+
+  for (u32 i = 0; i < LOG_MSGS_PER_EPOCH; i++) {
+    send_log();
+  }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  u64 x = *(const u64 *)a;
+  u64 y = *(const u64 *)b;
+  return (x > y) - (x < y);
+}
+
+static double bench_crc(void)
+{
+  u8 buf[SBP_FRAMING_MAX_PAYLOAD_SIZE];
+  for (u32 i = 0; i < sizeof(buf); i++) {
+    buf[i] = i * 13;
+  }
+
+  volatile u16 crc = 0;
+  u64 t0 = time_ns();
+  for (u32 i = 0; i < CRC_BENCH_ITERATIONS; i++) {
+    crc = crc16_ccitt(buf, sizeof(buf), crc);
+  }
+  u64 t1 = time_ns();
+
+  return (double)(t1 - t0) / ((double)CRC_BENCH_ITERATIONS * sizeof(buf));
+}
+
+int main(int argc, char *argv[])
+{
+  u32 epochs = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_EPOCHS;
+  if (epochs == 0) {
+    fprintf(stderr, "usage: %s [epochs]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  send_time_ns = calloc((size_t)epochs * MSGS_PER_EPOCH, sizeof(u64));
+  latency_ns = calloc((size_t)epochs * MSGS_PER_EPOCH, sizeof(u64));
+  if ((send_time_ns == NULL) || (latency_ns == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  loopback_init(&loopback_ftdi);
+  loopback_init(&loopback_uarta);
+  loopback_init(&loopback_uartb);
+  block_pool_setup();
+  sbp_setup(0x42);
+
+  static sbp_msg_callbacks_node_t nodes[TRAFFIC_COUNT];
+  sbp_register_cbk(SBP_MSG_OBS, obs_cb, &nodes[TRAFFIC_OBS]);
+  sbp_register_cbk(SBP_MSG_TRACKING_IQ, iq_cb, &nodes[TRAFFIC_IQ]);
+  sbp_register_cbk(SBP_MSG_SETTINGS_READ_RESP, settings_cb,
+                   &nodes[TRAFFIC_SETTINGS]);
+  sbp_register_cbk(SBP_MSG_LOG, log_cb, &nodes[TRAFFIC_LOG]);
+
+  u64 send_ns = 0;
+  u64 rx_ns = 0;
+
+  for (u32 epoch = 0; epoch < epochs; epoch++) {
+    u64 t0 = time_ns();
+    send_epoch(epoch);
+    u64 t1 = time_ns();
+    sbp_process_messages();
+    u64 t2 = time_ns();
+    send_ns += t1 - t0;
+    rx_ns += t2 - t1;
+  }
+
+  u64 bytes = ftdi_state.tx.byte_counter;
+  u32 received = 0;
+  for (u32 c = 0; c < TRAFFIC_COUNT; c++) {
+    received += traffic[c].received;
+  }
+
+  printf("%" PRIu32 " epochs, %" PRIu32 " messages, %" PRIu64 " bytes "
+         "framed\n\n", epochs, n_sent, bytes);
+
+  printf("%-10s %8s %12s %14s\n", "traffic", "msgs", "payload B", "send ns/msg");
+  for (u32 c = 0; c < TRAFFIC_COUNT; c++) {
+    printf("%-10s %8" PRIu32 " %12" PRIu64 " %14.1f\n", traffic_names[c],
+           traffic[c].sent, traffic[c].payload_bytes,
+           (double)traffic[c].send_ns / MAX(traffic[c].sent, 1));
+  }
+  printf("\n");
+
+  double total_s = (send_ns + rx_ns) * 1e-9;
+  printf("throughput       %12.0f msgs/s %12.0f bytes/s\n",
+         n_sent / total_s, bytes / total_s);
+  printf("send (framing)   %12.2f ns/byte\n", (double)send_ns / bytes);
+  printf("receive (parse)  %12.2f ns/byte\n", (double)rx_ns / bytes);
+  printf("crc16_ccitt      %12.2f ns/byte\n", bench_crc());
+
+  qsort(latency_ns, n_latency, sizeof(u64), cmp_u64);
+  if (n_latency > 0) {
+    printf("latency          min %.2f us, median %.2f us, p99 %.2f us, "
+           "max %.2f us\n",
+           latency_ns[0] * 1e-3, latency_ns[n_latency / 2] * 1e-3,
+           latency_ns[(u64)n_latency * 99 / 100] * 1e-3,
+           latency_ns[n_latency - 1] * 1e-3);
+  }
+
+  if ((received != n_sent) || (n_latency != n_sent) ||
+      (loopback_ftdi.tx_dropped > 0) ||
+      (uart_state_msg.uart_ftdi.crc_error_count > 0)) {
+    printf("\nFAIL: %" PRIu32 " of %" PRIu32 " messages received, "
+           "%" PRIu32 " bytes dropped, %u CRC errors\n",
+           received, n_sent, loopback_ftdi.tx_dropped,
+           uart_state_msg.uart_ftdi.crc_error_count);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the bit-sliced software track correlator.
+ *
+ * The correlations are compared with a scalar model of the same carrier and
+ * code replicas, one multiply-accumulate per sample, over random samples and
+ * NCO settings so that integrations start at arbitrary carrier and code
+ * phases. A synthetic C/A signal at a known carrier phase then checks the
+ * phase of the prompt correlation and the outputs which stand in for
+ * nap_track_read_results(). Finally the throughput of one channel is
+ * reported. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libswiftnav/prns.h>
+
+#include "soft_corr.h"
+#include "check.h"
+
+#define SAMPLE_FREQ      16.368e6
+#define CHIP_FREQ        1.023e6
+#define CARRIER_FREQ     (4.092e6 + 1234.5)
+#define MS_SAMPLES       16368
+
+#define N_SAMPLES_MAX    (64 * MS_SAMPLES)
+#define N_WORDS_MAX      (N_SAMPLES_MAX / SOFT_CORR_WORD_SAMPLES + 1)
+
+#define PHASE_TOLERANCE_DEG 5.0
+#define BENCH_MS         1000
+
+static u8 code[(SOFT_CORR_CODE_LENGTH + 7) / 8];
+static u8 raw[N_SAMPLES_MAX];               /**< One sample per byte. */
+static u8 packed[N_SAMPLES_MAX / 4];
+static u64 sign[N_WORDS_MAX];
+static u64 mag[N_WORDS_MAX];
+
+static u32 rng_state = 12345;
+
+static u32 rand_u32(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+/** C/A code of PRN 1, packed as by ca_code(), first chip in the MSB. */
+static void code_generate(void)
+{
+  u16 g1 = 0x3ff, g2 = 0x3ff;
+  memset(code, 0, sizeof(code));
+  for (u32 i = 0; i < SOFT_CORR_CODE_LENGTH; i++) {
+    /* PRN 1 taps G2 stages 2 and 6. */
+    u8 chip = ((g1 >> 9) ^ (g2 >> 8) ^ (g2 >> 4)) & 1;
+    if (chip)
+      code[i / 8] |= 0x80 >> (i % 8);
+    u16 f1 = ((g1 >> 2) ^ (g1 >> 9)) & 1;
+    u16 f2 = ((g2 >> 1) ^ (g2 >> 2) ^ (g2 >> 5) ^ (g2 >> 7) ^ (g2 >> 8) ^
+              (g2 >> 9)) & 1;
+    g1 = ((g1 << 1) | f1) & 0x3ff;
+    g2 = ((g2 << 1) | f2) & 0x3ff;
+  }
+}
+
+/** Pack raw samples four to a byte and into sign and magnitude planes. */
+static void samples_load(u32 n, soft_corr_samples_t *s, u32 first_sample)
+{
+  memset(packed, 0, (n + 3) / 4);
+  for (u32 i = 0; i < n; i++)
+    packed[i / 4] |= raw[i] << (2 * (i % 4));
+  soft_corr_samples_pack(packed, n, sign, mag);
+  s->sign = sign;
+  s->mag = mag;
+  s->n_words = (n + SOFT_CORR_WORD_SAMPLES - 1) / SOFT_CORR_WORD_SAMPLES;
+  s->first_sample = first_sample;
+}
+
+/* -------------------------------------------------------------------------
+ * Scalar model
+ * ------------------------------------------------------------------------- */
+
+#define UNITS_PER_CHIP ((u64)1 << 32)
+#define UNITS_PER_CODE (SOFT_CORR_CODE_LENGTH * UNITS_PER_CHIP)
+
+typedef struct {
+  s64 carr_phase;
+  u64 code_phase;
+  u32 start_sample;
+} ref_state_t;
+
+static s32 sample_value(u8 s)
+{
+  return ((s & 0x2) ? -1 : 1) * ((s & 0x1) ? 3 : 1);
+}
+
+/* Carrier by octant of the phase, sampled at the octant center. */
+static void carrier_value(u32 phase, s32 *cos_v, s32 *sin_v)
+{
+  static const s8 cos_oct[8] = {2, 1, -1, -2, -2, -1, 1, 2};
+  static const s8 sin_oct[8] = {1, 2, 2, 1, -1, -2, -2, -1};
+  *cos_v = cos_oct[phase >> 29];
+  *sin_v = sin_oct[phase >> 29];
+}
+
+/** One integration with one multiply-accumulate per sample. The carrier
+ * replica of each SOFT_CORR_WORD_SAMPLES samples starts from the center of
+ * the phase state of its first sample, as the lookup table does. */
+static void ref_integrate(ref_state_t *r, const u8 *samples, u32 first_sample,
+                          u32 carr_pinc, u32 code_pinc, u32 length,
+                          soft_corr_scaling_t scaling, corr_t corrs[3])
+{
+  const u32 state_shift = 32 - SOFT_CORR_CARR_PHASE_STATES_LOG2;
+  const u64 spacing = UNITS_PER_CHIP / 2;
+  s64 acc_i[3] = {0, 0, 0};
+  s64 acc_q[3] = {0, 0, 0};
+  u32 pos = r->start_sample - first_sample;
+  u32 replica = 0;
+
+  for (u32 k = 0; k < length; k++) {
+    if ((k % SOFT_CORR_WORD_SAMPLES) == 0) {
+      u32 state = (u32)r->carr_phase >> state_shift;
+      replica = (state << state_shift) + (1U << (state_shift - 1));
+    }
+    s32 cos_v, sin_v;
+    carrier_value(replica, &cos_v, &sin_v);
+    s32 x = sample_value(samples[pos + k]);
+    u64 cp[3] = {
+      (r->code_phase + spacing) % UNITS_PER_CODE,
+      r->code_phase,
+      (r->code_phase + UNITS_PER_CODE - spacing) % UNITS_PER_CODE
+    };
+    for (u32 j = 0; j < 3; j++) {
+      s32 chip = get_chip(code, cp[j] / UNITS_PER_CHIP);
+      acc_i[j] += x * chip * cos_v;
+      acc_q[j] += x * chip * sin_v;
+    }
+    replica += carr_pinc;
+    r->carr_phase += (s32)carr_pinc;
+    r->code_phase = (r->code_phase + code_pinc) % UNITS_PER_CODE;
+  }
+
+  for (u32 j = 0; j < 3; j++) {
+    corrs[j].I = (acc_i[j] * scaling.gain) >> scaling.shift;
+    corrs[j].Q = (acc_q[j] * scaling.gain) >> scaling.shift;
+  }
+  r->start_sample += length;
+}
+
+/* -------------------------------------------------------------------------
+ * Tests
+ * ------------------------------------------------------------------------- */
+
+/* Packing follows the 2-bit sample layout. */
+static void test_pack(void)
+{
+  for (u32 i = 0; i < 1000; i++)
+    raw[i] = rand_u32() & 0x3;
+  soft_corr_samples_t s;
+  samples_load(1000, &s, 0);
+  CHECK(s.n_words == 16);
+  u32 n_bad = 0;
+  for (u32 i = 0; i < 1000; i++) {
+    u8 sg = (sign[i / 64] >> (i % 64)) & 1;
+    u8 mg = (mag[i / 64] >> (i % 64)) & 1;
+    n_bad += (sg != (raw[i] >> 1)) || (mg != (raw[i] & 1));
+  }
+  CHECK(n_bad == 0);
+  CHECK((sign[15] >> (1000 % 64)) == 0);
+}
+
+/* Bit-exact against the scalar model over random samples and NCOs. Every
+ * integration after the first starts at a non-zero carrier and code
+ * phase. */
+static void test_exact(soft_corr_scaling_t scaling)
+{
+  const u32 n = 8 * MS_SAMPLES;
+  const u32 first_sample = 1000;
+  for (u32 i = 0; i < n; i++)
+    raw[i] = rand_u32() & 0x3;
+  soft_corr_samples_t s;
+  samples_load(n, &s, first_sample);
+
+  for (u32 trial = 0; trial < 8; trial++) {
+    u32 start = first_sample + (rand_u32() % 100);
+    soft_corr_channel_t c;
+    soft_corr_init(&c, code, start, scaling);
+    ref_state_t r = {.start_sample = start};
+
+    u32 n_int = 0;
+    u32 n_bad = 0;
+    while (true) {
+      u32 carr_pinc = rand_u32();
+      u32 code_pinc = (u32)(UNITS_PER_CHIP * CHIP_FREQ / SAMPLE_FREQ) +
+                      (rand_u32() % 20000) - 10000;
+      u32 length = MS_SAMPLES - 50 + (rand_u32() % 100);
+      soft_corr_update(&c, carr_pinc, code_pinc, length);
+      if (!soft_corr_integrate(&c, &s))
+        break;
+
+      corr_t ref[3];
+      ref_integrate(&r, raw, first_sample, carr_pinc, code_pinc, length,
+                    scaling, ref);
+
+      u32 count;
+      corr_t corrs[3];
+      double cp_early, carr;
+      soft_corr_read_results(&c, &count, corrs, &cp_early, &carr);
+      CHECK(count == r.start_sample - length);
+      for (u32 j = 0; j < 3; j++)
+        n_bad += (corrs[j].I != ref[j].I) || (corrs[j].Q != ref[j].Q);
+      CHECK(r.code_phase == c.code_phase);
+      CHECK(r.carr_phase == c.carr_phase);
+      n_int++;
+    }
+    CHECK(n_int >= 7);
+    CHECK(n_bad == 0);
+    if (n_bad != 0)
+      printf("  trial %u: %u correlations differ\n", (unsigned)trial,
+             (unsigned)n_bad);
+  }
+}
+
+/* A synthetic signal at carrier phase phi0: the prompt correlation must be
+ * at phi0 in every integration, the carrier and code phase outputs must
+ * follow the NCOs as those of nap_track_read_results() do. */
+static void test_signal(double phi0)
+{
+  const u32 n_int = 20;
+  const u32 first_sample = 5000;
+  const u32 offset = 37;
+  const u32 n = offset + n_int * MS_SAMPLES;
+
+  s32 carr_pinc = (s32)llround(-CARRIER_FREQ / SAMPLE_FREQ * 4294967296.0);
+  u32 code_pinc = (u32)llround(CHIP_FREQ / SAMPLE_FREQ * 4294967296.0);
+  /* Frequencies as realised by the NCOs, so the replica does not drift. */
+  double carr_freq = -(double)carr_pinc / 4294967296.0 * SAMPLE_FREQ;
+
+  for (u32 i = 0; i < n; i++) {
+    double v = 0;
+    if (i >= offset) {
+      u32 k = i - offset;
+      u64 cp = ((u64)k * code_pinc) % UNITS_PER_CODE;
+      s32 chip = get_chip(code, cp / UNITS_PER_CHIP);
+      v = 2.0 * chip * cos(2 * M_PI * carr_freq * k / SAMPLE_FREQ + phi0);
+    }
+    /* Dither, uniform in [-1, 1). */
+    v += (double)(rand_u32() % 2000) / 1000.0 - 1.0;
+    raw[i] = ((v < 0) ? 0x2 : 0) | ((fabs(v) > 2.0) ? 0x1 : 0);
+  }
+  soft_corr_samples_t s;
+  samples_load(n, &s, first_sample);
+
+  soft_corr_channel_t c;
+  soft_corr_init(&c, code, first_sample + offset, SOFT_CORR_SCALING_RAW);
+  soft_corr_update(&c, (u32)carr_pinc, code_pinc, MS_SAMPLES);
+
+  u32 n_bad_phase = 0;
+  for (u32 m = 0; m < n_int; m++) {
+    CHECK(soft_corr_integrate(&c, &s));
+    u32 count;
+    corr_t corrs[3];
+    double cp_early, carr;
+    soft_corr_read_results(&c, &count, corrs, &cp_early, &carr);
+
+    double phase = atan2(corrs[1].Q, corrs[1].I);
+    double err = remainder(phase - phi0, 2 * M_PI) * 180 / M_PI;
+    if (fabs(err) > PHASE_TOLERANCE_DEG) {
+      printf("  phi0 %.2f integration %u: prompt phase error %.1f deg\n",
+             phi0, (unsigned)m, err);
+      n_bad_phase++;
+    }
+    double p = hypot(corrs[1].I, corrs[1].Q);
+    double e = hypot(corrs[0].I, corrs[0].Q);
+    double l = hypot(corrs[2].I, corrs[2].Q);
+    CHECK((p > 1.5 * e) && (p > 1.5 * l));
+    CHECK(fabs(e - l) < 0.1 * p);
+
+    u32 n_done = (m + 1) * MS_SAMPLES;
+    CHECK(count == first_sample + offset + m * MS_SAMPLES);
+    double carr_expected = -(double)((s64)n_done * carr_pinc) / 4294967296.0;
+    CHECK(fabs(carr - carr_expected) < 1e-9);
+    double cp_expected =
+      (double)(((u64)n_done * code_pinc + UNITS_PER_CHIP / 2) %
+               UNITS_PER_CODE) / UNITS_PER_CHIP;
+    CHECK(fabs(cp_early - cp_expected) < 1e-9);
+  }
+  CHECK(n_bad_phase == 0);
+}
+
+/* The outputs are scaled as the caller asked. */
+static void test_scaling(void)
+{
+  soft_corr_scaling_t nap = {.gain = 3, .shift = 8};
+  test_exact(nap);
+}
+
+static u64 time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Report the time taken by one channel to correlate a second of samples. */
+static void bench(void)
+{
+  const u32 n = 64 * MS_SAMPLES;
+  for (u32 i = 0; i < n; i++)
+    raw[i] = rand_u32() & 0x3;
+  soft_corr_samples_t s;
+  samples_load(n, &s, 0);
+
+  soft_corr_channel_t c;
+  soft_corr_init(&c, code, 0, SOFT_CORR_SCALING_RAW);
+  u32 code_pinc = (u32)llround(CHIP_FREQ / SAMPLE_FREQ * 4294967296.0);
+  s32 carr_pinc = (s32)llround(-CARRIER_FREQ / SAMPLE_FREQ * 4294967296.0);
+
+  u64 t0 = time_ns();
+  for (u32 m = 0; m < BENCH_MS; m++) {
+    if ((m % 64) == 0)
+      c.start_sample = 0;
+    soft_corr_update(&c, (u32)carr_pinc, code_pinc, MS_SAMPLES);
+    soft_corr_integrate(&c, &s);
+  }
+  double sec = (time_ns() - t0) * 1e-9;
+  double rate = (double)BENCH_MS * MS_SAMPLES / sec;
+  printf("soft_corr: %.1f Msamples/s per channel, %.2fx real time for 12 "
+         "channels\n", rate * 1e-6, rate / (12 * SAMPLE_FREQ));
+}
+
+int main(void)
+{
+  code_generate();
+
+  test_pack();
+  test_exact(SOFT_CORR_SCALING_RAW);
+  test_scaling();
+  test_signal(0.0);
+  test_signal(0.7);
+  test_signal(2.3);
+  test_signal(-1.2);
+  test_signal(-2.9);
+  bench();
+
+  return check_summary();
+}
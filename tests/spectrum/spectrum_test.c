@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the v3 spectrum helpers and spectrum monitor with injected
+ * tones.
+ *
+ * Sample FFTs are made from complex Gaussian noise plus tones at known
+ * frequencies and power, transformed with a reference FFT and quantized to
+ * 16 bits like the output of the NAP FFT core. The helpers must find the
+ * noise floor and the tones, and the monitor must raise and clear its alarm
+ * and publish the averaged spectrum in MSG_SPECAN. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ch.h>
+#include <libswiftnav/logging.h>
+
+#include "settings.h"
+#include "timing.h"
+#include "nap/fft.h"
+#include "nap/nap_constants.h"
+#include "spectrum.h"
+#include "spectrum_monitor.h"
+#include "check.h"
+
+#define LEN_LOG2 FFT_LEN_LOG2_MAX
+#define LEN (1 << LEN_LOG2)
+#define FS NAP_ACQ_SAMPLE_RATE_Hz
+#define TONES_MAX 4
+
+/** RMS of a noise bin in FFT output counts. */
+#define NOISE_RMS 100.0
+
+typedef struct {
+  double bin;       /**< Frequency in FFT bins, signed, may be fractional. */
+  double jn_db;     /**< Tone power over the noise power of one bin (dB). */
+} tone_t;
+
+/* -------------------------------------------------------------------------
+ * Sample FFT generation
+ * ------------------------------------------------------------------------- */
+
+static double re_buf[LEN];
+static double im_buf[LEN];
+static u32 rng_state = 1;
+
+static double uniform(void)
+{
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return ((rng_state >> 8) + 0.5) / (1 << 24);
+}
+
+static double gaussian(void)
+{
+  return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static void fft_ref(double *re, double *im, u32 n)
+{
+  for (u32 i = 1, j = 0; i < n; i++) {
+    u32 bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      double t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for (u32 len = 2; len <= n; len <<= 1) {
+    double a = -2.0 * M_PI / len;
+    for (u32 i = 0; i < n; i += len) {
+      for (u32 k = 0; k < len / 2; k++) {
+        double wr = cos(a * k), wi = sin(a * k);
+        double *ur = &re[i + k], *ui = &im[i + k];
+        double *vr = &re[i + k + len / 2], *vi = &im[i + k + len / 2];
+        double xr = *vr * wr - *vi * wi;
+        double xi = *vr * wi + *vi * wr;
+        *vr = *ur - xr;
+        *vi = *ui - xi;
+        *ur += xr;
+        *ui += xi;
+      }
+    }
+  }
+}
+
+/** Make the quantized FFT of noise plus tones. */
+static void make_fft(fft_cplx_t *out, const tone_t *tones, u32 n_tones)
+{
+  /* Noise of unit power per sample gives bins of power LEN. */
+  double sigma = sqrt(0.5);
+  for (u32 i = 0; i < LEN; i++) {
+    re_buf[i] = sigma * gaussian();
+    im_buf[i] = sigma * gaussian();
+  }
+  for (u32 t = 0; t < n_tones; t++) {
+    double a = sqrt(pow(10.0, tones[t].jn_db / 10.0) / LEN);
+    for (u32 i = 0; i < LEN; i++) {
+      double ph = 2.0 * M_PI * tones[t].bin * i / LEN;
+      re_buf[i] += a * cos(ph);
+      im_buf[i] += a * sin(ph);
+    }
+  }
+
+  fft_ref(re_buf, im_buf, LEN);
+
+  double scale = NOISE_RMS / sqrt(LEN);
+  for (u32 i = 0; i < LEN; i++) {
+    out[i].re = (s16)lround(fmax(-32768.0, fmin(32767.0, re_buf[i] * scale)));
+    out[i].im = (s16)lround(fmax(-32768.0, fmin(32767.0, im_buf[i] * scale)));
+  }
+}
+
+static u32 natural_bin(double bin)
+{
+  return (u32)lround(bin) & (LEN - 1);
+}
+
+/* -------------------------------------------------------------------------
+ * Stubs of the spectrum monitor environment
+ * ------------------------------------------------------------------------- */
+
+int TYPE_BOOL = TYPE_STRING + 1;
+time_quality_t time_quality = TIME_FINE;
+
+static tone_t fft_tones[TONES_MAX];
+static u32 fft_n_tones;
+static u32 n_ffts;
+static systime_t now;
+
+static struct {
+  u32 n;
+  u16 msg_type;
+  u8 len;
+  u8 buf[256];
+} sent;
+
+static u32 n_warnings;
+static u32 n_infos;
+
+void settings_register(struct setting *s, enum setting_types type)
+{
+}
+
+bool settings_default_notify(struct setting *setting, const char *val)
+{
+  return true;
+}
+
+void log_(u8 level, const char *msg, ...)
+{
+  if (level == LOG_WARN)
+    n_warnings++;
+  else if (level == LOG_INFO)
+    n_infos++;
+}
+
+u32 sbp_send_msg(u16 msg_type, u8 len, u8 buff[])
+{
+  sent.n++;
+  sent.msg_type = msg_type;
+  sent.len = len;
+  memcpy(sent.buf, buff, len);
+  return 0;
+}
+
+gps_time_t get_current_time(void)
+{
+  gps_time_t t = {.tow = 123.4567891, .wn = 1900};
+  return t;
+}
+
+systime_t chVTGetSystemTime(void)
+{
+  return now;
+}
+
+bool fft_samples(fft_samples_input_t samples_input, fft_cplx_t *out,
+                 u32 len_log2, fft_dir_t dir, u32 scale_schedule,
+                 u32 *sample_count)
+{
+  CHECK(len_log2 == LEN_LOG2);
+  CHECK(dir == FFT_DIR_FORWARD);
+  n_ffts++;
+  make_fft(out, fft_tones, fft_n_tones);
+  *sample_count = n_ffts * LEN;
+  return true;
+}
+
+/* -------------------------------------------------------------------------
+ * Helper tests
+ * ------------------------------------------------------------------------- */
+
+static s16 test_iq[2 * LEN];
+static fft_cplx_t *const test_fft = (fft_cplx_t *)test_iq;
+
+static float mean_power(const fft_cplx_t *fft)
+{
+  double sum = 0.0;
+  for (u32 i = 0; i < LEN; i++)
+    sum += spectrum_bin_power(fft[i].re, fft[i].im);
+  return sum / LEN;
+}
+
+/* The floor of pure noise is its mean bin power and nothing crosses a
+ * 20 dB threshold. */
+static void test_noise(void)
+{
+  make_fft(test_fft, NULL, 0);
+
+  float mean = mean_power(test_fft);
+  CHECK(fabs(mean / (NOISE_RMS * NOISE_RMS) - 1.0f) < 0.05f);
+
+  float floor = spectrum_noise_floor(test_iq, LEN);
+  CHECK(fabsf(floor / mean - 1.0f) < 0.05f);
+
+  spectrum_peak_t peaks[4];
+  CHECK(spectrum_peaks_find(test_iq, LEN, 100.0f * floor, peaks, 4) == 0);
+}
+
+/* Tones on and between bins are found at their frequency, one peak each,
+ * and leave the floor estimate unchanged. */
+static void test_tones(void)
+{
+  const tone_t tones[] = {
+    {.bin = 1320.0, .jn_db = 30.0},     /* +1.0 MHz, on a bin */
+    {.bin = -4000.5, .jn_db = 40.0},    /* -3.0 MHz, between two bins */
+    {.bin = 9000.0, .jn_db = 10.0},     /* below the threshold */
+  };
+  make_fft(test_fft, tones, 3);
+
+  float floor = spectrum_noise_floor(test_iq, LEN);
+  CHECK(fabs(floor / (NOISE_RMS * NOISE_RMS) - 1.0f) < 0.1f);
+
+  spectrum_peak_t peaks[4];
+  u32 n = spectrum_peaks_find(test_iq, LEN, 100.0f * floor, peaks, 4);
+  CHECK(n == 2);
+  if (n != 2)
+    return;
+
+  /* Peaks are reported in natural FFT order, positive frequencies first. */
+  CHECK(peaks[0].bin == natural_bin(tones[0].bin));
+  CHECK(fabsf(10.0f * log10f(peaks[0].power / floor) - 30.0f) < 1.5f);
+  CHECK((peaks[1].bin == natural_bin(tones[1].bin - 0.5)) ||
+        (peaks[1].bin == natural_bin(tones[1].bin + 0.5)));
+
+  float df = FS / LEN;
+  CHECK(fabs(spectrum_bin_freq(peaks[0].bin, LEN, FS) -
+              tones[0].bin * df) < 0.5f * df);
+  CHECK(fabs(spectrum_bin_freq(peaks[1].bin, LEN, FS) -
+              tones[1].bin * df) < df);
+
+  /* Only the first max_peaks are stored, all are counted. */
+  CHECK(spectrum_peaks_find(test_iq, LEN, 100.0f * floor, peaks, 1) == 2);
+  CHECK(peaks[0].bin == natural_bin(tones[0].bin));
+}
+
+/* The averaged spectrum is ordered by frequency and converges on the mean
+ * power of each group of bins. */
+static void test_average(void)
+{
+  const tone_t tone = {.bin = -8000.0, .jn_db = 40.0};
+  make_fft(test_fft, &tone, 1);
+
+  float average[SPECTRUM_MONITOR_BINS];
+  memset(average, 0, sizeof(average));
+  spectrum_average_update(test_iq, LEN, average, SPECTRUM_MONITOR_BINS, 1.0f);
+
+  u32 group = LEN / SPECTRUM_MONITOR_BINS;
+  u32 k_tone = (u32)(tone.bin + LEN / 2) / group;
+  u32 k_max = 0;
+  for (u32 k = 1; k < SPECTRUM_MONITOR_BINS; k++) {
+    if (average[k] > average[k_max])
+      k_max = k;
+  }
+  CHECK(k_max == k_tone);
+
+  float noise = NOISE_RMS * NOISE_RMS;
+  float expected = noise + noise * powf(10.0f, tone.jn_db / 10.0f) / group;
+  CHECK(fabsf(average[k_tone] / expected - 1.0f) < 0.1f);
+  CHECK(fabsf(average[0] / noise - 1.0f) < 0.3f);
+
+  /* A small weight moves the average by that fraction of the difference. */
+  float before = average[k_tone];
+  make_fft(test_fft, NULL, 0);
+  spectrum_average_update(test_iq, LEN, average, SPECTRUM_MONITOR_BINS, 0.1f);
+  CHECK(fabsf(average[k_tone] - (before + 0.1f * (noise - before))) <
+        0.02f * before);
+}
+
+/* -------------------------------------------------------------------------
+ * Monitor test
+ * ------------------------------------------------------------------------- */
+
+static void monitor_step(void)
+{
+  now += MS2ST(1000);
+  spectrum_monitor_run();
+}
+
+static void test_monitor(void)
+{
+  spectrum_monitor_setup();
+
+  fft_tones[0] = (tone_t){.bin = 2640.0, .jn_db = 35.0};
+  fft_n_tones = 1;
+
+  /* Alarm is raised on the third snapshot with the tone. */
+  monitor_step();
+  CHECK(n_ffts == 1);
+  monitor_step();
+  CHECK(n_warnings == 0);
+  monitor_step();
+  CHECK(n_warnings == 1);
+  CHECK(n_ffts == 3);
+
+  /* At most one FFT per interval. */
+  spectrum_monitor_run();
+  CHECK(n_ffts == 3);
+  CHECK(sent.n == 3);
+
+  /* Published spectrum. */
+  CHECK(sent.msg_type == SBP_MSG_SPECAN);
+  CHECK(sent.len == sizeof(msg_specan_t) + SPECTRUM_MONITOR_BINS);
+  msg_specan_t *m = (msg_specan_t *)sent.buf;
+  CHECK(m->t.wn == 1900);
+  CHECK(m->t.tow == 123457);
+  CHECK(abs(m->t.ns_residual + 210900) <= 1);
+  CHECK(fabs(m->freq_ref - (1575.42f - FS / 2e6f)) < 1e-3f);
+  CHECK(fabs(m->freq_step * SPECTRUM_MONITOR_BINS - FS / 1e6f) < 1e-3f);
+  CHECK(m->amplitude_unit == SPECTRUM_AMPLITUDE_STEP_dB);
+
+  float noise_db = 10.0f * log10f(NOISE_RMS * NOISE_RMS);
+  u32 group = LEN / SPECTRUM_MONITOR_BINS;
+  u32 k_tone = (u32)(fft_tones[0].bin + LEN / 2) / group;
+  for (u32 k = 0; k < SPECTRUM_MONITOR_BINS; k++) {
+    float db = m->amplitude_ref + m->amplitude_value[k] * m->amplitude_unit;
+    if (k == k_tone) {
+      float expected = noise_db +
+        10.0f * log10f(1.0f + powf(10.0f, fft_tones[0].jn_db / 10.0f) / group);
+      CHECK(fabsf(db - expected) < 1.0f);
+    } else {
+      CHECK(fabsf(db - noise_db) < 1.0f);
+    }
+  }
+
+  /* Alarm is cleared after five snapshots without the tone. */
+  fft_n_tones = 0;
+  for (u32 i = 0; i < 4; i++)
+    monitor_step();
+  CHECK(n_infos == 0);
+  monitor_step();
+  CHECK(n_infos == 1);
+  CHECK(n_warnings == 1);
+
+  /* Time is left out until it is known. */
+  time_quality = TIME_UNKNOWN;
+  monitor_step();
+  m = (msg_specan_t *)sent.buf;
+  CHECK((m->t.wn == 0) && (m->t.tow == 0) && (m->t.ns_residual == 0));
+}
+
+int main(void)
+{
+  test_noise();
+  test_tones();
+  test_average();
+  test_monitor();
+
+  return check_summary();
+}
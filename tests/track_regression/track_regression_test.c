@@ -0,0 +1,710 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host regression and benchmark harness for the tracking loop math.
+ *
+ * Each suite prints one line per test vector. In check mode the lines are
+ * compared against golden/<suite>.txt, in record mode the golden files are
+ * rewritten. Doubles are printed in hex so the comparison is bit-exact.
+ *
+ * A suite without a golden file fails the check, it must be recorded with
+ * the libswiftnav the firmware is built with since the suite output depends
+ * on it.
+ *
+ * The track_gps_l1ca suite runs the real tracker update path against
+ * synthetic correlations. The correlator model closes the loop through
+ * tracker_retune() with the same two integration pipeline delay as the NAP,
+ * so the correlation sequence each tracker sees is fully determined by the
+ * scenario parameters and the tracker's own outputs. */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libswiftnav/constants.h>
+
+#include "settings.h"
+#include "signal.h"
+#include "track.h"
+#include "track_api.h"
+#include "track_internal.h"
+#include "track/track_gps_l1ca.h"
+#include "nap/track_channel_calc.h"
+
+#define GOLDEN_DIR "golden"
+#define LINE_LEN 160
+
+/* Standard deviation of the correlator noise per 1 ms, per component. */
+#define SIM_NOISE_SIGMA 200.0
+#define SIM_NAV_BIT_MS 20
+/* Time after which the simulated bit sync reports alignment. */
+#define SIM_BIT_SYNC_MS 300
+
+#define BENCH_CALLS 1000000
+
+static enum {
+  MODE_CHECK,
+  MODE_RECORD,
+  MODE_BENCH,
+} mode = MODE_CHECK;
+
+/* -------------------------------------------------------------------------
+ * Golden file handling
+ * ------------------------------------------------------------------------- */
+
+static struct {
+  const char *name;
+  FILE *golden;
+  u32 line;
+  u32 mismatches;
+  bool missing;
+} suite;
+
+static u32 failed_suites;
+
+static void suite_begin(const char *name)
+{
+  char path[128];
+  snprintf(path, sizeof(path), GOLDEN_DIR "/%s.txt", name);
+
+  memset(&suite, 0, sizeof(suite));
+  suite.name = name;
+
+  switch (mode) {
+  case MODE_CHECK:
+    suite.golden = fopen(path, "r");
+    suite.missing = (suite.golden == NULL);
+    break;
+  case MODE_RECORD:
+    suite.golden = fopen(path, "w");
+    if (suite.golden == NULL) {
+      perror(path);
+      exit(EXIT_FAILURE);
+    }
+    break;
+  case MODE_BENCH:
+    break;
+  }
+}
+
+static void suite_line(const char *fmt, ...)
+{
+  char line[LINE_LEN];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+
+  suite.line++;
+
+  if (mode == MODE_RECORD) {
+    fprintf(suite.golden, "%s\n", line);
+    return;
+  }
+
+  if ((mode != MODE_CHECK) || suite.missing) {
+    return;
+  }
+
+  char expected[LINE_LEN];
+  if (fgets(expected, sizeof(expected), suite.golden) == NULL) {
+    expected[0] = '\0';
+  }
+  expected[strcspn(expected, "\n")] = '\0';
+
+  if (strcmp(line, expected) != 0) {
+    if (suite.mismatches++ < 5) {
+      printf("  %s:%u\n    expected: %s\n    actual:   %s\n",
+             suite.name, suite.line, expected, line);
+    }
+  }
+}
+
+static void suite_end(void)
+{
+  switch (mode) {
+  case MODE_CHECK:
+    if (suite.missing) {
+      printf("FAIL %s: no golden file, run 'make golden' on a known good "
+             "tree\n", suite.name);
+      failed_suites++;
+      break;
+    }
+    /* Extra golden lines mean vectors were dropped. */
+    char extra[LINE_LEN];
+    if (fgets(extra, sizeof(extra), suite.golden) != NULL) {
+      suite.mismatches++;
+      printf("  %s: golden file has more than %u lines\n",
+             suite.name, suite.line);
+    }
+    fclose(suite.golden);
+    if (suite.mismatches > 0) {
+      printf("FAIL %s: %u of %u lines differ\n",
+             suite.name, suite.mismatches, suite.line);
+      failed_suites++;
+    } else {
+      printf("PASS %s (%u vectors)\n", suite.name, suite.line);
+    }
+    break;
+  case MODE_RECORD:
+    fclose(suite.golden);
+    printf("RECORD %s (%u vectors)\n", suite.name, suite.line);
+    break;
+  case MODE_BENCH:
+    break;
+  }
+}
+
+/* -------------------------------------------------------------------------
+ * Helpers
+ * ------------------------------------------------------------------------- */
+
+/** Deterministic xorshift32 generator, independent of the host libc. */
+static u32 rng_next(u32 *state)
+{
+  u32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/** Approximately normal deviate with unit variance (Irwin-Hall, n = 4). */
+static double rng_normal(u32 *state)
+{
+  double sum = 0;
+  for (u32 i = 0; i < 4; i++) {
+    sum += rng_next(state) * (1.0 / 4294967296.0);
+  }
+  return (sum - 2.0) * sqrt(3.0);
+}
+
+static u64 hash_bytes(u64 hash, const void *data, size_t len)
+{
+  const u8 *p = data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+#define HASH_VALUE(hash, v) ((hash) = hash_bytes((hash), &(v), sizeof(v)))
+
+static u64 time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------
+ * Pure function suites
+ * ------------------------------------------------------------------------- */
+
+static void test_nav_bit_quantize(void)
+{
+  static const s32 edges[] = {
+    INT32_MIN, INT32_MIN + 1, -(1 << 24) - 1, -(1 << 24), -(1 << 24) + 1,
+    -2, -1, 0, 1, (1 << 24) - 1, (1 << 24), (1 << 24) + 1,
+    INT32_MAX - 1, INT32_MAX,
+  };
+
+  suite_begin("nav_bit_quantize");
+
+  for (u32 i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+    suite_line("%" PRId32 " %d", edges[i], nav_bit_quantize(edges[i]));
+  }
+
+  u32 rng = 0x6e617662;
+  for (u32 i = 0; i < 256; i++) {
+    s32 x = (s32)rng_next(&rng);
+    suite_line("%" PRId32 " %d", x, nav_bit_quantize(x));
+  }
+
+  suite_end();
+}
+
+static void test_propagate_code_phase(void)
+{
+  static const double code_phases[] = {
+    0.0, 0.5, 511.25, 1022.0, 1022.999999,
+  };
+  static const double carrier_freqs[] = {
+    -7000.0, -1234.5, 0.0, 0.1, 987.654321, 7000.0,
+  };
+  static const u32 n_samples[] = {
+    0, 1, 97, 99375, 1000000, 99375000, 0x7fffffff, 0xffffffff,
+  };
+
+  suite_begin("propagate_code_phase");
+
+  for (u32 i = 0; i < sizeof(code_phases) / sizeof(code_phases[0]); i++) {
+    for (u32 j = 0; j < sizeof(carrier_freqs) / sizeof(carrier_freqs[0]); j++) {
+      for (u32 k = 0; k < sizeof(n_samples) / sizeof(n_samples[0]); k++) {
+        double cp = propagate_code_phase(code_phases[i], carrier_freqs[j],
+                                         n_samples[k]);
+        suite_line("%a %a %" PRIu32 " %a",
+                   code_phases[i], carrier_freqs[j], n_samples[k], cp);
+      }
+    }
+  }
+
+  suite_end();
+}
+
+static void test_nap_track_calc(void)
+{
+  suite_begin("nap_track_calc");
+
+  u32 rng = 0x6e617074;
+  for (u32 i = 0; i < 64; i++) {
+    double carrier_freq = ((s32)rng_next(&rng) % 1000000) * 0.01;
+    double code_phase_rate = (1.0 + carrier_freq / GPS_L1_HZ) *
+                             GPS_CA_CHIPPING_RATE +
+                             ((s32)rng_next(&rng) % 10000) * 1e-4;
+    u32 code_pinc = nap_track_code_pinc(code_phase_rate);
+    suite_line("pinc %a %" PRId32 " %a %" PRIu32,
+               carrier_freq, nap_track_carr_pinc(carrier_freq),
+               code_phase_rate, code_pinc);
+
+    for (u8 codes = 1; codes <= 20; codes++) {
+      u32 cp_start = rng_next(&rng);
+      suite_line("len %u %08" PRIx32 " %" PRIu32 " %" PRIu32, codes, cp_start,
+                 code_pinc, nap_track_length_samples(codes, cp_start,
+                                                     code_pinc));
+    }
+
+    u64 nap_code_phase = ((u64)(rng_next(&rng) % 1023) << 32) |
+                         rng_next(&rng);
+    s64 nap_carr_phase = (s64)(((u64)rng_next(&rng) << 32) | rng_next(&rng));
+    suite_line("phase %016" PRIx64 " %a %016" PRIx64 " %a",
+               nap_code_phase, nap_track_code_phase_chips(nap_code_phase),
+               (u64)nap_carr_phase,
+               nap_track_carrier_phase_cycles(nap_carr_phase));
+  }
+
+  suite_end();
+}
+
+static void bench_pure_functions(void)
+{
+  volatile double cp_sink = 0;
+  volatile u32 len_sink = 0;
+  u32 rng = 1;
+
+  u64 t0 = time_ns();
+  for (u32 i = 0; i < BENCH_CALLS; i++) {
+    cp_sink = propagate_code_phase(cp_sink, 1000.0, 99375 + (i & 0xff));
+  }
+  u64 t1 = time_ns();
+  for (u32 i = 0; i < BENCH_CALLS; i++) {
+    len_sink += nap_track_length_samples(1 + (i & 0xf), rng_next(&rng),
+                                         44226618 + (i & 0xff));
+  }
+  u64 t2 = time_ns();
+
+  printf("BENCH propagate_code_phase      %8.1f ns/call\n",
+         (double)(t1 - t0) / BENCH_CALLS);
+  printf("BENCH nap_track_length_samples  %8.1f ns/call\n",
+         (double)(t2 - t1) / BENCH_CALLS);
+}
+
+/* -------------------------------------------------------------------------
+ * Simulated tracker channels
+ * ------------------------------------------------------------------------- */
+
+/** Replica parameters of one integration. */
+typedef struct {
+  double carrier_freq;
+  double code_phase_rate;
+  u32 int_ms;
+} sim_replica_t;
+
+/** Simulated signal and correlator for one tracker channel. */
+typedef struct {
+  /* Signal truth. */
+  double doppler;         /**< Doppler at t = 0 (Hz). */
+  double doppler_rate;    /**< Doppler rate (Hz/s). */
+  double cn0;             /**< C/N0 (dBHz). */
+  double code_err;        /**< Replica minus signal code phase (chips). */
+  double carr_err;        /**< Signal minus replica carrier phase (cycles). */
+  u32 time_ms;            /**< End of the last integration read. */
+  u32 rng;
+
+  /* Correlator pipeline: replica[0] is the integration in progress,
+   * replica[1] the one programmed by the last tracker_retune(). */
+  sim_replica_t replica[2];
+  corr_t cs[3];           /**< Next result of tracker_correlations_read(). */
+  u32 cs_ms;              /**< Length of the integration in cs. */
+
+  /* Outputs. */
+  u64 hash;
+  u32 updates;
+  u32 ambiguity_resets;
+} sim_channel_t;
+
+typedef struct {
+  const char *name;
+  double cn0;
+  double doppler_max;
+  double doppler_rate;
+  double freq_err;
+  double code_err;
+  u32 duration_ms;
+} sim_scenario_t;
+
+static const sim_scenario_t scenarios[] = {
+  /* name     cn0   dopp  rate  f_err code  ms */
+  {"strong",  45.0, 4000,    0,  20, 0.10, 3000},
+  {"weak",    34.0, 4000,    0,  10, 0.05, 3000},
+  {"dynamic", 42.0, 4000,   30,  30, 0.20, 3000},
+};
+
+static sim_channel_t sim_channels[NUM_GPS_L1CA_TRACKERS];
+static tracker_channel_info_t channel_infos[NUM_GPS_L1CA_TRACKERS];
+static tracker_common_data_t common_datas[NUM_GPS_L1CA_TRACKERS];
+static const tracker_interface_t *gps_l1ca_interface;
+
+/** Nav data bit in effect at time t. */
+static double sim_nav_bit(const sim_channel_t *s, u32 t_ms)
+{
+  u32 x = (s->rng >> 8) ^ (t_ms / SIM_NAV_BIT_MS) * 2654435761u;
+  x ^= x >> 15;
+  x *= 0x2c1b3c6d;
+  x ^= x >> 12;
+  return (x & 1) ? -1.0 : 1.0;
+}
+
+/** Produce the correlations of the integration in progress and advance the
+ * correlator pipeline.
+ *
+ * The NAP reports the arms in the order the tracker reverses before the loop
+ * filter, so cs[2] is the arm whose replica leads the prompt.
+ */
+static void sim_integrate(sim_channel_t *s)
+{
+  const sim_replica_t *r = &s->replica[0];
+  double amplitude = SIM_NOISE_SIGMA * sqrt(2.0 * pow(10.0, s->cn0 / 10.0) *
+                                            1e-3);
+  double I[3] = {0, 0, 0};
+  double Q[3] = {0, 0, 0};
+
+  for (u32 ms = 0; ms < r->int_ms; ms++) {
+    u32 t = s->time_ms + ms;
+    double f = s->doppler + s->doppler_rate * t * 1e-3;
+    double df = f - r->carrier_freq;
+    double phi = 2.0 * M_PI * (s->carr_err + 0.5 * df * 1e-3);
+    double a = amplitude * sim_nav_bit(s, t);
+
+    for (u32 k = 0; k < 3; k++) {
+      double d = fabs(s->code_err + 0.5 * ((double)k - 1.0));
+      double tri = (d < 1.0) ? 1.0 - d : 0.0;
+      I[k] += a * tri * cos(phi) + SIM_NOISE_SIGMA * rng_normal(&s->rng);
+      Q[k] += a * tri * sin(phi) + SIM_NOISE_SIGMA * rng_normal(&s->rng);
+    }
+
+    s->carr_err += df * 1e-3;
+    s->carr_err -= floor(s->carr_err);
+    double code_rate = (1.0 + f / GPS_L1_HZ) * GPS_CA_CHIPPING_RATE;
+    s->code_err += (r->code_phase_rate - code_rate) * 1e-3;
+  }
+
+  for (u32 k = 0; k < 3; k++) {
+    s->cs[k].I = lround(I[k]);
+    s->cs[k].Q = lround(Q[k]);
+  }
+  s->cs_ms = r->int_ms;
+  s->replica[0] = s->replica[1];
+}
+
+static void sim_channel_init(u32 ch, const sim_scenario_t *sc)
+{
+  sim_channel_t *s = &sim_channels[ch];
+  tracker_common_data_t *common_data = &common_datas[ch];
+  tracker_channel_info_t *channel_info = &channel_infos[ch];
+  double sign = (ch & 1) ? -1.0 : 1.0;
+
+  memset(s, 0, sizeof(*s));
+  s->doppler = sc->doppler_max * (2.0 * ch / (NUM_GPS_L1CA_TRACKERS - 1) - 1.0);
+  s->doppler_rate = sign * sc->doppler_rate;
+  s->cn0 = sc->cn0;
+  s->code_err = sign * sc->code_err;
+  s->rng = 0x9e3779b9 ^ (ch * 0x85ebca6b) ^ hash_bytes(0, sc->name,
+                                                      strlen(sc->name));
+  if (s->rng == 0) {
+    s->rng = 1;
+  }
+  s->hash = 0xcbf29ce484222325ULL;
+
+  memset(common_data, 0, sizeof(*common_data));
+  common_data->carrier_freq = s->doppler + sign * sc->freq_err;
+  common_data->code_phase_rate = (1.0 + common_data->carrier_freq /
+                                  GPS_L1_HZ) * GPS_CA_CHIPPING_RATE;
+  common_data->cn0 = sc->cn0 - 5.0;
+  common_data->TOW_ms = 100000;
+
+  s->replica[0].carrier_freq = common_data->carrier_freq;
+  s->replica[0].code_phase_rate = common_data->code_phase_rate;
+  s->replica[0].int_ms = 1;
+  s->replica[1] = s->replica[0];
+
+  channel_info->sid = construct_sid(CODE_GPS_L1CA, GPS_FIRST_PRN + ch);
+  channel_info->nap_channel = ch;
+  channel_info->context = s;
+
+  gps_l1ca_interface->trackers[ch].active = true;
+  gps_l1ca_interface->init(channel_info, common_data,
+                           gps_l1ca_interface->trackers[ch].data);
+}
+
+static void sim_channel_hash(sim_channel_t *s,
+                             const tracker_common_data_t *c)
+{
+  HASH_VALUE(s->hash, c->update_count);
+  HASH_VALUE(s->hash, c->mode_change_count);
+  HASH_VALUE(s->hash, c->cn0_below_use_thres_count);
+  HASH_VALUE(s->hash, c->cn0_above_drop_thres_count);
+  HASH_VALUE(s->hash, c->ld_opti_locked_count);
+  HASH_VALUE(s->hash, c->ld_pess_unlocked_count);
+  HASH_VALUE(s->hash, c->TOW_ms);
+  HASH_VALUE(s->hash, c->carrier_freq);
+  HASH_VALUE(s->hash, c->code_phase_rate);
+  HASH_VALUE(s->hash, c->cn0);
+  HASH_VALUE(s->hash, s->ambiguity_resets);
+}
+
+static void test_track_gps_l1ca(void)
+{
+  u64 update_ns = 0;
+  u64 updates = 0;
+
+  suite_begin("track_gps_l1ca");
+
+  for (u32 i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    const sim_scenario_t *sc = &scenarios[i];
+    u64 scenario_ns = 0;
+    u64 scenario_updates = 0;
+
+    for (u32 ch = 0; ch < NUM_GPS_L1CA_TRACKERS; ch++) {
+      sim_channel_init(ch, sc);
+    }
+
+    bool running = true;
+    while (running) {
+      running = false;
+
+      /* Correlations are produced outside the timed region. */
+      for (u32 ch = 0; ch < NUM_GPS_L1CA_TRACKERS; ch++) {
+        if (sim_channels[ch].time_ms < sc->duration_ms) {
+          sim_integrate(&sim_channels[ch]);
+        }
+      }
+
+      u64 t0 = time_ns();
+      for (u32 ch = 0; ch < NUM_GPS_L1CA_TRACKERS; ch++) {
+        if (sim_channels[ch].time_ms < sc->duration_ms) {
+          gps_l1ca_interface->update(&channel_infos[ch], &common_datas[ch],
+                                     gps_l1ca_interface->trackers[ch].data);
+          scenario_updates++;
+        }
+      }
+      scenario_ns += time_ns() - t0;
+
+      for (u32 ch = 0; ch < NUM_GPS_L1CA_TRACKERS; ch++) {
+        sim_channel_t *s = &sim_channels[ch];
+        if (s->time_ms < sc->duration_ms) {
+          sim_channel_hash(s, &common_datas[ch]);
+          s->updates++;
+          running |= (s->time_ms < sc->duration_ms);
+        }
+      }
+    }
+
+    for (u32 ch = 0; ch < NUM_GPS_L1CA_TRACKERS; ch++) {
+      const sim_channel_t *s = &sim_channels[ch];
+      const tracker_common_data_t *c = &common_datas[ch];
+      suite_line("%s %2" PRIu32 " %016" PRIx64 " %" PRIu32 " %a %a %a",
+                 sc->name, ch, s->hash, s->updates,
+                 c->carrier_freq, c->code_phase_rate, (double)c->cn0);
+      gps_l1ca_interface->disable(&channel_infos[ch], &common_datas[ch],
+                                  gps_l1ca_interface->trackers[ch].data);
+      gps_l1ca_interface->trackers[ch].active = false;
+    }
+
+    printf("BENCH track_gps_l1ca %-8s   %8.1f ns/update/channel\n",
+           sc->name, (double)scenario_ns / scenario_updates);
+    update_ns += scenario_ns;
+    updates += scenario_updates;
+  }
+
+  suite_end();
+
+  printf("BENCH track_gps_l1ca total      %8.1f ns/update/channel "
+         "(%" PRIu64 " updates, %u channels)\n",
+         (double)update_ns / updates, updates, NUM_GPS_L1CA_TRACKERS);
+}
+
+/* -------------------------------------------------------------------------
+ * Tracker API mocks
+ * ------------------------------------------------------------------------- */
+
+void tracker_interface_register(tracker_interface_list_element_t *element)
+{
+  if (element->interface->code == CODE_GPS_L1CA) {
+    gps_l1ca_interface = element->interface;
+  }
+}
+
+void tracker_correlations_read(tracker_context_t *context, corr_t *cs,
+                               u32 *sample_count, double *code_phase,
+                               double *carrier_phase)
+{
+  sim_channel_t *s = context;
+  memcpy(cs, s->cs, sizeof(s->cs));
+  s->time_ms += s->cs_ms;
+  *sample_count = s->time_ms * (u32)(TRACK_SAMPLE_FREQ / 1000);
+  *code_phase = s->code_err;
+  *carrier_phase = s->carr_err;
+}
+
+void tracker_retune(tracker_context_t *context, double carrier_freq,
+                    double code_phase_rate, u8 rollover_count)
+{
+  sim_channel_t *s = context;
+  s->replica[1].carrier_freq = carrier_freq;
+  s->replica[1].code_phase_rate = code_phase_rate;
+  s->replica[1].int_ms = rollover_count + 1;
+  HASH_VALUE(s->hash, carrier_freq);
+  HASH_VALUE(s->hash, code_phase_rate);
+  HASH_VALUE(s->hash, rollover_count);
+}
+
+s32 tracker_tow_update(tracker_context_t *context, s32 current_TOW_ms,
+                       u32 int_ms)
+{
+  (void)context;
+  return current_TOW_ms + int_ms;
+}
+
+void tracker_bit_sync_update(tracker_context_t *context, u32 int_ms,
+                             s32 corr_prompt_real)
+{
+  sim_channel_t *s = context;
+  HASH_VALUE(s->hash, int_ms);
+  HASH_VALUE(s->hash, corr_prompt_real);
+}
+
+u8 tracker_bit_length_get(tracker_context_t *context)
+{
+  (void)context;
+  return SIM_NAV_BIT_MS;
+}
+
+bool tracker_bit_aligned(tracker_context_t *context)
+{
+  sim_channel_t *s = context;
+  return (s->time_ms >= SIM_BIT_SYNC_MS) &&
+         (s->time_ms % SIM_NAV_BIT_MS == 0);
+}
+
+void tracker_ambiguity_unknown(tracker_context_t *context)
+{
+  sim_channel_t *s = context;
+  s->ambiguity_resets++;
+}
+
+void tracker_correlations_send(tracker_context_t *context, const corr_t *cs)
+{
+  (void)context;
+  (void)cs;
+}
+
+/* -------------------------------------------------------------------------
+ * Firmware stubs
+ * ------------------------------------------------------------------------- */
+
+int TYPE_BOOL = TYPE_STRING + 1;
+
+/** Apply the default value of string settings, as settings_register() does
+ * when the setting is not in the settings file. */
+void settings_register(struct setting *s, enum setting_types type)
+{
+  if (type == TYPE_STRING) {
+    char buf[128];
+    strncpy(buf, s->addr, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    bool ok = s->notify(s, buf);
+    assert(ok);
+    (void)ok;
+  }
+}
+
+bool settings_default_notify(struct setting *setting, const char *val)
+{
+  (void)setting;
+  (void)val;
+  return true;
+}
+
+void log_(u8 level, const char *msg, ...)
+{
+  (void)level;
+  (void)msg;
+}
+
+u32 random_int(void)
+{
+  return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1) {
+    if (strcmp(argv[1], "check") == 0) {
+      mode = MODE_CHECK;
+    } else if (strcmp(argv[1], "record") == 0) {
+      mode = MODE_RECORD;
+    } else if (strcmp(argv[1], "bench") == 0) {
+      mode = MODE_BENCH;
+    } else {
+      fprintf(stderr, "usage: %s [check|record|bench]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  signal_init();
+  track_gps_l1ca_register();
+  assert(gps_l1ca_interface != NULL);
+
+  test_nav_bit_quantize();
+  test_propagate_code_phase();
+  test_nap_track_calc();
+  test_track_gps_l1ca();
+
+  if (mode == MODE_BENCH) {
+    bench_pure_functions();
+  }
+
+  if (failed_suites > 0) {
+    printf("%u suite(s) failed\n", failed_suites);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
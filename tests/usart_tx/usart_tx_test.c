@@ -0,0 +1,476 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/* Host test of the USART TX queue.
+ *
+ * A stub DMA engine stands in for the STM32 stream: the start hook latches
+ * the memory address and length as dmaStreamSetMemory0() and
+ * dmaStreamSetTransactionSize() would, and completing a transfer appends the
+ * bytes to a wire buffer and runs the completion as the TX DMA ISR does.
+ * Transfers must read either the port's ring or a buffer still referenced,
+ * in place. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ch.h>
+
+#include "peripherals/usart_tx.h"
+#include "check.h"
+
+#define WIRE_SIZE 65536
+#define RANDOM_ITERATIONS 100000
+
+typedef struct {
+  const u8 *mem;      /**< Memory address of the active transfer. */
+  u32 len;            /**< Length of the active transfer. */
+  bool enabled;       /**< Transfer in progress. */
+  u32 n_starts;       /**< Number of transfers started. */
+  u32 n_start_errors; /**< Starts while enabled, unlocked or reading memory
+                           which is neither ring nor a held buffer. */
+  u8 wire[WIRE_SIZE]; /**< Bytes sent. */
+  u32 wire_len;
+  usart_tx_queue_t *q;
+} dma_stub_t;
+
+/* Transfers outside of the ring must cover a held buffer, whose data is its
+ * first member. */
+static bool dma_stub_valid(dma_stub_t *d, const u8 data[], u32 len)
+{
+  if ((data >= d->q->ring) && (data < d->q->ring + USART_TX_RING_SIZE))
+    return data + len <= d->q->ring + USART_TX_RING_SIZE;
+  const usart_tx_buf_t *b = (const usart_tx_buf_t *)data;
+  return (b->refs > 0) && (len == b->len);
+}
+
+static void dma_stub_start(void *ctx, const u8 data[], u32 len)
+{
+  dma_stub_t *d = (dma_stub_t *)ctx;
+  if (d->enabled || !host_sys_locked || (len == 0) ||
+      !dma_stub_valid(d, data, len))
+    d->n_start_errors++;
+  d->mem = data;
+  d->len = len;
+  d->enabled = true;
+  d->n_starts++;
+}
+
+/** Finish the active transfer as the TX DMA ISR would. */
+static bool dma_stub_complete(dma_stub_t *d)
+{
+  if (!d->enabled)
+    return false;
+
+  if (d->wire_len + d->len <= WIRE_SIZE) {
+    memcpy(&d->wire[d->wire_len], d->mem, d->len);
+    d->wire_len += d->len;
+  }
+  d->enabled = false;
+
+  chSysLock();
+  usart_tx_queue_completeI(d->q);
+  chSysUnlock();
+  return true;
+}
+
+static void dma_stub_drain(dma_stub_t *d)
+{
+  while (dma_stub_complete(d))
+    ;
+}
+
+static void dma_stub_init(dma_stub_t *d, usart_tx_queue_t *q)
+{
+  memset(d, 0, sizeof(*d));
+  d->q = q;
+  usart_tx_queue_init(q, dma_stub_start, d);
+}
+
+static u8 data[USART_TX_RING_SIZE + 1];
+
+static void data_fill(void)
+{
+  for (u32 i = 0; i < sizeof(data); i++)
+    data[i] = (u8)(i * 7 + (i >> 8));
+}
+
+static dma_stub_t dma_a, dma_b, dma_c;
+static usart_tx_queue_t queue_a, queue_b, queue_c;
+
+/** Allocate a buffer holding len bytes of data from offset. */
+static usart_tx_buf_t *buf_fill(u32 offset, u32 len)
+{
+  usart_tx_buf_t *b = usart_tx_buf_alloc();
+  if (b != NULL) {
+    memcpy(b->data, &data[offset], len);
+    b->len = len;
+  }
+  return b;
+}
+
+/* All buffers are back in the pool. */
+static bool pool_free(void)
+{
+  usart_tx_buf_t *bufs[USART_TX_BUF_COUNT];
+  u32 n;
+  for (n = 0; n < USART_TX_BUF_COUNT; n++) {
+    bufs[n] = usart_tx_buf_alloc();
+    if (bufs[n] == NULL)
+      break;
+  }
+  bool empty = (usart_tx_buf_alloc() == NULL);
+  for (u32 i = 0; i < n; i++)
+    usart_tx_buf_release(bufs[i]);
+  return (n == USART_TX_BUF_COUNT) && empty;
+}
+
+/* A write to an idle queue starts the DMA straight away from the ring. */
+static void test_start(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  CHECK(usart_tx_queue_write(&queue_a, data, 100) == 100);
+  CHECK(dma_a.enabled);
+  CHECK(dma_a.mem == queue_a.ring);
+  CHECK(dma_a.len == 100);
+  CHECK(usart_tx_queue_n_free(&queue_a) == USART_TX_RING_SIZE - 100);
+  CHECK(queue_a.write_mutex.locked == 0);
+
+  dma_stub_drain(&dma_a);
+  CHECK(dma_a.wire_len == 100);
+  CHECK(memcmp(dma_a.wire, data, 100) == 0);
+  CHECK(usart_tx_queue_n_free(&queue_a) == USART_TX_RING_SIZE);
+  CHECK(usart_tx_queue_write(&queue_a, data, 0) == 0);
+  CHECK(dma_a.n_starts == 1);
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* Writes made during a transfer are sent together by the next one, which is
+ * started from the completion. */
+static void test_chain(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  u32 len = 0;
+  for (u32 i = 0; i < 3; i++) {
+    CHECK(usart_tx_queue_write(&queue_a, &data[len], 10 + i) == 10 + i);
+    len += 10 + i;
+  }
+  CHECK(dma_a.n_starts == 1);
+  CHECK(dma_a.len == 10);
+
+  CHECK(dma_stub_complete(&dma_a));
+  CHECK(dma_a.n_starts == 2);
+  CHECK(dma_a.mem == &queue_a.ring[10]);
+  CHECK(dma_a.len == 11 + 12);
+
+  dma_stub_drain(&dma_a);
+  CHECK(dma_a.n_starts == 2);
+  CHECK(dma_a.wire_len == len);
+  CHECK(memcmp(dma_a.wire, data, len) == 0);
+  CHECK(!queue_a.busy);
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* Data wrapping around the end of the ring is sent in two transfers. */
+static void test_wrap(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  const u32 first = USART_TX_RING_SIZE - 10;
+  CHECK(usart_tx_queue_write(&queue_a, data, first) == first);
+  dma_stub_drain(&dma_a);
+
+  CHECK(usart_tx_queue_write(&queue_a, &data[first], 30) == 30);
+  CHECK(dma_a.mem == &queue_a.ring[first]);
+  CHECK(dma_a.len == 10);
+  CHECK(dma_stub_complete(&dma_a));
+  CHECK(dma_a.mem == queue_a.ring);
+  CHECK(dma_a.len == 20);
+  dma_stub_drain(&dma_a);
+
+  CHECK(dma_a.wire_len == first + 30);
+  CHECK(memcmp(dma_a.wire, data, first + 30) == 0);
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* The whole ring is available to small writes, a write which does not fit
+ * is refused entirely. */
+static void test_full(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  u32 n = 0;
+  while (usart_tx_queue_write(&queue_a, &data[8 * n], 8) == 8)
+    n++;
+  CHECK(n == USART_TX_RING_SIZE / 8);
+  CHECK(usart_tx_queue_n_free(&queue_a) == 0);
+  CHECK(queue_a.write_mutex.locked == 0);
+
+  /* Free the first transfer only, a larger write is still refused. */
+  CHECK(dma_stub_complete(&dma_a));
+  CHECK(usart_tx_queue_n_free(&queue_a) == 8);
+  CHECK(usart_tx_queue_write(&queue_a, data, 9) == 0);
+  CHECK(usart_tx_queue_write(&queue_a, data, 8) == 8);
+  CHECK(usart_tx_queue_n_free(&queue_a) == 0);
+
+  dma_stub_drain(&dma_a);
+  CHECK(dma_a.wire_len == USART_TX_RING_SIZE + 8);
+  CHECK(memcmp(dma_a.wire, data, USART_TX_RING_SIZE) == 0);
+  CHECK(memcmp(&dma_a.wire[USART_TX_RING_SIZE], data, 8) == 0);
+  CHECK(usart_tx_queue_write(&queue_a, data, USART_TX_RING_SIZE + 1) == 0);
+  CHECK(usart_tx_queue_write(&queue_a, data, USART_TX_RING_SIZE) ==
+        USART_TX_RING_SIZE);
+  dma_stub_drain(&dma_a);
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* A stalled port does not take space from another one. */
+static void test_independent(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+  dma_stub_init(&dma_b, &queue_b);
+
+  CHECK(usart_tx_queue_write(&queue_b, data, USART_TX_RING_SIZE) ==
+        USART_TX_RING_SIZE);
+  CHECK(usart_tx_queue_n_free(&queue_b) == 0);
+
+  for (u32 i = 0; i < 4 * USART_TX_RING_SIZE / 64; i++) {
+    CHECK(usart_tx_queue_write(&queue_a, data, 64) == 64);
+    dma_stub_drain(&dma_a);
+  }
+  CHECK(dma_a.wire_len == 4 * USART_TX_RING_SIZE);
+  CHECK(usart_tx_queue_n_free(&queue_b) == 0);
+
+  dma_stub_drain(&dma_b);
+  CHECK(dma_b.wire_len == USART_TX_RING_SIZE);
+  CHECK(dma_a.n_start_errors == 0);
+  CHECK(dma_b.n_start_errors == 0);
+}
+
+/* Interleave writes and completions at random, wrapping the ring many times,
+ * and check the bytes on the wire. */
+static void test_random(void)
+{
+  static u8 expected[WIRE_SIZE];
+  u32 expected_len = 0;
+  u32 n_refused = 0;
+
+  dma_stub_init(&dma_a, &queue_a);
+  srand(1);
+
+  for (u32 i = 0; i < RANDOM_ITERATIONS; i++) {
+    u32 op = rand() % 6;
+    if (op < 2) {
+      dma_stub_complete(&dma_a);
+    } else {
+      u32 len = 1 + (rand() % USART_TX_BUF_SIZE);
+      u32 offset = rand() % (sizeof(data) - len);
+      const u8 *p = &data[offset];
+      bool queued;
+      if (op < 4) {
+        queued = (usart_tx_queue_write(&queue_a, p, len) == len);
+      } else {
+        usart_tx_buf_t *b = buf_fill(offset, len);
+        CHECK(b != NULL);
+        queued = usart_tx_queue_submit(&queue_a, b);
+        usart_tx_buf_release(b);
+      }
+      if (queued) {
+        if (expected_len + len <= WIRE_SIZE)
+          memcpy(&expected[expected_len], p, len);
+        expected_len += len;
+      } else {
+        n_refused++;
+      }
+    }
+    CHECK(queue_a.pending <= USART_TX_RING_SIZE);
+    CHECK(queue_a.wr - queue_a.rd <= USART_TX_QUEUE_LEN);
+
+    if (dma_a.wire_len + 2 * USART_TX_RING_SIZE > WIRE_SIZE) {
+      dma_stub_drain(&dma_a);
+      CHECK(dma_a.wire_len == expected_len);
+      CHECK(memcmp(dma_a.wire, expected, expected_len) == 0);
+      dma_a.wire_len = 0;
+      expected_len = 0;
+    }
+  }
+
+  dma_stub_drain(&dma_a);
+  CHECK(dma_a.wire_len == expected_len);
+  CHECK(memcmp(dma_a.wire, expected, expected_len) == 0);
+  CHECK(queue_a.rd == queue_a.wr);
+  CHECK(queue_a.n_bufs == 0);
+  CHECK(usart_tx_queue_n_free(&queue_a) == USART_TX_RING_SIZE);
+  CHECK(pool_free());
+  CHECK(queue_a.write_mutex.locked == 0);
+  CHECK(dma_a.n_start_errors == 0);
+  CHECK(n_refused > 0);
+}
+
+/* A submitted buffer is sent in place and returns to the pool once the
+ * transfer has completed. */
+static void test_submit(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  usart_tx_buf_t *b = buf_fill(0, 50);
+  CHECK(usart_tx_queue_submit(&queue_a, b));
+  CHECK(dma_a.mem == b->data);
+  CHECK(dma_a.len == 50);
+  CHECK(b->refs == 2);
+  CHECK(usart_tx_queue_n_free(&queue_a) == USART_TX_RING_SIZE - 50);
+  usart_tx_buf_release(b);
+  CHECK(b->refs == 1);
+
+  dma_stub_drain(&dma_a);
+  CHECK(b->refs == 0);
+  CHECK(dma_a.wire_len == 50);
+  CHECK(memcmp(dma_a.wire, data, 50) == 0);
+  CHECK(queue_a.write_mutex.locked == 0);
+  CHECK(pool_free());
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* Copies and buffers are sent in the order queued, copies following each
+ * other share a transfer. */
+static void test_order(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  usart_tx_buf_t *b1 = buf_fill(10, 20);
+  usart_tx_buf_t *b2 = buf_fill(40, 5);
+  CHECK(usart_tx_queue_write(&queue_a, &data[0], 10) == 10);
+  CHECK(usart_tx_queue_submit(&queue_a, b1));
+  CHECK(usart_tx_queue_write(&queue_a, &data[30], 4) == 4);
+  CHECK(usart_tx_queue_write(&queue_a, &data[34], 6) == 6);
+  CHECK(usart_tx_queue_submit(&queue_a, b2));
+  CHECK(usart_tx_queue_write(&queue_a, &data[45], 3) == 3);
+  usart_tx_buf_release(b1);
+  usart_tx_buf_release(b2);
+  CHECK(queue_a.wr - queue_a.rd == 5);
+
+  CHECK(dma_stub_complete(&dma_a));
+  CHECK(dma_a.mem == b1->data);
+  CHECK(dma_stub_complete(&dma_a));
+  CHECK(dma_a.mem == &queue_a.ring[10]);
+  CHECK(dma_a.len == 10);
+  dma_stub_drain(&dma_a);
+
+  CHECK(dma_a.n_starts == 5);
+  CHECK(dma_a.wire_len == 48);
+  CHECK(memcmp(dma_a.wire, data, 48) == 0);
+  CHECK(pool_free());
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* A port holds at most its share of the pool, further buffers are copied,
+ * and buffers count against the same byte budget as copies. */
+static void test_share(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+
+  u32 n = 0;
+  bool queued = true;
+  while (queued) {
+    usart_tx_buf_t *b = buf_fill(0, 200);
+    CHECK(b != NULL);
+    queued = usart_tx_queue_submit(&queue_a, b);
+    if (queued) {
+      n++;
+      CHECK(b->refs == ((n <= USART_TX_PORT_BUFS) ? 2 : 1));
+    }
+    usart_tx_buf_release(b);
+  }
+  CHECK(n == USART_TX_RING_SIZE / 200);
+  CHECK(queue_a.n_bufs == USART_TX_PORT_BUFS);
+  CHECK(usart_tx_queue_n_free(&queue_a) ==
+        USART_TX_RING_SIZE - n * 200);
+  CHECK(usart_tx_queue_write(&queue_a, data,
+                             USART_TX_RING_SIZE - n * 200) ==
+        USART_TX_RING_SIZE - n * 200);
+  CHECK(usart_tx_queue_n_free(&queue_a) == 0);
+
+  dma_stub_drain(&dma_a);
+  CHECK(dma_a.wire_len == USART_TX_RING_SIZE);
+  for (u32 i = 0; i < n; i++)
+    CHECK(memcmp(&dma_a.wire[200 * i], data, 200) == 0);
+  CHECK(pool_free());
+  CHECK(dma_a.n_start_errors == 0);
+}
+
+/* Frames built one at a time and submitted to every port, as sbp.c does.
+ * Two stalled ports never leave the third short of buffers. */
+static void test_stalled(void)
+{
+  dma_stub_init(&dma_a, &queue_a);
+  dma_stub_init(&dma_b, &queue_b);
+  dma_stub_init(&dma_c, &queue_c);
+
+  u32 n_alloc_failed = 0;
+  u32 n_copied = 0;
+  u32 len = 0;
+  for (u32 i = 0; i < 1000; i++) {
+    /* Alternate frames between the stalled ports so they hold different
+     * buffers. */
+    usart_tx_queue_t *stalled = (i % 2) ? &queue_b : &queue_c;
+    u32 frame_len = 8 + (i % 100);
+    usart_tx_buf_t *b = buf_fill(len % USART_TX_RING_SIZE, frame_len);
+    if (b == NULL) {
+      n_alloc_failed++;
+      continue;
+    }
+    usart_tx_queue_submit(stalled, b);
+    u32 n_bufs = queue_a.n_bufs;
+    CHECK(usart_tx_queue_submit(&queue_a, b));
+    n_copied += (queue_a.n_bufs == n_bufs);
+    usart_tx_buf_release(b);
+    if (dma_a.wire_len + frame_len <= WIRE_SIZE) {
+      dma_stub_drain(&dma_a);
+      CHECK(memcmp(&dma_a.wire[dma_a.wire_len - frame_len],
+                   &data[len % USART_TX_RING_SIZE], frame_len) == 0);
+    }
+    len += frame_len;
+  }
+  CHECK(n_alloc_failed == 0);
+  CHECK(n_copied == 0);
+  CHECK(queue_b.n_bufs == USART_TX_PORT_BUFS);
+  CHECK(queue_c.n_bufs == USART_TX_PORT_BUFS);
+  /* The stalled ports filled up with copies once their share was held. */
+  CHECK(usart_tx_queue_n_free(&queue_b) < 8 + 100);
+  CHECK(usart_tx_queue_n_free(&queue_c) < 8 + 100);
+
+  dma_stub_drain(&dma_b);
+  dma_stub_drain(&dma_c);
+  CHECK(pool_free());
+  CHECK(dma_a.n_start_errors == 0);
+  CHECK(dma_b.n_start_errors == 0);
+  CHECK(dma_c.n_start_errors == 0);
+}
+
+int main(void)
+{
+  data_fill();
+
+  test_start();
+  test_chain();
+  test_wrap();
+  test_full();
+  test_independent();
+  test_submit();
+  test_order();
+  test_share();
+  test_stalled();
+  test_random();
+
+  return check_summary();
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env python
+# Copyright (C) 2016 Swift Navigation Inc.
+#
+# This source is subject to the license found in the file 'LICENSE' which must
+# be be distributed together with this source. All other rights reserved.
+#
+# THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+# EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+
+"""Per-symbol RAM placement report of a firmware image.
+
+Data and bss symbols of the ELF are listed with nm, assigned to the memory
+regions of the linker script by address and grouped by subsystem using the
+source file nm reports from the debug information. Hot-path symbols are
+marked with '*'. Symbols that are accessed by DMA are marked with '!' when
+placed in a region DMA can not reach. Placement is configured in
+src/mem_placement.h.
+
+  make memmap
+  tools/memmap.py --ldscript src/board/v2/STM32F405xG.ld build/piksi_firmware.elf
+"""
+
+import argparse
+import collections
+import re
+import subprocess
+import sys
+
+# Source path patterns, checked in order, and their subsystem.
+SUBSYSTEMS = [
+  (r'ChibiOS/', 'chibios'),
+  (r'libswiftnav/', 'libswiftnav'),
+  (r'libsbp/', 'libsbp'),
+  (r'/manage\.c$', 'manage'),
+  (r'/(track[a-z_]*|decode|l2c_capb|cw)\.c$|/nap/', 'track'),
+  (r'/acq[a-z_]*\.c$|/spectrum', 'acq'),
+  (r'/(solution|base_obs|hatch|position)\.c$', 'solution'),
+  (r'/ephemeris\.c$', 'ephemeris'),
+  (r'/(sbp[a-z_]*|settings|nmea)\.c$', 'sbp'),
+  (r'/(cfs|minIni)/|cfs-coffee-arch\.c$', 'cfs'),
+  (r'/peripherals/', 'peripherals'),
+]
+
+# Symbols touched on every NAP interrupt or every solution epoch.
+HOT_SYMBOLS = set([
+  'wa_nap_exti', 'tracker_channels', 'tracking_lock_counters',
+  'wa_time_matched_obs_thread', 'wa_solution_thread', 'obs_buff',
+  'es', 'wa_sbp_thread', 'tx_bufs',
+])
+
+# Symbols read or written by DMA.
+DMA_SYMBOLS = set(['tx_bufs', 'dma_buffer'])
+
+DATA_TYPES = 'bBdDgGsS'
+
+
+def parse_size(expr):
+  expr = re.sub(r'(?<![0-9a-fA-Fx])(\d+)\s*([kK])', r'(\1*1024)', expr)
+  expr = re.sub(r'(?<![0-9a-fA-Fx])(\d+)\s*M', r'(\1*1024*1024)', expr)
+  if not re.match(r'^[0-9a-fA-Fx+\-*() ]+$', expr):
+    raise ValueError('bad expression %r' % expr)
+  return eval(expr)
+
+
+def parse_regions(ldscript):
+  """Read the MEMORY block of a linker script."""
+  regions = []
+  text = open(ldscript).read()
+  block = re.search(r'MEMORY\s*\{(.*?)\}', text, re.S).group(1)
+  for line in block.splitlines():
+    m = re.match(r'\s*(\w+)\s*(\([^)]*\))?\s*:\s*org\s*=\s*([^,]+),'
+                 r'\s*len\s*=\s*([^/]+?)\s*(/\*\s*(.*?)\s*\*/)?\s*$', line)
+    if not m:
+      continue
+    org = parse_size(m.group(3))
+    length = parse_size(m.group(4))
+    if length == 0:
+      continue
+    label = m.group(1)
+    if m.group(6):
+      label += ' (%s)' % m.group(6)
+    regions.append((label, org, length))
+  return regions
+
+
+def region_of(regions, addr):
+  """Smallest region containing the address."""
+  best = None
+  for r in regions:
+    if r[1] <= addr < r[1] + r[2]:
+      if best is None or r[2] < best[2]:
+        best = r
+  return best
+
+
+def subsystem_of(path):
+  if not path:
+    return 'unknown'
+  for pattern, name in SUBSYSTEMS:
+    if re.search(pattern, path):
+      return name
+  return 'other'
+
+
+def read_symbols(nm, elf):
+  out = subprocess.check_output([nm, '-S', '-l', '--defined-only', elf])
+  for line in out.decode('utf-8', 'replace').splitlines():
+    fields = line.split('\t')
+    parts = fields[0].split()
+    if len(parts) != 4 or parts[2] not in DATA_TYPES:
+      continue
+    addr, size, name = int(parts[0], 16), int(parts[1], 16), parts[3]
+    path = fields[1].rsplit(':', 1)[0] if len(fields) > 1 else ''
+    yield name, addr, size, path
+
+
+def base_name(name):
+  """Strip the suffix GCC appends to function static variables."""
+  return name.split('.')[0]
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Report RAM placement per region, subsystem and symbol.')
+  parser.add_argument('elf')
+  parser.add_argument('--ldscript', required=True,
+                      help='Linker script defining the memory regions.')
+  parser.add_argument('--nm', default='arm-none-eabi-nm')
+  parser.add_argument('--hot', action='append', default=[],
+                      help='Additional hot-path symbol.')
+  parser.add_argument('--top', type=int, default=0,
+                      help='Symbols listed per subsystem, 0 for all.')
+  args = parser.parse_args()
+
+  hot = HOT_SYMBOLS | set(args.hot)
+  regions = parse_regions(args.ldscript)
+
+  usage = collections.defaultdict(
+    lambda: collections.defaultdict(list))
+  for name, addr, size, path in read_symbols(args.nm, args.elf):
+    r = region_of(regions, addr)
+    if r is None:
+      continue
+    usage[r][subsystem_of(path)].append((size, name, path))
+
+  n_errors = 0
+  for r in sorted(usage, key=lambda r: r[1]):
+    subs = usage[r]
+    used = sum(s[0] for syms in subs.values() for s in syms)
+    print('%s  0x%08X  %d of %d bytes (%.1f%%)' %
+          (r[0], r[1], used, r[2], 100.0 * used / r[2]))
+    for sub in sorted(subs, key=lambda k: -sum(s[0] for s in subs[k])):
+      syms = sorted(subs[sub], reverse=True)
+      print('  %-12s %8d' % (sub, sum(s[0] for s in syms)))
+      if args.top:
+        syms = syms[:args.top]
+      for size, name, path in syms:
+        mark = ' '
+        if base_name(name) in hot:
+          mark = '*'
+        if base_name(name) in DMA_SYMBOLS and 'CCM' in r[0]:
+          mark = '!'
+          n_errors += 1
+        print('    %8d %s %-32s %s' % (size, mark, name,
+                                       path.split('/')[-1]))
+    print('')
+
+  print('* hot path, ! DMA buffer in a region DMA can not reach')
+  return 1 if n_errors else 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
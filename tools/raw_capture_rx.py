@@ -0,0 +1,172 @@
+#!/usr/bin/env python
+# Copyright (C) 2016 Swift Navigation Inc.
+#
+# This source is subject to the license found in the file 'LICENSE' which must
+# be be distributed together with this source. All other rights reserved.
+#
+# THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+# EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+
+"""Receive a raw sample capture from a Piksi v3.
+
+Reads the frames sent on the FTDI port while raw_capture.enable is set, from
+the serial port or from a file holding the port's bytes. Frames are checked
+(sync word, version, CRC, sequence) and their samples are unpacked to one
+byte per sample, 0-3, in the output file. Frames flagged as discontinuous and
+sequence gaps are reported with the NAP sample count where they occur.
+
+  tools/raw_capture_rx.py -p /dev/ttyUSB0 -b 3000000 samples.bin
+  tools/raw_capture_rx.py -f wire.bin samples.bin
+
+Exits nonzero if any frame was lost or corrupt.
+"""
+
+import argparse
+import struct
+import sys
+
+RAW_CAPTURE_SYNC = 0x43574152
+RAW_CAPTURE_VERSION = 1
+RAW_CAPTURE_FLAG_DISCONTINUITY = 0x0001
+
+# See raw_capture_header_t in src/board/v3/raw_capture.h.
+HEADER = struct.Struct('<IBBHIIII6sH')
+HEADER_CRC_OFFSET = HEADER.size - 2
+SYNC_BYTES = struct.pack('<I', RAW_CAPTURE_SYNC)
+
+READ_SIZE = 64 * 1024
+
+
+def crc16_ccitt(data, crc=0):
+  for b in bytearray(data):
+    crc ^= b << 8
+    for _ in range(8):
+      crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+      crc &= 0xffff
+  return crc
+
+
+def unpack_samples(payload, sample_bits):
+  per_byte = 8 // sample_bits
+  mask = (1 << sample_bits) - 1
+  table = [bytes(bytearray((b >> (i * sample_bits)) & mask
+                           for i in range(per_byte)))
+           for b in range(256)]
+  return b''.join(table[b] for b in bytearray(payload))
+
+
+class Receiver(object):
+
+  def __init__(self, out):
+    self.out = out
+    self.buf = b''
+    self.frames = 0
+    self.samples = 0
+    self.crc_errors = 0
+    self.lost = 0
+    self.discontinuities = 0
+    self.skipped = 0
+    self.sequence = None
+
+  def feed(self, data):
+    self.buf += data
+    while self.frame():
+      pass
+
+  def frame(self):
+    """Parse one frame from the buffer, return False if more data is
+    needed."""
+    start = self.buf.find(SYNC_BYTES)
+    if start < 0:
+      keep = len(SYNC_BYTES) - 1
+      self.skipped += max(0, len(self.buf) - keep)
+      self.buf = self.buf[-keep:]
+      return False
+    if start > 0:
+      self.skipped += start
+      self.buf = self.buf[start:]
+    if len(self.buf) < HEADER.size:
+      return False
+
+    (sync, version, sample_bits, flags, sequence, sample_count, n_samples,
+     payload_len, _, crc) = HEADER.unpack_from(self.buf)
+    if version != RAW_CAPTURE_VERSION or sample_bits not in (1, 2, 4, 8):
+      # False sync in the payload of a frame we lost the start of.
+      self.skipped += 1
+      self.buf = self.buf[1:]
+      return True
+
+    end = HEADER.size + payload_len
+    if len(self.buf) < end:
+      return False
+    payload = self.buf[HEADER.size:end]
+
+    if crc16_ccitt(payload, crc16_ccitt(self.buf[:HEADER_CRC_OFFSET])) != crc:
+      self.crc_errors += 1
+      sys.stderr.write('frame %d: CRC error\n' % sequence)
+      # Resync just after this sync word, the length may be corrupt too.
+      self.buf = self.buf[1:]
+      return True
+    self.buf = self.buf[end:]
+
+    if self.sequence is not None and sequence != self.sequence + 1:
+      lost = (sequence - self.sequence - 1) & 0xffffffff
+      self.lost += lost
+      sys.stderr.write('frame %d: %d frames lost\n' % (sequence, lost))
+    elif flags & RAW_CAPTURE_FLAG_DISCONTINUITY:
+      self.discontinuities += 1
+      sys.stderr.write('frame %d: samples skipped before sample count %d\n'
+                       % (sequence, sample_count))
+    self.sequence = sequence
+
+    self.out.write(unpack_samples(payload, sample_bits)[:n_samples])
+    self.frames += 1
+    self.samples += n_samples
+    return True
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Receive a raw sample capture.')
+  src = parser.add_mutually_exclusive_group(required=True)
+  src.add_argument('-p', '--port', help='serial port of the FTDI link')
+  src.add_argument('-f', '--file', help="recorded port bytes, '-' for stdin")
+  parser.add_argument('-b', '--baud', type=int, default=3000000,
+                      help='serial baud rate (default %(default)s)')
+  parser.add_argument('-n', '--frames', type=int, default=0,
+                      help='stop after this many frames (default: until EOF '
+                           'or interrupted)')
+  parser.add_argument('output', help='unpacked samples, one byte each')
+  args = parser.parse_args()
+
+  if args.port:
+    import serial
+    stream = serial.Serial(args.port, args.baud, timeout=1)
+  elif args.file == '-':
+    stream = getattr(sys.stdin, 'buffer', sys.stdin)
+  else:
+    stream = open(args.file, 'rb')
+
+  with open(args.output, 'wb') as out:
+    rx = Receiver(out)
+    try:
+      while args.frames == 0 or rx.frames < args.frames:
+        data = stream.read(READ_SIZE)
+        if not data:
+          if args.port:
+            continue
+          break
+        rx.feed(data)
+    except KeyboardInterrupt:
+      pass
+
+  print('%d frames, %d samples, %d lost, %d CRC errors, '
+        '%d discontinuities, %d bytes skipped'
+        % (rx.frames, rx.samples, rx.lost, rx.crc_errors,
+           rx.discontinuities, rx.skipped))
+  return 1 if (rx.lost or rx.crc_errors) else 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,183 @@
+#!/usr/bin/env python
+# Copyright (C) 2016 Swift Navigation Inc.
+#
+# This source is subject to the license found in the file 'LICENSE' which must
+# be be distributed together with this source. All other rights reserved.
+#
+# THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+# EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+
+"""Propose thread working area sizes from soak test stack watermarks.
+
+Reads JSON SBP logs, one message per line as written by the piksi_tools
+logger, and takes the lowest stack_free reported by MSG_THREAD_STATE for each
+thread. Thread names are matched to their working areas in the firmware
+source through chThdCreateStatic() and chRegSetThreadName(). The proposed
+size is the stack used at the low-water mark plus a margin.
+
+  tools/stack_sizes.py soak1.json soak2.json
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+SBP_MSG_THREAD_STATE = 0x0017
+
+WA_RE = re.compile(r'\b(?:THD_)?WORKING_AREA\w*\(\s*(\w+)\s*,\s*([^)]+?)\s*\)')
+CREATE_RE = re.compile(r'chThdCreateStatic\s*\(([^;]*)\)\s*;')
+DEFINE_RE = re.compile(r'^\s*#define\s+(\w+)\s+([^/\n]+?)\s*(?:/[/*].*)?$', re.M)
+NAME_RE = re.compile(r'chRegSetThreadName\s*\(\s*"([^"]*)"\s*\)')
+
+
+def split_args(text):
+  args, depth, cur = [], 0, ''
+  for c in text:
+    if c == ',' and depth == 0:
+      args.append(cur.strip())
+      cur = ''
+      continue
+    depth += (c == '(') - (c == ')')
+    cur += c
+  args.append(cur.strip())
+  return args
+
+
+def source_files(src, board):
+  for root, dirs, files in os.walk(src):
+    rel = os.path.relpath(root, src).split(os.sep)
+    if len(rel) >= 2 and rel[0] == 'board' and rel[1] not in (board, 'nap'):
+      continue
+    for f in files:
+      if f.endswith('.c') or f.endswith('.h'):
+        yield os.path.join(root, f)
+
+
+def eval_size(expr, defines, depth=0):
+  expr = expr.strip()
+  if depth > 8:
+    return None
+  tokens = re.findall(r'[A-Za-z_]\w*', expr)
+  for t in tokens:
+    if t not in defines:
+      return None
+    v = eval_size(defines[t], defines, depth + 1)
+    if v is None:
+      return None
+    expr = re.sub(r'\b%s\b' % t, str(v), expr)
+  if not re.match(r'^[0-9xa-fA-F+\-*/() ]+$', expr):
+    return None
+  return int(eval(expr))
+
+
+def parse_firmware(src, board):
+  """Map thread names to (working area, configured size)."""
+  texts = dict((p, open(p).read()) for p in source_files(src, board))
+  defines = {}
+  for text in texts.values():
+    for name, value in DEFINE_RE.findall(text):
+      defines.setdefault(name, value)
+
+  threads = {}
+  for path, text in texts.items():
+    was = dict(WA_RE.findall(text))
+    for m in CREATE_RE.finditer(text):
+      args = split_args(m.group(1))
+      if len(args) < 4 or args[0] not in was:
+        continue
+      fn = args[3]
+      body = re.search(r'\b%s\s*\([^)]*\)\s*\{' % re.escape(fn), text)
+      if body is None:
+        continue
+      name = NAME_RE.search(text, body.end())
+      if name is None:
+        continue
+      threads[name.group(1)] = (args[0], eval_size(was[args[0]], defines),
+                                os.path.relpath(path, src))
+  return threads
+
+
+def read_watermarks(paths):
+  """Lowest stack_free and number of samples per thread name."""
+  marks = {}
+  for path in paths:
+    f = sys.stdin if path == '-' else open(path)
+    for line in f:
+      try:
+        msg = json.loads(line)
+      except ValueError:
+        continue
+      if not isinstance(msg, dict):
+        continue
+      msg = msg.get('data', msg)
+      if msg.get('msg_type') != SBP_MSG_THREAD_STATE:
+        continue
+      name = msg['name'].rstrip('\0').strip()
+      free, n = marks.get(name, (None, 0))
+      free = msg['stack_free'] if free is None else min(free,
+                                                        msg['stack_free'])
+      marks[name] = (free, n + 1)
+  return marks
+
+
+def lookup(threads, name):
+  """Match a possibly truncated thread name."""
+  if name in threads:
+    return threads[name]
+  for full, v in threads.items():
+    if full.startswith(name):
+      return v
+  return None
+
+
+def round_up(x, n):
+  return (x + n - 1) // n * n
+
+
+def main():
+  parser = argparse.ArgumentParser(
+    description='Propose working area sizes from stack watermarks.')
+  parser.add_argument('logs', nargs='+', help="JSON SBP logs, '-' for stdin")
+  parser.add_argument('--src', default=os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), '..', 'src'))
+  parser.add_argument('--board', default='v2')
+  parser.add_argument('--margin', type=float, default=0.25,
+                      help='Margin as a fraction of the stack used.')
+  parser.add_argument('--min-margin', type=int, default=256,
+                      help='Minimum margin in bytes.')
+  args = parser.parse_args()
+
+  threads = parse_firmware(args.src, args.board)
+  marks = read_watermarks(args.logs)
+
+  fmt = '%-18s %-28s %8s %8s %8s %8s %8s'
+  print(fmt % ('thread', 'working area', 'size', 'min free', 'used',
+               'proposed', 'reclaim'))
+  total = 0
+  for name in sorted(marks):
+    free, n = marks[name]
+    t = lookup(threads, name)
+    if t is None or t[1] is None:
+      print(fmt % (name, t[0] if t else '?', '?', free, '?', '?', '?'))
+      continue
+    wa, size, path = t
+    used = max(size - free, 0)
+    proposed = round_up(max(int(used * (1 + args.margin)),
+                            used + args.min_margin), 8)
+    reclaim = size - proposed
+    total += max(reclaim, 0)
+    print(fmt % (name, wa, size, free, used, proposed, reclaim))
+
+  unseen = sorted(set(threads) - set(
+    k for k in threads for m in marks if k.startswith(m)))
+  if unseen:
+    print('\nNo samples for: %s' % ', '.join(unseen))
+  print('\nReclaimable: %d bytes' % total)
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())